@@ -0,0 +1,107 @@
+/*
+ * Copyright the NTPsec project contributors
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Hack to time the header handling on the receive path.
+ *
+ * "parse" decodes all eleven header fields into a struct parsed_pkt
+ * the way parse_packet() used to for every packet.  "inplace" reads
+ * only what fast_xmit() needs to answer a client: li_vn_mode, ppoll,
+ * and the transmit timestamp, copied without byte swapping.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "ntp.h"
+#include "ntp_endian.h"
+#include "recvbuff.h"
+
+#define UNUSED_ARG(arg)         ((void)(arg))
+
+#define BATCHSIZE 10000000
+#define BILLION 1000000000
+
+static struct recvbuf rbuf;
+static volatile uint32_t sink;
+
+static void parse(struct recvbuf *rb) {
+	uint8_t const* recv_buf = rb->recv_buffer;
+	struct parsed_pkt * pkt = &rb->pkt;
+
+	pkt->li_vn_mode = recv_buf[0];
+	pkt->stratum = recv_buf[1];
+	pkt->ppoll = recv_buf[2];
+	pkt->precision = (int8_t)recv_buf[3];
+	pkt->rootdelay = ntp_be32dec(recv_buf + 4);
+	pkt->rootdisp = ntp_be32dec(recv_buf + 8);
+	memcpy(pkt->refid, recv_buf + 12, REFIDLEN);
+	pkt->reftime = ntp_be64dec(recv_buf + 16);
+	pkt->org = ntp_be64dec(recv_buf + 24);
+	pkt->rec = ntp_be64dec(recv_buf + 32);
+	pkt->xmt = ntp_be64dec(recv_buf + 40);
+}
+
+static long DoParse(void) {
+	struct timespec start, stop;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < BATCHSIZE; i++) {
+		rbuf.recv_buffer[47] = (uint8_t)i;
+		parse(&rbuf);
+		sink += rbuf.pkt.li_vn_mode + rbuf.pkt.ppoll +
+			(uint32_t)rbuf.pkt.xmt;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	return (stop.tv_sec-start.tv_sec)*(long)BILLION +
+		(stop.tv_nsec-start.tv_nsec);
+}
+
+static long DoInPlace(void) {
+	struct timespec start, stop;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < BATCHSIZE; i++) {
+		l_fp_w xmt;
+
+		rbuf.recv_buffer[47] = (uint8_t)i;
+		xmt = rbuf_xmt_w(&rbuf);
+		sink += rbuf_li_vn_mode(&rbuf) + rbuf_ppoll(&rbuf) +
+			xmt.l_uf;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	return (stop.tv_sec-start.tv_sec)*(long)BILLION +
+		(stop.tv_nsec-start.tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+	long nanos;
+
+	UNUSED_ARG(argc);
+	UNUSED_ARG(argv);
+
+	memset(&rbuf, 0, sizeof(rbuf));
+	rbuf.recv_length = LEN_PKT_NOMAC;
+	rbuf.recv_buffer[0] = PKT_LI_VN_MODE(LEAP_NOWARNING, NTP_VERSION,
+					     MODE_CLIENT);
+	rbuf.recv_buffer[2] = 6;
+	for (int i = 4; i < LEN_PKT_NOMAC; i++) {
+		rbuf.recv_buffer[i] = (uint8_t)(i * 37);
+	}
+
+	printf("# %d packets per sample\n", BATCHSIZE);
+	printf("#           ns/pkt\n");
+	nanos = DoParse();
+	printf("parse    %8.2f\n", (double)nanos/BATCHSIZE);
+	nanos = DoInPlace();
+	printf("inplace  %8.2f\n", (double)nanos/BATCHSIZE);
+
+	return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright the NTPsec project contributors
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Hack to time the per-syscall cost of a seccomp filter.
+ *
+ * Build with: cc seccomp-timing.c -o seccomp-timing -lseccomp
+ *
+ * Each case runs in a forked child since a filter can't be removed
+ * once loaded.  The filter allows the same number of syscalls as
+ * ntpd's sandbox.  "cold" puts the timed syscall at the end of the
+ * chain, "hot" raises its priority the way ntp_sandbox.c does for
+ * the packet path.
+ *
+ * recvmsg() on an empty non-blocking socket is the closest cheap
+ * stand-in for the receive path.  getppid() is a plain kernel call.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <seccomp.h>
+
+#define BATCHSIZE 1000000
+#define BILLION 1000000000
+#define FILLER 100
+
+enum mode { NONE, COLD, HOT, BINTREE };
+
+static const char *modename[] = {
+	"none", "cold", "hot", "bintree"
+};
+
+/* Filler for the allowlist; anything ntpd doesn't call per packet. */
+static void add_filler(scmp_filter_ctx ctx) {
+	/* What the child itself needs after the filter is loaded. */
+	const int needed[] = {
+		SCMP_SYS(read), SCMP_SYS(write), SCMP_SYS(close),
+		SCMP_SYS(socket), SCMP_SYS(bind), SCMP_SYS(clock_gettime),
+		SCMP_SYS(exit), SCMP_SYS(exit_group),
+	};
+	int added = 0;
+
+	for (unsigned int i = 0; i < sizeof(needed)/sizeof(needed[0]); i++) {
+		if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, needed[i], 0) == 0) {
+			added++;
+		}
+	}
+	for (int nr = 0; (added < FILLER) && (nr < 512); nr++) {
+		char *name = seccomp_syscall_resolve_num_arch(
+			SCMP_ARCH_NATIVE, nr);
+		if (NULL == name) {
+			continue;
+		}
+		free(name);
+		if (nr == SCMP_SYS(recvmsg) || nr == SCMP_SYS(getppid)) {
+			continue;
+		}
+		if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, nr, 0) == 0) {
+			added++;
+		}
+	}
+}
+
+static bool install(enum mode mode, int target) {
+	scmp_filter_ctx ctx;
+
+	if (NONE == mode) {
+		return true;
+	}
+	ctx = seccomp_init(SCMP_ACT_KILL);
+	if (NULL == ctx) {
+		return false;
+	}
+	add_filler(ctx);
+	if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(recvmsg), 0) < 0 ||
+	    seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(getppid), 0) < 0) {
+		seccomp_release(ctx);
+		return false;
+	}
+	switch (mode) {
+	case HOT:
+		seccomp_syscall_priority(ctx, target, 255);
+		break;
+	case BINTREE:
+#if (SCMP_VER_MAJOR > 2) || ((SCMP_VER_MAJOR == 2) && (SCMP_VER_MINOR >= 5))
+		seccomp_attr_set(ctx, SCMP_FLTATR_CTL_OPTIMIZE, 2);
+		break;
+#else
+		seccomp_release(ctx);
+		return false;
+#endif
+	default:
+		/* Lowest priority: competes with the filler. */
+		seccomp_syscall_priority(ctx, target, 0);
+		break;
+	}
+	if (seccomp_load(ctx) < 0) {
+		seccomp_release(ctx);
+		return false;
+	}
+	seccomp_release(ctx);
+	return true;
+}
+
+static long time_recvmsg(void) {
+	struct timespec start, stop;
+	struct sockaddr_in addr;
+	struct msghdr msg;
+	struct iovec iov;
+	char buf[64];
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = sizeof(buf);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < BATCHSIZE; i++) {
+		recvmsg(fd, &msg, MSG_DONTWAIT);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	close(fd);
+
+	return (stop.tv_sec-start.tv_sec)*(long)BILLION +
+		(stop.tv_nsec-start.tv_nsec);
+}
+
+static long time_getppid(void) {
+	struct timespec start, stop;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < BATCHSIZE; i++) {
+		getppid();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	return (stop.tv_sec-start.tv_sec)*(long)BILLION +
+		(stop.tv_nsec-start.tv_nsec);
+}
+
+/* Returns average ns per call, or -1 if the filter couldn't load. */
+static long run(enum mode mode, bool recv) {
+	int pipefd[2];
+	long nanos = -1;
+	pid_t pid;
+
+	if (pipe(pipefd) < 0) {
+		return -1;
+	}
+	pid = fork();
+	if (0 == pid) {
+		close(pipefd[0]);
+		if (install(mode, recv ? SCMP_SYS(recvmsg) : SCMP_SYS(getppid))) {
+			nanos = recv ? time_recvmsg() : time_getppid();
+		}
+		if (write(pipefd[1], &nanos, sizeof(nanos)) < 0) {
+			_exit(1);
+		}
+		_exit(0);
+	}
+	close(pipefd[1]);
+	if (read(pipefd[0], &nanos, sizeof(nanos)) != sizeof(nanos)) {
+		nanos = -1;
+	}
+	close(pipefd[0]);
+	waitpid(pid, NULL, 0);
+
+	return (nanos < 0) ? -1 : nanos/BATCHSIZE;
+}
+
+int main(int argc, char *argv[]) {
+	(void)argc;  /* Squash unused warnings */
+	(void)argv;
+
+	printf("# libseccomp %u.%u.%u, %d filler rules, %d calls per sample\n",
+	       SCMP_VER_MAJOR, SCMP_VER_MINOR, SCMP_VER_MICRO,
+	       FILLER, BATCHSIZE);
+	printf("#  filter  recvmsg  getppid  (ns per call)\n");
+	for (enum mode mode = NONE; mode <= BINTREE; mode++) {
+		long rv = run(mode, true);
+		long gp = run(mode, false);
+		if (rv < 0 || gp < 0) {
+			printf("%9s     n/a\n", modename[mode]);
+			continue;
+		}
+		printf("%9s %8ld %8ld\n", modename[mode], rv, gp);
+	}
+
+	return 0;
+}
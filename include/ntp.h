@@ -258,6 +258,7 @@ struct peer {
 	uint8_t	cast_flags;	/* additional flags */
 	uint8_t	last_event;	/* last peer error code */
 	uint8_t	num_events;	/* number of error events */
+	uint64_t gen;		/* change_gen at last change */
 	struct ntsclient_t nts_state;	/* per-peer NTS state */
 
 	/*
@@ -323,6 +324,7 @@ struct peer {
 	int	throttle;	/* rate control */
 	uptime_t	outdate;	/* send time last packet */
 	uptime_t	nextdate;	/* send time next packet */
+	uint16_t	phase;		/* transmit order within a second */
 
 	/*
 	 * Statistic counters
@@ -580,6 +582,7 @@ struct pkt {
 #define	PROTO_ORPHAN		26
 #define	PROTO_ORPHWAIT		27
 /* #define	PROTO_MODE7		28 was ntpdc */
+#define	PROTO_TSC		29
 
 /*
  * Configuration items for the loop filter
@@ -614,6 +617,8 @@ typedef struct mon_data	mon_entry;
 struct mon_data {
 	mon_entry *	hash_next;	/* next structure in hash list */
 	DECL_DLIST_LINK(mon_entry, mru);/* MRU list link pointers */
+	DECL_DLIST_LINK(mon_entry, plist);/* partition list links */
+	struct mon_part *part;		/* partition holding this entry */
 	endpt *		lcladr;		/* address on which this arrived */
 	l_fp		first;		/* first time seen */
 	l_fp		last;		/* last time seen */
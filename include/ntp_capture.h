@@ -0,0 +1,37 @@
+/*
+ * ntp_capture.h - sampled capture of incoming datagrams, in pcapng
+ */
+#ifndef GUARD_NTP_CAPTURE_H
+#define GUARD_NTP_CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct recvbuf;
+
+/*
+ * The little of pcapng (draft-ietf-opsawg-pcapng) that we write and
+ * ntpdreplay reads.  Blocks are in host byte order; readers use the
+ * byte-order magic to tell.
+ */
+#define PCAPNG_SHB		0x0A0D0D0AU	/* section header block */
+#define PCAPNG_IDB		0x00000001U	/* interface description */
+#define PCAPNG_EPB		0x00000006U	/* enhanced packet block */
+#define PCAPNG_MAGIC		0x1A2B3C4DU
+#define PCAPNG_OPT_END		0
+#define PCAPNG_OPT_TSRESOL	9		/* if_tsresol */
+#define PCAPNG_LINK_ETHERNET	1
+#define PCAPNG_LINK_RAW		101		/* bare IPv4 or IPv6 */
+
+/* Defaults for the capture command */
+#define CAPTURE_MAXSIZE		16384		/* KB per file */
+#define CAPTURE_FILES		4		/* files in the ring */
+
+extern bool	capture_enabled;
+
+extern void	capture_config(const char *file, unsigned long maxsize,
+			       int files, unsigned int sample);
+extern void	capture_packet(const struct recvbuf *);
+extern void	capture_timer(void);
+
+#endif	/* GUARD_NTP_CAPTURE_H */
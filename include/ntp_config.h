@@ -190,14 +190,17 @@ struct config_tree_tag {
 	int_fifo *	stats_list;
 	char *		stats_dir;
 	filegen_fifo *	filegen_opts;
+	attr_val_fifo *	capture;
 
 	/* Access Control Configuration */
 	attr_val_fifo *	limit_opts;
+	addr_opts_fifo *limit_parts;
 	attr_val_fifo *	mru_opts;
 	restrict_fifo *	restrict_opts;
 
 	addr_opts_fifo *fudge;
 	attr_val_fifo *	rlimit;
+	attr_val_fifo *	busypoll;
 	attr_val_fifo *	extra;
 	attr_val_fifo *	tinker;
 	attr_val_fifo *	nts;
@@ -258,6 +261,7 @@ attr_val *create_attr_ival(int attr, int value);
 attr_val *create_attr_uval(int attr, unsigned int value);
 attr_val *create_attr_rangeval(int attr, int first, int last);
 attr_val *create_attr_sval(int attr, const char *s);
+void destroy_attr_val_fifo(attr_val_fifo *av_fifo);
 filegen_node *create_filegen_node(int filegen_token,
 				  attr_val_fifo *options);
 string_node *create_string_node(char *str);
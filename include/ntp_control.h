@@ -35,6 +35,13 @@ struct ntp_control {
 #define	CTL_HEADER_LEN		(offsetof(struct ntp_control, data))
 #define	CTL_MAX_DATA_LEN	468
 
+/*
+ * Where clients look for the local stream socket ("controlsocket").
+ * On it each request and response is a 4-octet big-endian length and
+ * then the message; a response is one header and all of its data.
+ */
+#define	CTL_SOCKET_PATH		"/run/ntpd.sock"
+
 /*
  * Decoding for the r_m_e_op field
  */
@@ -162,10 +169,12 @@ struct ntp_control {
 
 /*
  * IFSTATS_FIELDS is the number of fields ntpd supplies for each ifstats
- * row.  Similarly RESLIST_FIELDS for reslist.
+ * row.  Similarly RESLIST_FIELDS for reslist and MONPARTS_FIELDS for
+ * monparts.
  */
 #define	IFSTATS_FIELDS	9
 #define	RESLIST_FIELDS	4
+#define	MONPARTS_FIELDS	10
 
 /*
  * To prevent replay attacks, MRU list nonces age out. Time is in seconds.
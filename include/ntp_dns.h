@@ -6,6 +6,8 @@
 
 #include "ntp_net.h"
 
+struct addrinfo;
+
 typedef enum {DNS_good, DNS_temp, DNS_error} DNS_Status;
 
 /* start DNS query (unless busy) */
@@ -16,7 +18,7 @@ extern void dns_check(void);
 
 /* Callbacks to process answers */
 extern void dns_take_server(struct peer*, sockaddr_u*);
-extern void dns_take_pool(struct peer*, sockaddr_u*);
+extern void dns_take_pool(struct peer*, struct addrinfo*);
 extern void dns_take_status(struct peer*, DNS_Status);
 
 /* SIGHUP or a new interface has appeared - try again */
@@ -32,8 +32,12 @@
 #define FGEN_FLAG_ENABLED	0x80 /* set this to really create files	  */
 				     /* without this, open is suppressed */
 
+/* size of the stdio buffer each open file generation gets */
+#define FILEGEN_BUFSIZ		BUFSIZ
+
 typedef struct filegen_tag {
 	FILE *	fp;	/* file referring to current generation */
+	char *	buf;	/* its stdio buffer, counted as MEM_STATS */
 	char *	dir;	/* currently always statsdir */
 	char *	fname;	/* filename prefix of generation file */
 			/* must be malloced, will be fed to free() */
@@ -159,6 +159,27 @@ extern	void	get_systime	(l_fp *);
 extern	bool	step_systime	(doubletime_t);
 extern	bool	adj_systime	(double, int (*adjtime)(const struct timeval *, struct timeval *));
 
+/* get_systime() from the TSC, see libntp/tsctime.c */
+struct tsc_stats {
+	bool		enabled;	/* enable tsc */
+	bool		active;		/* in use now */
+	int		good;		/* calibrations in a row within limit */
+	double		hz;		/* TSC rate */
+	double		err;		/* last calibration error, s */
+	double		maxerr;		/* worst while in use, s */
+	double		cost;		/* s per get_systime() from the TSC */
+	double		oscost;		/* s per clock_gettime() */
+	uint64_t	fallbacks;	/* times found unstable while in use */
+};
+extern	struct tsc_stats tsc_stats;
+extern	bool	tsc_gettime	(struct timespec *);
+extern	void	tsc_reset	(void);
+extern	bool	tsc_enable	(bool);
+extern	void	tsc_timer	(bool);
+/* For testing */
+extern	bool	tsc_calibrate	(uint64_t, struct timespec, uint64_t);
+extern	const char *tsc_state	(void);
+
 #define	lfptoa(fpv, ndec)	mfptoa((fpv), (ndec))
 #define	lfptoms(fpv, ndec)	mfptoms((fpv), (ndec))
 
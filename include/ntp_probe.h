@@ -0,0 +1,61 @@
+/*
+ * ntp_probe.h - USDT (statically defined tracing) probes
+ *
+ * With <sys/sdt.h> from SystemTap each probe is a single nop and a
+ * note in the ELF file, so they are always compiled in; bpftrace,
+ * perf and stap attach to them by name ("usdt:ntpd:ntpd:xmit").
+ * Arguments are still computed when the probe is not in use, so keep
+ * them to values already at hand.  Without <sys/sdt.h>, or with
+ * --disable-usdt, they vanish.  See contrib/bpftrace/ for scripts.
+ *
+ * NTP_PROBE(name, args...) takes up to 12 arguments after the name.
+ * PROBE_ADDR(sa) supplies three: the address family, a pointer to the
+ * 4 or 16 address bytes, and the port.  Times and offsets are signed
+ * nanoseconds, frequencies parts per billion.
+ *
+ * recv		addr, length, fd		network_packet_in()
+ * restrict	addr, restrict flags		receive(), restrictions()
+ * monitor	addr, restrict flags		receive(), ntp_monitor()
+ * auth		addr, key id, ok		receive(), MAC checked
+ * xmit		addr, length, authenticated,	fast_xmit(), reply sent
+ *		restrict flags, build ns
+ * filter	assoc id, offset, delay, disp	clock_filter()
+ * select	survivors, sys peer assoc id,	clock_select()
+ *		offset, jitter
+ * clock	result, state, offset, jitter,	local_clock()
+ *		frequency, poll
+ * cookie	length, key age (days, -1 if	nts_unpack_cookie()
+ *		too old), ok, aead
+ * ke_accept	addr				NTS-KE connection accepted
+ * ke_finish	addr, outcome (0 served,	NTS-KE connection closed
+ *		1 failed, 2 TLS failed,
+ *		3 rejected before TLS), ns
+ * dns_start	hostname, family		getaddrinfo() starting
+ * dns_finish	hostname, getaddrinfo() result
+ */
+#ifndef GUARD_NTP_PROBE_H
+#define GUARD_NTP_PROBE_H
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+/* Two steps, so PROBE_ADDR is expanded before the arguments are counted */
+#define NTP_PROBE(...)		NTP_PROBE_(__VA_ARGS__)
+#define NTP_PROBE_(name, ...)	STAP_PROBEV(ntpd, name, __VA_ARGS__)
+
+#define PROBE_ADDR(sa)	AF(sa),					\
+	(IS_IPV4(sa) ? (const void *)&NSRCADR(sa)		\
+		     : (const void *)PSOCK_ADDR6(sa)),		\
+	SRCPORT(sa)
+#define PROBE_NS(d)		((int64_t)((d) * 1e9))	/* from seconds */
+#define PROBE_PPB(d)		((int64_t)((d) * 1e9))	/* from s/s */
+#define PROBE_TSPEC_NS(ts)					\
+	((int64_t)(ts).tv_sec * NS_PER_S + (int64_t)(ts).tv_nsec)
+
+#else	/* !ENABLE_USDT */
+
+#define NTP_PROBE(...)		do { } while (0)
+
+#endif	/* !ENABLE_USDT */
+
+#endif	/* GUARD_NTP_PROBE_H */
@@ -98,6 +98,33 @@ extern	char *	estrdup_impl(const char *, const char *, int);
 #define	estrdup(s) estrdup_impl((s), __FILE__, __LINE__)
 #endif
 
+/*
+ * Live heap held by each part of ntpd, for "ntpq -c memstats" and the
+ * sysstats file.  The pools (MRU, receive buffers, peers, restrict
+ * entries, keys) count what they took from malloc(), on their free
+ * lists or not.
+ */
+typedef enum {
+	MEM_MRU,		/* MRU entries and hash table */
+	MEM_RECVBUF,		/* receive buffers */
+	MEM_PEER,		/* associations, with their NTS cookies */
+	MEM_RESTRICT,		/* restrict entries */
+	MEM_KEY,		/* symmetric keys and key hash table */
+	MEM_TLS,		/* OpenSSL heap; objects are TLS sessions */
+	MEM_CONFIG,		/* configuration trees not yet freed */
+	MEM_STATS,		/* statistics file buffers */
+	MEM_TAGS
+} mem_tag;
+
+struct mem_use {
+	unsigned long	bytes;
+	unsigned long	objects;
+};
+extern	struct mem_use	mem_use[MEM_TAGS];
+extern	void	mem_count	(mem_tag, long, long);
+extern	void *	etallocarray	(mem_tag, size_t, size_t);
+extern	void	etfree		(mem_tag, void *, size_t, size_t);
+
 
 extern	const char * eventstr	(int);
 extern	const char * ceventstr	(int);
@@ -47,6 +47,13 @@ extern	void	ctl_clr_stats	(void);
 extern	unsigned short ctlpeerstatus	(struct peer *);
 extern	void	init_control	(void);
 extern	void	process_control (struct recvbuf *, int);
+extern	void	ctl_queue_request (struct recvbuf *, int);
+extern	void	ctl_start_worker (void);
+extern	void	ctl_stream_config (const char *);
+extern	void	ctl_state_lock	(void);
+extern	void	ctl_state_unlock (void);
+extern	void	ctl_state_poll_lock (void);
+extern	void	ctl_state_share	(void);
 extern	void	report_event	(int, struct peer *, const char *);
 extern	int	mprintf_event	(int, struct peer *, const char *, ...)
 			NTP_PRINTF(3, 4);
@@ -108,6 +115,8 @@ extern  void    io_handler              (void);
 extern	void	init_io		(void);
 extern	void	io_open_sockets	(void);
 extern	void	io_clr_stats	(void);
+extern	void	busypoll_config	(int, int, int);
+extern	void	busypoll_start	(void);
 extern	void	sendpkt		(sockaddr_u *, endpt *, void *, unsigned int);
 extern const char * latoa(endpt *);
 extern  uint64_t dropped_count(void);
@@ -145,6 +154,10 @@ extern	unsigned short	ntp_monitor	(struct recvbuf *, unsigned short);
 extern	void	mon_clearinterface(endpt *interface);
 extern  int	mon_get_oldest_age(l_fp);
 extern  mon_entry *mon_get_slot(sockaddr_u *);
+extern	void	mon_partition(sockaddr_u *, float, float, float, uint64_t);
+struct mon_part;
+extern	unsigned short mon_rate_mask(float, const struct mon_part *,
+				     unsigned short);
 
 /* ntp_peer.c */
 extern	void	init_peer	(void);
@@ -172,6 +185,13 @@ extern	void	transmit	(struct peer *);
 extern	void	receive		(struct recvbuf *);
 extern	void	peer_clear	(struct peer *, const char *, const bool);
 extern	void	set_sys_leap	(uint8_t);
+extern	void	peer_changed	(struct peer *);
+extern	void	sys_changed	(void);
+
+extern	uint64_t gen_epoch;	/* change_gen at startup */
+extern	uint64_t change_gen;	/* numbers every change below */
+extern	uint64_t sys_gen;	/* system variables last changed */
+extern	uint64_t peers_gone_gen; /* an association last went away */
 
 extern	int	sys_orphan;
 extern	double	sys_mindist;
@@ -194,6 +214,10 @@ stat_sys_form(badauth);
 stat_sys_form(declined);
 stat_sys_form(limitrejected);
 stat_sys_form(kodsent);
+stat_sys_form(kodsuppressed);
+stat_sys_form(pooltaken);
+stat_sys_form(poolskipped);
+stat_sys_form(pooldropped);
 #undef stat_sys_form
 
 extern uptime_t stat_total_stattime(void);
@@ -225,6 +249,10 @@ extern	void	reinit_timer	(void);
 extern	void	timer		(void);
 extern	void	timer_clr_stats (void);
 extern	void	timer_interfacetimeout (uptime_t);
+extern	void	timer_pace	(double);
+extern	void	pace_run	(void);
+extern	void	pace_flush	(void);
+extern	struct timespec *pace_wait (struct timespec *);
 extern	int	interface_interval;
 extern	uptime_t	orphwait;		/* orphan wait time */
 
@@ -348,6 +376,27 @@ struct clock_state_machine {
 extern struct clock_state_machine clkstate;
 
 /* ntp_monitor.c */
+/*
+ * A partition of the MRU list and its rate limits, for clients of one
+ * local address ("limit interface").  Entries of a partition with a
+ * maxdepth are recycled only to make room in that partition; without
+ * one they share the rest of the list.
+ */
+struct mon_part {
+	struct mon_part *link;
+	sockaddr_u	addr;		/* local address, port ignored */
+	float		rate_limit;	/* responses per second */
+	float		decay_time;	/* seconds, exponential decay time */
+	float		kod_limit;	/* KoDs per second */
+	uint64_t	maxdepth;	/* entries, 0 to share the rest */
+	mon_entry	mru_list;	/* partition listhead, newest first */
+	uint64_t	entries;	/* on mru_list */
+	uint64_t	new;		/* new entries */
+	uint64_t	recycled;	/* entries recycled for new ones */
+	uint64_t	none;		/* no entry available */
+	uint64_t	limited;	/* packets rate limited */
+};
+
 struct monitor_data {
 	uint8_t	mon_hash_bits;		/* log2 size of hash table */
 	/*
@@ -359,6 +408,8 @@ struct monitor_data {
 	 */
 	mon_entry ** mon_hash;		/* MRU hash table */
 	mon_entry mon_mru_list;		/* mru listhead */
+	struct mon_part *mon_parts;	/* "limit interface" partitions */
+	struct mon_part	mon_rest;	/* everything else */
 	uint64_t	mru_entries;		/* mru list count */
 	uint64_t	mru_hashslots;		/* hash slots in use */
 	/*
@@ -376,19 +427,63 @@ struct monitor_data {
 	int		mru_maxage;		/* recycle if older than this */
 	int		mru_minage;		/* recycle if older & full */
 	uint64_t	mru_maxdepth;		/* MRU size hard limit */
+	char *		mru_share;		/* "mrushare" table, or NULL */
+/* Cold tier */
+	uint64_t	mru_coldmaxmem;		/* bytes, 0 for none */
+	uint64_t	mru_coldslots;		/* records it holds */
+	uint64_t	mru_colddepth;		/* records in use */
+	uint64_t	mru_coldmem;		/* bytes allocated */
+	uint64_t	mru_demoted;		/* entries kept as records */
+	uint64_t	mru_promoted;		/* new entries with a record */
+	uint64_t	mru_coldlost;		/* records overwritten */
 /* Slot (re)allocation counters */
 	uint64_t	mru_exists;		/* slot already exists */
 	uint64_t	mru_new;		/* allocated new slot */
 	uint64_t	mru_recycleold;		/* age > maxage */
 	uint64_t	mru_recyclefull;	/* full & age > minage */
 	uint64_t	mru_none;		/* couldn't allocate slot */
+/* mon_timer() housekeeping */
+	uint64_t	mru_aged;		/* freed, age > maxage */
+	uint64_t	mru_evicted;		/* freed to refill reserve */
+	uint64_t	mru_free;		/* entries on the free list */
+	uint64_t	mru_checked;		/* slots + entries checked */
+	uint64_t	mru_checkpasses;	/* complete check passes */
+	uint64_t	mru_checkerrors;	/* problems found */
+	uint64_t	mru_tickwork;		/* work done last second */
+	uint64_t	mru_tickworkmax;	/* most work in a second */
 /* rate limiting */
 	float		rate_limit;   /* responses per second */
 	float		decay_time;   /* seconds, exponential decay time */
 	float		kod_limit ;   /* KoDs per second */
+	float		kod_rate;     /* KoDs per second, all sources */
 };
 extern struct monitor_data mon_data;
 
+/* ntp_monshm.c */
+struct monshm_stats {
+	uint64_t	slots;		/* in the shared table */
+	uint64_t	hits;		/* packets from an address it had */
+	uint64_t	new;		/* addresses given an empty slot */
+	uint64_t	recycled;	/* ... given an old address's slot */
+	uint64_t	none;		/* ... not given one */
+	uint64_t	recovered;	/* locks held by a dead process */
+};
+extern struct monshm_stats monshm_stats;
+
+/* an entry of the shared table, for mrulist */
+struct monshm_row {
+	mon_entry	mon;		/* addresses, times, counts */
+	sockaddr_u	laddr;		/* local address last used */
+};
+
+extern	bool	monshm_open	(const char *, uint64_t);
+extern	bool	monshm_active	(void);
+extern	unsigned short monshm_touch(mon_entry *, const struct mon_part *,
+				    unsigned short);
+extern	size_t	monshm_snapshot	(struct monshm_row **);
+extern	bool	monshm_get	(const sockaddr_u *, struct monshm_row *);
+extern	uint64_t monshm_used	(void);
+
 /* ntp_peer.c */
 extern struct peer *peer_list;		/* peer structures list */
 
@@ -436,6 +531,8 @@ extern volatile struct signals_detected sig_flags;
 struct restriction_data {
   restrict_u *restrictlist4; /* IPv4 restriction list */
   restrict_u *restrictlist6; /* IPv6 restriction list */
+  restrict_u *sourcehash4[NTP_HASH_SIZE]; /* "restrict source" holes */
+  restrict_u *sourcehash6[NTP_HASH_SIZE];
   int        ntp_minpkt;     /* minimum (log 2 s) */
   uint8_t    ntp_minpoll;    /* increment (log 2 s) */
 };
@@ -467,6 +564,12 @@ extern unsigned long alarm_overflow;
 extern uptime_t	current_time;		/* seconds since startup */
 extern uptime_t	timer_timereset;
 extern unsigned long	timer_xmtcalls;
+extern unsigned long	timer_burst;
+extern unsigned long	timer_burstmax;
+extern unsigned long	timer_paced;
+extern unsigned long	timer_late;
+extern double		timer_spacing;
+extern double		timer_spacingmin;
 extern bool		leap_sec_in_progress;
 #ifdef ENABLE_LEAP_SMEAR
 extern struct leap_smear_info leap_smear;
@@ -500,6 +603,7 @@ void nts_init(void);   /* Before sandbox() */
 void nts_init2(void);  /* After sandbox() */
 bool nts_probe(struct peer *peer);
 bool nts_check(struct peer *peer);
+void nts_free_cookies(struct ntsclient_t *state);
 void nts_timer(void);
 
 /* ntp_sandbox.c */
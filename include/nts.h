@@ -11,6 +11,7 @@
 #include <stdint.h>
 
 #include "ntp_fp.h"
+#include "ntp_net.h"
 
 /* default file names */
 #define NTS_CERT_FILE "/etc/ntp/cert-chain.pem"
@@ -22,6 +23,11 @@
 
 #define NTS_KE_TIMEOUT		3
 
+/* NTS-KE admission control defaults, see nts_ke_admit() */
+#define NTS_KE_RATE		1.0	/* connections/s per source */
+#define NTS_KE_PREFIXRATE	10.0	/* connections/s per prefix */
+#define NTS_KE_QUEUE		16	/* accepted, waiting for TLS */
+
 bool nts_server_init(void);
 bool nts_client_init(void);
 bool nts_cookie_init(void);
@@ -37,10 +43,18 @@ bool nts_write_cookie_keys(void);
 
 int nts_make_cookie(uint8_t *cookie,
   uint16_t aead,
-  uint8_t *c2s, uint8_t *s2c, int keylen);
+  uint8_t *c2s, uint8_t *s2c, int keylen,
+  uint8_t *secret, int secretlen);
 bool nts_unpack_cookie(uint8_t *cookie, int cookielen,
   uint16_t *aead,
-  uint8_t *c2s, uint8_t *s2c, int *keylen);
+  uint8_t *c2s, uint8_t *s2c, int *keylen,
+  uint8_t *secret, int *secretlen);
+bool nts_export_secret(const uint8_t *exporter, int len, uint8_t *secret);
+bool nts_secret_keys(uint16_t aead, const uint8_t *secret, int secretlen,
+  uint8_t *c2s, uint8_t *s2c, int keylen);
+
+/* in nts.c, for the config code */
+int nts_string_to_aeads(const char* text, uint16_t *aeads, int max);
 
 /* working finger into a buffer - updated by append/unpack routines */
 struct BufCtl_t {
@@ -49,9 +63,11 @@ struct BufCtl_t {
 };
 typedef struct BufCtl_t BufCtl;
 
+bool nts_ke_admit(const sockaddr_u *addr, double now);
 bool nts_ke_process_receive(struct BufCtl_t *buf, int *aead);
 bool nts_ke_setup_send(struct BufCtl_t *buf, int aead,
-       uint8_t *c2s, uint8_t *s2c, int keylen);
+       uint8_t *c2s, uint8_t *s2c, int keylen,
+       uint8_t *secret, int secretlen);
 
 /***********************************************************/
 
@@ -94,8 +110,11 @@ uint16_t next_bytes(BufCtl* buf, uint8_t *data, int length);
 /***********************************************************/
 
 #define NTS_MAX_KEYLEN		64	/* used in cookies */
+#define NTS_MAX_SECRETLEN	48	/* TLS 1.3 exporter, SHA-384 */
 #define NTS_MAX_COOKIELEN	192	/* see nts_cookie.c */
 #define NTS_MAX_COOKIES		8	/* RFC 4.1.6 */
+#define NTS_LOW_COOKIES		3	/* start NTS-KE early below this */
+#define NTS_MAX_AEADS		8	/* in one algorithm list */
 #define NTS_UID_LENGTH		32	/* RFC 5.3 */
 #define NTS_UID_MAX_LENGTH	64
 
@@ -117,6 +136,8 @@ extern int nts_nKeys;		/* for tester */
 struct ntscfg_t {
 	char *ca;		/* root/trusted certificates */
 	char *aead;		/* AEAD algorithms on wire */
+	uint16_t aeads[NTS_MAX_AEADS];	/* aead, parsed */
+	int naeads;		/* 0 for the defaults */
 };
 
 /* Client-side state per connection to server */
@@ -127,12 +148,21 @@ struct ntsclient_t {
 	uint8_t c2s[NTS_MAX_KEYLEN], s2c[NTS_MAX_KEYLEN];
 	/* UID of last request sent - RFC 5.3 */
 	uint8_t UID[NTS_UID_LENGTH];
-	/* cookies */
+	/* cookies, NTS_MAX_COOKIES of cookielen bytes each, allocated
+	 * when NTS-KE tells us how long they are */
 	int readIdx, writeIdx;
 	int count;			/* -1 if not in NTS mode */
 	int cookielen;
-	uint8_t cookies[NTS_MAX_COOKIES][NTS_MAX_COOKIELEN];
+	uint8_t *cookies;
+	uptime_t refresh;		/* when to run NTS-KE early, 0 not yet */
+	/* statistics */
+	unsigned long used;		/* cookies sent */
+	unsigned long refreshed;	/* new cookies, from NTS-KE or replies */
+	unsigned long starved;		/* polls with no cookie left */
+	unsigned long rekeys;		/* NTS-KE started early */
 };
+#define NTS_COOKIE(st, i) \
+	((st)->cookies + (size_t)(i) * (size_t)(st)->cookielen)
 
 /* Server-side state per packet */
 struct ntspacket_t {
@@ -143,6 +173,8 @@ struct ntspacket_t {
 	uint16_t aead;
 	int keylen;
 	uint8_t c2s[NTS_MAX_KEYLEN], s2c[NTS_MAX_KEYLEN];
+	int secretlen;		/* 0 if the cookie carried the keys */
+	uint8_t secret[NTS_MAX_SECRETLEN];
 };
 
 
@@ -158,7 +190,12 @@ struct ntsconfig_t {
 	const char *KI;		/* file holding K/I for making cookies */
 	const char *ca;		/* root cert dir/file */
 	const char *aead;	/* AEAD algorithms on wire */
+	uint16_t aeads[NTS_MAX_AEADS];	/* aead, parsed */
+	int naeads;		/* 0 for the defaults */
 	bool tlscipherserverpreference;  /* OpenSSL 3.0 default is client */
+	double ke_rate;		/* NTS-KE connections/s per source */
+	double ke_prefixrate;	/* NTS-KE connections/s per prefix */
+	int ke_queue;		/* NTS-KE connections waiting for TLS */
 };
 
 
@@ -166,6 +203,8 @@ struct ntsconfig_t {
 #define CMAC_LENGTH 16
 /* The NONCE length comes from RFC 5116 and/or 5297. */
 #define NONCE_LENGTH 16
+/* GCM-SIV uses the same tag length but a fixed 12 byte nonce. */
+#define GCM_SIV_NONCE_LENGTH 12
 
 /* NTS protocol constants */
 
@@ -231,7 +270,10 @@ enum aead_ciphers {
 	AEAD_AES_256_OCB_TAGLEN96 = 27,
 	AEAD_AES_256_OCB_TAGLEN64 = 28,
 
-	AEAD_CHACHA20_POLY1305 = 29
+	AEAD_CHACHA20_POLY1305 = 29,
+
+	AEAD_AES_128_GCM_SIV = 30	/* RFC 8452, via OpenSSL 3.2+ */
+#define AEAD_AES_128_GCM_SIV_KEYLEN 16
 };
 
 
@@ -249,6 +291,7 @@ struct nts_counters {
   uint64_t server_recv_good;
   uint64_t server_recv_bad;
   uint64_t cookie_make;
+  uint64_t cookie_make_short;	/* from the session secret */
   uint64_t cookie_not_server;   /* we are not a NTS server */
   uint64_t cookie_decode_total; /* total attempts, includes too old */
   uint64_t cookie_decode_current;
@@ -270,6 +313,11 @@ struct ntske_counters {
   l_fp     serves_bad_cpu;
   uint64_t probes_good;
   uint64_t probes_bad;
+  uint64_t admitted;		/* passed admission control */
+  uint64_t queued;		/* admitted, waited for a worker */
+  uint64_t rejected_source;	/* over the per-source rate */
+  uint64_t rejected_prefix;	/* over the per-prefix rate */
+  uint64_t rejected_busy;	/* queue full */
 };
 extern struct nts_counters nts_cnt, old_nts_cnt;
 extern struct ntske_counters ntske_cnt, old_ntske_cnt;
@@ -32,6 +32,23 @@ void nts_log_ssl_error(void);
 int nts_get_key_length(uint16_t aead);
 int nts_translate_version(const char *arg);
 uint16_t nts_string_to_aead(const char* text);
+int nts_default_aeads(uint16_t *aeads, int max);
+
+/* in nts_extens.c, which owns the wire AEAD contexts */
+bool nts_aead_ok(uint16_t aead);
+int nts_aead_nonce_length(uint16_t aead);
+bool nts_aead_encrypt(uint16_t aead,
+  uint8_t *out, size_t *outlen,
+  const uint8_t *key, int keylen,
+  const uint8_t *nonce, int noncelen,
+  const uint8_t *plain, size_t plainlen,
+  const uint8_t *ad, size_t adlen);
+bool nts_aead_decrypt(uint16_t aead,
+  uint8_t *out, size_t *outlen,
+  const uint8_t *key, int keylen,
+  const uint8_t *nonce, int noncelen,
+  uint8_t *cipher, size_t cipherlen,
+  const uint8_t *ad, size_t adlen);
 
 bool nts_make_keys(SSL *ssl, uint16_t aead,
   uint8_t *c2s, uint8_t *s2c, int keylen);
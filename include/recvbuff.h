@@ -1,6 +1,8 @@
 #ifndef GUARD_RECVBUFF_H
 #define GUARD_RECVBUFF_H
 
+#include <string.h>
+
 #include "ntp.h"
 #include "ntp_net.h"
 #include "ntp_lists.h"
@@ -52,6 +54,33 @@ struct recvbuf {
 #endif /* REFCLOCK */
 };
 
+/*
+ * Accessors for the NTP header fields the server side needs, read in
+ * place from recv_buffer.  'pkt' is only filled in for replies to our
+ * own requests.
+ */
+static inline uint8_t
+rbuf_li_vn_mode(const struct recvbuf *rb)
+{
+	return rb->recv_buffer[0];
+}
+
+static inline uint8_t
+rbuf_ppoll(const struct recvbuf *rb)
+{
+	return rb->recv_buffer[2];
+}
+
+/* transmit timestamp, still in network order */
+static inline l_fp_w
+rbuf_xmt_w(const struct recvbuf *rb)
+{
+	l_fp_w xmt;
+
+	memcpy(&xmt, rb->recv_buffer + 40, sizeof(xmt));
+	return xmt;
+}
+
 extern	void	init_recvbuff(unsigned int); /* not really pure */
 
 /* freerecvbuf - make a single recvbuf available for reuse
@@ -33,6 +33,16 @@
 #include <ctgrind.h>
 #endif
 
+/* NTPsec: AES-NI path for short messages, see AES_SIV_FAST_MAX below.
+ * Off for ctgrind builds, which want to check the OpenSSL path. */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__)) && \
+    !defined(ENABLE_CTGRIND) && !defined(DISABLE_AES_SIV_FAST)
+#define AES_SIV_FAST 1
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#endif
+
 #if CHAR_BIT != 8
 #error "libaes_siv requires an 8-bit char type"
 #endif
@@ -207,6 +217,20 @@ static inline void dbl(block *block) {
         putword(block, 1, low);
 }
 
+#ifdef AES_SIV_FAST
+/* Expanded keys for the last key used by the short message path.
+   NTS reuses keys (the cookie key, a client's c2s), so keeping them
+   saves the key schedule as well as the trips through EVP. */
+struct fast_keys {
+        size_t key_len;                 /* 0 if empty */
+        unsigned char key[64];
+        int rounds;
+        block mac_rk[15], ctr_rk[15];   /* K1 and K2 of RFC 5297 */
+        block k1, k2;                   /* CMAC subkeys */
+        block d0;                       /* CMAC(zero) */
+};
+#endif
+
 struct AES_SIV_CTX_st {
         /* d stores intermediate results of S2V; it corresponds to D from the
            pseudocode in section 2.4 of RFC 5297. */
@@ -215,6 +239,9 @@ struct AES_SIV_CTX_st {
         /* SIV_AES_Init() sets up cmac_ctx_init. cmac_ctx is a scratchpad used
            by SIV_AES_AssociateData() and SIV_AES_(En|De)cryptFinal. */
         CMAC_CTX *cmac_ctx_init, *cmac_ctx;
+#ifdef AES_SIV_FAST
+        struct fast_keys fast;
+#endif
 };
 
 void AES_SIV_CTX_cleanup(AES_SIV_CTX *ctx) {
@@ -238,6 +265,9 @@ void AES_SIV_CTX_cleanup(AES_SIV_CTX *ctx) {
         CMAC_CTX_cleanup(ctx->cmac_ctx);
 #endif
         OPENSSL_cleanse(&ctx->d, sizeof ctx->d);
+#ifdef AES_SIV_FAST
+        OPENSSL_cleanse(&ctx->fast, sizeof ctx->fast);
+#endif
 }
 
 void AES_SIV_CTX_free(AES_SIV_CTX *ctx) {
@@ -251,6 +281,9 @@ void AES_SIV_CTX_free(AES_SIV_CTX *ctx) {
                         CMAC_CTX_free(ctx->cmac_ctx);
                 }
 		OPENSSL_cleanse(&ctx->d, sizeof ctx->d);
+#ifdef AES_SIV_FAST
+                OPENSSL_cleanse(&ctx->fast, sizeof ctx->fast);
+#endif
                 OPENSSL_free(ctx);
         }
 }
@@ -264,6 +297,9 @@ AES_SIV_CTX *AES_SIV_CTX_new(void) {
         ctx->cipher_ctx = EVP_CIPHER_CTX_new();
         ctx->cmac_ctx_init = CMAC_CTX_new();
         ctx->cmac_ctx = CMAC_CTX_new();
+#ifdef AES_SIV_FAST
+        ctx->fast.key_len = 0;
+#endif
 
         if (UNLIKELY(ctx->cipher_ctx == NULL ||
                      ctx->cmac_ctx_init == NULL ||
@@ -537,6 +573,230 @@ done:
         return ret;
 }
 
+#ifdef AES_SIV_FAST
+/*
+ * NTPsec: short message path.
+ *
+ * NTS runs AES-SIV over one packet or one cookie at a time, a few
+ * dozen to a few hundred bytes.  At that size the OpenSSL path is
+ * mostly overhead: a CMAC_CTX_copy and EVP dispatch for each S2V
+ * string, key setup for every call, and another EVP pass for CTR.
+ * This does the whole of AES_SIV_Encrypt()/AES_SIV_Decrypt() with
+ * AES-NI on round keys kept in the context.
+ *
+ * Used for 256 and 512 bit keys and inputs up to AES_SIV_FAST_MAX
+ * on CPUs that have AES-NI; everything else takes the code above.
+ */
+#define AES_SIV_FAST_MAX 1024
+
+#define FAST_TARGET __attribute__((target("aes,sse2")))
+
+static int fast_ok = -1;  /* -1: not checked yet */
+
+static int aes_siv_fast_available(void) {
+        if (UNLIKELY(fast_ok < 0)) {
+                __builtin_cpu_init();
+                fast_ok = __builtin_cpu_supports("aes") ? 1 : 0;
+        }
+        return fast_ok;
+}
+
+static inline FAST_TARGET __m128i load(block const *b) {
+        return _mm_loadu_si128((const __m128i *)b->byte);
+}
+
+static inline FAST_TARGET void store(block *b, __m128i x) {
+        _mm_storeu_si128((__m128i *)b->byte, x);
+}
+
+static inline FAST_TARGET __m128i expand_step(__m128i k, __m128i t) {
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+        return _mm_xor_si128(k, t);
+}
+
+#define EXPAND128(i, rcon)                                              \
+        k = expand_step(k, _mm_shuffle_epi32(                           \
+                _mm_aeskeygenassist_si128(k, rcon), 0xff));             \
+        store(&rk[i], k)
+
+static FAST_TARGET void expand128(block *rk, unsigned char const *key) {
+        __m128i k = _mm_loadu_si128((const __m128i *)key);
+        store(&rk[0], k);
+        EXPAND128(1, 0x01); EXPAND128(2, 0x02); EXPAND128(3, 0x04);
+        EXPAND128(4, 0x08); EXPAND128(5, 0x10); EXPAND128(6, 0x20);
+        EXPAND128(7, 0x40); EXPAND128(8, 0x80); EXPAND128(9, 0x1b);
+        EXPAND128(10, 0x36);
+}
+
+#define EXPAND256(i, rcon)                                              \
+        a = expand_step(a, _mm_shuffle_epi32(                           \
+                _mm_aeskeygenassist_si128(b, rcon), 0xff));             \
+        store(&rk[i], a);                                               \
+        if (i < 14) {                                                   \
+                b = expand_step(b, _mm_shuffle_epi32(                   \
+                        _mm_aeskeygenassist_si128(a, 0), 0xaa));        \
+                store(&rk[i + 1], b);                                   \
+        }
+
+static FAST_TARGET void expand256(block *rk, unsigned char const *key) {
+        __m128i a = _mm_loadu_si128((const __m128i *)key);
+        __m128i b = _mm_loadu_si128((const __m128i *)(key + 16));
+        store(&rk[0], a);
+        store(&rk[1], b);
+        EXPAND256(2, 0x01); EXPAND256(4, 0x02); EXPAND256(6, 0x04);
+        EXPAND256(8, 0x08); EXPAND256(10, 0x10); EXPAND256(12, 0x20);
+        EXPAND256(14, 0x40);
+}
+
+static inline FAST_TARGET __m128i aes_block(block const *rk, int rounds,
+                                            __m128i x) {
+        int i;
+        x = _mm_xor_si128(x, load(&rk[0]));
+        for (i = 1; i < rounds; i++) {
+                x = _mm_aesenc_si128(x, load(&rk[i]));
+        }
+        return _mm_aesenclast_si128(x, load(&rk[rounds]));
+}
+
+/* CMAC with K1 */
+static FAST_TARGET __m128i fast_cmac(struct fast_keys const *fk,
+                                     unsigned char const *in, size_t len) {
+        unsigned char last[16];
+        __m128i x = _mm_setzero_si128();
+        size_t full = len ? (len - 1) / 16 : 0;  /* blocks before the last */
+        size_t i, rest = len - 16 * full;
+
+        for (i = 0; i < full; i++) {
+                x = _mm_xor_si128(x, _mm_loadu_si128(
+                        (const __m128i *)(in + 16 * i)));
+                x = aes_block(fk->mac_rk, fk->rounds, x);
+        }
+        if (rest == 16) {
+                memcpy(last, in + 16 * full, 16);
+                x = _mm_xor_si128(x, load(&fk->k1));
+        } else {
+                if (rest > 0) {
+                        memcpy(last, in + 16 * full, rest);
+                }
+                last[rest] = 0x80;
+                memset(last + rest + 1, 0, 15 - rest);
+                x = _mm_xor_si128(x, load(&fk->k2));
+        }
+        x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)last));
+        OPENSSL_cleanse(last, sizeof last);
+        return aes_block(fk->mac_rk, fk->rounds, x);
+}
+
+static FAST_TARGET int fast_setkey(struct fast_keys *fk,
+                                   unsigned char const *key, size_t key_len) {
+        block l;
+        size_t half = key_len / 2;
+
+        if (fk->key_len == key_len &&
+            CRYPTO_memcmp(fk->key, key, key_len) == 0) {
+                return 1;
+        }
+        if (key_len == 32) {
+                fk->rounds = 10;
+                expand128(fk->mac_rk, key);
+                expand128(fk->ctr_rk, key + half);
+        } else if (key_len == 64) {
+                fk->rounds = 14;
+                expand256(fk->mac_rk, key);
+                expand256(fk->ctr_rk, key + half);
+        } else {
+                return 0;
+        }
+        store(&l, aes_block(fk->mac_rk, fk->rounds, _mm_setzero_si128()));
+        dbl(&l);
+        fk->k1 = l;
+        dbl(&l);
+        fk->k2 = l;
+        /* CMAC of one zero block is just E(K1 subkey) */
+        store(&fk->d0, aes_block(fk->mac_rk, fk->rounds, load(&fk->k1)));
+        OPENSSL_cleanse(&l, sizeof l);
+        memcpy(fk->key, key, key_len);
+        fk->key_len = key_len;
+        return 1;
+}
+
+/* S2V over ad, nonce (if non-NULL), p */
+static FAST_TARGET void fast_s2v(struct fast_keys const *fk, block *v,
+                                 unsigned char const *ad, size_t ad_len,
+                                 unsigned char const *nonce, size_t nonce_len,
+                                 unsigned char const *p, size_t len) {
+        block d = fk->d0, t;
+        size_t i;
+
+        dbl(&d);
+        store(&t, fast_cmac(fk, ad, ad_len));
+        xorblock(&d, &t);
+        if (nonce != NULL) {
+                dbl(&d);
+                store(&t, fast_cmac(fk, nonce, nonce_len));
+                xorblock(&d, &t);
+        }
+        if (len >= 16) {
+                /* T = P xorend D */
+                unsigned char buf[AES_SIV_FAST_MAX];
+                memcpy(buf, p, len);
+                for (i = 0; i < 16; i++) {
+                        buf[len - 16 + i] ^= d.byte[i];
+                }
+                store(v, fast_cmac(fk, buf, len));
+                OPENSSL_cleanse(buf, len);
+        } else {
+                /* T = dbl(D) xor pad(P), one complete block */
+                dbl(&d);
+                memset(t.byte, 0, sizeof t.byte);
+                if (len > 0) {
+                        memcpy(t.byte, p, len);
+                }
+                t.byte[len] = 0x80;
+                xorblock(&t, &d);
+                xorblock(&t, &fk->k1);
+                store(v, aes_block(fk->mac_rk, fk->rounds, load(&t)));
+        }
+        OPENSSL_cleanse(&d, sizeof d);
+        OPENSSL_cleanse(&t, sizeof t);
+}
+
+/* CTR with the 128-bit big endian counter of RFC 5297.  Bits 31 and 63
+   of the IV are clear, so the low word can't carry for this size. */
+static FAST_TARGET void fast_ctr(struct fast_keys const *fk,
+                                 unsigned char *out, unsigned char const *in,
+                                 size_t len, block const *v) {
+        block q = *v;
+        uint64_t hi, lo;
+        size_t i;
+
+        q.byte[8] &= 0x7f;
+        q.byte[12] &= 0x7f;
+        hi = getword(&q, 0);
+        lo = getword(&q, 1);
+        for (i = 0; i < len; i += 16) {
+                block ks;
+                size_t n = len - i < 16 ? len - i : 16;
+                size_t j;
+                putword(&q, 0, hi);
+                putword(&q, 1, lo++);
+                store(&ks, aes_block(fk->ctr_rk, fk->rounds, load(&q)));
+                for (j = 0; j < n; j++) {
+                        out[i + j] = in[i + j] ^ ks.byte[j];
+                }
+                OPENSSL_cleanse(&ks, sizeof ks);
+        }
+}
+
+static int aes_siv_fast_usable(size_t key_len, size_t total) {
+        return (key_len == 32 || key_len == 64) &&
+               total <= AES_SIV_FAST_MAX &&
+               aes_siv_fast_available();
+}
+#endif /* AES_SIV_FAST */
+
 int AES_SIV_Encrypt(AES_SIV_CTX *ctx, unsigned char *out, size_t *out_len,
                     unsigned char const *key, size_t key_len,
                     unsigned char const *nonce, size_t nonce_len,
@@ -547,6 +807,23 @@ int AES_SIV_Encrypt(AES_SIV_CTX *ctx, unsigned char *out, size_t *out_len,
         }
         *out_len = plaintext_len + 16;
 
+#ifdef AES_SIV_FAST
+        if (LIKELY(aes_siv_fast_usable(key_len, plaintext_len) &&
+                   ad_len <= AES_SIV_FAST_MAX &&
+                   nonce_len <= AES_SIV_FAST_MAX)) {
+                block v;
+                if (UNLIKELY(!fast_setkey(&ctx->fast, key, key_len))) {
+                        return 0;
+                }
+                fast_s2v(&ctx->fast, &v, ad, ad_len, nonce, nonce_len,
+                         plaintext, plaintext_len);
+                /* out may be plaintext moved up by 16, so CTR first */
+                fast_ctr(&ctx->fast, out + 16, plaintext, plaintext_len, &v);
+                memcpy(out, v.byte, 16);
+                return 1;
+        }
+#endif
+
         if (UNLIKELY(AES_SIV_Init(ctx, key, key_len) != 1)) {
                 return 0;
         }
@@ -579,6 +856,30 @@ int AES_SIV_Decrypt(AES_SIV_CTX *ctx, unsigned char *out, size_t *out_len,
         }
         *out_len = ciphertext_len - 16;
 
+#ifdef AES_SIV_FAST
+        if (LIKELY(aes_siv_fast_usable(key_len, ciphertext_len - 16) &&
+                   ad_len <= AES_SIV_FAST_MAX &&
+                   nonce_len <= AES_SIV_FAST_MAX)) {
+                block v, t;
+                uint64_t result;
+                memcpy(v.byte, ciphertext, 16);
+                if (UNLIKELY(!fast_setkey(&ctx->fast, key, key_len))) {
+                        return 0;
+                }
+                fast_ctr(&ctx->fast, out, ciphertext + 16,
+                         ciphertext_len - 16, &v);
+                fast_s2v(&ctx->fast, &t, ad, ad_len, nonce, nonce_len,
+                         out, ciphertext_len - 16);
+                xorblock(&t, &v);
+                result = t.word[0] | t.word[1];
+                if (result != 0) {
+                        OPENSSL_cleanse(out, ciphertext_len - 16);
+                        return 0;
+                }
+                return 1;
+        }
+#endif
+
         if (UNLIKELY(AES_SIV_Init(ctx, key, key_len) != 1)) {
                 return 0;
         }
@@ -571,6 +571,68 @@ static void test_decrypt_failure(void) {
         AES_SIV_CTX_free(ctx);
 }
 
+/* NTPsec: the one-shot calls take the short message path for 256 and
+   512 bit keys; the incremental calls never do.  They must agree. */
+static void test_short_path(void) {
+        unsigned char key[64], ad[80], nonce[16], plaintext[1100];
+        unsigned char c1[1200], c2[1200], p1[1200];
+        size_t key_len, len, c1_len, p1_len;
+        AES_SIV_CTX *ctx1, *ctx2;
+        size_t i;
+        int ret;
+
+        printf("Test short message path: ");
+        for (i = 0; i < sizeof key; i++) key[i] = (unsigned char)(3 * i + 1);
+        for (i = 0; i < sizeof ad; i++) ad[i] = (unsigned char)(5 * i + 2);
+        for (i = 0; i < sizeof nonce; i++) nonce[i] = (unsigned char)(7 * i);
+        for (i = 0; i < sizeof plaintext; i++)
+                plaintext[i] = (unsigned char)(11 * i + 3);
+
+        ctx1 = AES_SIV_CTX_new();
+        ctx2 = AES_SIV_CTX_new();
+        assert(ctx1 != NULL && ctx2 != NULL);
+        for (key_len = 32; key_len <= 64; key_len += 32) {
+                for (len = 0; len <= sizeof plaintext; len++) {
+                        if (len > 70 && len < 1010 && len % 16 != 3) {
+                                continue;
+                        }
+                        c1_len = sizeof c1;
+                        ret = AES_SIV_Encrypt(ctx1, c1, &c1_len, key, key_len,
+                                              nonce, sizeof nonce,
+                                              plaintext, len, ad, len % 81);
+                        assert(ret == 1 && c1_len == len + 16);
+
+                        ret = AES_SIV_Init(ctx2, key, key_len);
+                        assert(ret == 1);
+                        ret = AES_SIV_AssociateData(ctx2, ad, len % 81);
+                        assert(ret == 1);
+                        ret = AES_SIV_AssociateData(ctx2, nonce, sizeof nonce);
+                        assert(ret == 1);
+                        ret = AES_SIV_EncryptFinal(ctx2, c2, c2 + 16,
+                                                   plaintext, len);
+                        assert(ret == 1);
+                        assert(!memcmp(c1, c2, c1_len));
+
+                        p1_len = sizeof p1;
+                        ret = AES_SIV_Decrypt(ctx1, p1, &p1_len, key, key_len,
+                                              nonce, sizeof nonce,
+                                              c1, c1_len, ad, len % 81);
+                        assert(ret == 1 && p1_len == len);
+                        assert(!memcmp(p1, plaintext, len));
+
+                        c1[len % c1_len] ^= 1;
+                        p1_len = sizeof p1;
+                        ret = AES_SIV_Decrypt(ctx1, p1, &p1_len, key, key_len,
+                                              nonce, sizeof nonce,
+                                              c1, c1_len, ad, len % 81);
+                        assert(ret == 0);
+                }
+        }
+        AES_SIV_CTX_free(ctx1);
+        AES_SIV_CTX_free(ctx2);
+        printf("OK\n");
+}
+
 int main(void) {
         test_malloc_failure();
 	test_cleanup_before_free();
@@ -582,5 +644,6 @@ int main(void) {
         test_copy();
         test_bad_key();
         test_decrypt_failure();
+        test_short_path();
         return 0;
 }
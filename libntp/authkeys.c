@@ -28,6 +28,7 @@ typedef struct auth_alloc_tag auth_alloc;
 struct auth_alloc_tag {
 	auth_alloc *	link;
 	void *		mem;		/* enable free() atexit */
+	int		count;		/* auth_info structs at mem */
 };
 
 auth_alloc *	auth_allocs;
@@ -36,6 +37,7 @@ auth_alloc *	auth_allocs;
 static inline unsigned short	auth_log2(double x);
 static void	auth_moremem	(int);
 static void	auth_resize_hashtable(void);
+static void	auth_alloc_hashtable(void);
 static void	alloc_auth_info(auth_info **, keyid_t,	AUTH_Type,
 				    const char *,
 				    unsigned short, unsigned short, uint8_t *);
@@ -54,6 +56,7 @@ static auth_info key_listhead;		/* list of all in-use keys */
 static unsigned short authhashbuckets = INIT_AUTHHASHSIZE;
 static unsigned short authhashmask = INIT_AUTHHASHSIZE - 1;
 static auth_info **key_hash;
+static size_t	key_hash_size;	/* bytes at key_hash */
 
 unsigned int authnumkeys;	/* number of active keys */
 unsigned int authnumfreekeys;	/* number of free keys */
@@ -94,15 +97,10 @@ static auth_info *authfreekeys;
 void
 auth_init(void)
 {
-	size_t newalloc;
-
 	/*
 	 * Initialize hash table and free list
 	 */
-	newalloc = authhashbuckets * sizeof(key_hash[0]);
-
-	key_hash = erealloc(key_hash, newalloc);
-	memset(key_hash, '\0', newalloc);
+	auth_alloc_hashtable();
 
 	INIT_DLIST(key_listhead, llink);
 
@@ -150,10 +148,13 @@ free_auth_mem(void)
 		free_auth_info(sk, &key_hash[KEYHASH(sk->keyid)]);
 	}
 	free(key_hash);
+	mem_count(MEM_KEY, -(long)key_hash_size, 0);
 	key_hash = NULL;
+	key_hash_size = 0;
 	for (alloc = auth_allocs; NULL != alloc; alloc = next_alloc) {
 		next_alloc = alloc->link;
-		free(alloc->mem);
+		etfree(MEM_KEY, alloc->mem, alloc->count, sizeof(auth_info));
+		free(alloc);
 	}
 	authfreekeys = NULL;
 	authnumfreekeys = 0;
@@ -172,31 +173,42 @@ auth_moremem(
 	auth_info *	auth;
 	int		i;
 #ifdef DEBUG
-	void *		base;
 	auth_alloc *	allocrec;
-# define MOREMEM_EXTRA_ALLOC	(sizeof(*allocrec))
-#else
-# define MOREMEM_EXTRA_ALLOC	(0)
 #endif
 
 	i = (keycount > 0)
 		? keycount
 		: MEMINC;
-	auth = emalloc_zero((unsigned int)i * sizeof(*auth) + MOREMEM_EXTRA_ALLOC);
+	auth = etallocarray(MEM_KEY, (unsigned int)i, sizeof(*auth));
 #ifdef DEBUG
-	base = auth;
+	allocrec = emalloc(sizeof(*allocrec));
+	allocrec->mem = auth;
+	allocrec->count = i;
+	LINK_SLIST(auth_allocs, allocrec, link);
 #endif
 	authnumfreekeys += i;
 
 	for (; i > 0; i--, auth++) {
 		LINK_SLIST(authfreekeys, auth, llink.f);
 	}
+}
 
-#ifdef DEBUG
-	allocrec = (void *)auth;
-	allocrec->mem = base;
-	LINK_SLIST(auth_allocs, allocrec, link);
-#endif
+
+/*
+ * auth_alloc_hashtable - (re)allocate an empty key_hash of
+ *			  authhashbuckets buckets
+ */
+static void
+auth_alloc_hashtable(void)
+{
+	size_t newalloc;
+
+	newalloc = authhashbuckets * sizeof(key_hash[0]);
+
+	key_hash = erealloc(key_hash, newalloc);
+	memset(key_hash, '\0', newalloc);
+	mem_count(MEM_KEY, (long)newalloc - (long)key_hash_size, 0);
+	key_hash_size = newalloc;
 }
 
 
@@ -240,7 +252,6 @@ auth_resize_hashtable(void)
 	unsigned int	totalkeys;
 	unsigned short	hashbits;
 	unsigned short	hash;
-	size_t		newalloc;
 	auth_info *	auth;
 
 	totalkeys = authnumkeys + (unsigned int)authnumfreekeys;
@@ -250,10 +261,7 @@ auth_resize_hashtable(void)
 
 	authhashbuckets = 1 << hashbits;
 	authhashmask = authhashbuckets - 1;
-	newalloc = authhashbuckets * sizeof(key_hash[0]);
-
-	key_hash = erealloc(key_hash, newalloc);
-	memset(key_hash, '\0', newalloc);
+	auth_alloc_hashtable();
 
 	ITER_DLIST_BEGIN(key_listhead, auth, llink, auth_info)
 		hash = KEYHASH(auth->keyid);
@@ -352,6 +360,7 @@ free_auth_info(
 	if (NULL != auth->key) {
 		memset(auth->key, '\0', auth->key_size);
 		free(auth->key);
+		mem_count(MEM_KEY, -(long)auth->key_size, 0);
                 auth->key = NULL;
 	}
 #if OPENSSL_VERSION_NUMBER > 0x20000000L
@@ -502,9 +511,11 @@ auth_setkey(
 			if (NULL != auth->key) {
 				memset(auth->key, '\0', auth->key_size);
                         	free(auth->key);
+				mem_count(MEM_KEY, -(long)auth->key_size, 0);
 			}
 			auth->key_size = (unsigned short)key_size;
                         auth->key = emalloc(key_size);
+			mem_count(MEM_KEY, (long)key_size, 0);
 			memcpy(auth->key, key, key_size);
 			return;
 		}
@@ -514,6 +525,7 @@ auth_setkey(
 	 * Need to allocate new structure.  Do it.
 	 */
 	newkey = emalloc(key_size);
+	mem_count(MEM_KEY, (long)key_size, 0);
 	memcpy(newkey, key, key_size);
 	alloc_auth_info(bucket, keyno, type, name, 0,
 		    (unsigned short)key_size, newkey);
@@ -547,6 +559,7 @@ auth_delkeys(void)
 			if (NULL != auth->key) {
 				memset(auth->key, '\0', auth->key_size);
 				free(auth->key);
+				mem_count(MEM_KEY, -(long)auth->key_size, 0);
 				auth->key = NULL;
 			}
 			auth->key_size = 0;
@@ -138,3 +138,61 @@ estrdup_impl(
 	return copy;
 }
 
+
+
+/*
+ * Heap accounting by owner, see mem_tag in ntp_stdlib.h.  The NTS-KE
+ * and control threads allocate too, so the counters are bumped with
+ * the compiler's atomics; a word-sized load is good enough to read
+ * them.  Counts are unsigned and wrap, so negative deltas work.
+ */
+struct mem_use	mem_use[MEM_TAGS];
+
+void
+mem_count(
+	mem_tag	tag,
+	long	bytes,
+	long	objects
+	)
+{
+	__atomic_fetch_add(&mem_use[tag].bytes, (unsigned long)bytes,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&mem_use[tag].objects, (unsigned long)objects,
+			   __ATOMIC_RELAXED);
+}
+
+/*
+ * etallocarray - zeroed eallocarray() counted as nmemb objects of tag
+ */
+void *
+etallocarray(
+	mem_tag	tag,
+	size_t	nmemb,
+	size_t	size
+	)
+{
+	void *	mem;
+
+	mem = eallocarray(nmemb, size);
+	memset(mem, '\0', nmemb * size);
+	mem_count(tag, (long)(nmemb * size), (long)nmemb);
+
+	return mem;
+}
+
+/*
+ * etfree - free() what etallocarray(tag, nmemb, size) returned
+ */
+void
+etfree(
+	mem_tag	tag,
+	void *	mem,
+	size_t	nmemb,
+	size_t	size
+	)
+{
+	if (NULL == mem)
+		return;
+	free(mem);
+	mem_count(tag, -(long)(nmemb * size), -(long)nmemb);
+}
@@ -19,6 +19,10 @@
 
 #ifdef LIBRESSL_VERSION_NUMBER
 static void	atexit_ssl_cleanup(void);
+#else
+static void *	ssl_malloc(size_t, const char *, int);
+static void *	ssl_realloc(void *, size_t, const char *, int);
+static void	ssl_free(void *, const char *, int);
 #endif
 
 static bool ssl_init_done;
@@ -38,6 +42,12 @@ ssl_init(void)
 		return;
 	}
 
+#ifndef LIBRESSL_VERSION_NUMBER
+	/* Count OpenSSL's heap as MEM_TLS.  This fails, harmlessly,
+	 * if OpenSSL has already allocated something. */
+	CRYPTO_set_mem_functions(ssl_malloc, ssl_realloc, ssl_free);
+#endif
+
 #ifndef DISABLE_NTS
 	OPENSSL_init_ssl(OPENSSL_INIT_LOAD_SSL_STRINGS|OPENSSL_INIT_LOAD_CRYPTO_STRINGS|OPENSSL_INIT_ADD_ALL_CIPHERS|OPENSSL_INIT_ADD_ALL_DIGESTS, NULL);
 #endif
@@ -118,3 +128,81 @@ atexit_ssl_cleanup(void)
 	EVP_cleanup();
 }
 #endif
+
+
+#ifndef LIBRESSL_VERSION_NUMBER
+/*
+ * OpenSSL memory hooks.  Each block starts with its size so ssl_free()
+ * can uncount it; the union keeps what follows aligned for anything.
+ */
+typedef union {
+	size_t		size;
+	long double	align_ld;	/* max_align_t is C11 */
+	long long	align_ll;
+	void *		align_p;
+} ssl_mem_hdr;
+
+static void *
+ssl_malloc(
+	size_t		num,
+	const char *	file,
+	int		line
+	)
+{
+	ssl_mem_hdr *	hdr;
+
+	UNUSED_ARG(file);
+	UNUSED_ARG(line);
+	hdr = malloc(sizeof(*hdr) + num);
+	if (NULL == hdr)
+		return NULL;
+	hdr->size = num;
+	mem_count(MEM_TLS, (long)num, 0);
+	return hdr + 1;
+}
+
+static void *
+ssl_realloc(
+	void *		ptr,
+	size_t		num,
+	const char *	file,
+	int		line
+	)
+{
+	ssl_mem_hdr *	hdr;
+	size_t		old;
+
+	if (NULL == ptr)
+		return ssl_malloc(num, file, line);
+	if (0 == num) {
+		ssl_free(ptr, file, line);
+		return NULL;
+	}
+	hdr = (ssl_mem_hdr *)ptr - 1;
+	old = hdr->size;
+	hdr = realloc(hdr, sizeof(*hdr) + num);
+	if (NULL == hdr)
+		return NULL;
+	hdr->size = num;
+	mem_count(MEM_TLS, (long)num - (long)old, 0);
+	return hdr + 1;
+}
+
+static void
+ssl_free(
+	void *		ptr,
+	const char *	file,
+	int		line
+	)
+{
+	ssl_mem_hdr *	hdr;
+
+	UNUSED_ARG(file);
+	UNUSED_ARG(line);
+	if (NULL == ptr)
+		return;
+	hdr = (ssl_mem_hdr *)ptr - 1;
+	mem_count(MEM_TLS, -(long)hdr->size, 0);
+	free(hdr);
+}
+#endif
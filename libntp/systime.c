@@ -91,7 +91,9 @@ get_systime(
 	)
 {
 	struct timespec ts;	/* seconds and nanoseconds */
-	get_ostime(&ts);
+
+	if (!tsc_stats.enabled || !tsc_gettime(&ts))
+		get_ostime(&ts);
 	*now = tspec_stamp_to_lfp(ts);
 }
 
@@ -261,6 +263,9 @@ step_systime(
 
 	/* <--- time-critical path ended with call to the settime hook <--- */
 
+	if (tsc_stats.enabled)
+		tsc_reset();
+
 	msyslog(LOG_WARNING, "CLOCK: time stepped by %Lf", step);
 	if (fabsl(step) > 86400) {
 	    /* Get the full year (both old and new) into the log file.
@@ -0,0 +1,297 @@
+/*
+ * tsctime.c - get_systime() from the CPU's time stamp counter
+ *
+ * Copyright the NTPsec project contributors
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <pthread.h>
+
+#include "ntp.h"
+#include "ntp_syslog.h"
+#include "ntp_stdlib.h"
+#include "timespecops.h"
+
+/*
+ * Fast time source.  Where reading CLOCK_REALTIME is a real system
+ * call rather than a vDSO read, as on some virtual machines,
+ * "enable tsc" has get_systime() extrapolate from the CPU's invariant
+ * time stamp counter instead.  tsc_timer(), once a second, pairs a TSC
+ * reading with the system clock, works out the TSC rate over the last
+ * second and checks how far the calibration it replaces was off.  An
+ * error over TSC_MAXERR, or a TSC that didn't move forward, puts
+ * get_systime() back on the system clock until TSC_SETTLE good
+ * seconds in a row have gone by.  So does a step, and a leap second
+ * coming up (tsc_timer(true)): the TSC knows nothing of either.
+ * Readings more than TSC_SPAN past the last calibration, if the timer
+ * falls behind, come from the system clock too.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define HAVE_TSC
+# include <cpuid.h>
+# include <x86intrin.h>
+#endif
+
+#define TSC_MAXERR	10e-6	/* s, worse than this is unstable */
+#define TSC_SETTLE	8	/* good calibrations before use */
+#define TSC_SPAN	3	/* s, longest extrapolation */
+#define TSC_PAIRS	3	/* tries at pairing TSC and system clock */
+#define TSC_COSTLOOP	16	/* reads timed for tsc_stats.cost */
+
+struct tsc_stats tsc_stats;
+
+/*
+ * Written only by the thread that runs tsc_timer(), under lock.
+ * get_systime() may be called from any thread.
+ */
+static struct {
+	pthread_mutex_t	lock;
+	bool		active;		/* get_systime() uses it */
+	uint64_t	tsc;		/* TSC at calibration */
+	struct timespec	ts;		/* system clock at calibration */
+	double		ns_per_tick;	/* 0 until there's a rate */
+	uint64_t	span;		/* TSC_SPAN in ticks */
+} tsc_cal = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+
+
+/*
+ * tsc_gettime - the system clock as extrapolated from the TSC.  False
+ * if get_systime() should read the system clock itself.
+ */
+bool
+tsc_gettime(
+	struct timespec *	tsp
+	)
+{
+#ifdef HAVE_TSC
+	struct timespec	ts;
+	uint64_t	base, span, ticks;
+	double		ns_per_tick;
+	bool		active;
+
+	pthread_mutex_lock(&tsc_cal.lock);
+	active = tsc_cal.active;
+	base = tsc_cal.tsc;
+	ts = tsc_cal.ts;
+	ns_per_tick = tsc_cal.ns_per_tick;
+	span = tsc_cal.span;
+	pthread_mutex_unlock(&tsc_cal.lock);
+	if (!active)
+		return false;
+
+	ticks = __rdtsc() - base;	/* behind base wraps to huge */
+	if (ticks > span)
+		return false;
+	*tsp = add_tspec_ns(ts, (long)(ticks * ns_per_tick));
+	return true;
+#else
+	UNUSED_ARG(tsp);
+	return false;
+#endif
+}
+
+
+#ifdef HAVE_TSC
+
+/*
+ * tsc_pair - read the system clock between two TSC readings, keeping
+ * the closest of a few tries.  Returns the TSC halfway between.
+ */
+static uint64_t
+tsc_pair(
+	struct timespec *	tsp,
+	uint64_t *		width
+	)
+{
+	struct timespec	ts;
+	uint64_t	t0, t1, mid = 0;
+	int		i;
+
+	*width = UINT64_MAX;
+	for (i = 0; i < TSC_PAIRS; i++) {
+		t0 = __rdtsc();
+		if (clock_gettime(CLOCK_REALTIME, &ts) < 0)
+			continue;
+		t1 = __rdtsc();
+		if (t1 - t0 < *width) {
+			*width = t1 - t0;
+			mid = t0 + (t1 - t0) / 2;
+			*tsp = ts;
+		}
+	}
+	return mid;
+}
+
+
+#endif	/* HAVE_TSC */
+
+
+/*
+ * tsc_reset - back to the system clock, and start calibrating afresh
+ */
+void
+tsc_reset(void)
+{
+	pthread_mutex_lock(&tsc_cal.lock);
+	tsc_cal.active = false;
+	tsc_cal.ns_per_tick = 0;
+	tsc_cal.tsc = 0;
+	pthread_mutex_unlock(&tsc_cal.lock);
+	tsc_stats.active = false;
+	tsc_stats.good = 0;
+}
+
+
+/*
+ * tsc_enable - "enable tsc" and "disable tsc".  False if this CPU has
+ * no invariant TSC.
+ */
+bool
+tsc_enable(
+	bool	on
+	)
+{
+#ifdef HAVE_TSC
+	unsigned int	eax, ebx, ecx, edx;
+
+	/* CPUID 0x80000007, EDX bit 8: invariant TSC */
+	if (on && (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+		   !(edx & (1U << 8))))
+		return false;
+	tsc_reset();
+	tsc_stats.enabled = on;
+	return true;
+#else
+	return !on;
+#endif
+}
+
+
+/*
+ * tsc_calibrate - take a TSC reading paired with the system clock,
+ * width TSC ticks apart, as the new calibration.  False if the pair is
+ * too far apart to be any use.  The innards of tsc_timer(), apart so
+ * the tests can feed it readings.
+ */
+bool
+tsc_calibrate(
+	uint64_t	tsc,
+	struct timespec	ts,
+	uint64_t	width
+	)
+{
+	uint64_t	ticks;
+	double		ns, ns_per_tick, err;
+
+	if (tsc_cal.ns_per_tick > 0 &&
+	    width * tsc_cal.ns_per_tick > TSC_MAXERR * NS_PER_S / 2)
+		return false;	/* interrupted, try next time */
+	ticks = tsc - tsc_cal.tsc;
+	ns = tspec_to_d(sub_tspec(ts, tsc_cal.ts)) * NS_PER_S;
+	if (0 == tsc_cal.tsc) {
+		ns_per_tick = 0;	/* first reading, no rate yet */
+	} else if (tsc <= tsc_cal.tsc || ns <= 0 ||
+		   ns > (double)TSC_SPAN * NS_PER_S) {
+		ns_per_tick = 0;	/* TSC or clock jumped */
+		if (tsc_stats.active)
+			tsc_stats.fallbacks++;
+		tsc_stats.active = false;
+		tsc_stats.good = 0;
+	} else {
+		ns_per_tick = ns / (double)ticks;
+		if (tsc_cal.ns_per_tick > 0) {
+			err = (ns - (double)ticks * tsc_cal.ns_per_tick) *
+			    S_PER_NS;
+			tsc_stats.err = err;
+			if (fabs(err) > TSC_MAXERR) {
+				if (tsc_stats.active)
+					tsc_stats.fallbacks++;
+				tsc_stats.active = false;
+				tsc_stats.good = 0;
+			} else {
+				if (tsc_stats.active &&
+				    fabs(err) > tsc_stats.maxerr)
+					tsc_stats.maxerr = fabs(err);
+				if (++tsc_stats.good >= TSC_SETTLE)
+					tsc_stats.active = true;
+			}
+		}
+		tsc_stats.hz = NS_PER_S / ns_per_tick;
+		tsc_stats.oscost = width * ns_per_tick * S_PER_NS;
+	}
+
+	pthread_mutex_lock(&tsc_cal.lock);
+	tsc_cal.tsc = tsc;
+	tsc_cal.ts = ts;
+	tsc_cal.ns_per_tick = ns_per_tick;
+	tsc_cal.span = ns_per_tick > 0 ?
+	    (uint64_t)(TSC_SPAN * (double)NS_PER_S / ns_per_tick) : 0;
+	tsc_cal.active = tsc_stats.active;
+	pthread_mutex_unlock(&tsc_cal.lock);
+	return true;
+}
+
+
+/*
+ * tsc_timer - recalibrate, once a second.  Hold the TSC off while
+ * hold is true.
+ */
+void
+tsc_timer(
+	bool	hold
+	)
+{
+#ifdef HAVE_TSC
+	struct timespec	ts, scratch;
+	uint64_t	tsc, width, t0;
+	bool		was_active = tsc_stats.active;
+	int		i;
+
+	if (!tsc_stats.enabled)
+		return;
+	if (hold) {
+		if (tsc_cal.tsc != 0)
+			tsc_reset();
+		return;
+	}
+
+	tsc = tsc_pair(&ts, &width);
+	if (!tsc_calibrate(tsc, ts, width))
+		return;
+
+	if (tsc_stats.active) {
+		t0 = __rdtsc();
+		for (i = 0; i < TSC_COSTLOOP; i++)
+			(void)tsc_gettime(&scratch);
+		tsc_stats.cost = (__rdtsc() - t0) * tsc_cal.ns_per_tick *
+		    S_PER_NS / TSC_COSTLOOP;
+	}
+	if (tsc_stats.active && !was_active)
+		msyslog(LOG_INFO, "CLOCK: using the TSC, %.3f MHz",
+			tsc_stats.hz / 1e6);
+	else if (!tsc_stats.active && was_active)
+		msyslog(LOG_NOTICE,
+			"CLOCK: TSC off by %.3f us, using the system clock",
+			tsc_stats.err * US_PER_S);
+#else
+	UNUSED_ARG(hold);
+#endif
+}
+
+
+/*
+ * tsc_state - for mode 6
+ */
+const char *
+tsc_state(void)
+{
+	if (!tsc_stats.enabled)
+		return "off";
+	return tsc_stats.active ? "on" : "calibrating";
+}
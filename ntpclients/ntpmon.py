@@ -173,6 +173,41 @@ class Fatal(Exception):
         return self.msg
 
 
+class PeerCache:
+    """Peer variables, read again only for associations ntpd says
+have changed since the last refresh."""
+
+    def __init__(self, session):
+        self.session = session
+        self.gen = 0
+        self.peers = {}         # association ID -> Peer
+        self.variables = {}     # association ID -> variables
+
+    def refresh(self):
+        "Return the associations, forgetting variables that changed."
+        (gen, _, full, changed) = self.session.readchanges(self.gen)
+        self.gen = gen or 0
+        if full:
+            self.peers = {}
+            self.variables = {}
+        for peer in changed:
+            self.peers[peer.associd] = peer
+            self.variables.pop(peer.associd, None)
+        return sorted(self.peers.values(), key=lambda p: p.associd)
+
+    def readvar(self, associd):
+        "Peer variables, from ntpd only if they changed."
+        if associd not in self.variables:
+            try:
+                self.variables[associd] = self.session.readvar(associd,
+                                                               raw=True)
+            except ntp.packet.ControlException as e:
+                if e.errorcode == ntp.control.CERR_BADASSOC:
+                    self.peers.pop(associd, None)
+                raise
+        return self.variables[associd]
+
+
 class OutputContext:
     def __enter__(self):
         "Begin critical region."
@@ -287,6 +322,7 @@ if __name__ == '__main__':
         session.logfp = logfp
         session.openhost(arguments[0] if arguments else "localhost")
         sysvars = session.readvar(raw=True)
+        peer_cache = PeerCache(session)
         with OutputContext() as ctx:
             while True:
                 stdscr.erase()
@@ -300,7 +336,7 @@ if __name__ == '__main__':
                 else:
                     if showpeers:
                         try:
-                            peers = session.readstat()
+                            peers = peer_cache.refresh()
                         except ntp.packet.ControlException as e:
                             raise Fatal(e.message)
                         except IOError as e:
@@ -322,8 +358,7 @@ if __name__ == '__main__':
                                      ntp.control.CTL_PST_REACH))):
                                 continue
                             try:
-                                variables = session.readvar(peer.associd,
-                                                            raw=True)
+                                variables = peer_cache.readvar(peer.associd)
                             except ntp.packet.ControlException as e:
                                 if e.errorcode == ntp.control.CERR_BADASSOC:
                                     # Probable race condition due to pool
@@ -343,7 +378,7 @@ if __name__ == '__main__':
                                 hilite = curses.A_REVERSE
                             else:
                                 hilite = curses.A_NORMAL
-                            data = peer_report.summary(session.rstatus,
+                            data = peer_report.summary(peer.status,
                                                        variables,
                                                        peer.associd)
                             data = data.encode('UTF-8')
@@ -400,37 +400,34 @@ usage: timeout [ msec ]
 
     def collect_display2(self, variables):
         "Query and display a collection of variables from the system."
-        try:
-            queried = self.session.readvar(0,
-                                           [v[0] for v in variables] +
-                                           [v[0] + '_r' for v in variables],
-                                           raw=True)
-        except ntp.packet.ControlException as e:
-            if ntp.control.CERR_UNKNOWNVAR == e.errorcode:
-                self.warn("Unknown variable.  Trying one at a time.")
-                varlist = [v[0] for v in variables] + \
-                          [v[0] + '_r' for v in variables]
-                items = []
-                for var in varlist:
-                    try:
-                        queried = self.session.readvar(0, [var],
-                                                       raw=True)
-                        for (name, (value, rawvalue)) in queried.items():
-                            items.append((name, (value, rawvalue)))
-                    except ntp.packet.ControlException as e:
-                        if ntp.control.CERR_UNKNOWNVAR == e.errorcode:
-                            items.append((var, ("???", None)))
-                            continue
-                        raise e
-                queried = ntp.util.OrderedDict(items)
-            else:
-                self.warn(e.message)
+        queried = ntp.util.OrderedDict()
+        # A request has to fit in one datagram, so ask a few at a time
+        for i in range(0, len(variables), 8):
+            chunk = variables[i:i + 8]
+            varlist = [v[0] for v in chunk] + [v[0] + '_r' for v in chunk]
+            try:
+                queried.update(self.session.readvar(0, varlist, raw=True))
+            except ntp.packet.ControlException as e:
+                if ntp.control.CERR_UNKNOWNVAR == e.errorcode:
+                    self.warn("Unknown variable.  Trying one at a time.")
+                    for var in varlist:
+                        try:
+                            queried.update(self.session.readvar(0, [var],
+                                                                raw=True))
+                        except ntp.packet.ControlException as e:
+                            if ntp.control.CERR_UNKNOWNVAR == e.errorcode:
+                                queried[var] = ("???", None)
+                                continue
+                            raise e
+                else:
+                    self.warn(e.message)
+                    return
+            except IOError as e:
+                self.warn(e.strerror)
                 return
-        except IOError as e:
-            self.warn(e.strerror)
-            return
+            if self.rawmode:
+                self.say(self.session.response)
         if self.rawmode:
-            self.say(self.session.response)
             return
         try:
             runs, runl = None, None
@@ -478,9 +475,14 @@ usage: timeout [ msec ]
     def collect_display(self, associd, variables, decodestatus):
         "Query and display a collection of variables from the system."
         try:
-            queried = self.session.readvar(associd,
-                                           [v[0] for v in variables],
-                                           raw=True)
+            # A request has to fit in one datagram, so ask a few at a time
+            queried = ntp.util.OrderedDict()
+            for i in range(0, len(variables), 16):
+                chunk = [v[0] for v in variables[i:i + 16]]
+                queried.update(self.session.readvar(associd, chunk,
+                                                    raw=True))
+                if self.rawmode:
+                    self.say(self.session.response)
         except ntp.packet.ControlException as e:
             if ntp.control.CERR_UNKNOWNVAR == e.errorcode:
                 self.warn("Unknown variable.  Trying one at a time.")
@@ -505,7 +507,6 @@ usage: timeout [ msec ]
             self.warn(e.strerror)
             return
         if self.rawmode:
-            self.say(self.session.response)
             return
         if decodestatus:
             if associd == 0:
@@ -1187,6 +1188,10 @@ usage: cv [ assocID ] [ name=value[,...] ]
             ("selbroken", "bad reference time:   ", NTP_INT),
             ("candidate", "candidate order:      ", NTP_INT),
             ("ntscookies", "count of nts cookies: ", NTP_INT),
+            ("ntsused", "nts cookies used:     ", NTP_INT),
+            ("ntsrefreshed", "nts cookies received: ", NTP_INT),
+            ("ntsstarved", "nts cookie shortages: ", NTP_INT),
+            ("ntsrekeys", "nts-ke started early: ", NTP_INT),
         )
         if not line:
             self.warn("usage: pstats assocID")
@@ -1516,6 +1521,13 @@ usage: reslist
             ("clk_jitter", "clock jitter:     ", NTP_FLOAT),
             ("clk_wander", "clock wander:     ", NTP_FLOAT),
             ("authdelay", "symm. auth. delay:", NTP_FLOAT),
+            ("tsc", "TSC time source:  ", NTP_STR),
+            ("tsc_hz", "TSC rate (Hz):    ", NTP_FLOAT),
+            ("tsc_err", "TSC last error:   ", NTP_FLOAT),
+            ("tsc_maxerr", "TSC worst error:  ", NTP_FLOAT),
+            ("tsc_cost", "TSC read cost:    ", NTP_FLOAT),
+            ("tsc_oscost", "OS read cost:     ", NTP_FLOAT),
+            ("tsc_fallbacks", "TSC fallbacks:    ", NTP_INT),
         )
         self.collect_display(associd=0, variables=sysinfo, decodestatus=True)
 
@@ -1562,6 +1574,12 @@ usage: kerninfo
         sysstats = (
             ("ss_uptime",    "uptime:               ", NTP_UPTIME),
             ("ss_numctlreq", "control requests:     ", NTP_INT),
+            ("ctl_queue",    "control queue:        ", NTP_INT),
+            ("ctl_queue_max", "control queue peak:   ", NTP_INT),
+            ("ctl_queue_dropped", "control dropped:      ", NTP_INT),
+            ("ctl_busy",     "control busy:         ", NTP_FLOAT),
+            ("ctl_slowest",  "slowest control reply:", NTP_FLOAT),
+            ("ctl_stream",   "control socket:       ", NTP_INT),
         )
         sysstats2 = (
             ("ss_reset",     "sysstats reset:       ", NTP_UPTIME),
@@ -1578,7 +1596,11 @@ usage: kerninfo
             ("ss_restricted","restricted:           ", NTP_PACKETS),
             ("ss_limited",   "rate limited:         ", NTP_PACKETS),
             ("ss_kodsent",   "KoD responses:        ", NTP_PACKETS),
+            ("ss_kodsuppressed", "KoD suppressed:       ", NTP_PACKETS),
             ("ss_processed", "processed for time:   ", NTP_PACKETS),
+            ("ss_pooltaken", "pool servers taken:   ", NTP_PACKETS),
+            ("ss_poolskipped", "pool servers skipped: ", NTP_PACKETS),
+            ("ss_pooldropped", "pool servers dropped: ", NTP_PACKETS),
         )
         self.collect_display(associd=0, variables=sysstats, decodestatus=False)
         self.collect_display2(variables=sysstats2)
@@ -1609,7 +1631,28 @@ usage: sysstats
             ("mru_recycleold",  "alloc: recycle old:   ", NTP_INT),
             ("mru_recyclefull", "alloc: recycle full:  ", NTP_INT),
             ("mru_none",        "alloc: none:          ", NTP_INT),
+            ("mru_free",        "free addresses:       ", NTP_INT),
+            ("mru_aged",        "timer: aged out:      ", NTP_INT),
+            ("mru_evicted",     "timer: evicted:       ", NTP_INT),
+            ("mru_tickwork",    "timer: work last tick:", NTP_INT),
+            ("mru_tickworkmax", "timer: most work:     ", NTP_INT),
+            ("mru_checked",     "check: items:         ", NTP_INT),
+            ("mru_checkpasses", "check: passes:        ", NTP_INT),
+            ("mru_checkerrors", "check: errors:        ", NTP_INT),
             ("mru_oldest_age",  "age of oldest slot:   ", NTP_UPTIME),
+            ("mru_coldslots",   "cold: slots:          ", NTP_INT),
+            ("mru_colddepth",   "cold: in use:         ", NTP_INT),
+            ("mru_coldmem",     "cold: bytes:          ", NTP_INT),
+            ("mru_demoted",     "cold: demoted:        ", NTP_INT),
+            ("mru_promoted",    "cold: promoted:       ", NTP_INT),
+            ("mru_coldlost",    "cold: lost:           ", NTP_INT),
+            ("mru_shared",      "shared: slots:        ", NTP_INT),
+            ("mru_shared_used", "shared: in use:       ", NTP_INT),
+            ("mru_shared_hits", "shared: hits:         ", NTP_INT),
+            ("mru_shared_new",  "shared: new:          ", NTP_INT),
+            ("mru_shared_recycled", "shared: recycled:     ", NTP_INT),
+            ("mru_shared_none", "shared: none:         ", NTP_INT),
+            ("mru_shared_recovered", "shared: recovered:    ", NTP_INT),
         )
         self.collect_display(associd=0, variables=monstats, decodestatus=False)
 
@@ -1617,6 +1660,59 @@ usage: sysstats
         self.say("""\
 function: display monitor (mrulist) counters and limits
 usage: monstats
+""")
+
+    def do_memstats(self, _line):
+        "display heap held by each part of ntpd"
+        memstats = (
+            ("mem_mru",        "MRU bytes:            ", NTP_INT),
+            ("mem_mru_n",      "MRU entries:          ", NTP_INT),
+            ("mem_recvbuf",    "recvbuf bytes:        ", NTP_INT),
+            ("mem_recvbuf_n",  "recvbufs:             ", NTP_INT),
+            ("mem_peer",       "peer bytes:           ", NTP_INT),
+            ("mem_peer_n",     "peers:                ", NTP_INT),
+            ("mem_restrict",   "restrict bytes:       ", NTP_INT),
+            ("mem_restrict_n", "restrict entries:     ", NTP_INT),
+            ("mem_key",        "key bytes:            ", NTP_INT),
+            ("mem_key_n",      "keys:                 ", NTP_INT),
+            ("mem_tls",        "TLS bytes:            ", NTP_INT),
+            ("mem_tls_n",      "TLS sessions:         ", NTP_INT),
+            ("mem_config",     "config bytes:         ", NTP_INT),
+            ("mem_config_n",   "config trees:         ", NTP_INT),
+            ("mem_stats",      "stats buffer bytes:   ", NTP_INT),
+            ("mem_stats_n",    "stats buffers:        ", NTP_INT),
+        )
+        self.collect_display(associd=0, variables=memstats, decodestatus=False)
+
+    def help_memstats(self):
+        self.say("""\
+function: display heap held by each part of ntpd
+usage: memstats
+""")
+
+    def do_monparts(self, line):
+        "show the MRU partitions and rate limits for each local address"
+        try:
+            self.session.password()
+            entries = self.session.monparts()
+            if self.rawmode:
+                self.say(self.session.response + "\n")
+            else:
+                formatter = ntp.util.MonpartsSummary()
+                self.say(ntp.util.MonpartsSummary.header)
+                self.say(("=" * ntp.util.MonpartsSummary.width) + "\n")
+                for entry in entries:
+                    self.say(formatter.summary(entry))
+        except ntp.packet.ControlException as e:
+            self.warn(e.message)
+            return
+        except IOError:
+            self.warn("***Can't read control key from /etc/ntp.conf")
+
+    def help_monparts(self):
+        self.say("""\
+function: show the MRU partitions and rate limits for each local address
+usage: monparts
 """)
 
 # FIXME: This table should move to ntpd
@@ -1662,6 +1758,7 @@ usage: authinfo
    ("nts_server_recv_bad",       "NTS server recvs w error:   ", NTP_UINT),
    ("nts_server_send",           "NTS server sends:           ", NTP_UINT),
    ("nts_cookie_make",           "NTS make cookies:           ", NTP_UINT),
+   ("nts_cookie_make_short",     " NTS make cookies short:    ", NTP_UINT),
    ("nts_cookie_not_server",     "NTS cookies not server:     ", NTP_UINT),
    ("nts_cookie_decode_total",   "NTS decode cookies total:   ", NTP_UINT),
    ("nts_cookie_decode_current", " NTS decode cookies current:", NTP_UINT),
@@ -1683,6 +1780,11 @@ usage: authinfo
    ("nts_ke_serves_bad_cpu",     "NTS KE serves bad CPU:      ", NTP_FLOAT),
    ("nts_ke_probes_good",        "NTS KE client probes good:  ", NTP_UINT),
    ("nts_ke_probes_bad",         "NTS KE client probes bad:   ", NTP_UINT),
+   ("nts_ke_admitted",           "NTS KE admitted:            ", NTP_UINT),
+   ("nts_ke_queued",             "NTS KE queued:              ", NTP_UINT),
+   ("nts_ke_rejected_source",    "NTS KE rejected source rate:", NTP_UINT),
+   ("nts_ke_rejected_prefix",    "NTS KE rejected prefix rate:", NTP_UINT),
+   ("nts_ke_rejected_busy",      "NTS KE rejected busy:       ", NTP_UINT),
   )
         self.collect_display(associd=0, variables=ntsinfo, decodestatus=False)
         self.collect_display(associd=0, variables=ntskeinfo, decodestatus=False)
@@ -1750,6 +1852,12 @@ usage: iostats
             ("timerstats_reset", "time since reset:  ", NTP_UPTIME),
             ("timer_overruns", "timer overruns:    ", NTP_INT),
             ("timer_xmts", "calls to transmit: ", NTP_INT),
+            ("timer_burst", "due last second:   ", NTP_INT),
+            ("timer_burstmax", "most due at once:  ", NTP_INT),
+            ("timer_paced", "paced transmits:   ", NTP_INT),
+            ("timer_late", "late transmits:    ", NTP_INT),
+            ("timer_spacing", "mean spacing (ms): ", NTP_FLOAT),
+            ("timer_spacingmin", "min spacing (ms):  ", NTP_FLOAT),
         )
         self.collect_display(associd=0, variables=timerstats,
                              decodestatus=False)
@@ -28,6 +28,7 @@ struct key_tok ntp_keywords[] = {
 { "bias",		T_Bias,			FOLLBY_TOKEN },
 { "baud",		T_Baud,			FOLLBY_TOKEN },
 { "clock",		T_Clock,		FOLLBY_STRING },
+{ "controlsocket",	T_Controlsocket,	FOLLBY_STRING },
 { "cookie",		T_Cookie,		FOLLBY_TOKEN },
 { "ctl",		T_Ctl,			FOLLBY_TOKEN },
 { "disable",		T_Disable,		FOLLBY_TOKEN },
@@ -115,6 +116,11 @@ struct key_tok ntp_keywords[] = {
 { "pid",		T_Pid,			FOLLBY_TOKEN },
 { "week",		T_Week,			FOLLBY_TOKEN },
 { "year",		T_Year,			FOLLBY_TOKEN },
+/* capture_option */
+{ "capture",		T_Capture,		FOLLBY_TOKEN },
+{ "files",		T_Files,		FOLLBY_TOKEN },
+{ "maxsize",		T_Maxsize,		FOLLBY_TOKEN },
+{ "sample",		T_Sample,		FOLLBY_TOKEN },
 /*** ORPHAN MODE COMMANDS ***/
 /* tos_option */
 { "minclock",		T_Minclock,		FOLLBY_TOKEN },
@@ -127,6 +133,7 @@ struct key_tok ntp_keywords[] = {
 { "maxdist",		T_Maxdist,		FOLLBY_TOKEN },
 { "orphan",		T_Orphan,		FOLLBY_TOKEN },
 { "orphanwait",		T_Orphanwait,		FOLLBY_TOKEN },
+{ "pace",		T_Pace,			FOLLBY_TOKEN },
 { "nonvolatile",	T_Nonvolatile,		FOLLBY_TOKEN },
 /* access_control_flag */
 { "default",		T_Default,		FOLLBY_TOKEN },
@@ -148,8 +155,10 @@ struct key_tok ntp_keywords[] = {
 { "ntpport",		T_Ntpport,		FOLLBY_TOKEN },
 /* limit_option */
 { "average",		T_Average,		FOLLBY_TOKEN },
+{ "kodrate",		T_Kodrate,		FOLLBY_TOKEN },
 { "monitor",		T_Monitor,		FOLLBY_TOKEN },
 /* mru_option */
+{ "coldmem",		T_Coldmem,		FOLLBY_TOKEN },
 { "incalloc",		T_Incalloc,		FOLLBY_TOKEN },
 { "incmem",		T_Incmem,		FOLLBY_TOKEN },
 { "initalloc",		T_Initalloc,		FOLLBY_TOKEN },
@@ -160,6 +169,7 @@ struct key_tok ntp_keywords[] = {
 { "minage",		T_Minage,		FOLLBY_TOKEN },
 { "maxmem",		T_Maxmem,		FOLLBY_TOKEN },
 { "mru",		T_Mru,			FOLLBY_TOKEN },
+{ "mrushare",		T_Mrushare,		FOLLBY_STRING },
 /* fudge_factor */
 { "flag1",		T_Flag1,		FOLLBY_TOKEN },
 { "flag2",		T_Flag2,		FOLLBY_TOKEN },
@@ -175,6 +185,12 @@ struct key_tok ntp_keywords[] = {
 { "kernel",		T_Kernel,		FOLLBY_TOKEN },
 { "ntp",		T_Ntp,			FOLLBY_TOKEN },
 { "stats",		T_Stats,		FOLLBY_TOKEN },
+{ "tsc",		T_Tsc,			FOLLBY_TOKEN },
+/* busypoll_option */
+{ "busypoll",		T_Busypoll,		FOLLBY_TOKEN },
+{ "cpu",		T_Cpu,			FOLLBY_TOKEN },
+{ "priority",		T_Priority,		FOLLBY_TOKEN },
+{ "sockpoll",		T_Sockpoll,		FOLLBY_TOKEN },
 /* rlimit_option */
 { "memlock",		T_Memlock,		FOLLBY_TOKEN },
 { "stacksize",		T_Stacksize,		FOLLBY_TOKEN },
@@ -209,6 +225,9 @@ struct key_tok ntp_keywords[] = {
 { "tlsciphersuites",	T_Tlsciphersuites,	FOLLBY_STRING },
 { "tlsecdhcurves",	T_Tlsecdhcurves,	FOLLBY_STRING },
 { "tlscipherserverpreference",	T_Tlscipherserverpreference,	FOLLBY_TOKEN },
+{ "kerate",		T_Kerate,		FOLLBY_TOKEN },
+{ "keprefixrate",	T_Keprefixrate,		FOLLBY_TOKEN },
+{ "kequeue",		T_Kequeue,		FOLLBY_TOKEN },
 };
 
 typedef struct big_scan_state_tag {
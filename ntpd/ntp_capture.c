@@ -0,0 +1,307 @@
+/*
+ * ntp_capture.c - sample incoming datagrams into a pcapng ring
+ *
+ * Copyright the NTPsec project contributors
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * "capture file F" writes one in every "sample" datagrams that reach
+ * read_network_packet() to F, with its kernel receive timestamp.  When
+ * F passes "maxsize" KB it is renamed F.1 (F.1 to F.2 and so on) and a
+ * fresh F is started, keeping at most "files" files on disk.
+ *
+ * There is no link layer to record, so each datagram is written as a
+ * bare IPv4 or IPv6 packet (LINKTYPE_RAW) with headers rebuilt from
+ * the source address and the local address of the socket it arrived
+ * on.  For a wildcard socket that is the wildcard address.
+ * ntpd/ntpdreplay.c feeds such files back into receive().
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntpd.h"
+#include "ntp_capture.h"
+#include "ntp_stdlib.h"
+#include "recvbuff.h"
+#include "timespecops.h"
+
+#define IP4_HDR_LEN	20
+#define IP6_HDR_LEN	40
+#define UDP_HDR_LEN	8
+#define EPB_HDR_LEN	28	/* type through original length */
+
+bool	capture_enabled;
+
+static struct {
+	char *		file;		/* path of the newest file */
+	unsigned long	maxsize;	/* bytes per file */
+	int		files;		/* files in the ring */
+	unsigned int	sample;		/* keep 1 in this many */
+	unsigned int	skip;		/* to drop before the next keeper */
+	FILE *		fp;
+	unsigned long	size;		/* bytes in the open file */
+	bool		failed;		/* open failed, don't retry */
+} cap;
+
+static bool capture_open(void);
+static void capture_rotate(void);
+
+
+/*
+ * capture_config - "capture file F [maxsize KB] [files N] [sample N]"
+ *
+ * A relative F is taken from statsdir.
+ */
+void
+capture_config(
+	const char *	file,
+	unsigned long	maxsize,
+	int		files,
+	unsigned int	sample
+	)
+{
+	char	path[MAXFILENAME];
+
+	if (cap.fp != NULL) {
+		fclose(cap.fp);
+		cap.fp = NULL;
+	}
+	free(cap.file);
+	cap.file = NULL;
+	capture_enabled = false;
+	if (NULL == file || '\0' == *file)
+		return;
+
+	if ('/' == file[0])
+		strlcpy(path, file, sizeof(path));
+	else
+		snprintf(path, sizeof(path), "%s%s", statsdir, file);
+	cap.file = estrdup(path);
+	cap.maxsize = (maxsize ? maxsize : CAPTURE_MAXSIZE) * 1024;
+	cap.files = (files > 0) ? files : CAPTURE_FILES;
+	cap.sample = sample ? sample : 1;
+	cap.skip = 0;
+	cap.size = 0;
+	cap.failed = false;
+	capture_enabled = true;
+	msyslog(LOG_INFO, "CONFIG: capturing 1 in %u packets to %s, "
+		"%d files of %lu KB", cap.sample, cap.file, cap.files,
+		cap.maxsize / 1024);
+}
+
+
+/*
+ * capture_open - start a new file with its section and interface
+ * blocks.  Done lazily from the packet path, after droproot.
+ */
+static bool
+capture_open(void)
+{
+	/* Versions, link type and option headers are 16-bit pairs */
+	const uint16_t version[2] = { 1, 0 };
+	const uint16_t link[2] = { PCAPNG_LINK_RAW, 0 };
+	const uint16_t tsresol[2] = { PCAPNG_OPT_TSRESOL, 1 };
+	const uint8_t nsec[4] = { 9, 0, 0, 0 };	/* one octet, padded */
+	uint32_t shb[7] = {
+		PCAPNG_SHB, sizeof(shb), PCAPNG_MAGIC,
+		0,				/* version */
+		0xffffffffU, 0xffffffffU,	/* section length unknown */
+		sizeof(shb)
+	};
+	uint32_t idb[8] = {
+		PCAPNG_IDB, sizeof(idb),
+		0,				/* link type */
+		0,				/* no snap length */
+		0,				/* if_tsresol, */
+		0,				/* nanoseconds */
+		PCAPNG_OPT_END,			/* and its length, 0 */
+		sizeof(idb)
+	};
+
+	if (cap.failed)
+		return false;
+	memcpy(&shb[3], version, sizeof(version));
+	memcpy(&idb[2], link, sizeof(link));
+	memcpy(&idb[4], tsresol, sizeof(tsresol));
+	memcpy(&idb[5], nsec, sizeof(nsec));
+
+	cap.fp = fopen(cap.file, "wb");
+	if (NULL == cap.fp) {
+		msyslog(LOG_ERR, "LOG: capture file %s: %s",
+			cap.file, strerror(errno));
+		cap.failed = true;
+		return false;
+	}
+	if (fwrite(shb, sizeof(shb), 1, cap.fp) != 1 ||
+	    fwrite(idb, sizeof(idb), 1, cap.fp) != 1) {
+		msyslog(LOG_ERR, "LOG: capture file %s: %s",
+			cap.file, strerror(errno));
+		fclose(cap.fp);
+		cap.fp = NULL;
+		cap.failed = true;
+		return false;
+	}
+	cap.size = sizeof(shb) + sizeof(idb);
+	return true;
+}
+
+
+/*
+ * capture_rotate - F.n-2 -> F.n-1, ..., F -> F.1
+ */
+static void
+capture_rotate(void)
+{
+	char	from[MAXFILENAME], to[MAXFILENAME];
+	int	i;
+
+	fclose(cap.fp);
+	cap.fp = NULL;
+	for (i = cap.files - 1; i > 0; i--) {
+		if (i > 1)
+			snprintf(from, sizeof(from), "%s.%d", cap.file, i - 1);
+		else
+			strlcpy(from, cap.file, sizeof(from));
+		snprintf(to, sizeof(to), "%s.%d", cap.file, i);
+		if (rename(from, to) < 0 && ENOENT != errno)
+			msyslog(LOG_ERR, "LOG: capture rename %s: %s",
+				from, strerror(errno));
+	}
+}
+
+
+static uint16_t
+ip_checksum(
+	const uint8_t *	p,
+	size_t		len,
+	uint32_t	sum
+	)
+{
+	for (; len > 1; p += 2, len -= 2)
+		sum += (uint32_t)(p[0] << 8 | p[1]);
+	if (len)
+		sum += (uint32_t)(p[0] << 8);
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)~sum;
+}
+
+static void
+put16(
+	uint8_t *	p,
+	unsigned int	v
+	)
+{
+	p[0] = (uint8_t)(v >> 8);
+	p[1] = (uint8_t)v;
+}
+
+
+/*
+ * capture_packet - called for every datagram read while capturing
+ */
+void
+capture_packet(
+	const struct recvbuf *rb
+	)
+{
+	uint8_t		blk[EPB_HDR_LEN + IP6_HDR_LEN + UDP_HDR_LEN +
+			    RX_BUFF_SIZE + 3 + 4];
+	uint8_t *	ip = blk + EPB_HDR_LEN;
+	uint8_t *	udp;
+	const sockaddr_u *src = &rb->recv_srcadr;
+	const sockaddr_u *dst = &rb->dstadr->sin;
+	struct timespec	ts;
+	uint64_t	ns;
+	uint32_t	w[7];
+	size_t		iplen, blklen;
+
+	if (cap.skip > 0) {
+		cap.skip--;
+		return;
+	}
+	cap.skip = cap.sample - 1;
+	if (rb->recv_length > RX_BUFF_SIZE || AF(src) != AF(dst))
+		return;
+	if (NULL == cap.fp && !capture_open())
+		return;
+
+	if (IS_IPV4(src)) {
+		iplen = IP4_HDR_LEN + UDP_HDR_LEN + rb->recv_length;
+		memset(ip, 0, IP4_HDR_LEN);
+		ip[0] = 0x45;
+		put16(ip + 2, (unsigned int)iplen);
+		ip[6] = 0x40;			/* don't fragment */
+		ip[8] = 64;			/* TTL */
+		ip[9] = IPPROTO_UDP;
+		memcpy(ip + 12, &NSRCADR(src), 4);
+		memcpy(ip + 16, &NSRCADR(dst), 4);
+		put16(ip + 10, ip_checksum(ip, IP4_HDR_LEN, 0));
+		udp = ip + IP4_HDR_LEN;
+	} else {
+		iplen = IP6_HDR_LEN + UDP_HDR_LEN + rb->recv_length;
+		memset(ip, 0, IP6_HDR_LEN);
+		ip[0] = 0x60;
+		put16(ip + 4, (unsigned int)(iplen - IP6_HDR_LEN));
+		ip[6] = IPPROTO_UDP;
+		ip[7] = 64;			/* hop limit */
+		memcpy(ip + 8, PSOCK_ADDR6(src), 16);
+		memcpy(ip + 24, PSOCK_ADDR6(dst), 16);
+		udp = ip + IP6_HDR_LEN;
+	}
+	put16(udp, SRCPORT(src));
+	put16(udp + 2, SRCPORT(dst));
+	put16(udp + 4, (unsigned int)(UDP_HDR_LEN + rb->recv_length));
+	put16(udp + 6, 0);
+	memcpy(udp + UDP_HDR_LEN, rb->recv_buffer, rb->recv_length);
+	if (IS_IPV6(src)) {
+		/* UDP over IPv6 must carry a checksum, pseudo header first */
+		uint32_t sum = ip_checksum(ip + 8, 32, 0) ^ 0xffff;
+		uint16_t ck;
+
+		sum += (uint32_t)(UDP_HDR_LEN + rb->recv_length) + IPPROTO_UDP;
+		ck = ip_checksum(udp, UDP_HDR_LEN + rb->recv_length, sum);
+		put16(udp + 6, ck ? ck : 0xffff);
+	}
+
+	ts = lfp_stamp_to_tspec(rb->recv_time, time(NULL));
+	ns = (uint64_t)ts.tv_sec * NS_PER_S + (uint64_t)ts.tv_nsec;
+	blklen = EPB_HDR_LEN + ((iplen + 3) & ~(size_t)3) + 4;
+	memset(ip + iplen, 0, blklen - 4 - EPB_HDR_LEN - iplen);
+	w[0] = PCAPNG_EPB;
+	w[1] = (uint32_t)blklen;
+	w[2] = 0;				/* interface */
+	w[3] = (uint32_t)(ns >> 32);
+	w[4] = (uint32_t)ns;
+	w[5] = (uint32_t)iplen;			/* captured */
+	w[6] = (uint32_t)iplen;			/* on the wire */
+	memcpy(blk, w, EPB_HDR_LEN);
+	memcpy(blk + blklen - 4, &w[1], 4);
+
+	if (fwrite(blk, blklen, 1, cap.fp) != 1) {
+		msyslog(LOG_ERR, "LOG: capture file %s: %s",
+			cap.file, strerror(errno));
+		fclose(cap.fp);
+		cap.fp = NULL;
+		cap.failed = true;
+		return;
+	}
+	cap.size += blklen;
+	if (cap.size >= cap.maxsize)
+		capture_rotate();
+}
+
+
+/*
+ * capture_timer - hourly, so a quiet capture still reaches the disk
+ */
+void
+capture_timer(void)
+{
+	if (cap.fp != NULL)
+		fflush(cap.fp);
+}
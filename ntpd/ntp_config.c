@@ -25,6 +25,7 @@
 #include "ntp_io.h"
 #include "ntp_refclock.h"
 #include "ntp_filegen.h"
+#include "ntp_capture.h"
 #include "ntp_stdlib.h"
 #include "lib_strbuf.h"
 #include "ntp_assert.h"
@@ -178,6 +179,7 @@ static void free_config_peers(config_tree *);
 static void free_config_phone(config_tree *);
 static void free_config_reset_counters(config_tree *);
 static void free_config_rlimit(config_tree *);
+static void free_config_busypoll(config_tree *);
 static void free_config_setvar(config_tree *);
 static void free_config_system_opts(config_tree *);
 static void free_config_extra(config_tree *);
@@ -204,7 +206,6 @@ static void destroy_string_fifo(string_fifo *);
 		destroy_string_fifo(pf);		\
 		(pf) = NULL;			\
 	} while (0)
-static void destroy_attr_val_fifo(attr_val_fifo *);
 #define FREE_ATTR_VAL_FIFO(pf)			\
 	do {					\
 		destroy_attr_val_fifo(pf);	\
@@ -238,6 +239,7 @@ static void destroy_addr_opts_fifo(addr_opts_fifo *);
 static void config_logconfig(config_tree *);
 static void config_monitor(config_tree *);
 static void config_rlimit(config_tree *);
+static void config_busypoll(config_tree *);
 static void config_system_opts(config_tree *);
 static void config_extra(config_tree *);
 static void config_tinker(config_tree *);
@@ -334,6 +336,7 @@ free_config_tree(
 	free_config_tinker(ptree);
 	free_config_nts(ptree);
 	free_config_rlimit(ptree);
+	free_config_busypoll(ptree);
 	free_config_system_opts(ptree);
 	free_config_logconfig(ptree);
 	free_config_phone(ptree);
@@ -346,7 +349,7 @@ free_config_tree(
 	free_config_reset_counters(ptree);
 	free_auth_node(ptree);
 
-	free(ptree);
+	etfree(MEM_CONFIG, ptree, 1, sizeof(*ptree));
 }
 
 /* generic fifo routines for structs linked by 1st member */
@@ -632,6 +635,11 @@ create_peer_node(
 
 		case T_Aead:
 		    my_node->ctl.nts_cfg.aead = option->value.s;
+#ifndef DISABLE_NTS
+		    my_node->ctl.nts_cfg.naeads = nts_string_to_aeads(
+			option->value.s, my_node->ctl.nts_cfg.aeads,
+			NTS_MAX_AEADS);
+#endif
 		    break;
 
 		case T_Ca:
@@ -937,7 +945,7 @@ destroy_string_fifo(
 }
 
 
-static void
+void
 destroy_attr_val_fifo(
 	attr_val_fifo *	av_fifo
 	)
@@ -1261,6 +1269,16 @@ config_tos(
 			item = PROTO_MINSANE;
 			break;
 
+		case T_Pace:
+			if (val < 0 || val > 1) {
+				msyslog(LOG_WARNING,
+					"CONFIG: tos pace %g out of range 0 to 1",
+					val);
+				val = (val < 0) ? 0 : 1;
+			}
+			timer_pace(val);
+			continue;
+
 		}
 		proto_config(item, 0, val);
 	}
@@ -1429,6 +1447,50 @@ config_monitor(
 		filegen_config(filegen, statsdir, filegen_file,
 			       (unsigned int)filegen_type, (unsigned int)filegen_flag);
 	}
+
+	/* Packet capture; the last "capture file" wins */
+	my_opts = HEAD_PFIFO(ptree->capture);
+	if (my_opts != NULL) {
+		const char *	cap_file = NULL;
+		unsigned long	cap_maxsize = 0;
+		int		cap_files = 0;
+		unsigned int	cap_sample = 0;
+
+		for (; my_opts != NULL; my_opts = my_opts->link) {
+			switch (my_opts->attr) {
+
+			case T_File:
+				cap_file = my_opts->value.s;
+				cap_maxsize = 0;
+				cap_files = 0;
+				cap_sample = 0;
+				break;
+
+			case T_Maxsize:
+				if (my_opts->value.i > 0)
+					cap_maxsize = (unsigned long)my_opts->value.i;
+				break;
+
+			case T_Files:
+				cap_files = my_opts->value.i;
+				break;
+
+			case T_Sample:
+				if (my_opts->value.i > 0)
+					cap_sample = (unsigned int)my_opts->value.i;
+				break;
+
+			default:
+				msyslog(LOG_ERR,
+					"CONFIG: Unknown capture option token %d",
+					my_opts->attr);
+				break;
+			}
+		}
+		if (cap_file != NULL)
+			capture_config(cap_file, cap_maxsize, cap_files,
+				       cap_sample);
+	}
 }
 
 
@@ -1444,6 +1506,7 @@ free_config_monitor(
 
 	FREE_INT_FIFO(ptree->stats_list);
 	FREE_FILEGEN_FIFO(ptree->filegen_opts);
+	FREE_ATTR_VAL_FIFO(ptree->capture);
 }
 
 
@@ -1455,6 +1518,7 @@ config_access(
 	static bool		warned_signd;
 	attr_val *		my_opt;
 	restrict_node *		my_node;
+	addr_opts_node *	my_part;
 	int_node *		curr_flag;
 	sockaddr_u		addr;
 	sockaddr_u		mask;
@@ -1481,6 +1545,19 @@ config_access(
 
 		switch (my_opt->attr) {
 
+		case T_Coldmem:
+			/* mon_start() sizes the tier once, at startup */
+			if (NULL != mon_data.mon_hash)
+				msyslog(LOG_WARNING,
+					"CONFIG: mru coldmem ignored, "
+					"it takes effect only at startup");
+			else if (0 <= my_opt->value.i)
+				mon_data.mru_coldmaxmem =
+					my_opt->value.u * (uint64_t)1024;
+			else
+				range_err = true;
+			break;
+
 		case T_Incalloc:
 			if (0 <= my_opt->value.i)
 				mon_data.mru_incalloc = my_opt->value.u;
@@ -1575,7 +1652,71 @@ config_access(
 			mon_data.kod_limit = my_opt->value.d;
 			break;
 
+		case T_Kodrate:
+			mon_data.kod_rate = my_opt->value.d;
+			break;
+
+		case T_Maxdepth:
+			msyslog(LOG_ERR,
+				"CONFIG: limit maxdepth needs an interface, "
+				"ignored.");
+			break;
+
+		}
+	}
+
+	/* Configure the per local address limits */
+	my_part = HEAD_PFIFO(ptree->limit_parts);
+	for (; my_part != NULL; my_part = my_part->link) {
+		float		rate_limit = mon_data.rate_limit;
+		float		decay_time = mon_data.decay_time;
+		float		kod_limit = mon_data.kod_limit;
+		uint64_t	maxdepth = 0;
+
+		ZERO_SOCK(&addr);
+		AF(&addr) = (unsigned short)my_part->addr->type;
+		if (getnetnum(my_part->addr->address, &addr) != 1) {
+			msyslog(LOG_ERR,
+				"CONFIG: limit interface %s: not an IP "
+				"address, ignored.", my_part->addr->address);
+			continue;
+		}
+		my_opt = HEAD_PFIFO(my_part->options);
+		for (; my_opt != NULL; my_opt = my_opt->link) {
+
+			switch (my_opt->attr) {
+
+			default:
+				INSIST(0);
+				break;
+
+			case T_Average:
+				rate_limit = my_opt->value.d;
+				break;
+
+			case T_Burst:
+				decay_time = my_opt->value.d;
+				break;
+
+			case T_Kod:
+				kod_limit = my_opt->value.d;
+				break;
+
+			case T_Kodrate:
+				msyslog(LOG_ERR,
+					"CONFIG: limit kodrate is for all "
+					"interfaces, ignored.");
+				break;
+
+			case T_Maxdepth:
+				if (my_opt->value.d >= 0)
+					maxdepth = (uint64_t)my_opt->value.d;
+				break;
+
+			}
 		}
+		mon_partition(&addr, rate_limit, decay_time, kod_limit,
+			      maxdepth);
 	}
 
 	/* Configure the restrict options */
@@ -1819,6 +1960,7 @@ free_config_access(
 {
 	FREE_ATTR_VAL_FIFO(ptree->mru_opts);
 	FREE_ATTR_VAL_FIFO(ptree->limit_opts);
+	FREE_ADDR_OPTS_FIFO(ptree->limit_parts);
 	FREE_RESTRICT_FIFO(ptree->restrict_opts);
 }
 
@@ -1861,6 +2003,50 @@ config_rlimit(
 }
 
 
+/*
+ * config_busypoll - "busypoll [cpu N] [priority N] [sockpoll usec]"
+ */
+static void
+config_busypoll(
+	config_tree *ptree
+	)
+{
+	attr_val *	bp_av;
+	bool		enabled = false;
+	int		cpu = -1;
+	int		priority = 0;
+	int		sockpoll = 0;
+
+	bp_av = HEAD_PFIFO(ptree->busypoll);
+	for (; bp_av != NULL; bp_av = bp_av->link) {
+		switch (bp_av->attr) {
+
+		default:
+			INSIST(0);
+			break;
+
+		case T_Busypoll:
+			enabled = true;
+			break;
+
+		case T_Cpu:
+			cpu = bp_av->value.i;
+			break;
+
+		case T_Priority:
+			priority = bp_av->value.i;
+			break;
+
+		case T_Sockpoll:
+			sockpoll = bp_av->value.i;
+			break;
+		}
+	}
+	if (enabled)
+		busypoll_config(cpu, priority, sockpoll);
+}
+
+
 static void
 config_extra(
 	config_tree *ptree
@@ -1960,6 +2146,8 @@ config_nts(
 			break;
 		case T_Aead:
 			ntsconfig.aead = estrdup(nts->value.s);
+			ntsconfig.naeads = nts_string_to_aeads(ntsconfig.aead,
+				ntsconfig.aeads, NTS_MAX_AEADS);
 			break;
 
 		case T_Ca:
@@ -1982,6 +2170,24 @@ config_nts(
 			ntsconfig.ntsenable = true;
 			break;
 
+		case T_Keprefixrate:
+			ntsconfig.ke_prefixrate = nts->value.d;
+			break;
+
+		case T_Kequeue:
+			if (nts->value.i < 1) {
+				msyslog(LOG_ERR,
+					"CONFIG: nts kequeue %d too small, "
+					"ignored.", nts->value.i);
+				break;
+			}
+			ntsconfig.ke_queue = nts->value.i;
+			break;
+
+		case T_Kerate:
+			ntsconfig.ke_rate = nts->value.d;
+			break;
+
 		case T_Key:
 			ntsconfig.key = estrdup(nts->value.s);
 			break;
@@ -2023,6 +2229,14 @@ free_config_rlimit(
 	FREE_ATTR_VAL_FIFO(ptree->rlimit);
 }
 
+static void
+free_config_busypoll(
+	config_tree *ptree
+	)
+{
+	FREE_ATTR_VAL_FIFO(ptree->busypoll);
+}
+
 static void
 free_config_extra(
 	config_tree *ptree
@@ -2235,6 +2449,10 @@ apply_enable_disable(
 			proto_config(PROTO_FILEGEN, (unsigned long)enable, 0.);
 			break;
 
+		case T_Tsc:
+			proto_config(PROTO_TSC, (unsigned long)enable, 0.);
+			break;
+
 		}
 	}
 }
@@ -2592,6 +2810,15 @@ config_vars(
 			stats_config(STATS_PID_FILE, curr_var->value.s);
 			break;
 
+		case T_Controlsocket:
+			ctl_stream_config(curr_var->value.s);
+			break;
+
+		case T_Mrushare:
+			free(mon_data.mru_share);
+			mon_data.mru_share = estrdup(curr_var->value.s);
+			break;
+
 		case T_Logfile:
 			/* processed in config_logfile */
 			break;
@@ -3042,6 +3269,7 @@ config_ntpd(
 	config_tinker(ptree);
 	config_nts(ptree);
 	config_rlimit(ptree);
+	config_busypoll(ptree);
 	config_system_opts(ptree);
 	config_logconfig(ptree);
 	config_phone(ptree);
@@ -3198,7 +3426,7 @@ save_and_apply_config_tree(bool input_from_file)
 	 * a list that can be used to dump the configuration back to
 	 * a text file.
 	 */
-	ptree = emalloc(sizeof(*ptree));
+	ptree = etallocarray(MEM_CONFIG, 1, sizeof(*ptree));
 	memcpy(ptree, &cfgt, sizeof(*ptree));
 	ZERO(cfgt);
 
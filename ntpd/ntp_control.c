@@ -8,9 +8,15 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 
 #include <openssl/evp.h>	/* provides OpenSSL digest API */
 
@@ -57,6 +63,88 @@ static uint64_t numctlbadop;		/* bad op code found in packet */
 
 static int log_limit = 0;               /* Avoid DDoS to log file */ 
 
+/*
+ * Control requests are answered by a worker thread, so a long mrulist
+ * or ifstats response doesn't hold up the packets queued behind it.
+ *
+ * The worker only runs while holding state_mutex, which the main
+ * thread holds except while it waits in pselect(), so the rest of
+ * ntpd can go on assuming it is single threaded.  Whoever holds it
+ * also owns lib_getbuf().  The long responses hand the lock back
+ * between entries (ctl_yield()) whenever the main thread is waiting
+ * for it.  Without the worker (ntpdsim, ntpdreplay, or pthread_create()
+ * failing) requests are answered inline.  The busy-poll receive thread
+ * (ntp_io.c) takes the same lock for each packet it handles.
+ */
+#define CTL_QUEUE_LEN	32	/* requests waiting for the worker */
+
+struct ctl_request {
+	struct recvbuf	rb;
+	int		restrict_mask;
+	uint32_t	ifnum;		/* of rb.dstadr, to spot a reused one */
+	int		conn;		/* stream connection, -1 for UDP */
+};
+
+static struct {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;		/* request queued */
+	bool		running;	/* worker started */
+	int		head;		/* oldest, being answered */
+	int		count;
+	struct ctl_request req[CTL_QUEUE_LEN];
+} ctlq = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t state_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long state_gen;		/* main thread took state_mutex */
+static pthread_mutex_t wanted_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int state_wanted;		/* main thread waiting for it */
+static bool state_shared;		/* another thread may take it */
+
+static int ctl_queue_max;		/* deepest queue since reset */
+static uint64_t ctl_queue_dropped;	/* queue full or interface gone */
+static double ctl_busy;			/* seconds spent answering */
+static double ctl_slowest;		/* longest single request */
+
+/*
+ * The local stream socket ("controlsocket") takes the same requests
+ * from clients on this machine.  Each request and response is a
+ * 4-octet big-endian length and a mode 6 message; the response is one
+ * header and all of its data, with no fragments, padding or MAC.
+ * Whoever can open the socket file gets in, so requests on it count
+ * as authenticated and unrestricted.  A thread reads them and queues
+ * them for the worker, which hands the answers back to the thread to
+ * write as the client takes them, so a slow client holds up only its
+ * own connection.
+ */
+#define CTL_STREAM_CONNS	8	/* clients at once */
+#define CTL_STREAM_TIMEOUT	2	/* seconds a client has to read */
+
+struct ctl_conn {
+	int		fd;		/* -1 when free */
+	bool		busy;		/* request with the worker */
+	size_t		have;		/* octets of the request read */
+	uint8_t *	out;		/* response to write, or NULL */
+	size_t		outlen;
+	size_t		sent;		/* octets of it written */
+	time_t		deadline;	/* hang up if not written by then */
+	uint8_t		buf[4 + RX_BUFF_SIZE];
+};
+
+static struct {
+	int		listen_fd;
+	int		wake[2];	/* worker to thread: one is free */
+	struct ctl_conn	conn[CTL_STREAM_CONNS];
+} ctls = {
+	.listen_fd = -1,
+	.wake = { -1, -1 },
+};
+
+static uint64_t ctl_stream_reqs;	/* requests on the stream socket */
+
 // Refactored C?_VARLIST innards
 ssize_t CI_VARLIST(char*, char*, const struct ctl_var*, bool*);
 bool CF_VARLIST(const struct ctl_var*, const struct ctl_var*, const struct ctl_var*);
@@ -85,6 +173,17 @@ struct ctl_proc {
 static  void    unmarshall_ntp_control(struct ntp_control *, struct recvbuf *);
 static  uint16_t extract_16bits_from_stream(uint8_t *);
 static	void	ctl_error	(uint8_t);
+static	void *	ctl_worker	(void *);
+static	bool	ctl_enqueue	(const struct recvbuf *, int, uint32_t, int);
+static	void *	ctl_stream	(void *);
+static	void	ctl_stream_read	(int);
+static	void	ctl_stream_write (int);
+static	void	ctl_stream_close (int);
+static	void	ctl_stream_put	(const void *, size_t);
+static	void	ctl_stream_frame (uint8_t);
+static	void	ctl_stream_reply (int);
+static	bool	ctl_endpt_live	(const endpt *, uint32_t);
+static	bool	ctl_yield	(void);
 #ifdef REFCLOCK
 static	unsigned short ctlclkstatus	(struct refclockstat *);
 #endif
@@ -129,15 +228,21 @@ static	void	send_mru_entry	(mon_entry *, int);
 #ifdef USE_RANDOMIZE_RESPONSES
 static	void	send_random_tag_value(int);
 #endif /* USE_RANDOMIZE_RESPONSES */
+static	mon_entry *mru_next	(mon_entry *, struct monshm_row *, size_t);
+static	mon_entry *mru_snapshot_find(struct monshm_row *, size_t,
+				     const sockaddr_u *, l_fp);
 static	void	read_mru_list	(struct recvbuf *, int);
 static	void	send_ifstats_entry(endpt *, unsigned int);
 static	void	read_ifstats	(struct recvbuf *);
 static	void	sockaddrs_from_restrict_u(sockaddr_u *,	sockaddr_u *,
 					  restrict_u *, int);
 static	void	send_restrict_entry(restrict_u *, int, unsigned int);
-static	void	send_restrict_list(restrict_u *, int, unsigned int *);
+static	bool	send_restrict_list(restrict_u **, int, unsigned int *);
 static	void	read_addr_restrictions(struct recvbuf *);
+static	void	send_monpart_entry(struct mon_part *, unsigned int);
+static	void	read_mon_partitions(struct recvbuf *);
 static	void	read_ordlist	(struct recvbuf *, int);
+static	void	read_changes	(void);
 static	uint32_t	derive_nonce	(sockaddr_u *, uint32_t, uint32_t);
 static	void	generate_nonce	(struct recvbuf *, char *, size_t);
 static	int	validate_nonce	(const char *, struct recvbuf *);
@@ -168,7 +273,7 @@ enum var_type {v_time,
 enum var_type_special {
 	vs_peer, vs_peeradr, vs_peermode,
 	vs_systime,
-	vs_refid, vs_mruoldest, vs_varlist};
+	vs_refid, vs_mruoldest, vs_mrushared, vs_varlist};
 struct var {
   const char* name;
   const int flags;
@@ -312,7 +417,28 @@ static const struct var sys_var[] = {
   Var_u64("mru_recycleold", RO, mon_data.mru_recycleold),
   Var_u64("mru_recyclefull", RO, mon_data.mru_recyclefull),
   Var_u64("mru_none", RO, mon_data.mru_none),
+  Var_u64("mru_aged", RO, mon_data.mru_aged),
+  Var_u64("mru_evicted", RO, mon_data.mru_evicted),
+  Var_u64("mru_free", RO, mon_data.mru_free),
+  Var_u64("mru_checked", RO, mon_data.mru_checked),
+  Var_u64("mru_checkpasses", RO, mon_data.mru_checkpasses),
+  Var_u64("mru_checkerrors", RO, mon_data.mru_checkerrors),
+  Var_u64("mru_tickwork", RO, mon_data.mru_tickwork),
+  Var_u64("mru_tickworkmax", RO, mon_data.mru_tickworkmax),
   Var_special("mru_oldest_age", RO, vs_mruoldest),
+  Var_u64("mru_coldslots", RO, mon_data.mru_coldslots),
+  Var_u64("mru_colddepth", RO, mon_data.mru_colddepth),
+  Var_u64("mru_coldmem", RO, mon_data.mru_coldmem),
+  Var_u64("mru_demoted", RO, mon_data.mru_demoted),
+  Var_u64("mru_promoted", RO, mon_data.mru_promoted),
+  Var_u64("mru_coldlost", RO, mon_data.mru_coldlost),
+  Var_u64("mru_shared", RO, monshm_stats.slots),
+  Var_special("mru_shared_used", RO, vs_mrushared),
+  Var_u64("mru_shared_hits", RO, monshm_stats.hits),
+  Var_u64("mru_shared_new", RO, monshm_stats.new),
+  Var_u64("mru_shared_recycled", RO, monshm_stats.recycled),
+  Var_u64("mru_shared_none", RO, monshm_stats.none),
+  Var_u64("mru_shared_recovered", RO, monshm_stats.recovered),
 
 #define Var_Pair(name, location) \
   Var_u64P(name, RO, stat_##location), \
@@ -334,12 +460,22 @@ static const struct var sys_var[] = {
   Var_Pair("ss_restricted", restricted),
   Var_Pair("ss_limited", limitrejected),
   Var_Pair("ss_kodsent", kodsent),
+  Var_Pair("ss_kodsuppressed", kodsuppressed),
+  Var_Pair("ss_pooltaken", pooltaken),
+  Var_Pair("ss_poolskipped", poolskipped),
+  Var_Pair("ss_pooldropped", pooldropped),
   Var_Pair("ss_processed", processed),
 #undef Var_Pair
 
 /* We own this one.  See above.  No proc mode.
  * Note that lots of others are not (yet?) in this table.  */
   Var_u64("ss_numctlreq", RO, numctlreq),
+  Var_int("ctl_queue", RO, ctlq.count),
+  Var_int("ctl_queue_max", RO, ctl_queue_max),
+  Var_u64("ctl_queue_dropped", RO, ctl_queue_dropped),
+  Var_dbl("ctl_busy", RO|ToMS, ctl_busy),
+  Var_dbl("ctl_slowest", RO|ToMS, ctl_slowest),
+  Var_u64("ctl_stream", RO, ctl_stream_reqs),
 
   Var_special("peeradr", RO, vs_peeradr),
   Var_special("peermode", RO, vs_peermode),
@@ -347,6 +483,15 @@ static const struct var sys_var[] = {
 /* authinfo: Shared Key Authentication */
   Var_since("authreset", RO, auth_timereset),
   Var_l_fp_ms("authdelay", RO, sys_authdelay),
+
+/* TSC time source, libntp/tsctime.c */
+  Var_strP("tsc", RO, tsc_state),
+  Var_dbl("tsc_hz", RO, tsc_stats.hz),
+  Var_dbl("tsc_err", RO|ToMS|DBL6, tsc_stats.err),
+  Var_dbl("tsc_maxerr", RO|ToMS|DBL6, tsc_stats.maxerr),
+  Var_dbl("tsc_cost", RO|ToMS|DBL6, tsc_stats.cost),
+  Var_dbl("tsc_oscost", RO|ToMS|DBL6, tsc_stats.oscost),
+  Var_u64("tsc_fallbacks", RO, tsc_stats.fallbacks),
   Var_uint("authkeys", RO, authnumkeys),
   Var_uint("authfreek", RO, authnumfreekeys),
   Var_uli("authklookups", RO, authkeylookups),
@@ -397,9 +542,29 @@ static const struct var sys_var[] = {
   Var_uliP("free_rbuf", RO, free_recvbuffs),
   Var_uliP("used_rbuf", RO, lowater_additions),
 
+/* memstats: live heap by owner, libntp/emalloc.c */
+#define Var_Mem(name, tag) \
+  Var_uli("mem_" name, RO, mem_use[tag].bytes), \
+  Var_uli("mem_" name "_n", RO, mem_use[tag].objects)
+  Var_Mem("mru", MEM_MRU),
+  Var_Mem("recvbuf", MEM_RECVBUF),
+  Var_Mem("peer", MEM_PEER),
+  Var_Mem("restrict", MEM_RESTRICT),
+  Var_Mem("key", MEM_KEY),
+  Var_Mem("tls", MEM_TLS),
+  Var_Mem("config", MEM_CONFIG),
+  Var_Mem("stats", MEM_STATS),
+#undef Var_Mem
+
   Var_since("timerstats_reset", RO, timer_timereset),
   Var_uli("timer_overruns", RO, alarm_overflow),
   Var_uli("timer_xmts", RO, timer_xmtcalls),
+  Var_uli("timer_burst", RO, timer_burst),
+  Var_uli("timer_burstmax", RO, timer_burstmax),
+  Var_uli("timer_paced", RO, timer_paced),
+  Var_uli("timer_late", RO, timer_late),
+  Var_dbl("timer_spacing", RO|ToMS, timer_spacing),
+  Var_dbl("timer_spacingmin", RO|ToMS, timer_spacingmin),
 
   Var_uli("clk_wander_threshold", RO|ToPPM, timer_xmtcalls),
 
@@ -426,6 +591,7 @@ static const struct var sys_var[] = {
   Var_Pair("nts_server_recv_good", nts_cnt.server_recv_good),
   Var_Pair("nts_server_recv_bad", nts_cnt.server_recv_bad),
   Var_Pair("nts_cookie_make", nts_cnt.cookie_make),
+  Var_Pair("nts_cookie_make_short", nts_cnt.cookie_make_short),
   Var_Pair("nts_cookie_not_server", nts_cnt.cookie_not_server),
   Var_Pair("nts_cookie_decode_total", nts_cnt.cookie_decode_total),
   Var_Pair("nts_cookie_decode_current", nts_cnt.cookie_decode_current),
@@ -448,6 +614,11 @@ static const struct var sys_var[] = {
   Var_PairF("nts_ke_serves_bad_cpu", ntske_cnt.serves_bad_cpu),
   Var_Pair("nts_ke_probes_good", ntske_cnt.probes_good),
   Var_Pair("nts_ke_probes_bad", ntske_cnt.probes_bad),
+  Var_Pair("nts_ke_admitted", ntske_cnt.admitted),
+  Var_Pair("nts_ke_queued", ntske_cnt.queued),
+  Var_Pair("nts_ke_rejected_source", ntske_cnt.rejected_source),
+  Var_Pair("nts_ke_rejected_prefix", ntske_cnt.rejected_prefix),
+  Var_Pair("nts_ke_rejected_busy", ntske_cnt.rejected_busy),
 #undef Var_Pair
 #undef Var_PairF
 #endif
@@ -593,6 +764,14 @@ static const struct ctl_var peer_var2[] = {
 	/* new in NTPsec */
 #define	CP_NTSCOOKIES		49
 	{ CP_NTSCOOKIES, RO|DEF, "ntscookies" },
+#define	CP_NTSUSED		50
+	{ CP_NTSUSED,	RO, "ntsused" },
+#define	CP_NTSREFRESHED		51
+	{ CP_NTSREFRESHED, RO, "ntsrefreshed" },
+#define	CP_NTSSTARVED		52
+	{ CP_NTSSTARVED, RO, "ntsstarved" },
+#define	CP_NTSREKEYS		53
+	{ CP_NTSREKEYS,	RO, "ntsrekeys" },
 #define	CP_MAXCODE		((sizeof(peer_var2)/sizeof(peer_var2[0])) - 1)
 	{ 0,		EOV, "" }
 };
@@ -673,6 +852,12 @@ static bool	datasent;	/* flag to avoid initial ", " */
 static bool	datanotbinflag;
 static sockaddr_u *rmt_addr;
 static endpt *lcl_inter;
+static uint32_t lcl_ifnum;
+static bool	res_lost;	/* interface went away mid-response */
+static int	res_stream = -1; /* stream connection, or -1 */
+static uint8_t *res_buf;	/* response frame for it */
+static size_t	res_len;
+static size_t	res_size;
 
 static auth_info* res_auth;  /* !NULL => authenticate */
 
@@ -756,7 +941,10 @@ ctl_error(
 	/*
 	 * send packet and bump counters
 	 */
-	if (NULL != res_auth) {
+	if (res_stream >= 0) {
+		res_len = 0;	/* drop any data put so far */
+		ctl_stream_frame(rpkt.r_m_e_op);
+	} else if (NULL != res_auth) {
 		maclen = authencrypt(res_auth, (uint32_t *)&rpkt,
 				     CTL_HEADER_LEN);
 		sendpkt(rmt_addr, lcl_inter, &rpkt,
@@ -791,6 +979,9 @@ process_control(
 	numctlreq++;
 	rmt_addr = &rbufp->recv_srcadr;
 	lcl_inter = rbufp->dstadr;
+	if (NULL != lcl_inter)
+		lcl_ifnum = lcl_inter->ifnum;
+	res_lost = false;
 	unmarshall_ntp_control(&pkt_core, rbufp);
 	pkt = &pkt_core;
 
@@ -917,7 +1108,7 @@ process_control(
 				ctl_error(CERR_BADOP);  // Not Implemented
 				return;
 			}
-			if (cc->flags == AUTH
+			if (cc->flags == AUTH && res_stream < 0
 			    && (NULL == res_auth
 				|| res_auth->keyid != ctl_auth_keyid)) {
 				ctl_error(CERR_PERMISSION);
@@ -937,6 +1128,594 @@ process_control(
 }
 
 
+/*
+ * ctl_queue_request - hand a control request to the worker
+ */
+void
+ctl_queue_request(
+	struct recvbuf *rbufp,
+	int restrict_mask
+	)
+{
+	if (!ctlq.running || NULL == rbufp->dstadr) {
+		process_control(rbufp, restrict_mask);
+		return;
+	}
+	if (!ctl_enqueue(rbufp, restrict_mask, rbufp->dstadr->ifnum, -1))
+		ctl_queue_dropped++;
+}
+
+
+/*
+ * ctl_enqueue - add a request to the worker's queue, false if full
+ */
+static bool
+ctl_enqueue(
+	const struct recvbuf *rbufp,
+	int		restrict_mask,
+	uint32_t	ifnum,
+	int		conn
+	)
+{
+	struct ctl_request *req;
+
+	pthread_mutex_lock(&ctlq.mutex);
+	if (CTL_QUEUE_LEN == ctlq.count) {
+		pthread_mutex_unlock(&ctlq.mutex);
+		return false;
+	}
+	req = &ctlq.req[(ctlq.head + ctlq.count) % CTL_QUEUE_LEN];
+	req->rb = *rbufp;
+	req->restrict_mask = restrict_mask;
+	req->ifnum = ifnum;
+	req->conn = conn;
+	if (conn >= 0)
+		ctls.conn[conn].busy = true;
+	ctlq.count++;
+	if (ctlq.count > ctl_queue_max)
+		ctl_queue_max = ctlq.count;
+	pthread_cond_signal(&ctlq.cond);
+	pthread_mutex_unlock(&ctlq.mutex);
+	return true;
+}
+
+
+/*
+ * ctl_start_worker - start the control worker.  The caller comes
+ * away holding the state lock.
+ */
+void
+ctl_start_worker(void)
+{
+	pthread_t worker;
+	sigset_t block_mask, saved_sig_mask;
+	int rc;
+
+	sigfillset(&block_mask);
+	pthread_sigmask(SIG_BLOCK, &block_mask, &saved_sig_mask);
+	rc = pthread_create(&worker, NULL, ctl_worker, NULL);
+	pthread_sigmask(SIG_SETMASK, &saved_sig_mask, NULL);
+	if (rc) {
+		msyslog(LOG_ERR, "MODE6: ctl_start_worker: error from "
+			"pthread_create: %s, answering inline", strerror(rc));
+		return;
+	}
+	ctlq.running = true;
+	ctl_state_share();
+
+	if (-1 == ctls.listen_fd)
+		return;
+	pthread_sigmask(SIG_BLOCK, &block_mask, &saved_sig_mask);
+	rc = pthread_create(&worker, NULL, ctl_stream, NULL);
+	pthread_sigmask(SIG_SETMASK, &saved_sig_mask, NULL);
+	if (rc)
+		msyslog(LOG_ERR, "MODE6: ctl_start_worker: error from "
+			"pthread_create: %s, controlsocket unused",
+			strerror(rc));
+}
+
+
+/*
+ * ctl_state_share - from now on the main thread holds the state lock
+ * only while it is awake.  It comes away holding it.
+ */
+void
+ctl_state_share(void)
+{
+	if (state_shared)
+		return;
+	pthread_mutex_lock(&state_mutex);
+	state_shared = true;
+}
+
+
+/*
+ * ctl_state_lock, ctl_state_unlock - the main thread takes the state
+ * lock when it wakes up and drops it before waiting for input; the
+ * busy-poll thread takes it around each packet, through
+ * ctl_state_poll_lock().
+ */
+void
+ctl_state_lock(void)
+{
+	if (!state_shared)
+		return;
+	pthread_mutex_lock(&wanted_mutex);
+	state_wanted++;
+	pthread_mutex_unlock(&wanted_mutex);
+	pthread_mutex_lock(&state_mutex);
+	state_gen++;
+	getbuf_init();
+	pthread_mutex_lock(&wanted_mutex);
+	state_wanted--;
+	pthread_mutex_unlock(&wanted_mutex);
+}
+
+void
+ctl_state_unlock(void)
+{
+	if (!state_shared)
+		return;
+	/* the worker and the busy-poll thread may both be waiting */
+	pthread_cond_broadcast(&state_cond);
+	pthread_mutex_unlock(&state_mutex);
+}
+
+
+/*
+ * ctl_state_poll_lock - ctl_state_lock() for the busy-poll thread.
+ * It would otherwise take the lock straight back after each packet,
+ * ahead of a main thread waiting to run timer() and its select loop,
+ * so like ctl_yield() it lets the main thread have it first.
+ */
+void
+ctl_state_poll_lock(void)
+{
+	unsigned long gen;
+	bool wanted;
+
+	if (!state_shared)
+		return;
+	ctl_state_lock();
+	for (;;) {
+		/* ours is off again, so this is the main thread */
+		pthread_mutex_lock(&wanted_mutex);
+		wanted = state_wanted > 0;
+		pthread_mutex_unlock(&wanted_mutex);
+		if (!wanted)
+			break;
+		gen = state_gen;
+		while (gen == state_gen)
+			pthread_cond_wait(&state_cond, &state_mutex);
+	}
+	getbuf_init();
+}
+
+
+/*
+ * ctl_worker - answer queued requests in arrival order
+ */
+static void *
+ctl_worker(
+	void *arg
+	)
+{
+	struct ctl_request *req;
+	struct timespec start, finish;
+	double busy;
+
+	UNUSED_ARG(arg);
+#ifdef HAVE_SECCOMP_H
+	setup_SIGSYS_trap();	/* enable trap for this thread */
+#endif
+
+	for (;;) {
+		pthread_mutex_lock(&ctlq.mutex);
+		while (0 == ctlq.count)
+			pthread_cond_wait(&ctlq.cond, &ctlq.mutex);
+		req = &ctlq.req[ctlq.head];
+		pthread_mutex_unlock(&ctlq.mutex);
+
+		pthread_mutex_lock(&state_mutex);
+		getbuf_init();		/* lib_getbuf() is ours for now */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (req->conn >= 0) {
+			ctl_stream_reqs++;
+			get_systime(&req->rb.recv_time);	/* for nonces */
+			res_stream = req->conn;
+			res_len = 0;
+			process_control(&req->rb, req->restrict_mask);
+			res_stream = -1;
+		/* the interface may have been dropped while it waited */
+		} else if (ctl_endpt_live(req->rb.dstadr, req->ifnum))
+			process_control(&req->rb, req->restrict_mask);
+		else
+			ctl_queue_dropped++;
+		clock_gettime(CLOCK_MONOTONIC, &finish);
+		busy = tspec_to_d(sub_tspec(finish, start));
+		ctl_busy += busy;
+		if (busy > ctl_slowest)
+			ctl_slowest = busy;
+		pthread_mutex_unlock(&state_mutex);
+
+		/* the frame is ours alone, so pass it on without the lock */
+		if (req->conn >= 0)
+			ctl_stream_reply(req->conn);
+
+		pthread_mutex_lock(&ctlq.mutex);
+		ctlq.head = (ctlq.head + 1) % CTL_QUEUE_LEN;
+		ctlq.count--;
+		pthread_mutex_unlock(&ctlq.mutex);
+	}
+	return NULL;
+}
+
+
+/*
+ * ctl_endpt_live - is this interface still in the list?
+ */
+static bool
+ctl_endpt_live(
+	const endpt *	ep,
+	uint32_t	ifnum
+	)
+{
+	const endpt *	la;
+
+	for (la = io_data.ep_list; la != NULL; la = la->elink)
+		if (la == ep)
+			return la->ifnum == ifnum;
+	return false;
+}
+
+
+/*
+ * ctl_yield - let the main thread have the state lock if it is waiting
+ *
+ * Returns true if it did, in which case the caller must check anything
+ * it was walking.  If the interface the request came in on went away
+ * meanwhile, res_lost is set and the rest of the response is dropped.
+ */
+static bool
+ctl_yield(void)
+{
+	unsigned long gen;
+	bool wanted;
+
+	if (!ctlq.running)
+		return false;
+	pthread_mutex_lock(&wanted_mutex);
+	wanted = state_wanted > 0;
+	pthread_mutex_unlock(&wanted_mutex);
+	if (!wanted)
+		return false;
+
+	gen = state_gen;
+	while (gen == state_gen)
+		pthread_cond_wait(&state_cond, &state_mutex);
+	getbuf_init();
+	if (NULL != lcl_inter && !ctl_endpt_live(lcl_inter, lcl_ifnum)) {
+		lcl_inter = NULL;
+		res_lost = true;
+	}
+	return true;
+}
+
+
+/*
+ * ctl_stream_config - listen for clients on a local stream socket
+ */
+void
+ctl_stream_config(
+	const char *	path
+	)
+{
+	struct sockaddr_un addr;
+	struct stat	st;
+	int		fd;
+	int		i;
+
+	if (-1 != ctls.listen_fd) {
+		msyslog(LOG_ERR, "MODE6: controlsocket %s ignored, "
+			"already have one", path);
+		return;
+	}
+	ZERO(addr);
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		msyslog(LOG_ERR, "MODE6: controlsocket %s: name too long",
+			path);
+		return;
+	}
+	strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+	/* one left behind by an earlier ntpd, but nothing else */
+	if (0 == lstat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0
+	    || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+	    || chmod(path, 0660) < 0
+	    || listen(fd, CTL_STREAM_CONNS) < 0
+	    || pipe(ctls.wake) < 0) {
+		msyslog(LOG_ERR, "MODE6: controlsocket %s: %s",
+			path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+	for (i = 0; i < CTL_STREAM_CONNS; i++)
+		ctls.conn[i].fd = -1;
+	ctls.listen_fd = fd;
+	msyslog(LOG_INFO, "MODE6: listening on %s", path);
+}
+
+
+/*
+ * ctl_stream - accept clients on the stream socket, queue their
+ * requests and write back the responses.  A connection isn't read
+ * while the worker has its request or its response is being written.
+ */
+static void *
+ctl_stream(
+	void *arg
+	)
+{
+	struct pollfd	pfd[2 + CTL_STREAM_CONNS];
+	int		who[2 + CTL_STREAM_CONNS];
+	struct timespec	now;
+	char		junk[CTL_STREAM_CONNS];
+	nfds_t		n, k;
+	int		i, spare, timeout;
+
+	UNUSED_ARG(arg);
+#ifdef HAVE_SECCOMP_H
+	setup_SIGSYS_trap();	/* enable trap for this thread */
+#endif
+
+	for (;;) {
+		n = 0;
+		pfd[n].fd = ctls.wake[0];
+		pfd[n].events = POLLIN;
+		who[n++] = -1;
+		spare = -1;
+		timeout = -1;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		pthread_mutex_lock(&ctlq.mutex);
+		for (i = 0; i < CTL_STREAM_CONNS; i++) {
+			struct ctl_conn *c = &ctls.conn[i];
+
+			if (-1 == c->fd)
+				spare = i;
+			else if (c->busy)
+				continue;
+			else if (NULL == c->out) {
+				pfd[n].fd = c->fd;
+				pfd[n].events = POLLIN;
+				who[n++] = i;
+			} else if (now.tv_sec >= c->deadline) {
+				/* it stopped reading */
+				ctl_stream_close(i);
+				spare = i;
+			} else {
+				pfd[n].fd = c->fd;
+				pfd[n].events = POLLOUT;
+				who[n++] = i;
+				if (timeout < 0 || timeout >
+				    (c->deadline - now.tv_sec) * 1000)
+					timeout = (int)(c->deadline -
+						now.tv_sec) * 1000;
+			}
+		}
+		pthread_mutex_unlock(&ctlq.mutex);
+		if (spare >= 0) {
+			pfd[n].fd = ctls.listen_fd;
+			pfd[n].events = POLLIN;
+			who[n++] = CTL_STREAM_CONNS;
+		}
+
+		if (poll(pfd, n, timeout) < 0)
+			continue;
+		for (k = 0; k < n; k++) {
+			if (0 == pfd[k].revents)
+				continue;
+			if (-1 == who[k]) {
+				if (read(ctls.wake[0], junk, sizeof(junk)) < 0)
+					continue;
+			} else if (CTL_STREAM_CONNS == who[k]) {
+				i = accept(ctls.listen_fd, NULL, NULL);
+				if (i < 0)
+					continue;
+				ctls.conn[spare].fd = i;
+				ctls.conn[spare].have = 0;
+			} else if (NULL != ctls.conn[who[k]].out)
+				ctl_stream_write(who[k]);
+			else
+				ctl_stream_read(who[k]);
+		}
+	}
+	return NULL;
+}
+
+
+/*
+ * ctl_stream_read - read more of a request and queue it when complete
+ */
+static void
+ctl_stream_read(
+	int	i
+	)
+{
+	struct ctl_conn *c = &ctls.conn[i];
+	struct recvbuf	rb;
+	uint32_t	len;
+	size_t		want;
+	ssize_t		got;
+
+	want = 4;
+	if (c->have >= 4) {
+		memcpy(&len, c->buf, sizeof(len));
+		want += ntohl(len);
+	}
+	got = read(c->fd, c->buf + c->have, want - c->have);
+	if (got <= 0) {
+		ctl_stream_close(i);
+		return;
+	}
+	c->have += (size_t)got;
+	if (c->have < 4)
+		return;
+	memcpy(&len, c->buf, sizeof(len));
+	len = ntohl(len);
+	if (len < CTL_HEADER_LEN || len > sizeof(rb.recv_buffer)) {
+		ctl_stream_close(i);
+		return;
+	}
+	if (c->have < 4 + len)
+		return;
+
+	/* as if from 127.0.0.1, for nonces and the log */
+	ZERO(rb);
+	memcpy(rb.recv_buffer, c->buf + 4, len);
+	rb.recv_length = len;
+	SET_AF(&rb.recv_srcadr, AF_INET);
+	SET_ADDR4N(&rb.recv_srcadr, htonl(INADDR_LOOPBACK));
+	c->have = 0;
+	if (!ctl_enqueue(&rb, 0, 0, i)) {
+		ctl_queue_dropped++;
+		ctl_stream_close(i);
+	}
+}
+
+
+/*
+ * ctl_stream_write - write as much of the response as the client will
+ * take without waiting, and read again once it has all of it
+ */
+static void
+ctl_stream_write(
+	int	i
+	)
+{
+	struct ctl_conn *c = &ctls.conn[i];
+	ssize_t		sent;
+
+	sent = send(c->fd, c->out + c->sent, c->outlen - c->sent,
+		    MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (sent < 0 && (EINTR == errno || EAGAIN == errno ||
+			 EWOULDBLOCK == errno))
+		return;
+	if (sent <= 0) {
+		ctl_stream_close(i);
+		return;
+	}
+	c->sent += (size_t)sent;
+	if (c->sent < c->outlen)
+		return;
+	free(c->out);
+	c->out = NULL;
+}
+
+
+/*
+ * ctl_stream_close - hang up on a client
+ */
+static void
+ctl_stream_close(
+	int	i
+	)
+{
+	close(ctls.conn[i].fd);
+	ctls.conn[i].fd = -1;
+	ctls.conn[i].have = 0;
+	free(ctls.conn[i].out);
+	ctls.conn[i].out = NULL;
+}
+
+
+/*
+ * ctl_stream_put - add response data to the frame, after room for the
+ * length and header
+ */
+static void
+ctl_stream_put(
+	const void *	dp,
+	size_t		dlen
+	)
+{
+	if (0 == res_len)
+		res_len = 4 + CTL_HEADER_LEN;
+	if (res_len + dlen > res_size) {
+		res_size = 2 * res_size;
+		if (res_len + dlen > res_size)
+			res_size = res_len + dlen + 1024;
+		res_buf = erealloc(res_buf, res_size);
+	}
+	if (dlen > 0)
+		memcpy(res_buf + res_len, dp, dlen);
+	res_len += dlen;
+}
+
+
+/*
+ * ctl_stream_frame - finish the frame with its length and header.  The
+ * count only fits 16 bits, so clients go by the length.
+ */
+static void
+ctl_stream_frame(
+	uint8_t	r_m_e_op
+	)
+{
+	size_t		dlen;
+	uint32_t	len;
+
+	ctl_stream_put(NULL, 0);
+	dlen = res_len - 4 - CTL_HEADER_LEN;
+	rpkt.r_m_e_op = r_m_e_op;
+	rpkt.offset = 0;
+	rpkt.count = htons((unsigned short)(dlen < 0xffff ? dlen : 0xffff));
+	len = htonl((uint32_t)(res_len - 4));
+	memcpy(res_buf, &len, sizeof(len));
+	memcpy(res_buf + 4, &rpkt, CTL_HEADER_LEN);
+}
+
+
+/*
+ * ctl_stream_reply - hand the response frame and the connection back
+ * to the stream thread, which writes it.  A client that hasn't taken
+ * all of it within CTL_STREAM_TIMEOUT is hung up on, as is one that
+ * gets no response (a request dropped as malformed).
+ */
+static void
+ctl_stream_reply(
+	int	i
+	)
+{
+	struct ctl_conn *c = &ctls.conn[i];
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&ctlq.mutex);
+	if (0 == res_len)
+		shutdown(c->fd, SHUT_RDWR);	/* the thread closes it */
+	else {
+		/* the next response gets a buffer of its own */
+		c->out = res_buf;
+		c->outlen = res_len;
+		c->sent = 0;
+		c->deadline = now.tv_sec + CTL_STREAM_TIMEOUT;
+		res_buf = NULL;
+		res_size = 0;
+	}
+	res_len = 0;
+	c->busy = false;
+	pthread_mutex_unlock(&ctlq.mutex);
+	if (write(ctls.wake[1], "", 1) < 0)
+		msyslog(LOG_ERR, "MODE6: ctl_stream_reply: %s",
+			strerror(errno));
+}
+
+
 /*
  * ctlpeerstatus - return a status word for this peer
  */
@@ -1021,6 +1800,13 @@ ctl_flushpkt(
 		*datapt++ = '\n';
 		dlen += 2;
 	}
+	if (res_stream >= 0) {
+		ctl_stream_put(rpkt.data, (size_t)dlen);
+		if (!more)
+			ctl_stream_frame(CTL_RESPONSE |
+					 (res_opcode & CTL_OP_MASK));
+		goto next;
+	}
 	sendlen = dlen + (int)CTL_HEADER_LEN;
 
 	/*
@@ -1065,6 +1851,7 @@ ctl_flushpkt(
 	} else {
 		sendpkt(rmt_addr, lcl_inter, &rpkt, sendlen);
 	}
+  next:
 	if (more) {
 		numctlfrags++;
 	} else {
@@ -1559,6 +2346,9 @@ ctl_putspecial(const struct var * v) {
         get_systime(&now);
         ctl_putuint(v->name, mon_get_oldest_age(now));
         break;
+    case vs_mrushared:
+        ctl_putuint(v->name, monshm_used());
+        break;
     case vs_varlist:
         for (cv = ext_sys_var; !(EOV & cv->flags); cv++) {
             ctl_putdata(cv->text, strlen(cv->text), false);
@@ -1766,6 +2556,14 @@ ctl_putpeer(
 
 	CASE_INT(CP_NTSCOOKIES, p->nts_state.count);
 
+	CASE_UINT(CP_NTSUSED, p->nts_state.used);
+
+	CASE_UINT(CP_NTSREFRESHED, p->nts_state.refreshed);
+
+	CASE_UINT(CP_NTSSTARVED, p->nts_state.starved);
+
+	CASE_UINT(CP_NTSREKEYS, p->nts_state.rekeys);
+
 	default:
 		break;
 	}
@@ -2268,6 +3066,10 @@ read_status(
 		ctl_flushpkt(0);
 		return;
 	}
+	if (reqpt < reqend) {
+		read_changes();
+		return;
+	}
 	n = 0;
 	rpkt.status = htons(ctlsysstatus());
 	for (peer = peer_list; peer != NULL; peer = peer->p_link) {
@@ -2286,6 +3088,65 @@ read_status(
 }
 
 
+/*
+ * read_changes - a readstat of association 0 with "since=G" lists
+ * only the associations that changed after generation G, as text:
+ *
+ *	gen=N, sysgen=S, full=0|1, id.0=associd, st.0=status, ...
+ *
+ * N is the G to send next time and S the generation of the latest
+ * change to the system variables.  full=1 means every association is
+ * listed, because one went away (or ntpd restarted) since G, and the
+ * client should forget any it has that aren't.  A restart is caught
+ * by the random epoch each boot's generations start from.
+ */
+static void
+read_changes(void)
+{
+	static const struct ctl_var since_var[] = {
+		{ 0,		PADDING, "" },
+		{ 1,		RO, "since" },
+		{ 0,		EOV, "" }
+	};
+	const struct ctl_var *v;
+	struct peer *peer;
+	char *	val;
+	char	tag[32];
+	uint64_t since = 0;
+	unsigned int i;
+	bool	full;
+
+	while (NULL != (v = ctl_getitem2(since_var, &val))) {
+		if (v->flags & EOV) {
+			ctl_error(CERR_UNKNOWNVAR);
+			return;
+		}
+		if (NULL == val || 1 != sscanf(val, "%" SCNu64, &since)) {
+			ctl_error(CERR_BADVALUE);
+			return;
+		}
+	}
+	/* since from another boot falls outside this one's epoch */
+	full = since <= gen_epoch || since < peers_gone_gen ||
+	    since > change_gen;
+	rpkt.status = htons(ctlsysstatus());
+	ctl_putuint("gen", change_gen);
+	ctl_putuint("sysgen", sys_gen);
+	ctl_putint("full", full);
+	i = 0;
+	for (peer = peer_list; peer != NULL; peer = peer->p_link) {
+		if (!full && peer->gen <= since)
+			continue;
+		snprintf(tag, sizeof(tag), "id.%u", i);
+		ctl_putuint(tag, peer->associd);
+		snprintf(tag, sizeof(tag), "st.%u", i);
+		ctl_puthex(tag, ctlpeerstatus(peer));
+		i++;
+	}
+	ctl_flushpkt(0);
+}
+
+
 /*
  * read_peervars - half of read_variables() implementation
  */
@@ -2775,6 +3636,57 @@ send_mru_entry(
 }
 
 
+/*
+ * mru_next - the next newer entry after mon, from the MRU list or,
+ *	      given one, a snapshot of the shared table
+ */
+static mon_entry *
+mru_next(
+	mon_entry *		mon,
+	struct monshm_row *	snapshot,
+	size_t			rows
+	)
+{
+	struct monshm_row *row;
+
+	if (NULL == snapshot)
+		return PREV_DLIST(mon_data.mon_mru_list, mon, mru);
+	/* mon is the first member of its row */
+	row = (struct monshm_row *)mon + 1;
+	return (row < snapshot + rows) ? &row->mon : NULL;
+}
+
+
+/*
+ * mru_snapshot_find - the snapshot row for addr last seen at last,
+ *		       if there is one.  Rows are in order of last.
+ */
+static mon_entry *
+mru_snapshot_find(
+	struct monshm_row *	snapshot,
+	size_t			rows,
+	const sockaddr_u *	addr,
+	l_fp			last
+	)
+{
+	size_t	lo = 0;
+	size_t	hi = rows;
+	size_t	mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (snapshot[mid].mon.last < last)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < rows && snapshot[lo].mon.last == last; lo++)
+		if (SOCK_EQ(&snapshot[lo].mon.rmtadr, addr))
+			return &snapshot[lo].mon;
+	return NULL;
+}
+
+
 /*
  * read_mru_list - supports ntpq's mrulist command.
  *
@@ -2830,6 +3742,10 @@ send_mru_entry(
  *	laddr=		Return entries associated with the server's IP
  *			address given.  No port specification is needed,
  *			and any supplied is ignored.
+ *	shared=		Read the table shared with other ntpd processes
+ *			("mrushare") instead of this one's MRU list.
+ *			Each request reads its own copy of the table,
+ *			so concurrent fetches don't disturb each other.
  *      recent=		Set the reporting start point to retrieve roughly
  *			a specified number of most recent entries
  *			'Roughly' because the logic cannot anticipate
@@ -2918,6 +3834,7 @@ static void read_mru_list(
 	static const char	minlstint_text[] =	"minlstint";
 	static const char	laddr_text[] =		"laddr";
 	static const char	recent_text[] =		"recent";
+	static const char	shared_text[] =		"shared";
 	static const char	resaxx_fmt[] =		"0x%hx";
 
 	unsigned int		limit;
@@ -2931,6 +3848,10 @@ static void read_mru_list(
 	unsigned int		minlstint;
 	sockaddr_u		laddr;
 	unsigned int		recent;
+	bool			shared;
+	struct monshm_row	row;
+	struct monshm_row *	snapshot;	/* for shared= */
+	size_t			snapshot_rows;
 	endpt *                 lcladr;
 	unsigned int		count;
 	static unsigned int	countdown;
@@ -2950,6 +3871,7 @@ static void read_mru_list(
 	mon_entry *		mon;
 	mon_entry *		prior_mon;
 	l_fp			now;
+	l_fp			seen;
 
 	if (RES_NOMRULIST & restrict_mask) {
 		ctl_error(CERR_PERMISSION);
@@ -2977,6 +3899,7 @@ static void read_mru_list(
 	set_var(&in_parms, minlstint_text, sizeof(minlstint_text), 0);
 	set_var(&in_parms, laddr_text, sizeof(laddr_text), 0);
 	set_var(&in_parms, recent_text, sizeof(recent_text), 0);
+	set_var(&in_parms, shared_text, sizeof(shared_text), 0);
 	for (i = 0; i < COUNTOF(last); i++) {
 		snprintf(buf, sizeof(buf), last_fmt, (int)i);
 		set_var(&in_parms, buf, strlen(buf) + 1, 0);
@@ -2996,6 +3919,7 @@ static void read_mru_list(
 	maxlstint = 0;
 	minlstint = 0;
 	recent = 0;
+	shared = false;
 	lcladr = NULL;
 	priors = 0;
 	ZERO(last);
@@ -3052,6 +3976,8 @@ static void read_mru_list(
 		} else if (!strcmp(recent_text, v->text)) {
 			if (1 != sscanf(val, "%u", &recent))
 				goto blooper;
+		} else if (!strcmp(shared_text, v->text)) {
+			shared = true;
 		} else if (1 == sscanf(v->text, last_fmt, &si) &&
 			   (size_t)si < COUNTOF(last)) {
 			if (2 != sscanf(val, "0x%08x.%08x", &ui, &uf))
@@ -3108,10 +4034,20 @@ static void read_mru_list(
 	} else if (0 != limit && 0 == frags)
 		frags = MRU_FRAGS_LIMIT;
 
+	if (shared && !monshm_active()) {
+		/* no "mrushare" table to read */
+		ctl_error(CERR_BADOP);
+		return;
+	}
+
 	mon = NULL;
 	if (limit == 1) {
 		for (i = 0; i < COUNTOF(last); i++) {
-			mon = mon_get_slot(&addr[i]);
+			if (shared)
+				mon = monshm_get(&addr[i], &row)
+					  ? &row.mon : NULL;
+			else
+				mon = mon_get_slot(&addr[i]);
 			if (mon != NULL) {
 				send_mru_entry(mon, i);
 			}
@@ -3124,11 +4060,26 @@ static void read_mru_list(
 		return;
 	}
 
+	/*
+	 * The shared table is read from a copy, oldest first, taken
+	 * for this request alone.  Like the MRU list, it may have
+	 * moved on since the client's last request; the starting
+	 * point search below copes with that the same way.
+	 */
+	snapshot = NULL;
+	snapshot_rows = 0;
+	if (shared)
+		snapshot_rows = monshm_snapshot(&snapshot);
+
 	/*
 	 * Find the starting point if one was provided.
 	 */
 	for (i = 0; i < (size_t)priors; i++) {
-		mon = mon_get_slot(&addr[i]);
+		if (shared)
+			mon = mru_snapshot_find(snapshot, snapshot_rows,
+						&addr[i], last[i]);
+		else
+			mon = mon_get_slot(&addr[i]);
 		if (mon != NULL) {
 			if (mon->last == last[i])
 				break;
@@ -3141,6 +4092,7 @@ static void read_mru_list(
 		if (NULL == mon) {
 			/* tell ntpq to try again with older entries */
 			ctl_error(CERR_UNKNOWNVAR);
+			free(snapshot);
 			return;
 		}
 		/* confirm the prior entry used as starting point */
@@ -3154,7 +4106,11 @@ static void read_mru_list(
 		 * that case return the starting point entry.
 		 */
 		if (limit > 1)
-			mon = PREV_DLIST(mon_data.mon_mru_list, mon, mru);
+			mon = mru_next(mon, shared ? snapshot : NULL,
+				       snapshot_rows);
+	} else if (shared) {
+		mon = snapshot_rows ? &snapshot[0].mon : NULL;
+		countdown = snapshot_rows;
 	} else {	/* start with the oldest */
 		mon = TAIL_DLIST(mon_data.mon_mru_list, mru);
 		countdown = mon_data.mru_entries;
@@ -3169,8 +4125,17 @@ static void read_mru_list(
 	prior_mon = NULL;
 	for (count = 0;
 	     mon != NULL && res_frags < frags && count < limit;
-	     mon = PREV_DLIST(mon_data.mon_mru_list, mon, mru)) {
+	     mon = mru_next(mon, shared ? snapshot : NULL, snapshot_rows)) {
 
+		/*
+		 * Entries are never freed, only zeroed and reused, and
+		 * every touch moves last.  If this one has changed
+		 * while the main thread ran, stop here; ntpq picks up
+		 * from the entries it already has.
+		 */
+		seen = mon->last;
+		if (ctl_yield() && (mon->last != seen || res_lost))
+			break;
 		if (mon->count < mincount)
 			continue;
 		if (mon->dropped < mindrop)
@@ -3187,7 +4152,9 @@ static void read_mru_list(
 		if (minlstint > 0 && lfpuint(now) - lfpuint(mon->last) <
 		    minlstint)
 			continue;
-		if (lcladr != NULL && mon->lcladr != lcladr)
+		if (lcladr != NULL && (shared
+		    ? !SOCK_EQ(&((struct monshm_row *)mon)->laddr, &lcladr->sin)
+		    : mon->lcladr != lcladr))
 			continue;
 		if (recent != 0 && countdown-- > recent)
 			continue;
@@ -3216,6 +4183,7 @@ static void read_mru_list(
 			ctl_putts("last.newest", prior_mon->last);
 	}
 	ctl_flushpkt(0);
+	free(snapshot);
 }
 
 /*
@@ -3348,6 +4316,9 @@ read_ifstats(
 	 * ifnum in turn.
 	 */
 	for (ifidx = 0; ifidx < io_data.sys_ifnum; ifidx++) {
+		/* the list is searched afresh for each entry anyway */
+		if (ctl_yield() && res_lost)
+			return;
 		for (la = io_data.ep_list; la != NULL; la = la->elink)
 			if (ifidx == la->ifnum)
 				break;
@@ -3484,17 +4455,37 @@ send_restrict_entry(
 }
 
 
-static void
+/*
+ * send_restrict_list - send one list, finding its place again by
+ * count after handing the lock back.  False if the request is lost.
+ */
+static bool
 send_restrict_list(
-	restrict_u *	pres,
+	restrict_u **	phead,
 	int		ipv6,
-	unsigned int *		pidx
+	unsigned int *	pidx
 	)
 {
-	for ( ; pres != NULL; pres = pres->link) {
+	restrict_u *	pres;
+	unsigned int	pos;
+	unsigned int	n;
+
+	pres = *phead;
+	for (pos = 0; pres != NULL; pos++) {
+		if (ctl_yield()) {
+			if (NULL == lcl_inter)
+				return false;
+			pres = *phead;
+			for (n = 0; pres != NULL && n < pos; n++)
+				pres = pres->link;
+			if (NULL == pres)
+				break;
+		}
 		send_restrict_entry(pres, ipv6, *pidx);
 		(*pidx)++;
+		pres = pres->link;
 	}
+	return true;
 }
 
 
@@ -3511,14 +4502,159 @@ read_addr_restrictions(
 	UNUSED_ARG(rbufp);
 
 	idx = 0;
-	send_restrict_list(rstrct.restrictlist4, false, &idx);
-	send_restrict_list(rstrct.restrictlist6, true, &idx);
+	if (!send_restrict_list(&rstrct.restrictlist4, false, &idx))
+		return;
+	for (int i = 0; i < NTP_HASH_SIZE; i++)
+		if (!send_restrict_list(&rstrct.sourcehash4[i], false, &idx))
+			return;
+	if (!send_restrict_list(&rstrct.restrictlist6, true, &idx))
+		return;
+	for (int i = 0; i < NTP_HASH_SIZE; i++)
+		if (!send_restrict_list(&rstrct.sourcehash6[i], true, &idx))
+			return;
 	ctl_flushpkt(0);
 }
 
 
 /*
- * read_ordlist - CTL_OP_READ_ORDLIST_A for ntpq -c ifstats & reslist
+ * send_monpart_entry - one row of "ntpq -c monparts", in random order
+ *			like the ifstats and reslist rows
+ */
+static void
+send_monpart_entry(
+	struct mon_part *	p,
+	unsigned int		idx
+	)
+{
+	const char addr_fmtu[] =	"addr.%u";
+	const char average_fmt[] =	"average.%u";
+	const char burst_fmt[] =	"burst.%u";
+	const char kod_fmt[] =		"kod.%u";
+	const char depth_fmt[] =	"depth.%u";
+	const char maxdepth_fmt[] =	"maxdepth.%u";
+	const char new_fmt[] =		"new.%u";
+	const char recycled_fmt[] =	"recycled.%u";
+	const char none_fmt[] =		"none.%u";
+	const char limited_fmt[] =	"limited.%u";
+	char		tag[32];
+	uint8_t		sent[MONPARTS_FIELDS]; /* 10 tag=value pairs */
+	int		noisebits;
+	uint32_t	noise;
+	unsigned int	which = 0;
+	unsigned int	remaining;
+	const char *	pch;
+
+	remaining = COUNTOF(sent);
+	ZERO(sent);
+	noise = 0;
+	noisebits = 0;
+	while (remaining > 0) {
+		if (noisebits < 4) {
+			/* coverity[DC.WEAK_CRYPTO] */
+			noise = (uint32_t)random();
+			noisebits = 31;
+		}
+#ifdef USE_RANDOMIZE_RESPONSES
+		which = (noise & 0xf) % COUNTOF(sent);
+#endif /* USE_RANDOMIZE_RESPONSES */
+		noise >>= 4;
+		noisebits -= 4;
+
+		while (sent[which])
+			which = (which + 1) % COUNTOF(sent);
+
+		switch (which) {
+
+		case 0:
+			snprintf(tag, sizeof(tag), addr_fmtu, idx);
+			pch = (AF_UNSPEC == AF(&p->addr))
+				  ? "*" : socktoa(&p->addr);
+			ctl_putunqstr(tag, pch, strlen(pch));
+			break;
+
+		case 1:
+			snprintf(tag, sizeof(tag), average_fmt, idx);
+			ctl_putdblf(tag, false, 6, p->rate_limit);
+			break;
+
+		case 2:
+			snprintf(tag, sizeof(tag), burst_fmt, idx);
+			ctl_putdblf(tag, false, 6, p->decay_time);
+			break;
+
+		case 3:
+			snprintf(tag, sizeof(tag), kod_fmt, idx);
+			ctl_putdblf(tag, false, 6, p->kod_limit);
+			break;
+
+		case 4:
+			snprintf(tag, sizeof(tag), depth_fmt, idx);
+			ctl_putuint(tag, p->entries);
+			break;
+
+		case 5:
+			snprintf(tag, sizeof(tag), maxdepth_fmt, idx);
+			ctl_putuint(tag, p->maxdepth);
+			break;
+
+		case 6:
+			snprintf(tag, sizeof(tag), new_fmt, idx);
+			ctl_putuint(tag, p->new);
+			break;
+
+		case 7:
+			snprintf(tag, sizeof(tag), recycled_fmt, idx);
+			ctl_putuint(tag, p->recycled);
+			break;
+
+		case 8:
+			snprintf(tag, sizeof(tag), none_fmt, idx);
+			ctl_putuint(tag, p->none);
+			break;
+
+		case 9:
+			snprintf(tag, sizeof(tag), limited_fmt, idx);
+			ctl_putuint(tag, p->limited);
+			break;
+
+		default:
+			/* Get here if MONPARTS_FIELDS is too big. */
+			break;
+		}
+		sent[which] = true;
+		remaining--;
+	}
+#ifdef USE_RANDOMIZE_RESPONSES
+	send_random_tag_value((int)idx);
+#endif /* USE_RANDOMIZE_RESPONSES */
+}
+
+
+/*
+ * read_mon_partitions - the MRU partitions from "limit interface",
+ *			 everything else first
+ */
+static void
+read_mon_partitions(
+	struct recvbuf *	rbufp
+	)
+{
+	struct mon_part *	p;
+	unsigned int		idx;
+
+	UNUSED_ARG(rbufp);
+
+	send_monpart_entry(&mon_data.mon_rest, 0);
+	idx = 1;
+	for (p = mon_data.mon_parts; p != NULL; p = p->link)
+		send_monpart_entry(p, idx++);
+	ctl_flushpkt(0);
+}
+
+
+/*
+ * read_ordlist - CTL_OP_READ_ORDLIST_A for ntpq -c ifstats, reslist
+ *		  and monparts
  */
 static void
 read_ordlist(
@@ -3530,6 +4666,8 @@ read_ordlist(
 	const size_t ifstatint8_ts = COUNTOF(ifstats_s) - 1;
 	const char addr_rst_s[] = "addr_restrictions";
 	const size_t a_r_chars = COUNTOF(addr_rst_s) - 1;
+	const char mon_parts_s[] = "mon_partitions";
+	const size_t m_p_chars = COUNTOF(mon_parts_s) - 1;
 	struct ntp_control *	cpkt;
 	struct ntp_control pkt_core;
 	unsigned short		qdata_octets;
@@ -3545,8 +4683,9 @@ read_ordlist(
 	 * contains "ifstats" (not null terminated) to retrieve local
 	 * addresses and associated stats.  It is "addr_restrictions"
 	 * to retrieve the IPv4 then IPv6 remote address restrictions,
-	 * which are access control lists.  Other request data return
-	 * CERR_UNKNOWNVAR.
+	 * which are access control lists.  "mon_partitions" retrieves
+	 * the MRU partitions and their rate limits.  Other request data
+	 * return CERR_UNKNOWNVAR.
 	 */
 	unmarshall_ntp_control(&pkt_core, rbufp);
 	cpkt = &pkt_core;
@@ -3561,6 +4700,11 @@ read_ordlist(
 		read_addr_restrictions(rbufp);
 		return;
 	}
+	if (m_p_chars == qdata_octets &&
+	    !memcmp(mon_parts_s, cpkt->data, m_p_chars)) {
+		read_mon_partitions(rbufp);
+		return;
+	}
 	ctl_error(CERR_UNKNOWNVAR);
 }
 
@@ -3718,6 +4862,11 @@ report_event(
 	char	statstr[NTP_MAXSTRLEN];
 	size_t	len;
 
+	if (peer == NULL)
+		sys_changed();
+	else
+		peer_changed(peer);
+
 	/*
 	 * Report the error to the protostats file and system log
 	 */
@@ -3834,6 +4983,13 @@ ctl_clr_stats(void)
 	numctlbadversion = 0;
 	numctldatatooshort = 0;
 	numctlbadop = 0;
+	pthread_mutex_lock(&ctlq.mutex);
+	ctl_queue_max = ctlq.count;
+	pthread_mutex_unlock(&ctlq.mutex);
+	ctl_queue_dropped = 0;
+	ctl_busy = 0;
+	ctl_slowest = 0;
+	ctl_stream_reqs = 0;
 }
 
 static unsigned short
@@ -18,6 +18,7 @@
 
 #include "ntpd.h"
 #include "ntp_dns.h"
+#include "ntp_probe.h"
 
 
 /* Notes:
@@ -120,18 +121,18 @@ void dns_check(void)
 		answer = NULL;
 	}
 
-	for (ai = answer; NULL != ai; ai = ai->ai_next) {
-		sockaddr_u sockaddr;
-		if (sizeof(sockaddr_u) < ai->ai_addrlen)
-			continue;  /* Weird */
-		memcpy(&sockaddr, ai->ai_addr, ai->ai_addrlen);
-		/* Both dns_take_pool and dns_take_server log something. */
-		// msyslog(LOG_INFO, "DNS: Take %s=>%s",
-		//		socktoa(ai->ai_addr), socktoa(&sockaddr));
-		if (active->cast_flags & MDF_POOL)
-			dns_take_pool(active, &sockaddr);
-		else
+	if (active->cast_flags & MDF_POOL) {
+		/* Pool takes the whole answer set at once. */
+		dns_take_pool(active, answer);
+	} else {
+		for (ai = answer; NULL != ai; ai = ai->ai_next) {
+			sockaddr_u sockaddr;
+			if (sizeof(sockaddr_u) < ai->ai_addrlen)
+				continue;  /* Weird */
+			memcpy(&sockaddr, ai->ai_addr, ai->ai_addrlen);
+			/* dns_take_server logs something. */
 			dns_take_server(active, &sockaddr);
+		}
 	}
 
 	switch (gai_rc) {
@@ -190,7 +191,9 @@ static void* dns_lookup(void* arg)
 		hints.ai_protocol = IPPROTO_UDP;
 		hints.ai_socktype = SOCK_DGRAM;
 		hints.ai_family = AF(&pp->srcadr);
+		NTP_PROBE(dns_start, pp->hostname, hints.ai_family);
 		gai_rc = getaddrinfo(pp->hostname, NTP_PORTA, &hints, &answer);
+		NTP_PROBE(dns_finish, pp->hostname, gai_rc);
 	}
 
 	kill(getpid(), SIGDNS);
@@ -40,6 +40,7 @@
 #define SUFFIX_SEP '.'
 
 static	void	filegen_open	(FILEGEN *, const time_t);
+static	void	filegen_close	(FILEGEN *);
 static	int	valid_fileref	(const char *, const char *)
 			         __attribute__((pure));
 static	void	filegen_init	(const char *, const char *, FILEGEN *);
@@ -60,6 +61,7 @@ filegen_init(
 	)
 {
 	fgp->fp = NULL;
+	fgp->buf = NULL;
 	fgp->dir = estrdup(dir);
 	fgp->fname = estrdup(fname);
 	fgp->id_lo = 0;
@@ -101,6 +103,7 @@ filegen_open(
 	char *suffix;	/* where to print suffix extension */
 	unsigned int len, suflen;
 	FILE *fp;
+	char *buf;	/* stdio buffer for fp */
 	struct tm tm;
 
 	/* get basic filename in buffer, leave room for extensions */
@@ -283,11 +286,11 @@ filegen_open(
 		if (ENOENT != errno)
 			msyslog(LOG_ERR, "LOG: can't open %s: %s", fullname, strerror(errno));
 	} else {
-		if (NULL != gen->fp) {
-			fclose(gen->fp);
-			gen->fp = NULL;
-		}
+		buf = etallocarray(MEM_STATS, 1, FILEGEN_BUFSIZ);
+		setvbuf(fp, buf, _IOFBF, FILEGEN_BUFSIZ);
+		filegen_close(gen);
 		gen->fp = fp;
+		gen->buf = buf;
 
 		if (gen->flag & FGEN_FLAG_LINK) {
 			/*
@@ -313,6 +316,22 @@ filegen_open(
 	return;
 }
 
+/*
+ * close the current generation, if any, and free its buffer
+ */
+static void
+filegen_close(
+	FILEGEN *	gen
+	)
+{
+	if (NULL != gen->fp) {
+		fclose(gen->fp);
+		gen->fp = NULL;
+	}
+	etfree(MEM_STATS, gen->buf, 1, FILEGEN_BUFSIZ);
+	gen->buf = NULL;
+}
+
 /*
  * this function sets up gen->fp to point to the correct
  * generation of the file for the time specified by 'now'
@@ -327,10 +346,7 @@ filegen_setup(
 	bool	current;
 
 	if (!(gen->flag & FGEN_FLAG_ENABLED)) {
-		if (NULL != gen->fp) {
-			fclose(gen->fp);
-			gen->fp = NULL;
-		}
+		filegen_close(gen);
 		return;
 	}
 
@@ -397,8 +413,7 @@ filegen_config(
 }
 
 	if (NULL != gen->fp) {
-		fclose(gen->fp);
-		gen->fp = NULL;
+		filegen_close(gen);
 		file_existed = true;
 	} else {
 		file_existed = false;
@@ -6,6 +6,8 @@
 
 #include <stdio.h>
 #include <signal.h>
+#include <pthread.h>
+#include <sched.h>
 #include <fnmatch.h>
 #if !defined(FNM_CASEFOLD) && defined(FNM_IGNORECASE)
 # define FNM_CASEFOLD FNM_IGNORECASE
@@ -19,7 +21,9 @@
 #include "ntp_refclock.h"
 #include "ntp_stdlib.h"
 #include "ntp_assert.h"
+#include "ntp_capture.h"
 #include "ntp_dns.h"
+#include "ntp_probe.h"
 #include "timespecops.h"
 
 #include "isc_interfaceiter.h"
@@ -253,6 +257,8 @@ static void		maintain_activefds(int fd, bool closing);
  * Routines to read the ntp packets
  */
 static int	read_network_packet	(SOCKET, endpt *);
+static void	network_packet_in	(struct recvbuf *, endpt *);
+static void *	busypoll_thread		(void *);
 static void input_handler (fd_set *);
 #ifdef REFCLOCK
 static int	read_refclock_packet	(SOCKET, struct refclockio *);
@@ -269,6 +275,41 @@ volatile struct signals_detected sig_flags = {
 };
 static sigset_t blockMask;
 
+/*
+ * Busy-poll receive.  With "busypoll" in ntp.conf a thread of its own
+ * spins on the server sockets with non-blocking reads, instead of the
+ * main thread sleeping in pselect() until the kernel wakes it, and
+ * answers each packet as soon as it has read it.  It takes the state
+ * lock (ctl_state_poll_lock()) for each packet, so the protocol code
+ * still runs in one thread at a time, and lets the main thread go
+ * first when it is waiting; the main thread keeps the timer,
+ * refclocks and the routing socket, and no longer selects on the
+ * server sockets.  The thread can be pinned to a CPU and run
+ * SCHED_FIFO; give it a CPU of its own, as it never sleeps.  With
+ * only one CPU online it isn't started.
+ *
+ * The thread reads the sockets holding busypoll.lock.  The main thread
+ * holds it while interfaces come and go and bumps gen, so the thread
+ * never reads a socket that was closed, or whose number was reused.
+ * The thread gives the lock up after each sweep of the sockets, but a
+ * mutex isn't fair: a thread that never sleeps takes it straight back.
+ * So the main thread raises waiting first, and the poll thread keeps
+ * off the lock, yielding, until it is down again.
+ */
+static struct {
+	pthread_mutex_t	lock;
+	bool		enabled;	/* "busypoll" in ntp.conf */
+	bool		running;
+	int		cpu;		/* to pin to, -1 for none */
+	int		priority;	/* SCHED_FIFO, 0 to leave alone */
+	int		sockpoll;	/* SO_BUSY_POLL, microseconds */
+	unsigned long	gen;		/* bumped when endpoints change */
+	unsigned int	waiting;	/* main thread wants lock */
+} busypoll = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cpu = -1,
+};
+
 void
 maintain_activefds(
 	int fd,
@@ -1223,7 +1264,12 @@ interface_update(void)
 	if (io_data.disable_dynamic_updates)
 		return;
 
+	__atomic_fetch_add(&busypoll.waiting, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&busypoll.lock);
 	new_interface_found = update_interfaces();
+	busypoll.gen++;
+	pthread_mutex_unlock(&busypoll.lock);
+	__atomic_fetch_sub(&busypoll.waiting, 1, __ATOMIC_SEQ_CST);
 
 	if (!new_interface_found)
 		return;
@@ -1961,6 +2007,15 @@ open_socket(
 
 	make_socket_nonblocking(fd);
 
+#ifdef SO_BUSY_POLL
+	if (busypoll.sockpoll > 0 &&
+	    setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busypoll.sockpoll,
+		       sizeof(busypoll.sockpoll)) < 0)
+		msyslog(LOG_WARNING,
+			"IO: setsockopt SO_BUSY_POLL fails on address %s: %s",
+			socktoa(addr), strerror(errno));
+#endif
+
 	add_fd_to_list(fd, FD_TYPE_SOCKET);
 
 #ifdef F_GETFL
@@ -2176,6 +2231,23 @@ read_network_packet(
 	DPRINT(3, ("read_network_packet: fd=%d length %d from %s\n",
 		   fd, (int)buflen, socktoa(&rb->recv_srcadr)));
 
+	rb->fd = fd;
+	rb->recv_time = fetch_packetstamp(&msghdr);
+	network_packet_in(rb, itf);
+	freerecvbuf(rb);
+	return (buflen);
+}
+
+
+/*
+ * network_packet_in - process a packet read from itf
+ */
+static void
+network_packet_in(
+	struct recvbuf *	rb,
+	endpt *			itf
+	)
+{
 	/*
 	 * We used to drop network packets with addresses matching the magic
 	 * refclock format here. Now we do the check in the protocol machine,
@@ -2199,26 +2271,187 @@ read_network_packet(
 		   ) {
 			pkt_count.dropped++;
 			DPRINT(2, ("DROPPING that packet\n"));
-			freerecvbuf(rb);
-			return buflen;
+			return;
 		}
 		DPRINT(2, ("processing that packet\n"));
 	}
 
 	/*
-	 * Got one.  Mark how and when it got here,
-	 * put it on the full list and do bookkeeping.
+	 * Got one.  Mark where it got here and do bookkeeping.
 	 */
 	rb->dstadr = itf;
-	rb->fd = fd;
-	rb->recv_time = fetch_packetstamp(&msghdr);
 
+	NTP_PROBE(recv, PROBE_ADDR(&rb->recv_srcadr), rb->recv_length, rb->fd);
+	if (capture_enabled)
+		capture_packet(rb);
 	receive(rb);
-	freerecvbuf(rb);
 
 	itf->received++;
 	pkt_count.received++;
-	return (buflen);
+}
+
+
+/*
+ * busypoll_config - "busypoll [cpu N] [priority N] [sockpoll usec]"
+ */
+void
+busypoll_config(
+	int	cpu,
+	int	priority,
+	int	sockpoll
+	)
+{
+	busypoll.enabled = true;
+	busypoll.cpu = cpu;
+	busypoll.priority = priority;
+	busypoll.sockpoll = sockpoll;
+}
+
+
+/*
+ * busypoll_start - start the busy-poll thread if configured.  Called
+ * after the sandbox is set up.
+ */
+void
+busypoll_start(void)
+{
+	pthread_t thread;
+	sigset_t block_mask, saved_sig_mask;
+	int rc;
+
+	if (!busypoll.enabled)
+		return;
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+		/* it would fight the main thread for the only CPU */
+		msyslog(LOG_WARNING, "IO: busypoll: needs more than one "
+			"CPU, using select()");
+		return;
+	}
+	ctl_state_share();	/* before the thread can want it */
+	sigfillset(&block_mask);
+	pthread_sigmask(SIG_BLOCK, &block_mask, &saved_sig_mask);
+	rc = pthread_create(&thread, NULL, busypoll_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &saved_sig_mask, NULL);
+	if (rc) {
+		msyslog(LOG_ERR, "IO: busypoll: error from pthread_create: "
+			"%s, using select()", strerror(rc));
+		return;
+	}
+	busypoll.running = true;
+}
+
+
+/*
+ * busypoll_thread - read the server sockets without ever sleeping
+ */
+static void *
+busypoll_thread(
+	void *	arg
+	)
+{
+	static struct recvbuf rb;	/* the free list isn't ours */
+	struct {
+		SOCKET	fd;
+		endpt *	ep;
+	} *sock = NULL;
+	size_t		nsock = 0, next = 0, i;
+	unsigned long	gen = 0;
+	bool		stale = true;
+	struct msghdr	msghdr;
+	struct iovec	iovec;
+	char		control[100];	/* as in read_network_packet() */
+	ssize_t		buflen;
+	endpt *		ep;
+
+	UNUSED_ARG(arg);
+#ifdef HAVE_SECCOMP_H
+	setup_SIGSYS_trap();	/* enable trap for this thread */
+#endif
+
+#ifdef CPU_SET
+	if (busypoll.cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(busypoll.cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			msyslog(LOG_ERR, "IO: busypoll: can't pin to CPU %d: %s",
+				busypoll.cpu, strerror(errno));
+	}
+#endif
+	if (busypoll.priority > 0) {
+		struct sched_param sched;
+		int rc;
+
+		sched.sched_priority = min(busypoll.priority,
+					   sched_get_priority_max(SCHED_FIFO));
+		rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sched);
+		if (rc)
+			msyslog(LOG_ERR, "IO: busypoll: pthread_setschedparam(): %s",
+				strerror(rc));
+	}
+	msyslog(LOG_INFO, "IO: busypoll: reading the server sockets");
+
+	for (;;) {
+		if (0 < __atomic_load_n(&busypoll.waiting, __ATOMIC_SEQ_CST)) {
+			sched_yield();
+			continue;
+		}
+		pthread_mutex_lock(&busypoll.lock);
+		if (stale || gen != busypoll.gen) {
+			nsock = 0;
+			for (ep = io_data.ep_list; ep != NULL; ep = ep->elink)
+				nsock++;
+			sock = erealloc(sock, (nsock + 1) * sizeof(*sock));
+			nsock = 0;
+			for (ep = io_data.ep_list; ep != NULL; ep = ep->elink) {
+				if (INVALID_SOCKET == ep->fd)
+					continue;
+				sock[nsock].fd = ep->fd;
+				sock[nsock].ep = ep;
+				nsock++;
+			}
+			gen = busypoll.gen;
+			stale = false;
+		}
+		buflen = -1;
+		for (i = 0; i < nsock; i++) {
+			next = (next + 1) % nsock;
+			iovec.iov_base = &rb.recv_buffer;
+			iovec.iov_len = sizeof(rb.recv_buffer);
+			memset(&msghdr, '\0', sizeof(msghdr));
+			msghdr.msg_name = &rb.recv_srcadr;
+			msghdr.msg_namelen = sizeof(rb.recv_srcadr);
+			msghdr.msg_iov = &iovec;
+			msghdr.msg_iovlen = 1;
+			msghdr.msg_control = (void *)&control;
+			msghdr.msg_controllen = sizeof(control);
+			buflen = recvmsg(sock[next].fd, &msghdr, MSG_DONTWAIT);
+			if (buflen > 0)
+				break;
+		}
+		pthread_mutex_unlock(&busypoll.lock);
+		if (buflen <= 0)
+			continue;
+
+		rb.recv_length = (size_t)buflen;
+		rb.fd = sock[next].fd;
+		rb.recv_time = fetch_packetstamp(&msghdr);
+		ctl_state_poll_lock();
+		++pkt_count.handler_pkts;
+		ep = sock[next].ep;
+		if (gen != busypoll.gen) {
+			pkt_count.dropped++;	/* ep may be gone */
+			stale = true;
+		} else if (ep->ignore_packets) {
+			pkt_count.ignored++;
+		} else {
+			network_packet_in(&rb, ep);
+		}
+		ctl_state_unlock();
+		ZERO(rb);	/* as get_free_recv_buffer() leaves it */
+	}
+	return NULL;
 }
 
 /*
@@ -2231,18 +2464,31 @@ io_handler(void)
 	sigset_t runMask;
 	fd_set rdfdes;
 	int nfound;
+	struct timespec wait;
 
 	/*
 	 * Use select() on all input fd's for unlimited
-	 * time.  select() will terminate on SIGALARM or on the
-	 * reception of input.
+	 * time, or until a paced transmit is due.  select() will
+	 * terminate on SIGALARM or on the reception of input.
 	 */
 	pthread_sigmask(SIG_BLOCK, &blockMask, &runMask);
 	flag = sig_flags.sawALRM || sig_flags.sawQuit || sig_flags.sawHUP || \
 	  sig_flags.sawDNS;
 	if (!flag) {
 	  rdfdes = activefds;
-	  nfound = pselect(maxactivefd+1, &rdfdes, NULL, NULL, NULL, &runMask);
+	  if (busypoll.running) {
+		/* the busy-poll thread reads these */
+		endpt *ep;
+
+		for (ep = io_data.ep_list; ep != NULL; ep = ep->elink)
+			if (ep->fd != INVALID_SOCKET)
+				FD_CLR(ep->fd, &rdfdes);
+	  }
+	  ctl_state_unlock();	/* the control worker may run meanwhile */
+	  /* no longer than until the next paced transmit */
+	  nfound = pselect(maxactivefd+1, &rdfdes, NULL, NULL,
+			   pace_wait(&wait), &runMask);
+	  ctl_state_lock();
 	} else {
 	  nfound = -1;
 	  errno = EINTR;
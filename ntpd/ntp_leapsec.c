@@ -337,6 +337,62 @@ leapsec_query(
 	return fired;
 }
 
+#ifdef ENABLE_LEAP_SMEAR
+/* ------------------------------------------------------------------ */
+void
+leapsec_smear_update(
+	leap_smear_info_t *   ls,
+	const leap_result_t * qr,
+	time_t                now,
+	long                  intv)
+{
+	double dtemp = (double)now;
+
+	ls->in_progress = false;
+	ls->doffset = 0.0;
+	ls->slope = 0;
+	ls->dt_min = 0;
+	ls->dt_max = 0;
+
+	if (!ls->enabled)
+		ls->interval = 0;
+	else if (qr->tai_diff == 0)
+		ls->interval = 0;
+	else if (ls->interval == 0) {
+		ls->interval = intv;
+		ls->intv_end = (double)qr->ttime;
+		ls->intv_start = ls->intv_end - ls->interval;
+	}
+
+	if (ls->interval &&
+	    dtemp >= ls->intv_start && dtemp <= ls->intv_end) {
+		/*
+		 * For now we just do a linear interpolation over the smear interval
+		 * https://developers.google.com/time/smear
+		 */
+		ls->doffset = -((dtemp - ls->intv_start) * qr->tai_diff
+				/ ls->interval);
+		ls->slope = -(((int64_t)qr->tai_diff << 32) / ls->interval);
+		ls->dt_min = -(int64_t)((dtemp - ls->intv_start) * FRAC);
+		ls->dt_max = (int64_t)((ls->intv_end - dtemp) * FRAC);
+		/*
+		 * TODO see if we're inside an inserted leap second, so
+		 * we need to compute
+		 * leap_smear.doffset = 1.0 - leap_smear.doffset
+		 */
+		ls->in_progress = true;
+	}
+
+	/*
+	 * Update the current leap smear offset, eventually 0.0 if outside
+	 * smear interval.
+	 */
+	ls->offset = dtolfp(ls->doffset);
+	ls->ref = lfpinit_u((uint32_t)((uint64_t)now + JAN_1970), 0);
+	ls->refid = convertLFPToRefID(ls->offset);
+}
+#endif	/* ENABLE_LEAP_SMEAR */
+
 /* ------------------------------------------------------------------ */
 bool
 leapsec_frame(
@@ -111,9 +111,40 @@ struct leap_smear_info {
 	long interval;      /* smear interval, in [s], should be at least some hours */
 	double intv_start;  /* start time of the smear interval */
 	double intv_end;    /* end time of the smear interval */
+	/* Published once per tick for the packet path, see leap_smear_at() */
+	l_fp ref;           /* time 'offset' was computed for */
+	int64_t slope;      /* offset change per second, in l_fp units */
+	int64_t dt_min;     /* smear interval start, relative to 'ref' */
+	int64_t dt_max;     /* smear interval end, relative to 'ref' */
+	uint32_t refid;     /* refid to send while smearing */
 };
 typedef struct leap_smear_info leap_smear_info_t;
 
+/* Update the smear state from a query result at time 'now'. 'intv' is
+ * the configured smear interval; it's latched when a leap second is
+ * first scheduled.
+ */
+extern void leapsec_smear_update(leap_smear_info_t *, const leap_result_t *,
+				 time_t now, long intv);
+
+/* Get the smear offset at 'when' from the state published by the last
+ * leapsec_smear_update().  This extrapolates along the smear line, so
+ * it stays exact between updates without touching the leap table.
+ * Only meaningful if 'in_progress' is set.
+ */
+static inline l_fp
+leap_smear_at(const leap_smear_info_t *ls, l_fp when)
+{
+	int64_t dt = (int64_t)(when - ls->ref);
+
+	if (dt < ls->dt_min)
+		dt = ls->dt_min;
+	else if (dt > ls->dt_max)
+		dt = ls->dt_max;
+	/* dt in 2^-16 s keeps the product in range for any interval */
+	return ls->offset + (l_fp)((dt / 65536) * ls->slope / 65536);
+}
+
 #endif  /* ENABLE_LEAP_SMEAR */
 
 
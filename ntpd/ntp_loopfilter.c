@@ -17,6 +17,7 @@
 #include "ntpd.h"
 #include "ntp_io.h"
 #include "ntp_calendar.h"
+#include "ntp_probe.h"
 #include "ntp_stdlib.h"
 #include "ntp_syscall.h"
 #include "timespecops.h"
@@ -618,6 +619,10 @@ local_clock(
 			rval = 2;
 			if (state == EVNT_NSET) {
 				rstclock(EVNT_FREQ, 0);
+				NTP_PROBE(clock, rval, state,
+					  PROBE_NS(fp_offset), 0,
+					  PROBE_PPB(loop_data.drift_comp),
+					  clkstate.sys_poll);
 				return (rval);
 			}
 			break;
@@ -881,6 +886,9 @@ local_clock(
 		   clock_offset, clkstate.clock_jitter,
            loop_data.drift_comp * US_PER_S,
            loop_data.clock_stability * US_PER_S, clkstate.sys_poll));
+	NTP_PROBE(clock, rval, state, PROBE_NS(fp_offset),
+		  PROBE_NS(clkstate.clock_jitter),
+		  PROBE_PPB(loop_data.drift_comp), clkstate.sys_poll);
 	return (rval);
 }
 
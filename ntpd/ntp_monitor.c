@@ -32,6 +32,13 @@
  * tail for the MRU list, unlinking from the hash table, and
  * reinitializing.
  *
+ * An entry leaving the MRU list, recycled, aged out or dropped with
+ * its local address, can leave a compact record in the cold tier
+ * ("mru coldmem"): address, first and last seconds, and saturating
+ * count and score.  A new address found there comes back with its
+ * history, so a client that went quiet doesn't return with a fresh
+ * rate budget and its counts carry on.
+ *
  * INC_MONLIST is the default allocation granularity in entries.
  * INIT_MONLIST is the default initial allocation in entries.
  */
@@ -45,6 +52,46 @@
 # define MRU_MAXDEPTH_DEF	(1024 * 1024 / sizeof(mon_entry))
 #endif
 
+/*
+ * MON_TICK_WORK bounds what mon_timer() does each second: entries
+ * aged out or evicted plus hash slots and entries checked.
+ */
+#ifndef MON_TICK_WORK
+# define	MON_TICK_WORK	2048
+#endif
+
+/*
+ * A check pass of the hash table starts at most this often (seconds),
+ * and only if the list has changed since the last one started.
+ */
+#ifndef MON_CHECK_INTERVAL
+# define	MON_CHECK_INTERVAL	3600
+#endif
+
+/*
+ * Cold records are in two arrays, one per address family.  An address
+ * is in one of the COLD_WAYS records from its hash on or nowhere; a
+ * new one takes an empty record there or the one seen longest ago.
+ * Scores are kept in units of 1/COLD_SCALE packet per second.
+ */
+#define COLD_WAYS	8
+#define COLD_SCALE	256.0f
+
+struct cold_rec {
+	uint32_t	first;		/* l_fp seconds */
+	uint32_t	last;		/* l_fp seconds, 0 if empty */
+	uint16_t	count;		/* packets, saturating */
+	uint16_t	score;		/* COLD_SCALE units, saturating */
+	uint32_t	addr[];		/* 1 word for IPv4, 4 for IPv6 */
+};
+
+struct cold_table {
+	char *		recs;
+	unsigned int	words;		/* of address */
+	size_t		size;		/* of a record */
+	uint32_t	mask;		/* records - 1 */
+};
+
 #define MON_HASH_SLOTS          (1U << mon_data.mon_hash_bits)
 #define MON_HASH_MASK           (MON_HASH_SLOTS - 1)
 #define MON_HASH(addr)          (sock_hash(addr) & MON_HASH_MASK)
@@ -65,9 +112,12 @@ struct monitor_data mon_data = {
 	.mru_recycleold = 0,	/* recycle slot: age > mru_maxage */
 	.mru_recyclefull = 0,	/* recycle slot: full and age > mru_minage */
 	.mru_none = 0,		/* couldn't get one */
+	.mru_aged = 0,		/* aged out by mon_timer() */
+	.mru_evicted = 0,	/* evicted to refill the reserve */
 	.rate_limit = 1.0,	/* responses per second */
 	.decay_time = 20,	/* seconds, exponential decay time */
 	.kod_limit = 0.5,	/* KoDs per second */
+	.kod_rate = 1000,	/* KoDs per second, all sources */
 
 };
 
@@ -78,11 +128,33 @@ struct monitor_data mon_data = {
 static  mon_entry *mon_free;		/* free list or null if none */
 static	uint64_t mru_alloc;		/* mru list + free list count */
 static	uint64_t mon_mem_increments;	/* times called malloc() */
+static	size_t	mon_hash_octets;	/* size of mon_hash */
+static	struct cold_table cold4 = { NULL, 1, 0, 0 };
+static	struct cold_table cold6 = { NULL, 4, 0, 0 };
 
 static	void	mon_getmoremem(void);
 static	void	remove_from_hash(mon_entry *);
 static	void	mon_free_entry(mon_entry *);
+static	void	mon_unlink(mon_entry *);
 static	void	mon_reclaim_entry(mon_entry *);
+static	int	mon_age(const mon_entry *, l_fp);
+static	struct mon_part *mon_find_part(const endpt *);
+static	unsigned int mon_age_out(unsigned int);
+static	unsigned int mon_fill_reserve(unsigned int);
+static	unsigned int mon_check(unsigned int);
+static	void	mon_check_entry(mon_entry *, unsigned int);
+static	void	mon_cold_alloc(struct cold_table *, size_t);
+static	struct cold_rec *mon_cold_find(const sockaddr_u *, bool);
+static	void	mon_demote(const mon_entry *);
+static	bool	mon_promote(mon_entry *, const struct mon_part *);
+
+/*
+ * Where the incremental consistency check has got to
+ */
+static	unsigned int	check_slot;	/* next hash slot to check */
+static	unsigned int	check_complaints; /* logged this pass */
+static	bool		check_dirty = true; /* changed since the pass began */
+static	uptime_t	check_started;	/* when the last pass began */
 
 
 /*
@@ -96,6 +168,7 @@ init_mon(void)
 	 * until mon_start().
 	 */
 	INIT_DLIST(mon_data.mon_mru_list, mru);
+	INIT_DLIST(mon_data.mon_rest.mru_list, plist);
 }
 
 
@@ -128,6 +201,24 @@ mon_free_entry(
 {
 	ZERO(*m);
 	LINK_SLIST(mon_free, m, hash_next);
+	mon_data.mru_free++;
+}
+
+
+/*
+ * mon_unlink - take an entry off the MRU list, its partition's list and
+ *		the hash array.  Indirectly decrements mru_entries.
+ */
+static void
+mon_unlink(
+	mon_entry *m
+	)
+{
+	UNLINK_DLIST(m, mru);
+	UNLINK_DLIST(m, plist);
+	m->part->entries--;
+	remove_from_hash(m);
+	check_dirty = true;
 }
 
 
@@ -147,8 +238,8 @@ mon_reclaim_entry(
 {
 	INSIST(NULL != m);
 
-	UNLINK_DLIST(m, mru);
-	remove_from_hash(m);
+	mon_demote(m);
+	mon_unlink(m);
 	ZERO(*m);
 }
 
@@ -167,7 +258,7 @@ mon_getmoremem(void)
 		      : mon_data.mru_incalloc;
 
 	if (entries) {
-		chunk = eallocarray(entries, sizeof(*chunk));
+		chunk = etallocarray(MEM_MRU, entries, sizeof(*chunk));
 		mru_alloc += entries;
 		for (chunk += entries; entries; entries--)
 			mon_free_entry(--chunk);
@@ -179,6 +270,134 @@ mon_getmoremem(void)
 }
 
 
+/*
+ * mon_cold_alloc - give a cold table the most records that fit in
+ *		    octets, a power of two
+ */
+static void
+mon_cold_alloc(
+	struct cold_table *	t,
+	size_t			octets
+	)
+{
+	size_t	records;
+
+	t->size = sizeof(struct cold_rec) + t->words * sizeof(uint32_t);
+	records = COLD_WAYS;
+	while (2 * records * t->size <= octets)
+		records *= 2;
+	t->recs = emalloc_zero(records * t->size);
+	t->mask = (uint32_t)records - 1;
+	mem_count(MEM_MRU, (long)(records * t->size), 0);
+	mon_data.mru_coldslots += records;
+	mon_data.mru_coldmem += records * t->size;
+}
+
+
+/*
+ * mon_cold_find - the cold record for addr, or with take a record to
+ *		   put it in, its address filled in
+ */
+static struct cold_rec *
+mon_cold_find(
+	const sockaddr_u *	addr,
+	bool			take
+	)
+{
+	struct cold_table *	t;
+	struct cold_rec *	r;
+	struct cold_rec *	victim = NULL;
+	uint32_t		key[4];
+	uint32_t		slot;
+	int			i;
+
+	t = IS_IPV4(addr) ? &cold4 : &cold6;
+	if (NULL == t->recs)
+		return NULL;
+	if (IS_IPV4(addr))
+		key[0] = NSRCADR(addr);
+	else
+		memcpy(key, PSOCK_ADDR6(addr), sizeof(key));
+	slot = sock_hash(addr) * 0x9e3779b1U;
+	for (i = 0; i < COLD_WAYS; i++) {
+		r = (void *)(t->recs + ((slot + i) & t->mask) * t->size);
+		if (0 == r->last) {
+			if (NULL == victim || victim->last != 0)
+				victim = r;
+		} else if (!memcmp(r->addr, key,
+				   t->words * sizeof(uint32_t))) {
+			return r;
+		} else if (NULL == victim ||
+			   (victim->last != 0 &&
+			    (int32_t)(r->last - victim->last) < 0)) {
+			victim = r;
+		}
+	}
+	if (!take)
+		return NULL;
+	if (victim->last != 0)
+		mon_data.mru_coldlost++;
+	else
+		mon_data.mru_colddepth++;
+	memcpy(victim->addr, key, t->words * sizeof(uint32_t));
+	return victim;
+}
+
+
+/*
+ * mon_demote - keep what matters of an entry leaving the MRU list
+ */
+static void
+mon_demote(
+	const mon_entry *	mon
+	)
+{
+	struct cold_rec *	r;
+	float			score;
+
+	r = mon_cold_find(&mon->rmtadr, true);
+	if (NULL == r)
+		return;
+	r->first = lfpuint(mon->first);
+	r->last = max(1, lfpuint(mon->last));
+	r->count = (uint16_t)min(mon->count, UINT16_MAX);
+	score = mon->score * COLD_SCALE + 0.5f;
+	r->score = (score < UINT16_MAX) ? (uint16_t)score : UINT16_MAX;
+	mon_data.mru_demoted++;
+}
+
+
+/*
+ * mon_promote - give a new entry its cold history, if it has one.
+ *		 The entry has last, score and count for this packet.
+ */
+static bool
+mon_promote(
+	mon_entry *		mon,
+	const struct mon_part *	part
+	)
+{
+	struct cold_rec *	r;
+	int32_t			since_last;
+	float			score;
+
+	r = mon_cold_find(&mon->rmtadr, false);
+	if (NULL == r)
+		return false;
+	since_last = (int32_t)(lfpuint(mon->last) - r->last);
+	score = r->score / COLD_SCALE;
+	if (since_last > 0)
+		score *= expf(-since_last / part->decay_time);
+	mon->score += score;
+	mon->first = lfpinit_u(r->first, 0);
+	mon->count += r->count;
+	r->last = 0;
+	mon_data.mru_colddepth--;
+	mon_data.mru_promoted++;
+	return true;
+}
+
+
 void
 mon_setup(int mode)
 {
@@ -191,6 +410,39 @@ mon_setdown(int mode)
 	mon_data.mon_enabled &= ~mode;
 }
 
+/*
+ * mon_partition - "limit interface addr ..." from the config
+ *
+ * maxdepth is taken from mru_maxdepth by mon_start().
+ */
+void
+mon_partition(
+	sockaddr_u *	addr,
+	float		rate_limit,
+	float		decay_time,
+	float		kod_limit,
+	uint64_t	maxdepth
+	)
+{
+	struct mon_part *p;
+	struct mon_part **pp;
+
+	for (pp = &mon_data.mon_parts; (p = *pp) != NULL; pp = &p->link)
+		if (SOCK_EQ(&p->addr, addr))
+			break;
+	if (NULL == p) {
+		p = emalloc_zero(sizeof(*p));
+		INIT_DLIST(p->mru_list, plist);
+		*pp = p;
+	}
+	p->addr = *addr;
+	p->rate_limit = rate_limit;
+	p->decay_time = decay_time;
+	p->kod_limit = kod_limit;
+	p->maxdepth = maxdepth;
+}
+
+
 /*
  * mon_start - start up the monitoring software
  */
@@ -199,9 +451,29 @@ mon_start(void)
 {
 	size_t octets;
 	unsigned int min_hash_slots;
+	struct mon_part *p;
+	uint64_t quota;
 
 	if (MON_OFF == mon_data.mon_enabled)
 		return;
+	/*
+	 * Whatever the partitions don't reserve is left to everyone
+	 * else, at least mru_mindepth of it.
+	 */
+	quota = 0;
+	for (p = mon_data.mon_parts; p != NULL; p = p->link)
+		quota += p->maxdepth;
+	if (quota + mon_data.mru_mindepth > mon_data.mru_maxdepth) {
+		mon_data.mru_maxdepth = quota + mon_data.mru_mindepth;
+		msyslog(LOG_WARNING,
+			"CONFIG: mru maxdepth raised to %llu to cover "
+			"limit interface maxdepth",
+			(unsigned long long)mon_data.mru_maxdepth);
+	}
+	mon_data.mon_rest.maxdepth = mon_data.mru_maxdepth - quota;
+	mon_data.mon_rest.rate_limit = mon_data.rate_limit;
+	mon_data.mon_rest.decay_time = mon_data.decay_time;
+	mon_data.mon_rest.kod_limit = mon_data.kod_limit;
 	if (0 == mon_mem_increments)
 		mon_getmoremem();
 	/* There used to be a 16 bit limit to mon_hash_bits.
@@ -220,6 +492,19 @@ mon_start(void)
 		(unsigned long long)mon_data.mru_maxdepth,
 		mon_data.mon_hash_bits, (unsigned long long)octets);
 	mon_data.mon_hash = erealloc_zero(mon_data.mon_hash, octets, 0);
+	mem_count(MEM_MRU, (long)octets - (long)mon_hash_octets, 0);
+	mon_hash_octets = octets;
+	/* half the cold tier for each family, kept across restarts */
+	if (mon_data.mru_coldmaxmem != 0 && NULL == cold4.recs) {
+		mon_cold_alloc(&cold4, mon_data.mru_coldmaxmem / 2);
+		mon_cold_alloc(&cold6, mon_data.mru_coldmaxmem / 2);
+		msyslog(LOG_INFO, "INIT: MRU cold tier %llu entries, "
+			"%llu bytes",
+			(unsigned long long)mon_data.mru_coldslots,
+			(unsigned long long)mon_data.mru_coldmem);
+	}
+	if (mon_data.mru_share != NULL)
+		monshm_open(mon_data.mru_share, mon_data.mru_maxdepth);
 }
 
 
@@ -230,6 +515,7 @@ void
 mon_stop(void)
 {
 	mon_entry *mon;
+	struct mon_part *p;
 
 	if (MON_OFF == mon_data.mon_enabled)
 		return;
@@ -243,10 +529,16 @@ mon_stop(void)
 		mon_free_entry(mon);
 	ITER_DLIST_END()
 
-	/* empty the MRU list and hash table. */
+	/* empty the MRU list, partitions and hash table. */
 	mon_data.mru_entries = 0;
 	mon_data.mru_hashslots = 0;
 	INIT_DLIST(mon_data.mon_mru_list, mru);
+	INIT_DLIST(mon_data.mon_rest.mru_list, plist);
+	mon_data.mon_rest.entries = 0;
+	for (p = mon_data.mon_parts; p != NULL; p = p->link) {
+		INIT_DLIST(p->mru_list, plist);
+		p->entries = 0;
+	}
 	memset(mon_data.mon_hash, '\0', sizeof(*mon_data.mon_hash) * MON_HASH_SLOTS);
 }
 
@@ -265,10 +557,10 @@ mon_clearinterface(
 	/* iterate mon over mon_mru_list */
 	ITER_DLIST_BEGIN(mon_data.mon_mru_list, mon, mru, mon_entry)
 		if (mon->lcladr == lcladr) {
-			/* remove from mru list */
-			UNLINK_DLIST(mon, mru);
-			/* remove from hash list, adjust mru_entries */
-			remove_from_hash(mon);
+			/* the client may come back on another address */
+			mon_demote(mon);
+			/* remove from lists, adjust mru_entries */
+			mon_unlink(mon);
 			/* put on free list */
 			mon_free_entry(mon);
 		}
@@ -286,6 +578,21 @@ mon_entry *mon_get_slot(sockaddr_u *addr)
 	return mon;
 }
 
+/*
+ * mon_age - seconds since an entry was last used, rounded
+ */
+static int
+mon_age(
+	const mon_entry *	mon,
+	l_fp			now
+	)
+{
+	now -= mon->last;
+	/* add one-half second to round up */
+	now += 0x80000000;
+	return lfpsint(now);
+}
+
 int mon_get_oldest_age(l_fp now)
 {
     mon_entry *	oldest;
@@ -303,12 +610,53 @@ int mon_get_oldest_age(l_fp now)
 		exit(3);
         }
     }
-    now -= oldest->last;
-    /* add one-half second to round up */
-    now += 0x80000000;
-    return lfpsint(now);
+    return mon_age(oldest, now);
+}
+
+
+/*
+ * mon_find_part - the partition for packets to a local address
+ */
+static struct mon_part *
+mon_find_part(
+	const endpt *	dst
+	)
+{
+	struct mon_part *p;
+
+	if (dst != NULL)
+		for (p = mon_data.mon_parts; p != NULL; p = p->link)
+			if (SOCK_EQ(&p->addr, &dst->sin))
+				return p;
+	return &mon_data.mon_rest;
+}
+
+/*
+ * mon_rate_mask - the restrict flags for a packet from a client with
+ *		   this score
+ */
+unsigned short
+mon_rate_mask(
+	float			score,
+	const struct mon_part *	part,
+	unsigned short		flags
+	)
+{
+	if (score < part->rate_limit) {
+		/* low score, turn off reject bits */
+		flags &= ~(RES_LIMITED | RES_KOD);
+	}
+
+	/* HACK: Much abusive traffic is big bursts.
+	 * Don't send KoDs for them or we can be used
+	 * as a DDoS reflector to hide the true source. */
+	if (score > (+part->kod_limit+part->rate_limit)) {
+		flags &= ~RES_KOD;
+	}
+	return flags;
 }
 
+
 /*
  * ntp_monitor - record stats about this packet
  *
@@ -334,16 +682,22 @@ ntp_monitor(
 	mon_entry *	mon;
 	mon_entry *	oldest;
 	int		oldest_age;
+	struct mon_part *part;		/* rate limits */
+	struct mon_part *pool;		/* where the entry lives */
 	unsigned int	hash;
 	unsigned short	restrict_mask;
 	uint8_t		mode;
 	uint8_t		version;
 	uint8_t		li_vn_mode;
 	float		since_last;	/* seconds since last packet */
+	bool		promoted;	/* history from the cold tier */
 
 	if (mon_data.mon_enabled == MON_OFF)
 		return ~(RES_LIMITED | RES_KOD) & flags;
 
+	check_dirty = true;
+	part = mon_find_part(rbufp->dstadr);
+	pool = part->maxdepth ? part : &mon_data.mon_rest;
 	hash = MON_HASH(&rbufp->recv_srcadr);
 	li_vn_mode = rbufp->recv_buffer[0];
 	mode = PKT_MODE(li_vn_mode);
@@ -364,33 +718,39 @@ ntp_monitor(
 		mon->last = rbufp->recv_time;
 		NSRCPORT(&mon->rmtadr) = NSRCPORT(&rbufp->recv_srcadr);
 		mon->count++;
-		restrict_mask = flags;
 		mon->vn_mode = VN_MODE(version, mode);
 
-		/* Shuffle to the head of the MRU list. */
+		/*
+		 * Shuffle to the head of the MRU list and its partition's.
+		 * One that now arrives on another local address moves to
+		 * that partition only if there is room; a full one keeps
+		 * its maxdepth and this entry stays where it was.
+		 */
 		UNLINK_DLIST(mon, mru);
 		LINK_DLIST(mon_data.mon_mru_list, mon, mru);
+		UNLINK_DLIST(mon, plist);
+		if (pool != mon->part && pool->entries < pool->maxdepth) {
+			mon->part->entries--;
+			pool->entries++;
+			mon->part = pool;
+		}
+		LINK_DLIST(mon->part->mru_list, mon, plist);
 
 		/* Keep score:
 		 * if packets arrive at 1/second,
 		 * score will build up to (almost) 1.0
 		 */
 		since_last = ldexpf(delta_fp, -32);
-		mon->score *= expf(-since_last/mon_data.decay_time);
-		mon->score += 1.0/mon_data.decay_time;
+		mon->score *= expf(-since_last/part->decay_time);
+		mon->score += 1.0/part->decay_time;
 
-		if (mon->score < mon_data.rate_limit) {
-			/* low score, turn off reject bits */
-			restrict_mask &= ~(RES_LIMITED | RES_KOD);
-		}
-		if (RES_LIMITED & restrict_mask)
+		if (monshm_active())
+			restrict_mask = monshm_touch(mon, part, flags);
+		else
+			restrict_mask = mon_rate_mask(mon->score, part, flags);
+		if (RES_LIMITED & restrict_mask) {
 			mon->dropped++;
-
-		/* HACK: Much abusive traffic is big bursts.
-		 * Don't send KoDs for them or we can be used
-		 * as a DDoS reflector to hide the true source. */
-		if (mon->score > (+mon_data.kod_limit+mon_data.rate_limit)) {
-			restrict_mask &= ~RES_KOD;
+			part->limited++;
 		}
 
 		mon->flags = restrict_mask;
@@ -411,8 +771,7 @@ ntp_monitor(
 	 * - mru_maxage ("mru maxage") is a ceiling on the age in
 	 *   seconds of entries.  Entries older than this are
 	 *   reclaimed once mon_mindepth is exceeded.  3600s default.
-	 *   Note that entries older than this can easily survive
-	 *   as they are reclaimed only as needed.
+	 *   mon_timer() frees them a few thousand a second.
 	 * - mru_maxdepth ("mru maxdepth") is a hard limit on the
 	 *   number of entries.
 	 * - "mru maxmem" sets mru_maxdepth to the number of entries
@@ -423,36 +782,54 @@ ntp_monitor(
 	 * - "mru initmem" sets mru_initalloc in units of kilobytes.
 	 *   The default is 4.
 	 * - mru_incalloc ("mru incalloc" sets the number of entries to
-	 *   allocate on-demand each time the free list is empty.
+	 *   allocate on-demand each time the free list is empty.  It is
+	 *   also the reserve mon_timer() keeps on the free list so that
+	 *   this path seldom has to reclaim or allocate.
 	 * - "mru incmem" sets mru_incalloc in units of kilobytes.
 	 *   The default is 4.
 	 * Whichever of "mru maxmem" or "mru maxdepth" occurs last in
 	 * ntp.conf controls.  Similarly for "mru initalloc" and "mru
 	 * initmem", and for "mru incalloc" and "mru incmem".
+	 * - "limit interface ... maxdepth" caps the entries for clients
+	 *   of one local address; only that partition's own entries are
+	 *   recycled for them, and mon_rest gets what is left over.
+	 *   The ages below are of the oldest entry in the partition.
 	 */
-	if (mon_data.mru_entries < mon_data.mru_mindepth) {
+	if (pool->entries < pool->maxdepth &&
+	    (mon_data.mru_entries < mon_data.mru_mindepth ||
+	     mon_free != NULL)) {
+		/* usually the free list, mon_timer() keeps a reserve */
 		mon_data.mru_new++;
+		part->new++;
 		if (NULL == mon_free)
 			mon_getmoremem();
 		UNLINK_HEAD_SLIST(mon, mon_free, hash_next);
+		mon_data.mru_free--;
 	} else {
-		oldest = TAIL_DLIST(mon_data.mon_mru_list, mru);
-		oldest_age = mon_get_oldest_age(rbufp->recv_time);
-		if (mon_data.mru_maxage < oldest_age) {
+		oldest = TAIL_DLIST(pool->mru_list, plist);
+		oldest_age = (oldest != NULL)
+				 ? mon_age(oldest, rbufp->recv_time)
+				 : 0;
+		if (oldest != NULL && mon_data.mru_maxage < oldest_age) {
 			mon_data.mru_recycleold++;
+			part->recycled++;
 			mon_reclaim_entry(oldest);
 			mon = oldest;
-		} else if (mon_free != NULL || mru_alloc < mon_data.mru_maxdepth) {
+		} else if (pool->entries < pool->maxdepth &&
+			   mru_alloc < mon_data.mru_maxdepth) {
 			mon_data.mru_new++;
-			if (NULL == mon_free)
-				mon_getmoremem();
+			part->new++;
+			mon_getmoremem();
 			UNLINK_HEAD_SLIST(mon, mon_free, hash_next);
-		} else if (oldest_age < mon_data.mru_minage) {
+			mon_data.mru_free--;
+		} else if (NULL == oldest ||
+			   oldest_age < mon_data.mru_minage) {
 			mon_data.mru_none++;
+			part->none++;
 			return ~(RES_LIMITED | RES_KOD) & flags;
 		} else {
 			mon_data.mru_recyclefull++;
-			/* coverity[var_deref_model] */
+			part->recycled++;
 			mon_reclaim_entry(oldest);
 			mon = oldest;
 		}
@@ -469,11 +846,22 @@ ntp_monitor(
 	mon->first = mon->last;
 	mon->count = 1;
 	mon->dropped = 0;
-	mon->score = 1.0/mon_data.decay_time;
-	mon->flags = ~(RES_LIMITED | RES_KOD) & flags;
+	mon->score = 1.0/part->decay_time;
 	memcpy(&mon->rmtadr, &rbufp->recv_srcadr, sizeof(mon->rmtadr));
 	mon->vn_mode = VN_MODE(version, mode);
 	mon->lcladr = rbufp->dstadr;
+	promoted = mon_promote(mon, part);
+	if (monshm_active()) {
+		/* new to us, perhaps not to the other processes */
+		mon->flags = monshm_touch(mon, part, flags);
+	} else if (promoted) {
+		mon->flags = mon_rate_mask(mon->score, part, flags);
+	} else
+		mon->flags = ~(RES_LIMITED | RES_KOD) & flags;
+	if (RES_LIMITED & mon->flags) {
+		mon->dropped++;
+		part->limited++;
+	}
 
 	/*
 	 * Drop him into front of the hash table. Also put him on top of
@@ -483,69 +871,202 @@ ntp_monitor(
 		mon_data.mru_hashslots++;
 	LINK_SLIST(mon_data.mon_hash[hash], mon, hash_next);
 	LINK_DLIST(mon_data.mon_mru_list, mon, mru);
+	LINK_DLIST(pool->mru_list, mon, plist);
+	pool->entries++;
+	mon->part = pool;
 
 	return mon->flags;
 }
 
-/* This is a hack to sanity check the MRU list
- * See issue #648 - duplicate ntpq-mrulist slots
- * I have no suspicions that the list is broken,
- * but this code is easy to write.
+
+/*
+ * mon_timer - once a second, a bounded slice of MRU housekeeping
  *
- * We may want to do things like log piggy slots.
+ * First entries older than mru_maxage (beyond mru_mindepth) go back
+ * on the free list, then the free list is topped up to mru_incalloc
+ * entries, from new memory while under mru_maxdepth and otherwise by
+ * evicting the oldest entries past mru_minage, so long as they belong
+ * to a partition that is close to its maxdepth.  That leaves
+ * ntp_monitor() taking a free entry for a new address rather than
+ * reclaiming one.
+ * Whatever is left of the MON_TICK_WORK budget goes to checking the
+ * hash chains and MRU links, a few slots at a time, in place of the
+ * full scan that took seconds on a big list (issue #648).
+ */
+void
+mon_timer(void)
+{
+	unsigned int	work;
+
+	if (MON_OFF == mon_data.mon_enabled || NULL == mon_data.mon_hash)
+		return;
+	work = mon_age_out(MON_TICK_WORK);
+	work += mon_fill_reserve(MON_TICK_WORK - work);
+	if (work < MON_TICK_WORK)
+		work += mon_check(MON_TICK_WORK - work);
+	mon_data.mru_tickwork = work;
+	mon_data.mru_tickworkmax = max(mon_data.mru_tickworkmax,
+				       mon_data.mru_tickwork);
+}
+
+
+/*
+ * mon_age_out - free entries older than mru_maxage, oldest first
+ */
+static unsigned int
+mon_age_out(
+	unsigned int	budget
+	)
+{
+	l_fp		now;
+	mon_entry *	oldest;
+	unsigned int	done;
+
+	if (mon_data.mru_entries <= mon_data.mru_mindepth)
+		return 0;
+	get_systime(&now);
+	for (done = 0; done < budget; done++) {
+		if (mon_data.mru_entries <= mon_data.mru_mindepth ||
+		    mon_get_oldest_age(now) <= mon_data.mru_maxage)
+			break;
+		oldest = TAIL_DLIST(mon_data.mon_mru_list, mru);
+		mon_demote(oldest);
+		mon_unlink(oldest);
+		mon_free_entry(oldest);
+		mon_data.mru_aged++;
+	}
+	return done;
+}
+
+
+/*
+ * mon_fill_reserve - keep mru_incalloc entries on the free list
+ */
+static unsigned int
+mon_fill_reserve(
+	unsigned int	budget
+	)
+{
+	l_fp		now;
+	mon_entry *	oldest;
+	unsigned int	done = 0;
+
+	while (mon_data.mru_free < mon_data.mru_incalloc &&
+	       mru_alloc < mon_data.mru_maxdepth) {
+		mon_getmoremem();
+		if (0 == mon_data.mru_incalloc)
+			return done;
+	}
+	if (mon_data.mru_free >= mon_data.mru_incalloc ||
+	    mon_data.mru_entries <= mon_data.mru_mindepth)
+		return done;
+	get_systime(&now);
+	for (; done < budget; done++) {
+		if (mon_data.mru_free >= mon_data.mru_incalloc ||
+		    mon_data.mru_entries <= mon_data.mru_mindepth ||
+		    mon_get_oldest_age(now) < mon_data.mru_minage)
+			break;
+		oldest = TAIL_DLIST(mon_data.mon_mru_list, mru);
+		/* don't take from a partition with room to spare */
+		if (oldest->part->entries + mon_data.mru_incalloc <=
+		    oldest->part->maxdepth)
+			break;
+		mon_demote(oldest);
+		mon_unlink(oldest);
+		mon_free_entry(oldest);
+		mon_data.mru_evicted++;
+	}
+	return done;
+}
+
+
+/*
+ * mon_check - check hash slots from where the last call left off
  *
- * model name      : Intel(R) Xeon(R) CPU E5-2630 0 @ 2.30GHz
- * 19 May 11:58:05 ntpd[17475]: MON: Scanned 5439966 slots in 2.303
- * That's too long for normal usage.  (Was #ifdef DEBUG)
+ * Each entry costs one unit of budget, each slot one more.  The last
+ * slot is finished even if that goes over.  A pass is complete when
+ * the cursor wraps.  A new pass starts MON_CHECK_INTERVAL after the
+ * last one began, and only if a packet came in or an entry went away
+ * since then.  Walking the table is most of the cost on an idle server.
  */
-void mon_timer(void) {
-#if 0
-	long int count = 0, hits = 0;
-	l_fp when = 0;
-	mon_entry *mon, *slot;
-	struct timespec start, finish;
-	float scan_time;
-
-	clock_gettime(CLOCK_MONOTONIC, &start);
-	for (	mon = TAIL_DLIST(mon_data.mon_mru_list, mru);
-		mon != NULL;
-		mon = PREV_DLIST(mon_data.mon_mru_list, mon, mru)) {
-	  count++;
-	  /* check if lookup of addr gets this slot */
-	  slot = mon_get_slot(&mon->rmtadr);
-	  if (mon != slot) {
-	    if (10 > hits++) {
-	      if (NULL == slot)
-	        msyslog(LOG_INFO, "MON: Can't find %ld, %s",
-		  count, sockporttoa(&mon->rmtadr));
-	      else
-	        msyslog(LOG_INFO, "MON: Wrong find %ld, %s",
-		  count, sockporttoa(&mon->rmtadr));
-	    }
-	  }
-	  /* check if time stamps are ordered */
-	  if (when > mon->last) {
-	    if (10 > hits++) {
-	      if (NULL == slot)
-	        msyslog(LOG_INFO, "MON: backwards %ld, 0x%08x.%08x 0x%08x.%08x %s",
-		  count,
-		  (unsigned int)lfpuint(mon->last),
-		  (unsigned int)lfpfrac(mon->last),
-		  (unsigned int)lfpuint(when),
-		  (unsigned int)lfpfrac(when),
-		  sockporttoa(&mon->rmtadr) );
-	    }
-	  }
-	  when = mon->last;
+static unsigned int
+mon_check(
+	unsigned int	budget
+	)
+{
+	mon_entry *	mon;
+	unsigned int	done = 0;
+
+	if (check_slot >= MON_HASH_SLOTS)
+		check_slot = 0;
+	while (done < budget) {
+		if (0 == check_slot) {
+			if (!check_dirty || (0 < mon_data.mru_checkpasses &&
+			    current_time - check_started < MON_CHECK_INTERVAL))
+				break;
+			check_dirty = false;
+			check_started = current_time;
+		}
+		mon = mon_data.mon_hash[check_slot];
+		done++;
+		for (; mon != NULL; mon = mon->hash_next) {
+			mon_check_entry(mon, check_slot);
+			done++;
+		}
+		if (++check_slot >= MON_HASH_SLOTS) {
+			check_slot = 0;
+			check_complaints = 0;
+			mon_data.mru_checkpasses++;
+		}
 	}
-	clock_gettime(CLOCK_MONOTONIC, &finish);
-	scan_time = tspec_to_d(sub_tspec(finish, start));
-	if (count == (long)mon_data.mru_entries)
-	    msyslog(LOG_INFO, "MON: Scanned %ld slots in %.3f",
-		count, scan_time);
-	else
-	    msyslog(LOG_ERR, "MON: Scan found %ld slots, expected %ld",
-		count, (long)mon_data.mru_entries);
-#endif
+	mon_data.mru_checked += done;
+	return done;
 }
 
+
+/*
+ * mon_check_entry - the tests the old full scan made, one entry at a time
+ */
+static void
+mon_check_entry(
+	mon_entry *	mon,
+	unsigned int	slot
+	)
+{
+	const char *	what = NULL;
+	int		level = LOG_ERR;
+	mon_entry *	older;
+	mon_entry *	other;
+
+	older = mon->mru.f;
+	if (older == &mon_data.mon_mru_list)
+		older = NULL;
+	if (MON_HASH(&mon->rmtadr) != slot)
+		what = "in wrong hash slot";
+	else if (0 == mon->last)
+		what = "never used";
+	else if (mon->mru.f->mru.b != mon || mon->mru.b->mru.f != mon)
+		what = "MRU links broken";
+	else if (NULL == mon->part || mon->plist.f->plist.b != mon ||
+		 mon->plist.b->plist.f != mon)
+		what = "partition links broken";
+	else if (older != NULL && older->last > mon->last) {
+		/* a backward clock step does this with nothing wrong */
+		what = "newer than the entry before it";
+		level = LOG_DEBUG;
+	} else if (older != NULL && mon_get_slot(&older->rmtadr) != older)
+		what = "next entry not found";
+	else
+		for (other = mon->hash_next; other != NULL;
+		     other = other->hash_next)
+			if (SOCK_EQ(&other->rmtadr, &mon->rmtadr)) {
+				what = "duplicated";
+				break;
+			}
+	if (NULL == what)
+		return;
+	mon_data.mru_checkerrors++;
+	if (10 > check_complaints++)
+		msyslog(level, "MON: MRU entry %s %s",
+			sockporttoa(&mon->rmtadr), what);
+}
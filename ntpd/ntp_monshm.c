@@ -0,0 +1,517 @@
+/*
+ * ntp_monshm.c - MRU rate-limit state shared between ntpd processes
+ *
+ * Several ntpd processes serving one host (behind SO_REUSEPORT, or
+ * one per address) each keep their own MRU list, so a client spread
+ * across them gets a rate budget from each and ntpq sees a part of
+ * the picture from each.  With "mrushare PATH" they also map a table
+ * from PATH that holds the per-address rate state: score, packet and
+ * drop counts, first and last times.  ntp_monitor() limits on the
+ * shared score, and "mrulist shared" reads the whole table.
+ *
+ * The table is set associative: an address hashes to one set of
+ * MONSHM_WAYS slots and lives in one of them or nowhere.  Each
+ * MONSHM_STRIPE sets share a process-shared robust mutex, so a
+ * process that dies holding one doesn't wedge the rest.
+ *
+ * Ownership: slots belong to the table, not to a process.  Under its
+ * set's lock any process may take a slot that is empty or, failing
+ * that, the least recently used one in the set if it is older than
+ * mru_minage.  Nothing else frees or moves a slot, and what happens in
+ * the table never touches a process's own MRU list.  The process that
+ * creates the file sizes the table from its mru maxdepth; the others
+ * use the size they find.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ntpd.h"
+#include "ntp_stdlib.h"
+
+#define MONSHM_MAGIC	0x4d52554dU	/* "MRUM" */
+#define MONSHM_VERSION	1
+#define MONSHM_WAYS	8		/* slots per set */
+#define MONSHM_STRIPE	64		/* sets per lock */
+#define MONSHM_MINSETS	64
+#define MONSHM_WAIT	200		/* 10 ms naps for the creator */
+
+struct monshm_slot {
+	sockaddr_u	addr;		/* remote address and last port */
+	sockaddr_u	laddr;		/* local address it last came to */
+	l_fp		first;		/* first time seen */
+	l_fp		last;		/* last time seen, 0 if unused */
+	uint32_t	count;		/* packets, all processes */
+	uint32_t	dropped;	/* packets rate limited */
+	float		score;		/* recent packets/second */
+	unsigned short	flags;		/* restrict flags, last packet */
+	uint8_t		vn_mode;	/* mode and version, last packet */
+};
+
+struct monshm_hdr {
+	uint32_t	magic;		/* written last, by the creator */
+	uint32_t	version;
+	uint32_t	slot_size;	/* sizeof(struct monshm_slot) */
+	uint32_t	set_bits;	/* log2 of the number of sets */
+	uint32_t	locks;		/* mutexes */
+	uint32_t	pad;
+	uint64_t	used;		/* slots in use */
+};
+
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+static struct monshm_hdr *	shm;		/* the mapping */
+static size_t			shm_size;
+static pthread_mutex_t *	shm_locks;
+static struct monshm_slot *	shm_slots;
+#endif
+
+struct monshm_stats monshm_stats;
+
+#define LOCK_SPACE(n)	(((n) * sizeof(pthread_mutex_t) + 63) & ~(size_t)63)
+
+
+/*
+ * monshm_size - bytes of file for a table with sets and locks
+ */
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+static size_t
+monshm_size(
+	unsigned int	set_bits,
+	unsigned int	locks
+	)
+{
+	return LOCK_SPACE(1) + LOCK_SPACE(locks) +
+	       ((size_t)MONSHM_WAYS << set_bits) * sizeof(struct monshm_slot);
+}
+
+
+static void
+monshm_map(
+	void *	base,
+	size_t	size
+	)
+{
+	shm = base;
+	shm_size = size;
+	shm_locks = (void *)((char *)base + LOCK_SPACE(1));
+	shm_slots = (void *)((char *)shm_locks + LOCK_SPACE(shm->locks));
+	monshm_stats.slots = (uint64_t)MONSHM_WAYS << shm->set_bits;
+}
+
+
+/*
+ * monshm_create - size and initialize a new table in fd
+ */
+static bool
+monshm_create(
+	int		fd,
+	uint64_t	maxdepth
+	)
+{
+	pthread_mutexattr_t attr;
+	struct monshm_hdr *hdr;
+	unsigned int	set_bits;
+	unsigned int	locks;
+	size_t		size;
+	void *		base;
+	unsigned int	i;
+
+	/* about twice maxdepth slots */
+	for (set_bits = 0;
+	     ((uint64_t)MONSHM_WAYS << set_bits) < 2 * maxdepth ||
+	     (1U << set_bits) < MONSHM_MINSETS;
+	     set_bits++)
+		continue;
+	set_bits = min(set_bits, 24);
+	locks = max(1, (1U << set_bits) / MONSHM_STRIPE);
+	size = monshm_size(set_bits, locks);
+	if (ftruncate(fd, (off_t)size) < 0)
+		return false;
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == base)
+		return false;
+
+	hdr = base;
+	hdr->version = MONSHM_VERSION;
+	hdr->slot_size = sizeof(struct monshm_slot);
+	hdr->set_bits = set_bits;
+	hdr->locks = locks;
+	monshm_map(base, size);
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	for (i = 0; i < locks; i++)
+		pthread_mutex_init(&shm_locks[i], &attr);
+	pthread_mutexattr_destroy(&attr);
+	__atomic_store_n(&hdr->magic, MONSHM_MAGIC, __ATOMIC_RELEASE);
+	return true;
+}
+
+
+/*
+ * monshm_attach - map the table another process made in fd
+ */
+static bool
+monshm_attach(
+	int		fd,
+	const char *	path
+	)
+{
+	struct monshm_hdr hdr;
+	struct stat	st;
+	void *		base;
+	int		tries;
+
+	for (tries = 0; ; tries++) {
+		if (fstat(fd, &st) < 0) {
+			msyslog(LOG_ERR, "MON: mrushare %s: %s", path,
+				strerror(errno));
+			return false;
+		}
+		if ((size_t)st.st_size >= sizeof(hdr) &&
+		    sizeof(hdr) == pread(fd, &hdr, sizeof(hdr), 0) &&
+		    MONSHM_MAGIC == hdr.magic)
+			break;
+		if (tries >= MONSHM_WAIT) {
+			msyslog(LOG_ERR, "MON: mrushare %s: never "
+				"initialized, remove it", path);
+			return false;
+		}
+		usleep(10000);
+	}
+	if (MONSHM_VERSION != hdr.version ||
+	    sizeof(struct monshm_slot) != hdr.slot_size ||
+	    hdr.set_bits > 24 || 0 == hdr.locks ||
+	    monshm_size(hdr.set_bits, hdr.locks) != (size_t)st.st_size) {
+		msyslog(LOG_ERR, "MON: mrushare %s: made by a different "
+			"ntpd, remove it", path);
+		return false;
+	}
+	base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	if (MAP_FAILED == base) {
+		msyslog(LOG_ERR, "MON: mrushare %s: %s", path,
+			strerror(errno));
+		return false;
+	}
+	monshm_map(base, (size_t)st.st_size);
+	return true;
+}
+#endif	/* HAVE_PTHREAD_MUTEXATTR_SETROBUST */
+
+
+/*
+ * monshm_open - share rate-limit state through the table at path,
+ *		 creating it if need be.  Called once, before the
+ *		 sandbox is set up.
+ */
+bool
+monshm_open(
+	const char *	path,
+	uint64_t	maxdepth
+	)
+{
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+	bool	ok;
+	int	fd;
+
+	if (NULL != shm)
+		return true;
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd >= 0) {
+		ok = monshm_create(fd, maxdepth);
+		if (!ok) {
+			msyslog(LOG_ERR, "MON: mrushare %s: %s", path,
+				strerror(errno));
+			unlink(path);
+		}
+	} else if (EEXIST == errno &&
+		   (fd = open(path, O_RDWR | O_CLOEXEC)) >= 0) {
+		ok = monshm_attach(fd, path);
+	} else {
+		msyslog(LOG_ERR, "MON: mrushare %s: %s", path,
+			strerror(errno));
+		ok = false;
+	}
+	if (fd >= 0)
+		close(fd);
+	if (ok)
+		msyslog(LOG_INFO, "MON: mrushare %s, %llu slots", path,
+			(unsigned long long)monshm_stats.slots);
+	return ok;
+#else
+	UNUSED_ARG(maxdepth);
+	msyslog(LOG_ERR, "MON: mrushare %s: no process-shared robust "
+		"mutexes on this system", path);
+	return false;
+#endif
+}
+
+
+bool
+monshm_active(void)
+{
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+	return NULL != shm;
+#else
+	return false;
+#endif
+}
+
+
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+/*
+ * monshm_set - first slot of the set for addr, and its lock
+ */
+static struct monshm_slot *
+monshm_set(
+	const sockaddr_u *	addr,
+	pthread_mutex_t **	lock
+	)
+{
+	unsigned int	set;
+
+	set = shm->set_bits
+		  ? (sock_hash(addr) * 0x9e3779b1U) >> (32 - shm->set_bits)
+		  : 0;
+	*lock = &shm_locks[set % shm->locks];
+	return &shm_slots[(size_t)set * MONSHM_WAYS];
+}
+
+
+/*
+ * monshm_lock - a process that died holding the lock may have left a
+ *		 slot half written; every field is usable on its own,
+ *		 so carry on.
+ */
+static void
+monshm_lock(
+	pthread_mutex_t *	lock
+	)
+{
+	if (EOWNERDEAD == pthread_mutex_lock(lock)) {
+		pthread_mutex_consistent(lock);
+		monshm_stats.recovered++;
+	}
+}
+#endif
+
+
+/*
+ * monshm_touch - count a packet from mon->rmtadr in the shared table
+ *
+ * Decays and bumps the shared score, copies it to mon->score and
+ * returns flags masked as ntp_monitor() would for that score.  With
+ * no slot to be had, the process's own score decides.
+ */
+unsigned short
+monshm_touch(
+	mon_entry *		mon,
+	const struct mon_part *	part,
+	unsigned short		flags
+	)
+{
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+	pthread_mutex_t *	lock;
+	struct monshm_slot *	set;
+	struct monshm_slot *	slot;
+	struct monshm_slot *	oldest;
+	unsigned short		mask;
+	float			since_last;
+	int			i;
+
+	set = monshm_set(&mon->rmtadr, &lock);
+	monshm_lock(lock);
+	slot = oldest = NULL;
+	for (i = 0; i < MONSHM_WAYS; i++) {
+		if (0 == set[i].last) {
+			if (NULL == oldest || 0 != oldest->last)
+				oldest = &set[i];
+		} else if (SOCK_EQ(&set[i].addr, &mon->rmtadr)) {
+			slot = &set[i];
+			break;
+		} else if (NULL == oldest || set[i].last < oldest->last)
+			oldest = &set[i];
+	}
+	if (slot != NULL) {
+		monshm_stats.hits++;
+		since_last = ldexpf((int64_t)(mon->last - slot->last), -32);
+		if (since_last > 0)
+			slot->score *= expf(-since_last / part->decay_time);
+		slot->score += 1.0f / part->decay_time;
+		slot->count++;
+	} else if (oldest != NULL &&
+		   (0 == oldest->last ||
+		    lfpsint(mon->last - oldest->last) > mon_data.mru_minage)) {
+		if (0 == oldest->last) {
+			monshm_stats.new++;
+			__atomic_fetch_add(&shm->used, 1, __ATOMIC_RELAXED);
+		} else
+			monshm_stats.recycled++;
+		slot = oldest;
+		ZERO(*slot);
+		slot->first = mon->last;
+		slot->score = 1.0f / part->decay_time;
+		slot->count = 1;
+	} else {
+		pthread_mutex_unlock(lock);
+		monshm_stats.none++;
+		return mon_rate_mask(mon->score, part, flags);
+	}
+	slot->addr = mon->rmtadr;
+	if (mon->lcladr != NULL)
+		slot->laddr = mon->lcladr->sin;
+	slot->last = max(slot->last, mon->last);
+	slot->vn_mode = mon->vn_mode;
+	mask = mon_rate_mask(slot->score, part, flags);
+	if (RES_LIMITED & mask)
+		slot->dropped++;
+	slot->flags = mask;
+	mon->score = slot->score;
+	pthread_mutex_unlock(lock);
+	return mask;
+#else
+	return mon_rate_mask(mon->score, part, flags);
+#endif
+}
+
+
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+static void
+monshm_row(
+	struct monshm_row *		row,
+	const struct monshm_slot *	slot
+	)
+{
+	ZERO(*row);
+	row->mon.rmtadr = slot->addr;
+	row->mon.first = slot->first;
+	row->mon.last = slot->last;
+	row->mon.count = (int)slot->count;
+	row->mon.dropped = slot->dropped;
+	row->mon.score = slot->score;
+	row->mon.flags = slot->flags;
+	row->mon.vn_mode = slot->vn_mode;
+	row->laddr = slot->laddr;
+}
+
+
+static int
+monshm_row_cmp(
+	const void *	a,
+	const void *	b
+	)
+{
+	const struct monshm_row *ra = a;
+	const struct monshm_row *rb = b;
+
+	if (ra->mon.last != rb->mon.last)
+		return (ra->mon.last < rb->mon.last) ? -1 : 1;
+	return memcmp(&ra->mon.rmtadr, &rb->mon.rmtadr,
+		      sizeof(ra->mon.rmtadr));
+}
+#endif
+
+
+/*
+ * monshm_snapshot - copy the used slots, oldest first, into a new
+ *		     array for mrulist.  Returns how many; free() the
+ *		     array when done.
+ */
+size_t
+monshm_snapshot(
+	struct monshm_row **	rows
+	)
+{
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+	struct monshm_row *	out;
+	size_t			room;
+	size_t			n;
+	size_t			sets;
+	size_t			set;
+	int			i;
+
+	*rows = NULL;
+	if (NULL == shm)
+		return 0;
+	/* more may be taken while we copy; they'll wait for next time */
+	room = __atomic_load_n(&shm->used, __ATOMIC_RELAXED);
+	if (0 == room)
+		return 0;
+	out = eallocarray(room, sizeof(*out));
+	sets = (size_t)1 << shm->set_bits;
+	for (set = 0, n = 0; set < sets && n < room; set++) {
+		pthread_mutex_t *lock = &shm_locks[set % shm->locks];
+		struct monshm_slot *slot = &shm_slots[set * MONSHM_WAYS];
+
+		monshm_lock(lock);
+		for (i = 0; i < MONSHM_WAYS && n < room; i++)
+			if (slot[i].last != 0)
+				monshm_row(&out[n++], &slot[i]);
+		pthread_mutex_unlock(lock);
+	}
+	qsort(out, n, sizeof(*out), monshm_row_cmp);
+	*rows = out;
+	return n;
+#else
+	*rows = NULL;
+	return 0;
+#endif
+}
+
+
+/*
+ * monshm_get - the table's entry for addr, if it has one
+ */
+bool
+monshm_get(
+	const sockaddr_u *	addr,
+	struct monshm_row *	row
+	)
+{
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+	pthread_mutex_t *	lock;
+	struct monshm_slot *	set;
+	bool			found = false;
+	int			i;
+
+	if (NULL == shm)
+		return false;
+	set = monshm_set(addr, &lock);
+	monshm_lock(lock);
+	for (i = 0; i < MONSHM_WAYS; i++)
+		if (set[i].last != 0 && SOCK_EQ(&set[i].addr, addr)) {
+			monshm_row(row, &set[i]);
+			found = true;
+			break;
+		}
+	pthread_mutex_unlock(lock);
+	return found;
+#else
+	UNUSED_ARG(addr);
+	UNUSED_ARG(row);
+	return false;
+#endif
+}
+
+
+/*
+ * monshm_used - slots in use, all processes
+ */
+uint64_t
+monshm_used(void)
+{
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+	if (NULL != shm)
+		return __atomic_load_n(&shm->used, __ATOMIC_RELAXED);
+#endif
+	return 0;
+}
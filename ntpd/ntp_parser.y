@@ -61,8 +61,10 @@
 %token	<Integer>	T_Baud
 %token	<Integer>	T_Bias
 %token	<Integer>	T_Burst
+%token	<Integer>	T_Busypoll
 %token	<Integer>	T_Calibrate
 %token	<Integer>	T_Ca
+%token	<Integer>	T_Capture
 %token	<Integer>	T_Ceiling
 %token	<Integer>	T_Cert
 %token	<Integer>	T_Clock
@@ -70,6 +72,8 @@
 %token	<Integer>	T_Cohort
 %token	<Integer>	T_Cookie
 %token	<Integer>	T_ControlKey
+%token	<Integer>	T_Controlsocket
+%token	<Integer>	T_Cpu
 %token	<Integer>	T_Ctl
 %token	<Integer>	T_Day
 %token	<Integer>	T_Default
@@ -86,6 +90,7 @@
 %token	<Integer>	T_End
 %token	<Integer>	T_False
 %token	<Integer>	T_File
+%token	<Integer>	T_Files
 %token	<Integer>	T_Filegen
 %token	<Integer>	T_Filenum
 %token	<Integer>	T_Flag1
@@ -99,6 +104,7 @@
 %token	<Integer>	T_Huffpuff
 %token	<Integer>	T_Iburst
 %token	<Integer>	T_Ignore
+%token	<Integer>	T_Coldmem
 %token	<Integer>	T_Incalloc
 %token	<Integer>	T_Incmem
 %token	<Integer>	T_Initalloc
@@ -113,9 +119,13 @@
 %token	<Integer>	T_Ipv6
 %token	<Integer>	T_Ipv6_flag
 %token	<Integer>	T_Kernel
+%token	<Integer>	T_Keprefixrate
+%token	<Integer>	T_Kequeue
+%token	<Integer>	T_Kerate
 %token	<Integer>	T_Key
 %token	<Integer>	T_Keys
 %token	<Integer>	T_Kod
+%token	<Integer>	T_Kodrate
 %token	<Integer>	T_Mssntp
 %token	<Integer>	T_Leapfile
 %token	<Integer>	T_Leapsmearinterval
@@ -134,6 +144,7 @@
 %token	<Integer>	T_Maxdist
 %token	<Integer>	T_Maxmem
 %token	<Integer>	T_Maxpoll
+%token	<Integer>	T_Maxsize
 %token	<Integer>	T_Maxtls
 %token	<Integer>	T_Mdnstries
 %token	<Integer>	T_Mem
@@ -149,6 +160,7 @@
 %token	<Integer>	T_Monitor
 %token	<Integer>	T_Month
 %token	<Integer>	T_Mru
+%token	<Integer>	T_Mrushare
 %token	<Integer>	T_Nic
 %token	<Integer>	T_Nolink
 %token	<Integer>	T_Nomodify
@@ -170,6 +182,7 @@
 %token	<Integer>	T_Ntskestats
 %token	<Integer>	T_Orphan
 %token	<Integer>	T_Orphanwait
+%token	<Integer>	T_Pace
 %token	<Integer>	T_Panic
 %token	<Integer>	T_Path
 %token	<Integer>	T_Peer
@@ -181,6 +194,7 @@
 %token	<Integer>	T_Port
 %token	<Integer>	T_Ppspath
 %token	<Integer>	T_Prefer
+%token	<Integer>	T_Priority
 %token	<Integer>	T_Protostats
 %token	<Integer>	T_Rawstats
 %token	<Integer>	T_Refclock
@@ -190,9 +204,11 @@
 %token	<Integer>	T_Reset
 %token	<Integer>	T_Restrict
 %token	<Integer>	T_Rlimit
+%token	<Integer>	T_Sample
 %token	<Integer>	T_Saveconfigdir
 %token	<Integer>	T_Server
 %token	<Integer>	T_Setvar
+%token	<Integer>	T_Sockpoll
 %token	<Integer>	T_Source
 %token	<Integer>	T_Stacksize
 %token	<Integer>	T_Statistics
@@ -218,6 +234,7 @@
 %token	<Integer>	T_Tos
 %token	<Integer>	T_True
 %token	<Integer>	T_Trustedkey
+%token	<Integer>	T_Tsc
 %token	<Integer>	T_Type
 %token	<Integer>	T_U_int			/* Not a token */
 %token	<Integer>	T_Unit
@@ -239,6 +256,9 @@
 %type	<Address_node>	address
 %type	<Integer>	address_fam
 %type	<Integer>	boolean
+%type	<Attr_val>	busypoll_option
+%type	<Integer>	busypoll_option_keyword
+%type	<Attr_val_fifo>	busypoll_option_list
 %type	<Integer>	client_type
 %type	<Integer>	counter_set_keyword
 %type	<Int_fifo>	counter_set_list
@@ -250,6 +270,9 @@
 %type	<Attr_val>	extra_option
 %type	<Attr_val_fifo>	extra_option_list
 %type	<Attr_val>	filegen_option
+%type	<Attr_val>	capture_option
+%type	<Integer>	capture_option_keyword
+%type	<Attr_val_fifo>	capture_option_list
 %type	<Attr_val_fifo>	filegen_option_list
 %type	<Integer>	filegen_type
 %type	<Attr_val>	fudge_factor
@@ -304,6 +327,7 @@
 %type	<Attr_val_fifo>	tinker_option_list
 %type	<Integer>	nts_string_option_keyword
 %type	<Integer>	nts_number_option_keyword
+%type	<Integer>	nts_dbl_option_keyword
 %type	<Attr_val>	nts_option
 %type	<Attr_val_fifo>	nts_option_list
 %type	<Attr_val>	tos_option
@@ -355,6 +379,7 @@ command :	/* NULL STATEMENT */
 	|	fudge_command
 	|	refclock_command
 	|	rlimit_command
+	|	busypoll_command
 	|	system_option_command
 	|	extra_command
 	|	tinker_command
@@ -613,6 +638,7 @@ tos_option_dbl_keyword
 	|	T_Maxdist
 	|	T_Minclock
 	|	T_Maxclock
+	|	T_Pace
 	;
 
 
@@ -639,6 +665,39 @@ monitoring_command
 			fgn = create_filegen_node($2, $3);
 			APPEND_G_FIFO(cfgt.filegen_opts, fgn);
 		}
+	|	T_Capture T_File T_String capture_option_list
+		{
+			if (lex_from_file()) {
+				APPEND_G_FIFO(cfgt.capture,
+					      create_attr_sval($2, $3));
+				CONCAT_G_FIFOS(cfgt.capture, $4);
+			} else {
+				YYFREE($3);
+				destroy_attr_val_fifo($4);
+				yyerror("capture remote configuration ignored");
+			}
+		}
+	;
+
+capture_option_list
+	:	/* empty list */
+			{ $$ = NULL; }
+	|	capture_option_list capture_option
+		{
+			$$ = $1;
+			APPEND_G_FIFO($$, $2);
+		}
+	;
+
+capture_option
+	:	capture_option_keyword T_Integer
+			{ $$ = create_attr_ival($1, $2); }
+	;
+
+capture_option_keyword
+	:	T_Files
+	|	T_Maxsize
+	|	T_Sample
 	;
 
 stats_list
@@ -750,6 +809,13 @@ access_control_command
 		{
 			CONCAT_G_FIFOS(cfgt.limit_opts, $2);
 		}
+	|	T_Limit T_Interface ip_address limit_option_list
+		{
+			addr_opts_node *aon;
+
+			aon = create_addr_opts_node($3, $4);
+			APPEND_G_FIFO(cfgt.limit_parts, aon);
+		}
 	|	T_Mru mru_option_list
 		{
 			CONCAT_G_FIFOS(cfgt.mru_opts, $2);
@@ -868,6 +934,8 @@ limit_option_keyword
 	:	T_Average
 	|	T_Burst
 	|	T_Kod
+	|	T_Kodrate
+	|	T_Maxdepth
 	;
 
 mru_option_list
@@ -889,7 +957,8 @@ mru_option
 	;
 
 mru_option_keyword
-	:	T_Incalloc
+	:	T_Coldmem
+	|	T_Incalloc
 	|	T_Incmem
 	|	T_Initalloc
 	|	T_Initmem
@@ -1015,6 +1084,45 @@ rlimit_option_keyword
 	;
 
 
+/* busypoll Commands
+ * -----------------
+ */
+
+busypoll_command
+	:	T_Busypoll busypoll_option_list
+		{
+			/* options without the marker are freed unused */
+			if (lex_from_file())
+				APPEND_G_FIFO(cfgt.busypoll,
+					      create_attr_ival($1, 1));
+			else
+				yyerror("busypoll remote configuration ignored");
+			CONCAT_G_FIFOS(cfgt.busypoll, $2);
+		}
+	;
+
+busypoll_option_list
+	:	/* empty list */
+			{ $$ = NULL; }
+	|	busypoll_option_list busypoll_option
+		{
+			$$ = $1;
+			APPEND_G_FIFO($$, $2);
+		}
+	;
+
+busypoll_option
+	:	busypoll_option_keyword T_Integer
+			{ $$ = create_attr_ival($1, $2); }
+	;
+
+busypoll_option_keyword
+	:	T_Cpu
+	|	T_Priority
+	|	T_Sockpoll
+	;
+
+
 /* Command for System Options
  * --------------------------
  */
@@ -1063,6 +1171,7 @@ system_option_flag_keyword
 	|	T_Kernel
 	|	T_Monitor
 	|	T_Ntp
+	|	T_Tsc
 	;
 
 system_option_local_flag_keyword
@@ -1168,6 +1277,8 @@ nts_option
 			{ $$ = create_attr_sval($1, $2); }
 	|	nts_number_option_keyword number
 			{ $$ = create_attr_ival($1, $2); }
+	|	nts_dbl_option_keyword number
+			{ $$ = create_attr_dval($1, $2); }
 	|	T_Disable
 			{ $$ = create_attr_ival($1, 0); }
 	|	T_Enable
@@ -1193,7 +1304,13 @@ nts_string_option_keyword
 	;
 
 nts_number_option_keyword
-	:	T_Port
+	:	T_Kequeue
+	|	T_Port
+	;
+
+nts_dbl_option_keyword
+	:	T_Keprefixrate
+	|	T_Kerate
 	;
 
 /* Miscellaneous Commands
@@ -1294,7 +1411,9 @@ misc_cmd_str_keyword
 	;
 
 misc_cmd_str_lcl_keyword
-	:	T_Logfile
+	:	T_Controlsocket
+	|	T_Logfile
+	|	T_Mrushare
 	|	T_Pidfile
 	|	T_Saveconfigdir
 	;
@@ -113,7 +113,7 @@ getmorepeermem(void)
 	int i;
 	struct peer *peers;
 
-	peers = emalloc_zero(INC_PEER_ALLOC * sizeof(*peers));
+	peers = etallocarray(MEM_PEER, INC_PEER_ALLOC, sizeof(*peers));
 
 	for (i = INC_PEER_ALLOC - 1; i >= 0; i--)
 		LINK_SLIST(peer_free, &peers[i], p_link);
@@ -403,6 +403,9 @@ free_peer(
 
 	if (p->hostname != NULL)
 		free(p->hostname);
+#ifndef DISABLE_NTS
+	nts_free_cookies(&p->nts_state);
+#endif
 
 	/* Add his corporeal form to peer free list */
 	ZERO(*p);
@@ -420,6 +423,7 @@ unpeer(
 	)
 {
 	mprintf_event(PEVNT_DEMOBIL, peer, "assoc %u", peer->associd);
+	peers_gone_gen = ++change_gen;
 	unrestrict_source(peer);
 	set_peerdstadr(peer, NULL);
 	peer_demobilizations++;
@@ -466,6 +470,7 @@ set_peerdstadr(
 		LINK_SLIST(dstadr->peers, p, ilink);
 		dstadr->peercnt++;
 	}
+	peer_changed(p);
 }
 
 /*
@@ -610,6 +615,7 @@ newpeer(
 	peer->associd = current_association_ID;
 	if (++current_association_ID == 0)
 		++current_association_ID;
+	peer->phase = (uint16_t)random();
 
 	peer->srcadr = *srcadr;
 	if (hostname != NULL)
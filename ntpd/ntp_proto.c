@@ -11,9 +11,11 @@
 #include "ntp_leapsec.h"
 #include "ntp_dns.h"
 #include "ntp_auth.h"
+#include "ntp_probe.h"
 #include "timespecops.h"
 
 #include <string.h>
+#include <netdb.h>
 #include <stdio.h>
 #ifdef HAVE_LIBSCF_H
 #include <libscf.h>
@@ -113,6 +115,14 @@ bool leap_sec_in_progress;
  * packets. A packet is delayed as long as the counter is greater than
  * zero. Note this does not affect the time value computations.
  */
+/*
+ * Outbound KoD bucket.  The MRU score holds each source to its limit,
+ * this caps the total so a flood from many (spoofed) sources can't
+ * turn us into a KoD generator.  Refilled lazily from current_time.
+ */
+static double	kod_tokens;
+static uptime_t	kod_stamp;
+
 /*
  * Nonspecified system state variables
  */
@@ -128,6 +138,19 @@ static	unsigned long	leapsec;	/* seconds to next leap (proximity class) */
 int	peer_ntpdate;		/* active peers in ntpdate mode */
 static int sys_survivors;		/* truest of the truechimers */
 
+/*
+ * Change generations, so a monitor can ask for just the associations
+ * that changed since it last looked (read_changes() in ntp_control.c).
+ * One counter numbers every change; the system and each peer keep
+ * the number of their latest.  Each boot starts the counter at a
+ * random epoch in the top half, so a generation from before a restart
+ * is out of range rather than matching an unrelated change.
+ */
+uint64_t	gen_epoch;
+uint64_t	change_gen;
+uint64_t	sys_gen;
+uint64_t	peers_gone_gen;
+
 /*
  * TOS and multicast mapping stuff
  */
@@ -155,6 +178,10 @@ struct statistics_counters {
 	uint64_t	sys_declined;		/* declined */
 	uint64_t	sys_limitrejected;	/* rate exceeded */
 	uint64_t	sys_kodsent;		/* KoD sent */
+	uint64_t	sys_kodsuppressed;	/* KoD bucket empty */
+	uint64_t	sys_pooltaken;		/* pool associations made */
+	uint64_t	sys_poolskipped;	/* pool addresses in use */
+	uint64_t	sys_pooldropped;	/* pool associations timed out */
 };
 volatile struct statistics_counters stat_proto_hourago, stat_proto_total;
 uptime_t	sys_stattime;		/* time since sysstats "reset" */
@@ -193,6 +220,10 @@ stat_sys_dumps(badauth)
 stat_sys_dumps(declined)
 stat_sys_dumps(limitrejected)
 stat_sys_dumps(kodsent)
+stat_sys_dumps(kodsuppressed)
+stat_sys_dumps(pooltaken)
+stat_sys_dumps(poolskipped)
+stat_sys_dumps(pooldropped)
 
 #undef stat_sys_dumps
 
@@ -215,12 +246,16 @@ static	void	clock_combine	(peer_select *, int, int);
 static	void	clock_select	(void);
 static	void	clock_update	(struct peer *);
 static	void	fast_xmit	(struct recvbuf *, auth_info*, int);
+static	bool	kod_take_token	(void);
+static	void	kod_xmit	(struct recvbuf *);
 static	int	local_refid	(struct peer *);
 static	void	peer_xmit	(struct peer *);
 static	int	peer_unfit	(struct peer *);
+static	void	peer_set_status	(struct peer *);
 static	double	root_distance	(struct peer *);
 #ifndef DISABLE_NTS
 static	void	restart_nts_ke	(struct peer *);
+static	bool	nts_refresh_due	(struct peer *);
 #endif
 static	void	maybe_log_junk	(const char *tag, struct recvbuf *rbuf);
 
@@ -279,25 +314,21 @@ is_control_packet(
 }
 
 
-static bool
-parse_packet(
+/*
+ * parse_header - convert the wire header into rbufp->pkt.
+ *
+ * Only replies to our requests need this.  Serving a client request
+ * touches three header fields, so fast_xmit() reads them in place
+ * with the rbuf_*() accessors instead.
+ */
+static void
+parse_header(
 	struct recvbuf * rbufp
 	)
 {
-	REQUIRE(rbufp != NULL);
-
-	size_t recv_length = rbufp->recv_length;
 	uint8_t const* recv_buf = rbufp->recv_buffer;
-
-	if(recv_length < LEN_PKT_NOMAC) {
-		/* Data is too short to possibly be a valid packet. */
-		return false;
-	}
-
 	struct parsed_pkt * pkt = &rbufp->pkt;
-	uint8_t const* bufptr = recv_buf + LEN_PKT_NOMAC;
 
-	/* Parse header fields */
 	pkt->li_vn_mode = recv_buf[0];
 	pkt->stratum = recv_buf[1];
 	pkt->ppoll = recv_buf[2];
@@ -309,6 +340,30 @@ parse_packet(
 	pkt->org = ntp_be64dec(recv_buf + 24);
 	pkt->rec = ntp_be64dec(recv_buf + 32);
 	pkt->xmt = ntp_be64dec(recv_buf + 40);
+}
+
+/*
+ * parse_packet - check the length and version and classify whatever
+ * follows the header: nothing, a MAC, or extensions.  The header
+ * itself is left on the wire; see parse_header().
+ */
+static bool
+parse_packet(
+	struct recvbuf * rbufp
+	)
+{
+	REQUIRE(rbufp != NULL);
+
+	size_t recv_length = rbufp->recv_length;
+	uint8_t const* recv_buf = rbufp->recv_buffer;
+
+	if(recv_length < LEN_PKT_NOMAC) {
+		/* Data is too short to possibly be a valid packet. */
+		return false;
+	}
+
+	uint8_t li_vn_mode = rbuf_li_vn_mode(rbufp);
+	uint8_t const* bufptr = recv_buf + LEN_PKT_NOMAC;
 
 	rbufp->keyid_present = false;
 	rbufp->keyid = 0;
@@ -317,10 +372,10 @@ parse_packet(
 	rbufp->extens_present = false;
 	rbufp->ntspacket.valid = false;
 
-	if(PKT_VERSION(pkt->li_vn_mode) > NTP_VERSION) {
+	if(PKT_VERSION(li_vn_mode) > NTP_VERSION) {
 		/* Unsupported version */
 		return false;
-	} else if(PKT_VERSION(pkt->li_vn_mode) == MODE_SERVER) {
+	} else if(PKT_VERSION(li_vn_mode) == MODE_SERVER) {
 		/* Only version 4 packets support extensions. */
 		/* But they also support shared key authentication. */
 		if (recv_length > (LEN_PKT_NOMAC+MAX_MAC_LEN)) {
@@ -339,7 +394,7 @@ parse_packet(
 		break;
 	    case 4:
 		/* crypto-NAK */
-		if(PKT_VERSION(pkt->li_vn_mode) < 3) {
+		if(PKT_VERSION(li_vn_mode) < 3) {
 			/* Only allowed as of NTPv3 */
 			return false;
 		}
@@ -350,14 +405,14 @@ parse_packet(
 	    case 6:
 		/* NTPv2 authenticator, which we allow but strip because
 		   we don't support it any more */
-		if(PKT_VERSION(pkt->li_vn_mode) != 2) { return false; }
+		if(PKT_VERSION(li_vn_mode) != 2) { return false; }
 		rbufp->keyid_present = false;
 		rbufp->keyid = 0;
 		rbufp->mac_len = 0;
 		break;
 	    case 20:
 		/* AES-128 CMAC, MD5 digest */
-		if(PKT_VERSION(pkt->li_vn_mode) < 3) {
+		if(PKT_VERSION(li_vn_mode) < 3) {
 			/* Only allowed as of NTPv3 */
 			return false;
 		}
@@ -367,7 +422,7 @@ parse_packet(
 		break;
 	    case 24:
 		/* SHA-1 digest */
-		if(PKT_VERSION(pkt->li_vn_mode) < 3) {
+		if(PKT_VERSION(li_vn_mode) < 3) {
 			/* Only allowed as of NTPv3 */
 			return false;
 		}
@@ -377,7 +432,7 @@ parse_packet(
 		break;
 	    case 72:
 		/* MS-SNTP */
-		if(PKT_VERSION(pkt->li_vn_mode) != 3) {
+		if(PKT_VERSION(li_vn_mode) != 3) {
 			/* Only allowed for NTPv3 */
 			return false;
 		}
@@ -465,6 +520,28 @@ static bool check_early_restrictions(
 	  );
 }
 
+/* Count the version of a request that is not a mode 6 query; those
+   intentionally use an early version.  A version newer than ours gets
+   past here but not past parse_packet().
+   return true to reject packet */
+static bool check_version(
+	struct recvbuf const* rbufp,
+	unsigned short restrict_mask
+	)
+{
+	uint8_t hisversion = PKT_VERSION(rbufp->recv_buffer[0]);
+	if (hisversion == NTP_VERSION) {
+		stat_proto_total.sys_newversion++;		/* new version */
+	} else if (!(restrict_mask & RES_VERSION) && hisversion >=
+	    NTP_OLDVERSION) {
+		stat_proto_total.sys_oldversion++;		/* previous version */
+	} else {
+		stat_proto_total.sys_badlength++;
+		return true;			/* old version */
+	}
+	return false;
+}
+
 /* rawstats_filter
  * Don't print all rejectioned packets or we could get DoSed.
  * Print the packet we use.
@@ -706,6 +783,7 @@ receive(
 	/* FIXME: This is lots more cleanup to do in this area. */
 
 	restrict_mask = restrictions(&rbufp->recv_srcadr);
+	NTP_PROBE(restrict, PROBE_ADDR(&rbufp->recv_srcadr), restrict_mask);
 
 	if(check_early_restrictions(rbufp, restrict_mask)) {
 		stat_proto_total.sys_restricted++;
@@ -713,13 +791,37 @@ receive(
 	}
 
 	restrict_mask = ntp_monitor(rbufp, restrict_mask);
+	NTP_PROBE(monitor, PROBE_ADDR(&rbufp->recv_srcadr), restrict_mask);
 	if (restrict_mask & RES_LIMITED) {
 		stat_proto_total.sys_limitrejected++;
 		if(!(restrict_mask & RES_KOD)) { return; }
+		/*
+		 * A plain client request gets its KoD straight from the
+		 * header bytes.  Requests with a MAC or extensions take
+		 * the long way: an unauthenticated KoD would be ignored.
+		 * So do notrust sources, which the long way drops as
+		 * badauth.
+		 */
+		if (PKT_MODE(rbufp->recv_buffer[0]) == MODE_CLIENT &&
+		    rbufp->recv_length == LEN_PKT_NOMAC &&
+		    !(restrict_mask & RES_NOTRUST)) {
+			/* only what the long way would have answered,
+			 * with the same counts */
+			if (check_version(rbufp, restrict_mask))
+				return;
+			if (PKT_VERSION(rbufp->recv_buffer[0]) >
+			    NTP_VERSION) {
+				stat_proto_total.sys_badlength++;
+				return;
+			}
+			kod_xmit(rbufp);
+			stat_proto_total.sys_processed++;
+			return;
+		}
 	}
 
 	if(is_control_packet(rbufp)) {
-		process_control(rbufp, restrict_mask);
+		ctl_queue_request(rbufp, restrict_mask);
 		stat_proto_total.sys_processed++;
 		return;
 	}
@@ -728,26 +830,17 @@ receive(
 	 * Version check must be after the query packets, since they
 	 * intentionally use an early version.
 	 */
-	{
-	uint8_t hisversion = PKT_VERSION(rbufp->recv_buffer[0]);
-	if (hisversion == NTP_VERSION) {
-		stat_proto_total.sys_newversion++;		/* new version */
-	} else if (!(restrict_mask & RES_VERSION) && hisversion >=
-	    NTP_OLDVERSION) {
-		stat_proto_total.sys_oldversion++;		/* previous version */
-	} else {
-		stat_proto_total.sys_badlength++;
-		return;			/* old version */
-	}
-	}
+	if (check_version(rbufp, restrict_mask))
+		return;
 
 	if (!parse_packet(rbufp)) {
 		stat_proto_total.sys_badlength++;
 		return;
 	}
 
-	mode = PKT_MODE(rbufp->pkt.li_vn_mode);
+	mode = PKT_MODE(rbuf_li_vn_mode(rbufp));
 	if (MODE_SERVER == mode) {
+	    parse_header(rbufp);
 	    /* Reply to our request:
 	     * Auth check breaks if we findpeer for MODE_CLIENT and
 	     * a site we are using as a server uses us as a server
@@ -802,6 +895,8 @@ receive(
 				 (int)(rbufp->recv_length - (rbufp->mac_len + 4)),
 				 (int)(rbufp->mac_len + 4))) {
 
+			NTP_PROBE(auth, PROBE_ADDR(&rbufp->recv_srcadr),
+				  rbufp->keyid, false);
 			stat_proto_total.sys_badauth++;
 			if(peer != NULL) {
 				peer->badauth++;
@@ -810,6 +905,8 @@ receive(
 			}
 			return;
 		}
+		NTP_PROBE(auth, PROBE_ADDR(&rbufp->recv_srcadr),
+			  rbufp->keyid, true);
 	}
 
 	switch (mode) {
@@ -928,6 +1025,7 @@ transmit(
 		peer->outdate = current_time;
 		peer->unreach++;
 		peer->reach <<= 1;
+		peer_changed(peer);
 		if (!peer->reach) {
 
 			/*
@@ -980,6 +1078,7 @@ transmit(
 			if ((peer->cfg.flags & FLAG_PREEMPT) &&
 			    (peer_associations > sys_maxclock) &&
 			    score_all(peer)) {
+				stat_proto_total.sys_pooldropped++;
 				report_event(PEVNT_RESTART, peer, "timeout");
 				peer_clear(peer, "TIME", false);
 				unpeer(peer);
@@ -1035,6 +1134,8 @@ clock_update(
 	 */
 	sys_vars.sys_peer = peer;
 	sys_epoch = peer->epoch;
+	sys_changed();
+	peer_changed(peer);
 	if (clkstate.sys_poll < peer->cfg.minpoll)
 		clkstate.sys_poll = peer->cfg.minpoll;
 	if (clkstate.sys_poll > peer->cfg.maxpoll)
@@ -1277,6 +1378,39 @@ poll_update(
 }
 
 
+/*
+ * peer_changed, sys_changed - note a change for monitors
+ */
+void
+peer_changed(
+	struct peer *peer
+	)
+{
+	peer->gen = ++change_gen;
+}
+
+void
+sys_changed(void)
+{
+	sys_gen = ++change_gen;
+}
+
+
+/*
+ * peer_set_status - take the selection status clock_select() chose
+ */
+static void
+peer_set_status(
+	struct peer *peer
+	)
+{
+	if (peer->status != peer->new_status) {
+		peer->status = peer->new_status;
+		peer_changed(peer);
+	}
+}
+
+
 /*
  * peer_clear - clear peer filter registers.  See Section 3.4.8 of the
  * spec.
@@ -1299,6 +1433,7 @@ peer_clear(
 	peer->disp = sys_maxdisp;
 	peer->flash = peer_unfit(peer);
 	peer->jitter = LOGTOD(sys_vars.sys_precision);
+	peer_changed(peer);
 
 	for (u = 0; u < NTP_SHIFT; u++) {
 		peer->filter_order[u] = u;
@@ -1363,6 +1498,10 @@ clock_filter(
 	double	dtemp, etemp, jtemp;
 	char	tbuf[80];
 
+	NTP_PROBE(filter, peer->associd, PROBE_NS(sample_offset),
+		  PROBE_NS(sample_delay), PROBE_NS(sample_disp));
+	peer_changed(peer);
+
 	/*
 	 * A sample consists of the offset, delay, dispersion and epoch
 	 * of arrival. The offset and delay are determined by the on-
@@ -2048,6 +2187,9 @@ clock_select(void)
 	 * system peer. If so and this is an old update, keep the
 	 * current statistics, but do not update the clock.
 	 */
+	NTP_PROBE(select, sys_survivors,
+		  (NULL == typesystem) ? 0 : typesystem->associd,
+		  PROBE_NS(clkstate.sys_offset), PROBE_NS(clkstate.sys_jitter));
 	if (typesystem == NULL) {
 		if (osys_peer != NULL) {
 			if (sys_orphwait > 0)
@@ -2056,7 +2198,7 @@ clock_select(void)
 		}
 		sys_vars.sys_peer = NULL;
 		for (peer = peer_list; peer != NULL; peer = peer->p_link)
-			peer->status = peer->new_status;
+			peer_set_status(peer);
 		return;
 	}
 
@@ -2073,7 +2215,7 @@ clock_select(void)
 	if (osys_peer != typesystem)
 		report_event(PEVNT_NEWPEER, typesystem, NULL);
 	for (peer = peer_list; peer != NULL; peer = peer->p_link)
-		peer->status = peer->new_status;
+		peer_set_status(peer);
 	clock_update(typesystem);
 }
 
@@ -2209,12 +2351,21 @@ peer_xmit(
 	 */
 	if (FLAG_NTS & peer->cfg.flags) {
 #ifndef DISABLE_NTS
-		if (0 < peer->nts_state.count)
-		  sendlen += extens_client_send(peer, &xpkt);
-		else {
+		if (0 >= peer->nts_state.count) {
+		  peer->nts_state.starved++;
 		  restart_nts_ke(peer);  /* out of cookies */
 		  return;
 		}
+		if (nts_refresh_due(peer)) {
+		  /* running low, NTS-KE now rather than later */
+		  peer->nts_state.rekeys++;
+		  peer_del_hash(peer);
+		  peer->ppoll = NTP_MAXPOLL_UNK;
+		  peer->nextdate = current_time;
+		  peer->cfg.flags |= FLAG_LOOKUP;
+		  return;
+		}
+		sendlen += extens_client_send(peer, &xpkt);
 #endif
 	} else if (0 != peer->cfg.peerkey) {
 		auth_info *auth = authlookup(peer->cfg.peerkey, true);
@@ -2241,14 +2392,66 @@ peer_xmit(
 }
 
 
-#ifdef ENABLE_LEAP_SMEAR
+/*
+ * kod_take_token - take a token from the outbound KoD bucket.
+ * A kod_rate of zero means no global limit.
+ */
+static bool
+kod_take_token(void)
+{
+	double rate = mon_data.kod_rate;
 
-static void
-leap_smear_add_offs(l_fp *t) {
-	*t += leap_smear.offset;
+	if (rate <= 0)
+		return true;
+	if (kod_stamp != current_time) {
+		kod_tokens += rate * (double)(current_time - kod_stamp);
+		kod_stamp = current_time;
+	}
+	/* Allow a burst of one second's worth */
+	if (kod_tokens > rate)
+		kod_tokens = rate;
+	if (kod_tokens < 1)
+		return false;
+	kod_tokens -= 1;
+	return true;
 }
 
-#endif	/* ENABLE_LEAP_SMEAR */
+/*
+ * kod_xmit - send a RATE KoD for a plain client request.
+ *
+ * Everything in a KoD except the first two octets, the poll and the
+ * refid is echoed from the request, and in wire order at that, so the
+ * request itself is the template and nothing needs parsing or byte
+ * swapping.  This is the fast path for rate-limited packets; fast_xmit()
+ * still builds KoDs for authenticated requests.
+ */
+static void
+kod_xmit(
+	struct recvbuf *rbufp	/* receive packet pointer */
+	)
+{
+	struct pkt xpkt;
+	uint8_t const *rb = rbufp->recv_buffer;
+
+	if (!kod_take_token()) {
+		stat_proto_total.sys_kodsuppressed++;
+		return;
+	}
+	stat_proto_total.sys_kodsent++;
+
+	memcpy(&xpkt, rb, LEN_PKT_NOMAC);
+	xpkt.li_vn_mode = PKT_LI_VN_MODE(LEAP_NOTINSYNC,
+	    PKT_VERSION(rb[0]), MODE_SERVER);
+	xpkt.stratum = STRATUM_PKT_UNSPEC;
+	xpkt.ppoll = max(xpkt.ppoll, rstrct.ntp_minpoll);
+	memcpy(&xpkt.refid, "RATE", REFIDLEN);
+	xpkt.org = xpkt.xmt;
+	xpkt.rec = xpkt.xmt;
+
+	sendpkt(&rbufp->recv_srcadr, rbufp->dstadr, &xpkt, LEN_PKT_NOMAC);
+	DPRINT(1, ("kod_xmit: at %u %s->%s\n", current_time,
+		   socktoa(&rbufp->dstadr->sin), socktoa(&rbufp->recv_srcadr)));
+}
 
 /*
  * fast_xmit - Send packet for nonpersistent association. Note that
@@ -2283,23 +2486,20 @@ fast_xmit(
 	 * synchronization.
 	 */
 	if (flags & RES_KOD) {
+		if (!kod_take_token()) {
+			stat_proto_total.sys_kodsuppressed++;
+			return;
+		}
 		stat_proto_total.sys_kodsent++;
+		/* Echo the request, as kod_xmit() does */
+		memcpy(&xpkt, rbufp->recv_buffer, LEN_PKT_NOMAC);
 		xpkt.li_vn_mode = PKT_LI_VN_MODE(LEAP_NOTINSYNC,
-		    PKT_VERSION(rbufp->pkt.li_vn_mode), MODE_SERVER);
+		    PKT_VERSION(rbuf_li_vn_mode(rbufp)), MODE_SERVER);
 		xpkt.stratum = STRATUM_PKT_UNSPEC;
-		xpkt.ppoll = max(rbufp->pkt.ppoll, rstrct.ntp_minpoll);
-		xpkt.precision = rbufp->pkt.precision;
+		xpkt.ppoll = max(rbuf_ppoll(rbufp), rstrct.ntp_minpoll);
 		memcpy(&xpkt.refid, "RATE", REFIDLEN);
-		xpkt.rootdelay = htonl(rbufp->pkt.rootdelay);
-		xpkt.rootdisp = htonl(rbufp->pkt.rootdisp);
-		xpkt.reftime.l_ui = htonl(rbufp->pkt.reftime >> 32);
-		xpkt.reftime.l_uf = htonl(rbufp->pkt.reftime & 0xFFFFFFFF);
-		xpkt.org.l_ui = htonl(rbufp->pkt.xmt >> 32);
-		xpkt.org.l_uf = htonl(rbufp->pkt.xmt & 0xFFFFFFFF);
-		xpkt.rec.l_ui = htonl(rbufp->pkt.xmt >> 32);
-		xpkt.rec.l_uf = htonl(rbufp->pkt.xmt & 0xFFFFFFFF);
-		xpkt.xmt.l_ui = htonl(rbufp->pkt.xmt >> 32);
-		xpkt.xmt.l_uf = htonl(rbufp->pkt.xmt & 0xFFFFFFFF);
+		xpkt.org = rbuf_xmt_w(rbufp);
+		xpkt.rec = xpkt.org;
 
 	/*
 	 * This is a normal packet. Use the system variables.
@@ -2311,6 +2511,7 @@ fast_xmit(
 		 */
 		l_fp this_ref_time;
 		l_fp this_recv_time;
+		l_fp smear = 0;
 #endif
 
 		/*
@@ -2328,9 +2529,9 @@ fast_xmit(
 		 * Note: There is significant NTPv1 traffic.  See #707
 		 */
 		xpkt.li_vn_mode = PKT_LI_VN_MODE(xmt_leap,
-		    PKT_VERSION(rbufp->pkt.li_vn_mode), MODE_SERVER);
+		    PKT_VERSION(rbuf_li_vn_mode(rbufp)), MODE_SERVER);
 		xpkt.stratum = STRATUM_TO_PKT(sys_vars.sys_stratum);
-		xpkt.ppoll = max(rbufp->pkt.ppoll, rstrct.ntp_minpoll);
+		xpkt.ppoll = max(rbuf_ppoll(rbufp), rstrct.ntp_minpoll);
 		xpkt.precision = sys_vars.sys_precision;
 		xpkt.refid = sys_vars.sys_refid;
 		xpkt.rootdelay = HTONS_FP(DTOUFP(sys_vars.sys_rootdelay));
@@ -2339,11 +2540,12 @@ fast_xmit(
 #ifdef ENABLE_LEAP_SMEAR
 		this_ref_time = sys_vars.sys_reftime;
 		if (leap_smear.in_progress) {
-			leap_smear_add_offs(&this_ref_time);
-			xpkt.refid = convertLFPToRefID(leap_smear.offset);
+			smear = leap_smear_at(&leap_smear, rbufp->recv_time);
+			this_ref_time += smear;
+			xpkt.refid = leap_smear.refid;
 			DPRINT(2, ("fast_xmit: leap_smear.in_progress: refid %8x, smear %s\n",
 				ntohl(xpkt.refid),
-				lfptoa(leap_smear.offset, 8)
+				lfptoa(smear, 8)
 				));
 		}
 		xpkt.reftime = htonl_fp(this_ref_time);
@@ -2351,13 +2553,10 @@ fast_xmit(
 		xpkt.reftime = htonl_fp(sys_vars.sys_reftime);
 #endif
 
-		xpkt.org.l_ui = htonl(rbufp->pkt.xmt >> 32);
-		xpkt.org.l_uf = htonl(rbufp->pkt.xmt & 0xFFFFFFFF);
+		xpkt.org = rbuf_xmt_w(rbufp);
 
 #ifdef ENABLE_LEAP_SMEAR
-		this_recv_time = rbufp->recv_time;
-		if (leap_smear.in_progress)
-			leap_smear_add_offs(&this_recv_time);
+		this_recv_time = rbufp->recv_time + smear;
 		xpkt.rec = htonl_fp(this_recv_time);
 #else
 		xpkt.rec = htonl_fp(rbufp->recv_time);
@@ -2365,8 +2564,7 @@ fast_xmit(
 
 		get_systime(&xmt_tx);
 #ifdef ENABLE_LEAP_SMEAR
-		if (leap_smear.in_progress)
-			leap_smear_add_offs(&xmt_tx);
+		xmt_tx += smear;
 #endif
 		xpkt.xmt = htonl_fp(xmt_tx);
 	}
@@ -2405,6 +2603,8 @@ fast_xmit(
 	sendpkt(&rbufp->recv_srcadr, rbufp->dstadr, &xpkt, (int)sendlen);
 	clock_gettime(CLOCK_MONOTONIC, &finish);
 	sys_authdelay = tspec_intv_to_lfp(sub_tspec(finish, start));
+	NTP_PROBE(xmit, PROBE_ADDR(&rbufp->recv_srcadr), sendlen,
+		  NULL != auth, flags, PROBE_TSPEC_NS(sub_tspec(finish, start)));
 	/* Previous versions of this code had separate DPRINT-s so it
 	 * could print the key on the auth case.  That requires separate
 	 * sendpkt-s on each branch or the DPRINT pollutes the timing. */
@@ -2477,27 +2677,22 @@ dns_take_server(
 
 /*
  dns_take_pool - process DNS query for pool.
+ The whole answer set is taken in one pass: the peer_ctl template is
+ built once and addresses already in use are only counted, not logged.
  */
 void
 dns_take_pool(
 	struct peer *pool,	/* pool solicitor association */
-	sockaddr_u *		rmtadr
+	struct addrinfo *answer	/* getaddrinfo() results */
 	)
 {
 	struct peer_ctl		pctl;
 	struct peer *		peer;
+	struct addrinfo *	ai;
 	endpt *			lcladr;
+	unsigned int		taken = 0;
+	unsigned int		skipped = 0;
 
-	peer = findexistingpeer(rmtadr, NULL, NULL, MODE_CLIENT);
-	if (NULL != peer) {
-		/* This address is already in use. */
-		msyslog(LOG_INFO, "DNS: Pool skipping: %s", socktoa(rmtadr));
-		return;
-	}
-
-	msyslog(LOG_INFO, "DNS: Pool taking: %s", socktoa(rmtadr));
-
-	lcladr = findinterface(rmtadr);
 	memset(&pctl, '\0', sizeof(struct peer_ctl));
 	pctl.version = pool->cfg.version;
 	pctl.minpoll = pool->cfg.minpoll;
@@ -2505,15 +2700,48 @@ dns_take_pool(
 	pctl.flags = FLAG_PREEMPT | (FLAG_IBURST & pool->cfg.flags);
 	pctl.mode = 0;
 	pctl.peerkey = 0;
-	peer = newpeer(rmtadr, NULL, lcladr,
-		       MODE_CLIENT, &pctl, MDF_UCAST, false);
-	peer_xmit(peer);
-	if (peer->cfg.flags & FLAG_IBURST)
-	  peer->retry = NTP_RETRY;
-	poll_update(peer, peer->hpoll);
 
-	DPRINT(1, ("dns_take_pool: at %u %s->%s pool\n",
-		   current_time, latoa(lcladr), socktoa(rmtadr)));
+	for (ai = answer; NULL != ai; ai = ai->ai_next) {
+		sockaddr_u rmtadr;
+
+		if (sizeof(sockaddr_u) < ai->ai_addrlen)
+			continue;  /* Weird */
+		memcpy(&rmtadr, ai->ai_addr, ai->ai_addrlen);
+
+		peer = findexistingpeer(&rmtadr, NULL, NULL, MODE_CLIENT);
+		if (NULL != peer) {
+			/* This address is already in use. */
+			DPRINT(1, ("dns_take_pool: skipping %s\n",
+				   socktoa(&rmtadr)));
+			skipped++;
+			continue;
+		}
+
+		msyslog(LOG_INFO, "DNS: Pool taking: %s", socktoa(&rmtadr));
+
+		lcladr = findinterface(&rmtadr);
+		peer = newpeer(&rmtadr, NULL, lcladr,
+			       MODE_CLIENT, &pctl, MDF_UCAST, false);
+		if (NULL == peer) {
+			skipped++;
+			continue;
+		}
+		peer_xmit(peer);
+		if (peer->cfg.flags & FLAG_IBURST)
+		  peer->retry = NTP_RETRY;
+		poll_update(peer, peer->hpoll);
+		taken++;
+
+		DPRINT(1, ("dns_take_pool: at %u %s->%s pool\n",
+			   current_time, latoa(lcladr), socktoa(&rmtadr)));
+	}
+
+	stat_proto_total.sys_pooltaken += taken;
+	stat_proto_total.sys_poolskipped += skipped;
+	if (0 != skipped) {
+		msyslog(LOG_INFO, "DNS: Pool skipping %u address%s already in use",
+			skipped, (1 == skipped) ? "" : "es");
+	}
 }
 
 /*
@@ -2595,9 +2823,34 @@ static void restart_nts_ke(struct peer *peer) {
 		hpoll = 12;	/* 4096, a bit over an hour */
 	peer->ppoll = NTP_MAXPOLL_UNK;
 	peer->hpoll = hpoll;
-	peer->nextdate = current_time + (1U << hpoll);
+	/* somewhere in the second half, so associations that ran out
+	 * together don't all come back to the NTS-KE server together */
+	peer->nextdate = current_time + (1U << (hpoll - 1)) +
+	    (uptime_t)(random() % (1U << (hpoll - 1)));
 	peer->cfg.flags |= FLAG_LOOKUP;
 };
+
+/* NTS cookies running low, some replies having been lost.  Pick a time
+ * at random within the polls the rest will last and run NTS-KE then,
+ * while the server may still answer, rather than after the last one.
+ * At random, so associations that lost the same replies don't all
+ * return to the NTS-KE server at once.
+ */
+static bool nts_refresh_due(struct peer *peer) {
+	struct ntsclient_t *state = &peer->nts_state;
+	unsigned long span;
+
+	if (NTS_LOW_COOKIES < state->count) {
+		state->refresh = 0;
+		return false;
+	}
+	if (0 == state->refresh) {
+		span = (unsigned long)(state->count - 1) << peer->hpoll;
+		state->refresh = current_time +
+		    (uptime_t)((0 < span) ? (unsigned long)random() % span : 0);
+	}
+	return state->refresh <= current_time;
+}
 #endif
 
 /*
@@ -2712,6 +2965,7 @@ void
 init_proto(const bool verbose)
 {
 	l_fp	dummy;
+	uint32_t epoch;
 
 	/*
 	 * Fill in the sys_* stuff.
@@ -2728,6 +2982,9 @@ init_proto(const bool verbose)
 	UNUSED_ARG(verbose);
 	sys_vars.sys_precision = -30; /* ns */  // FIXME FUZZ
 	get_systime(&dummy);
+	ntp_RAND_bytes((unsigned char *)&epoch, sizeof(epoch));
+	gen_epoch = (uint64_t)((epoch & 0x7fffffff) | 1) << 32;
+	change_gen = sys_gen = peers_gone_gen = gen_epoch;
 	sys_survivors = 0;
 	sys_stattime = current_time;
 	orphwait = current_time + (unsigned long)sys_orphwait;
@@ -2792,6 +3049,12 @@ proto_config(
 		stats_control = (bool)value;
 		break;
 
+	case PROTO_TSC:		/* TSC time source (tsc) */
+		if (!tsc_enable((bool)value))
+			msyslog(LOG_WARNING,
+				"CONFIG: no invariant TSC, 'enable tsc' ignored");
+		break;
+
 	/*
 	 * tos command - arguments are double, sometimes cast to int
 	 */
@@ -2888,7 +3151,7 @@ void maybe_log_junk(const char *tag, struct recvbuf *rbufp) {
     msyslog(LOG_INFO,
 	"%s: Count=%ld Print=%ld, Score=%.3f, M%d V%d from %s, lng=%d",
 	tag, junk_count, junk_print, junk_score,
-        PKT_MODE(rbufp->pkt.li_vn_mode), PKT_VERSION(rbufp->pkt.li_vn_mode),
+        PKT_MODE(rbuf_li_vn_mode(rbufp)), PKT_VERSION(rbuf_li_vn_mode(rbufp)),
         sockporttoa(&rbufp->recv_srcadr), lng);
     for (i=0,j=0; i<lng; i++) {
       if ((j+4)>JUNKSIZE) break;
@@ -58,7 +58,7 @@ create_buffers(unsigned int nbufs)
 	buffer_shortfall = 0;
 
 #ifndef DEBUG
-	bufp = emalloc_zero(abuf * sizeof(*bufp));
+	bufp = etallocarray(MEM_RECVBUF, abuf, sizeof(*bufp));
 #endif
 
 	for (i = 0; i < abuf; i++) {
@@ -68,7 +68,7 @@ create_buffers(unsigned int nbufs)
 		 * free()d during ntpd shutdown on DEBUG builds to
 		 * keep them out of heap leak reports.
 		 */
-		bufp = emalloc_zero(sizeof(*bufp));
+		bufp = etallocarray(MEM_RECVBUF, 1, sizeof(*bufp));
 #endif
 		LINK_SLIST(free_recv_list, bufp, link);
 		bufp++;
@@ -106,7 +106,7 @@ uninit_recvbuff(void)
 		UNLINK_HEAD_SLIST(rbunlinked, free_recv_list, link);
 		if (rbunlinked == NULL)
 			break;
-		free(rbunlinked);
+		etfree(MEM_RECVBUF, rbunlinked, 1, sizeof(*rbunlinked));
 	}
 }
 #endif	/* DEBUG */
@@ -104,12 +104,21 @@ static	bool		restrict_source_enabled = false;
 static	unsigned short	restrict_source_flags;
 static	unsigned short	restrict_source_mflags;
 
+/*
+ * The holes poked by restrict_source() are host entries for our own
+ * servers.  A big pool can add thousands of them, so rather than
+ * sorting them into the lists they are hashed by address into
+ * rstrct.sourcehash4/6, which restrictions() checks first.
+ */
+static	unsigned int	source_holes;	/* entries in the source hashes */
+
 /*
  * private functions
  */
 static restrict_u *	alloc_res4(void);
 static restrict_u *	alloc_res6(void);
 static void		free_res(restrict_u *, bool);
+static void		release_res(restrict_u *, bool);
 static void		inc_res_limited(void);
 static void		dec_res_limited(void);
 static restrict_u *	match_restrict4_addr(uint32_t, unsigned short);
@@ -118,6 +127,11 @@ static restrict_u *	match_restrict6_addr(const struct in6_addr *,
 static restrict_u *	match_restrict_entry(const restrict_u *, int);
 static int		res_sorts_before4(restrict_u *, restrict_u *);
 static int		res_sorts_before6(restrict_u *, restrict_u *);
+static unsigned int	res_hash4(uint32_t);
+static unsigned int	res_hash6(const struct in6_addr *);
+static restrict_u *	match_source4_addr(uint32_t, unsigned short);
+static restrict_u *	match_source6_addr(const struct in6_addr *,
+					   unsigned short);
 
 
 /*
@@ -179,7 +193,7 @@ alloc_res4(void)
 	if (res != NULL)
 		return res;
 
-	rl = emalloc_zero(count * cb);
+	rl = etallocarray(MEM_RESTRICT, count, cb);
 	/* link all but the first onto free list */
 	res = (void *)((char *)rl + (count - 1) * cb);
 	for (int i = count - 1; i > 0; i--) {
@@ -204,7 +218,7 @@ alloc_res6(void)
 	if (res != NULL)
 		return res;
 
-	rl = emalloc_zero(count * cb);
+	rl = etallocarray(MEM_RESTRICT, count, cb);
 	/* link all but the first onto free list */
 	res = (void *)((char *)rl + (count - 1) * cb);
 	for (int i = count - 1; i > 0; i--) {
@@ -226,16 +240,30 @@ free_res(
 	restrict_u **	plisthead;
 	restrict_u *	unlinked;
 
-	restrictcount--;
-	if (RES_LIMITED & res->flags)
-		dec_res_limited();
-
 	if (v6)
 		plisthead = &rstrct.restrictlist6;
 	else
 		plisthead = &rstrct.restrictlist4;
 	UNLINK_SLIST(unlinked, *plisthead, res, link, restrict_u);
 	INSIST(unlinked == res);
+	release_res(res, v6);
+}
+
+
+/*
+ * release_res - return an entry already off its list to the free list
+ */
+static void
+release_res(
+	restrict_u *	res,
+	bool		v6
+	)
+{
+	restrict_u **	plisthead;
+
+	restrictcount--;
+	if (RES_LIMITED & res->flags)
+		dec_res_limited();
 
 	if (v6) {
 		memset(res, '\0', V6_SIZEOF_RESTRICT_U);
@@ -309,6 +337,72 @@ match_restrict6_addr(
 }
 
 
+static unsigned int
+res_hash4(
+	uint32_t	addr
+	)
+{
+	return (addr ^ (addr >> 7) ^ (addr >> 17)) & NTP_HASH_MASK;
+}
+
+
+static unsigned int
+res_hash6(
+	const struct in6_addr *	addr
+	)
+{
+	unsigned int hashVal = 0;
+
+	for (int idx = 0; idx < (int)COUNTOF(addr->s6_addr); idx++)
+		hashVal = 37 * hashVal + addr->s6_addr[idx];
+	return hashVal & NTP_HASH_MASK;
+}
+
+
+/*
+ * match_source4_addr - look up a "restrict source" hole.
+ *
+ * Returns NULL if there isn't one, or if it is ntpport-only and the
+ * port doesn't match.
+ */
+static restrict_u *
+match_source4_addr(
+	uint32_t	addr,
+	unsigned short	port
+	)
+{
+	restrict_u *	res;
+
+	for (res = rstrct.sourcehash4[res_hash4(addr)]; res != NULL;
+	     res = res->link) {
+		if (res->u.v4.addr == addr
+		    && (!(RESM_NTPONLY & res->mflags)
+			|| NTP_PORT == port))
+			break;
+	}
+	return res;
+}
+
+
+static restrict_u *
+match_source6_addr(
+	const struct in6_addr *	addr,
+	unsigned short		port
+	)
+{
+	restrict_u *	res;
+
+	for (res = rstrct.sourcehash6[res_hash6(addr)]; res != NULL;
+	     res = res->link) {
+		if (ADDR6_EQ(addr, &res->u.v6.addr)
+		    && (!(RESM_NTPONLY & res->mflags)
+			|| NTP_PORT == (int)port))
+			break;
+	}
+	return res;
+}
+
+
 /*
  * match_restrict_entry - find an exact match on a restrict list.
  *
@@ -437,8 +531,13 @@ restrictions(
 		if (IN_CLASSD(SRCADR(srcadr)))
 			return (int)RES_IGNORE;
 
-		match = match_restrict4_addr(SRCADR(srcadr),
-					     SRCPORT(srcadr));
+		match = NULL;
+		if (source_holes > 0)
+			match = match_source4_addr(SRCADR(srcadr),
+						   SRCPORT(srcadr));
+		if (NULL == match)
+			match = match_restrict4_addr(SRCADR(srcadr),
+						     SRCPORT(srcadr));
 		match->hitcount++;
 		/*
 		 * res_not_found counts only use of the final default
@@ -464,7 +563,11 @@ restrictions(
 		if (IN6_IS_ADDR_MULTICAST(pin6))
 			return (int)RES_IGNORE;
 
-		match = match_restrict6_addr(pin6, SRCPORT(srcadr));
+		match = NULL;
+		if (source_holes > 0)
+			match = match_source6_addr(pin6, SRCPORT(srcadr));
+		if (NULL == match)
+			match = match_restrict6_addr(pin6, SRCPORT(srcadr));
 		match->hitcount++;
 		if (&restrict_def6 == match)
 			res_not_found++;
@@ -617,7 +720,8 @@ hack_restrict(
  *   dns_check/dns_take_server when DNS assigns an IP Address
  *   nts_check/dns_take_server when NTS assigns an IP Address
  *
- * Holes created have RESM_SOURCE in mflags
+ * Holes created have RESM_SOURCE in mflags and live in the
+ * source hashes, not on the restrict lists.
  * Restrictions must be initialized before adding servers
  */
 void
@@ -636,6 +740,15 @@ restrict_source(
 
 	SET_HOSTMASK(&onesmask, AF(addr));
 
+	if (IS_IPV4(addr))
+		res = match_source4_addr(SRCADR(addr), SRCPORT(addr));
+	else
+		res = match_source6_addr(&SOCK_ADDR6(addr), SRCPORT(addr));
+	if (NULL != res) {
+		/* already poked */
+		return;
+	}
+
 	/*
 	 * If there is a specific entry for this address, hands
 	 * off, as it is condidered more specific than "restrict
@@ -678,8 +791,25 @@ restrict_source(
 	msyslog(LOG_INFO, "RESTRICT: Poking hole in restrictions for %s",
 		socktoa(addr));
 
-	hack_restrict(RESTRICT_FLAGS, addr, &onesmask,
-		      restrict_source_mflags, restrict_source_flags);
+	if (IS_IPV4(addr)) {
+		res = alloc_res4();
+		res->u.v4.addr = SRCADR(addr);
+		res->u.v4.mask = SRCADR(&onesmask);
+		LINK_SLIST(rstrct.sourcehash4[res_hash4(res->u.v4.addr)],
+			   res, link);
+	} else {
+		res = alloc_res6();
+		res->u.v6.addr = SOCK_ADDR6(addr);
+		res->u.v6.mask = SOCK_ADDR6(&onesmask);
+		LINK_SLIST(rstrct.sourcehash6[res_hash6(&res->u.v6.addr)],
+			   res, link);
+	}
+	res->flags = restrict_source_flags;
+	res->mflags = restrict_source_mflags;
+	restrictcount++;
+	source_holes++;
+	if (RES_LIMITED & res->flags)
+		inc_res_limited();
 }
 
 /* unrestrict_source - remove hole poked in restrictions
@@ -690,25 +820,36 @@ unrestrict_source(
 	)
 {
 	sockaddr_u *	addr = &peer->srcadr;
-	sockaddr_u	onesmask;
+	restrict_u **	bucket;
 	restrict_u *	res;
+	restrict_u *	unlinked;
+	bool		v6;
 
+	if (0 == source_holes) {
+		return;		/* nothing to cleanup */
+	}
 	if (IS_IPV4(addr)) {
-		res = match_restrict4_addr(SRCADR(addr), SRCPORT(addr));
+		v6 = false;
+		bucket = &rstrct.sourcehash4[res_hash4(SRCADR(addr))];
+		res = match_source4_addr(SRCADR(addr), SRCPORT(addr));
+	} else if (IS_IPV6(addr)) {
+		v6 = true;
+		bucket = &rstrct.sourcehash6[res_hash6(&SOCK_ADDR6(addr))];
+		res = match_source6_addr(&SOCK_ADDR6(addr), SRCPORT(addr));
 	} else {
-		res = match_restrict6_addr(&SOCK_ADDR6(addr),
-					   SRCPORT(addr));
+		return;		/* never had an address */
 	}
-	if (!(res->mflags & RESM_SOURCE)) {
+	if (NULL == res) {
 		return;		/* nothing to cleanup */
 	}
 
 	msyslog(LOG_INFO, "RESTRICT: Removing hole in restrictions for %s",
 		socktoa(addr));
 
-	SET_HOSTMASK(&onesmask, AF(addr));
-	hack_restrict(RESTRICT_REMOVE, addr, &onesmask, 0, 0);
-
+	UNLINK_SLIST(unlinked, *bucket, res, link, restrict_u);
+	INSIST(unlinked == res);
+	source_holes--;
+	release_res(res, v6);
 }
 
 
@@ -7,10 +7,13 @@
 #include "ntpd.h"
 #include "ntp_stdlib.h"
 #include "ntp_calendar.h"
+#include "ntp_capture.h"
 #include "ntp_leapsec.h"
+#include "timespecops.h"
 
 #include <stdio.h>
 #include <signal.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include "ntp_syscall.h"
@@ -21,8 +24,10 @@
 #endif
 
 #define	EVENT_TIMEOUT	0	/* one second, that is */
+#define	PACE_WINDOW	1.0	/* default "tos pace", seconds */
 
 static void check_leapsec(time_t, bool);
+static int pace_cmp(const void *, const void *);
 
 /*
  * These routines provide support for the event timer.  The timer is
@@ -62,6 +67,35 @@ uptime_t current_time;		/* seconds since startup */
 uptime_t timer_timereset;
 unsigned long timer_xmtcalls;
 
+/*
+ * Transmit pacing.  timer() queues the associations due each second in
+ * order of their random phase, and pace_run() sends them evenly spaced
+ * over the pace window ("tos pace") instead of all at once, so that
+ * thousands of associations don't overflow the socket buffers or queue
+ * behind each other.  io_handler() sleeps no longer than until the
+ * next one is due.  Anything left when the next second starts goes at
+ * once and counts as late.
+ */
+static double		pace_window = PACE_WINDOW;	/* 0 for none */
+static struct pace {
+	uint16_t	phase;
+	associd_t	associd;	/* the peer may go meanwhile */
+} *			pace_queue;
+static size_t		pace_alloc;
+static size_t		pace_count;	/* queued this second */
+static size_t		pace_next;	/* next to send */
+static struct timespec	pace_start;	/* CLOCK_MONOTONIC, this second */
+static struct timespec	pace_last;	/* last paced transmit */
+static double		pace_gaps;	/* sum of gaps this second */
+static double		pace_gapmin;	/* smallest gap this second */
+
+unsigned long	timer_burst;		/* due last second */
+unsigned long	timer_burstmax;		/* most due in a second */
+unsigned long	timer_paced;		/* transmits paced */
+unsigned long	timer_late;		/* left for the next second */
+double		timer_spacing;		/* mean gap last second, s */
+double		timer_spacingmin;	/* smallest gap last second, s */
+
 static	void catchALRM (int);
 
 #ifdef HAVE_TIMER_CREATE
@@ -140,8 +174,7 @@ init_timer(void)
 	huffpuff_timer = 0;
 	interface_timer = 0;
 	current_time = 0;
-	timer_xmtcalls = 0;
-	timer_timereset = 0;
+	timer_clr_stats();
 
 	/*
 	 * Set up the alarm interrupt.	The first comes 2**EVENT_TIMEOUT
@@ -172,6 +205,7 @@ timer(void)
 	struct peer *	p;
 	struct peer *	next_peer;
 	time_t          now;
+	size_t		due;
 
 	/*
 	 * The basic timerevent is one second.  This is used to adjust the
@@ -194,8 +228,11 @@ timer(void)
 	/*
 	 * Now dispatch any peers whose event timer has expired. Be
 	 * careful here, since the peer structure might go away as the
-	 * result of the call.
+	 * result of the call.  Network peers are paced; pace_run()
+	 * sends the first right away.
 	 */
+	pace_flush();
+	timer_burst = due = 0;
 	for (p = peer_list; p != NULL; p = next_peer) {
 		next_peer = p->p_link;
 
@@ -213,9 +250,31 @@ timer(void)
 				refclock_transmit(p);
 			else
 #endif	/* REFCLOCK */
+			if (pace_window > 0) {
+				if (due >= pace_alloc) {
+					pace_alloc = max(64, 2 * pace_alloc);
+					pace_queue = ereallocarray(pace_queue,
+						pace_alloc, sizeof(*pace_queue));
+				}
+				pace_queue[due].phase = p->phase;
+				pace_queue[due++].associd = p->associd;
+				timer_burst++;
+			} else {
+				timer_burst++;
+				timer_xmtcalls++;
 				transmit(p);
+			}
 		}
 	}
+	timer_burstmax = max(timer_burstmax, timer_burst);
+	if (due > 0) {
+		qsort(pace_queue, due, sizeof(*pace_queue), pace_cmp);
+		pace_count = due;
+		pace_next = 0;
+		pace_gaps = pace_gapmin = 0;
+		clock_gettime(CLOCK_MONOTONIC, &pace_start);
+		pace_run();
+	}
 
 	/*
 	 * Orphan mode is active when enabled and when no servers less
@@ -246,6 +305,12 @@ timer(void)
 	 */
 	if (leapsec > LSPROX_NOWARN || 0 == (current_time & 7))
 		check_leapsec(now, (sys_vars.sys_leap == LEAP_NOTINSYNC));
+	/*
+	 * Recalibrate the TSC time source, keeping it off for the
+	 * last seconds before a leap.
+	 */
+	tsc_timer(leapsec >= LSPROX_ALERT);
+
 	if (sys_vars.sys_leap != LEAP_NOTINSYNC) {
 		if (leapsec >= LSPROX_ANNOUNCE && leapdif) {
 			if (leapdif > 0)
@@ -265,6 +330,11 @@ timer(void)
 		huffpuff();
 	}
 
+	/*
+	 * MRU aging, free reserve and consistency check
+	 */
+	mon_timer();
+
 	/*
 	 * Interface update timer
 	 */
@@ -283,7 +353,7 @@ timer(void)
 #ifndef DISABLE_NTS
 		nts_timer();
 #endif
-		mon_timer();
+		capture_timer();
 		check_logfile();
 		if (leapf_timer <= current_time) {
 			leapf_timer += SECSPERDAY;
@@ -327,6 +397,140 @@ if (debug >= 4 && msg != NULL)
 }
 
 
+/*
+ * pace_cmp - order queued peers by phase
+ */
+static int
+pace_cmp(
+	const void *	a,
+	const void *	b
+	)
+{
+	const struct pace *pa = a;
+	const struct pace *pb = b;
+
+	if (pa->phase != pb->phase)
+		return (pa->phase < pb->phase)
+		    ? COMPARE_LESSTHAN : COMPARE_GREATERTHAN;
+	if (pa->associd != pb->associd)
+		return (pa->associd < pb->associd)
+		    ? COMPARE_LESSTHAN : COMPARE_GREATERTHAN;
+	return COMPARE_EQUAL;
+}
+
+
+/*
+ * pace_due - when the next queued peer is to go, CLOCK_MONOTONIC
+ */
+static struct timespec
+pace_due(void)
+{
+	return add_tspec(pace_start,
+			 d_to_tspec(pace_window * (double)pace_next /
+				    (double)pace_count));
+}
+
+
+/*
+ * pace_send - transmit to the next queued peer, if it is still due.
+ *	       A reply or a reconfiguration since timer() may have
+ *	       moved it on or removed it.
+ */
+static void
+pace_send(void)
+{
+	struct peer *	p;
+	struct timespec	now;
+	double		gap;
+
+	p = findpeerbyassoc(pace_queue[pace_next++].associd);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (pace_next > 1) {
+		gap = tspec_to_d(sub_tspec(now, pace_last));
+		pace_gaps += gap;
+		if (pace_next == 2 || gap < pace_gapmin)
+			pace_gapmin = gap;
+	}
+	pace_last = now;
+	if (p != NULL && p->nextdate <= current_time) {
+		timer_xmtcalls++;
+		timer_paced++;
+		transmit(p);
+	}
+}
+
+
+/*
+ * pace_run - send what is due of this second's queue
+ */
+void
+pace_run(void)
+{
+	struct timespec	now;
+
+	if (pace_next >= pace_count)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while (pace_next < pace_count && cmp_tspec(pace_due(), now) <= 0)
+		pace_send();
+}
+
+
+/*
+ * pace_flush - send what is left of last second's queue and publish
+ *		its spacing
+ */
+void
+pace_flush(void)
+{
+	while (pace_next < pace_count) {
+		timer_late++;
+		pace_send();
+	}
+	if (pace_count > 1) {
+		timer_spacing = pace_gaps / (double)(pace_count - 1);
+		timer_spacingmin = pace_gapmin;
+	} else
+		timer_spacing = timer_spacingmin = 0;
+	pace_count = pace_next = 0;
+}
+
+
+/*
+ * pace_wait - how long io_handler() may sleep, NULL for as long as it
+ *	       likes
+ */
+struct timespec *
+pace_wait(
+	struct timespec *	wait
+	)
+{
+	struct timespec	now;
+
+	if (pace_next >= pace_count)
+		return NULL;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*wait = sub_tspec(pace_due(), now);
+	if (wait->tv_sec < 0)
+		wait->tv_sec = wait->tv_nsec = 0;
+	return wait;
+}
+
+
+/*
+ * timer_pace - "tos pace": the window, in seconds, to spread each
+ *		second's transmits over; 0 sends them all at once
+ */
+void
+timer_pace(
+	double	window
+	)
+{
+	pace_flush();
+	pace_window = window;
+}
+
+
 void
 timer_interfacetimeout(uptime_t timeout)
 {
@@ -341,6 +545,9 @@ void
 timer_clr_stats(void)
 {
 	timer_xmtcalls = 0;
+	timer_burstmax = 0;
+	timer_paced = 0;
+	timer_late = 0;
 	timer_timereset = current_time;
 }
 
@@ -389,60 +596,17 @@ check_leapsec(
 			   fired, (long long)now, (long long unsigned)now,
 			   lsdata.tai_diff, lsdata.ddist));
 #ifdef ENABLE_LEAP_SMEAR
-		leap_smear.in_progress = false;
-		leap_smear.doffset = 0.0;
-
-		if (leap_smear.enabled) {
-			if (lsdata.tai_diff) {
-				if (leap_smear.interval == 0) {
-					leap_smear.interval = leap_smear_intv;
-					leap_smear.intv_end = lsdata.ttime;
-					leap_smear.intv_start = leap_smear.intv_end - leap_smear.interval;
-					DPRINT(1, ("*** leapsec_query: setting leap_smear interval %li, begin %.0f, end %.0f\n",
-						   leap_smear.interval, leap_smear.intv_start, leap_smear.intv_end));
-				}
-			} else {
-				if (leap_smear.interval)
-					DPRINT(1, ("*** leapsec_query: clearing leap_smear interval\n"));
-				leap_smear.interval = 0;
-			}
-
-			if (leap_smear.interval) {
-				double dtemp = now;
-				if (dtemp >= leap_smear.intv_start && dtemp <= leap_smear.intv_end) {
-					double leap_smear_time = dtemp - leap_smear.intv_start;
-					/*
-					 * For now we just do a linear interpolation over the smear interval
-					 * https://developers.google.com/time/smear
-					 */
-					leap_smear.doffset = -(leap_smear_time * lsdata.tai_diff / leap_smear.interval);
-					/*
-					 * TODO see if we're inside an
-					 * inserted leap second, so we
-					 * need to compute
-					 * leap_smear.doffset = 1.0 -
-					 * leap_smear.doffset
-					 */
-					leap_smear.in_progress = true;
-#if 0 && defined( DEBUG )
-					msyslog(LOG_NOTICE, "CLOCK: *** leapsec_query: [%.0f:%.0f] (%li), now %u (%.0f), smear offset %.6f ms\n",
-						leap_smear.intv_start, leap_smear.intv_end, leap_smear.interval,
-						now, leap_smear_time, leap_smear.doffset);
-#else
-					DPRINT(1, ("*** leapsec_query: [%.0f:%.0f] (%li), now %lld (%.0f), smear offset %.6f ms\n",
-						   leap_smear.intv_start, leap_smear.intv_end, leap_smear.interval,
-						   (long long)now, leap_smear_time, leap_smear.doffset));
-#endif
-
-				}
-			}
-		} else
-			leap_smear.interval = 0;
-
 		/*
-		 * Update the current leap smear offset, eventually 0.0 if outside smear interval.
+		 * Publish the smear state for this second.  fast_xmit()
+		 * extrapolates from it, so it never has to look at the
+		 * leap table.
 		 */
-		leap_smear.offset = dtolfp(leap_smear.doffset);
+		leapsec_smear_update(&leap_smear, &lsdata, now,
+				     (long)leap_smear_intv);
+		if (leap_smear.in_progress)
+			DPRINT(1, ("*** leapsec_query: [%.0f:%.0f] (%li), now %lld, smear offset %.6f ms\n",
+				   leap_smear.intv_start, leap_smear.intv_end, leap_smear.interval,
+				   (long long)now, leap_smear.doffset));
 #endif	/* ENABLE_LEAP_SMEAR */
 
 		/* Full hit. Eventually step the clock, but always
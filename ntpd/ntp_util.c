@@ -661,6 +661,8 @@ void record_ref_stats(
  * rate exceeded
  * KoD sent
  * NTPv1 packets
+ * live heap bytes: MRU, recvbufs, peers, restrict, keys, TLS, config,
+ *   stats buffers
  */
 void
 record_sys_stats(void)
@@ -676,12 +678,16 @@ record_sys_stats(void)
 		fprintf(sysstats.fp,
 		    "%s %u %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
 		    " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 \
-		    " %" PRIu64 " %" PRIu64"\n",
+		    " %" PRIu64 " %" PRIu64,
 			timespec_to_MJDtime(&now), stat_stattime(),
 			stat_received(), stat_processed(), stat_newversion(),
 			stat_oldversion(), stat_restricted(), stat_badlength(),
 			stat_badauth(), stat_declined(), stat_limitrejected(),
 			stat_kodsent(), stat_version1());
+		/* live heap bytes, in mem_tag order */
+		for (int tag = 0; tag < MEM_TAGS; tag++)
+			fprintf(sysstats.fp, " %lu", mem_use[tag].bytes);
+		fputc('\n', sysstats.fp);
 		fflush(sysstats.fp);
 	}
 	proto_clr_stats();
@@ -788,7 +794,8 @@ void record_ntske_stats(void) {
 	filegen_setup(&ntskestats, now.tv_sec);
 	if (ntsstats.fp != NULL) {
 		fprintf(ntskestats.fp,
-		    "%s %u %llu %.3f %.3f %llu %.3f %.3f %llu %.3f %.3f %llu %llu\n",
+		    "%s %u %llu %.3f %.3f %llu %.3f %.3f %llu %.3f %.3f %llu %llu"
+		    " %llu %llu %llu %llu %llu\n",
 		    timespec_to_MJDtime(&now), current_time-ntske_stattime,
 		    ntske_since(serves_good),
 		    ntske_since_f(serves_good_wall),
@@ -800,7 +807,12 @@ void record_ntske_stats(void) {
 		    ntske_since_f(serves_bad_wall),
 		    ntske_since_f(serves_bad_cpu),
 		    ntske_since(probes_good),
-		    ntske_since(probes_bad) );
+		    ntske_since(probes_bad),
+		    ntske_since(admitted),
+		    ntske_since(queued),
+		    ntske_since(rejected_source),
+		    ntske_since(rejected_prefix),
+		    ntske_since(rejected_busy) );
 		fflush(ntskestats.fp);
 	}
 	old_ntske_cnt = ntske_cnt;
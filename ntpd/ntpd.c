@@ -876,6 +876,8 @@ main(
 	    msyslog(LOG_ERR, "statistics directory %s does not exist or is unwriteable, error %s", statsdir, strerror(errno));
 	}
 
+	ctl_start_worker();	/* after the sandbox is set up */
+	busypoll_start();	/* after the control worker */
 	mainloop();
         /* unreachable, mainloop() never returns */
 }
@@ -946,6 +948,7 @@ static void mainloop(void)
 		    sig_flags.sawALRM = false;
 			timer();
 		}
+		pace_run();
 
 		if (sig_flags.sawDNS) {
 			sig_flags.sawDNS = false;
@@ -0,0 +1,767 @@
+/*
+ * ntpdreplay.c - feed a packet capture through ntpd's receive path
+ *
+ * Copyright the NTPsec project contributors
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This links the configuration parser, ntp_proto.c, ntp_monitor.c,
+ * ntp_restrict.c, ntp_control.c and the NTS server code as ntpd does,
+ * reads UDP datagrams to port 123 out of a pcapng or pcap file (such
+ * as one written by "capture file"), and hands each one to receive()
+ * with its captured timestamp.  sendpkt() only counts.  The time taken
+ * is the cost of restrict, monitor, authentication, NTS and building
+ * replies, with the kernel, sockets and the select loop left out.
+ *
+ * The system clock is read but never set: get_systime() and friends
+ * are replaced so a capture full of server replies can't step it.
+ *
+ * Each pass over the capture is shifted later by the length of the
+ * capture, so rate limiting sees time moving forward as it did live.
+ * timer() runs once per captured second.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntpd.h"
+#include "ntp_auth.h"
+#include "ntp_capture.h"
+#include "ntp_config.h"
+#include "ntp_dns.h"
+#include "ntp_io.h"
+#include "ntp_refclock.h"
+#include "ntp_stdlib.h"
+#include "ntp_syscall.h"
+#include "ntp_syslog.h"
+#include "recvbuff.h"
+#include "timespecops.h"
+#ifndef DISABLE_NTS
+#include "nts.h"
+#endif
+
+#define PCAP_MAGIC_US	0xA1B2C3D4U	/* classic pcap, microseconds */
+#define PCAP_MAGIC_NS	0xA1B23C4DU	/* classic pcap, nanoseconds */
+#define LINK_LINUX_SLL	113		/* tcpdump -i any */
+#define MAX_IFACES	16
+#define MAX_ENDPTS	64
+
+static inline uint32_t bswap32(uint32_t v) { return __builtin_bswap32(v); }
+static inline uint16_t bswap16(uint16_t v) { return __builtin_bswap16(v); }
+
+struct rpkt {
+	uint64_t	ns;		/* capture time, ns since 1970 */
+	sockaddr_u	src;
+	endpt *		dst;
+	const uint8_t *	data;
+	size_t		len;
+};
+static struct rpkt *pkts;
+static size_t npkts, pkts_size;
+static unsigned long skipped;	/* not UDP to port 123 */
+
+static endpt endpts[MAX_ENDPTS];
+static int nendpts;
+
+static uint64_t replay_sent;
+
+/* What ntpd.c, ntp_io.c and ntp_dns.c would provide */
+const char *progname = "ntpdreplay";
+int waitsync_fd_to_close = -1;
+volatile struct signals_detected sig_flags;
+struct ntp_io_data io_data;
+uptime_t io_timereset;
+uint16_t extra_port = 0;
+time_stepped_callback step_callback;
+int qos = 0;
+
+static void usage(void);
+
+
+/*
+ * The clock.  Reading it is harmless; these stand in for all of
+ * libntp/systime.c and clockwork.c so nothing here can set it.
+ */
+void
+get_systime(
+	l_fp *	now
+	)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	*now = tspec_stamp_to_lfp(ts);
+}
+
+bool
+adj_systime(
+	double		adj,
+	int		(*ladjtime)(const struct timeval *, struct timeval *)
+	)
+{
+	UNUSED_ARG(adj);
+	UNUSED_ARG(ladjtime);
+	return true;
+}
+
+bool
+step_systime(
+	doubletime_t	step
+	)
+{
+	UNUSED_ARG(step);
+	return false;
+}
+
+int
+ntp_adjtime_ns(
+	struct timex *	ntv
+	)
+{
+	UNUSED_ARG(ntv);
+	return TIME_OK;
+}
+
+int
+ntp_set_tod(
+	struct timespec *tvs
+	)
+{
+	UNUSED_ARG(tvs);
+	return 0;
+}
+
+
+void
+sendpkt(
+	sockaddr_u *	dest,
+	endpt *		ep,
+	void *		pkt,
+	unsigned int	len
+	)
+{
+	UNUSED_ARG(dest);
+	UNUSED_ARG(pkt);
+	UNUSED_ARG(len);
+	replay_sent++;
+	ep->sent++;
+}
+
+static endpt *
+replay_endpt(
+	const sockaddr_u *addr
+	)
+{
+	static bool	warned;
+	endpt *	ep;
+	int	i;
+
+	for (i = 0; i < nendpts; i++)
+		if (SOCK_EQ(&endpts[i].sin, addr))
+			return &endpts[i];
+	if (MAX_ENDPTS == nendpts) {
+		/* the rest share the last one */
+		if (!warned)
+			fprintf(stderr, "ntpdreplay: more than %d local "
+				"addresses, %s and later are counted as %s\n",
+				MAX_ENDPTS, socktoa(addr),
+				socktoa(&endpts[MAX_ENDPTS - 1].sin));
+		warned = true;
+		return &endpts[MAX_ENDPTS - 1];
+	}
+	ep = &endpts[nendpts++];
+	ep->sin = *addr;
+	strlcpy(ep->name, "replay", sizeof(ep->name));
+	ep->fd = -1;
+	ep->family = AF(addr);
+	ep->flags = INT_UP;
+	ep->inuse = true;
+	return ep;
+}
+
+endpt *
+getinterface(
+	sockaddr_u *	addr,
+	uint32_t	flags
+	)
+{
+	UNUSED_ARG(flags);
+	return replay_endpt(addr);
+}
+
+endpt *
+select_peerinterface(
+	struct peer *	peer,
+	sockaddr_u *	srcadr,
+	endpt *		dstadr
+	)
+{
+	UNUSED_ARG(peer);
+	UNUSED_ARG(dstadr);
+	return replay_endpt(srcadr);
+}
+
+endpt *
+findinterface(
+	sockaddr_u *	addr
+	)
+{
+	return replay_endpt(addr);
+}
+
+endpt *
+wildcard_interface(
+	const sockaddr_u *addr
+	)
+{
+	return replay_endpt(addr);
+}
+
+void interface_update(void) {}
+void io_open_sockets(void) {}
+void io_clr_stats(void) {}
+void announce_starting(void) {}
+
+void
+busypoll_config(
+	int	cpu,
+	int	priority,
+	int	sockpoll
+	)
+{
+	UNUSED_ARG(cpu);
+	UNUSED_ARG(priority);
+	UNUSED_ARG(sockpoll);
+}
+
+void
+add_nic_rule(
+	nic_rule_match	match_type,
+	const char *	if_name,
+	int		prefixlen,
+	nic_rule_action	action
+	)
+{
+	UNUSED_ARG(match_type);
+	UNUSED_ARG(if_name);
+	UNUSED_ARG(prefixlen);
+	UNUSED_ARG(action);
+}
+
+bool
+is_ip_address(
+	const char *	host,
+	unsigned short	af,
+	sockaddr_u *	addr
+	)
+{
+	if (!decodenetnum(host, addr))
+		return false;
+	return AF_UNSPEC == af || AF(addr) == af;
+}
+
+const char *
+latoa(
+	endpt *	la
+	)
+{
+	return (NULL == la) ? "<null>" : socktoa(&la->sin);
+}
+
+uint64_t dropped_count(void) { return 0; }
+uint64_t ignored_count(void) { return skipped; }
+uint64_t received_count(void) { return npkts; }
+uint64_t sent_count(void) { return replay_sent; }
+uint64_t notsent_count(void) { return 0; }
+uint64_t handler_calls_count(void) { return npkts; }
+uint64_t handler_pkts_count(void) { return npkts; }
+
+#ifdef REFCLOCK
+/* Reference clocks can be configured, but never get a device */
+uint64_t handler_refrds_count(void) { return 0; }
+void inc_received_count(void) {}
+
+bool
+io_addclock(
+	struct refclockio *rio
+	)
+{
+	UNUSED_ARG(rio);
+	return false;
+}
+
+void
+io_closeclock(
+	struct refclockio *rio
+	)
+{
+	UNUSED_ARG(rio);
+}
+#endif
+
+bool
+dns_probe(
+	struct peer *	pp
+	)
+{
+	UNUSED_ARG(pp);
+	return false;
+}
+
+const char *
+ntpd_version(void)
+{
+	return "ntpdreplay ntpsec-" NTPSEC_VERSION_EXTENDED;
+}
+
+
+/*
+ * replay_ip - pick the UDP datagram to port 123 out of an IP packet
+ */
+static void
+replay_ip(
+	uint64_t	ns,
+	const uint8_t *	p,
+	size_t		len
+	)
+{
+	sockaddr_u	src, dst;
+	size_t		hlen;
+	struct rpkt *	rp;
+
+	ZERO(src);
+	ZERO(dst);
+	if (len >= 20 && 4 == p[0] >> 4) {
+		hlen = (size_t)(p[0] & 0xf) * 4;
+		if (hlen < 20 || len < hlen + 8 || IPPROTO_UDP != p[9] ||
+		    (((p[6] << 8) | p[7]) & 0x3fff) != 0) /* fragment */
+			goto skip;
+		AF(&src) = AF(&dst) = AF_INET;
+		memcpy(&NSRCADR(&src), p + 12, 4);
+		memcpy(&NSRCADR(&dst), p + 16, 4);
+	} else if (len >= 48 && 6 == p[0] >> 4) {
+		hlen = 40;
+		if (IPPROTO_UDP != p[6])
+			goto skip;
+		AF(&src) = AF(&dst) = AF_INET6;
+		memcpy(PSOCK_ADDR6(&src), p + 8, 16);
+		memcpy(PSOCK_ADDR6(&dst), p + 24, 16);
+	} else {
+		goto skip;
+	}
+	p += hlen;
+	len -= hlen;
+	SET_PORT(&src, (unsigned short)((p[0] << 8) | p[1]));
+	SET_PORT(&dst, (unsigned short)((p[2] << 8) | p[3]));
+	if (NTP_PORT != SRCPORT(&dst) ||
+	    ((p[4] << 8) | p[5]) < 8 || len < (size_t)((p[4] << 8) | p[5]))
+		goto skip;
+	len = (size_t)((p[4] << 8) | p[5]) - 8;
+	if (len > RX_BUFF_SIZE)
+		goto skip;
+
+	if (npkts == pkts_size) {
+		pkts_size = pkts_size ? 2 * pkts_size : 1024;
+		pkts = ereallocarray(pkts, pkts_size, sizeof(*pkts));
+	}
+	rp = &pkts[npkts++];
+	rp->ns = ns;
+	rp->src = src;
+	rp->dst = replay_endpt(&dst);
+	rp->data = p + 8;
+	rp->len = len;
+	return;
+
+    skip:
+	skipped++;
+}
+
+/*
+ * replay_frame - strip the link layer
+ */
+static void
+replay_frame(
+	unsigned int	link,
+	uint64_t	ns,
+	const uint8_t *	p,
+	size_t		len
+	)
+{
+	unsigned int	type;
+
+	switch (link) {
+	case PCAPNG_LINK_RAW:
+		break;
+
+	case PCAPNG_LINK_ETHERNET:
+		if (len < 14)
+			goto skip;
+		type = (unsigned int)(p[12] << 8 | p[13]);
+		p += 14;
+		len -= 14;
+		if (0x8100 == type && len >= 4) {	/* 802.1Q */
+			type = (unsigned int)(p[2] << 8 | p[3]);
+			p += 4;
+			len -= 4;
+		}
+		if (0x0800 != type && 0x86DD != type)
+			goto skip;
+		break;
+
+	case LINK_LINUX_SLL:
+		if (len < 16)
+			goto skip;
+		type = (unsigned int)(p[14] << 8 | p[15]);
+		p += 16;
+		len -= 16;
+		if (0x0800 != type && 0x86DD != type)
+			goto skip;
+		break;
+
+	default:
+		goto skip;
+	}
+	replay_ip(ns, p, len);
+	return;
+
+    skip:
+	skipped++;
+}
+
+/*
+ * read_pcap - the classic format, one link type for the file
+ */
+static bool
+read_pcap(
+	const uint8_t *	buf,
+	size_t		size
+	)
+{
+	uint32_t	h[6], r[4];
+	bool		swap, nano;
+	size_t		off;
+	int		i;
+
+	memcpy(h, buf, sizeof(h));
+	swap = (bswap32(h[0]) == PCAP_MAGIC_US ||
+		bswap32(h[0]) == PCAP_MAGIC_NS);
+	if (swap)
+		for (i = 0; i < 6; i++)
+			h[i] = bswap32(h[i]);
+	nano = (PCAP_MAGIC_NS == h[0]);
+
+	for (off = sizeof(h); off + sizeof(r) <= size; ) {
+		memcpy(r, buf + off, sizeof(r));
+		if (swap)
+			for (i = 0; i < 4; i++)
+				r[i] = bswap32(r[i]);
+		off += sizeof(r);
+		if (r[2] > size - off)
+			return false;
+		replay_frame(h[5] & 0xffff, (uint64_t)r[0] * NS_PER_S +
+			     (uint64_t)r[1] * (nano ? 1 : 1000),
+			     buf + off, r[2]);
+		off += r[2];
+	}
+	return true;
+}
+
+/*
+ * tsresol_ns - scale a timestamp in units of if_tsresol to ns
+ */
+static uint64_t
+tsresol_ns(
+	uint64_t	ts,
+	uint8_t		res
+	)
+{
+	uint64_t	scale = 1;
+	int		i;
+
+	if (res & 0x80) {
+		res &= 0x7f;
+		if (res >= 64)
+			return 0;
+		return (ts >> res) * NS_PER_S +
+		       (((ts & ((1ULL << res) - 1)) * NS_PER_S) >> res);
+	}
+	for (i = 9; i < res; i++)
+		scale *= 10;
+	if (res > 9)
+		return ts / scale;
+	for (i = res; i < 9; i++)
+		scale *= 10;
+	return ts * scale;
+}
+
+/*
+ * read_pcapng - sections, interfaces and enhanced packet blocks
+ */
+static bool
+read_pcapng(
+	const uint8_t *	buf,
+	size_t		size
+	)
+{
+	uint16_t	links[MAX_IFACES];
+	uint8_t		tsres[MAX_IFACES];
+	unsigned int	nifaces = 0;
+	bool		swap = false;
+	size_t		off, opt;
+	uint32_t	type, blen, w[7];
+	uint16_t	code, olen;
+	int		i;
+
+	for (off = 0; off + 12 <= size; off += blen) {
+		memcpy(w, buf + off, 12);
+		type = w[0];
+		if (PCAPNG_SHB == type) {
+			swap = (bswap32(w[2]) == PCAPNG_MAGIC);
+			if (!swap && PCAPNG_MAGIC != w[2])
+				return false;
+			nifaces = 0;
+		}
+		blen = swap ? bswap32(w[1]) : w[1];
+		if (swap)
+			type = bswap32(type);
+		if (blen < 12 || (blen & 3) || blen > size - off)
+			return false;
+
+		if (PCAPNG_IDB == type && blen >= 20) {
+			if (nifaces == MAX_IFACES)
+				continue;
+			memcpy(&code, buf + off + 8, 2);
+			links[nifaces] = swap ? bswap16(code) : code;
+			tsres[nifaces] = 6;	/* microseconds */
+			for (opt = off + 16; opt + 4 <= off + blen - 4;
+			     opt += 4 + ((olen + 3u) & ~3u)) {
+				memcpy(&code, buf + opt, 2);
+				memcpy(&olen, buf + opt + 2, 2);
+				if (swap) {
+					code = bswap16(code);
+					olen = bswap16(olen);
+				}
+				if (PCAPNG_OPT_END == code)
+					break;
+				if (PCAPNG_OPT_TSRESOL == code && 1 == olen)
+					tsres[nifaces] = buf[opt + 4];
+			}
+			nifaces++;
+		} else if (PCAPNG_EPB == type && blen >= 32) {
+			memcpy(w, buf + off, sizeof(w));
+			if (swap)
+				for (i = 0; i < 7; i++)
+					w[i] = bswap32(w[i]);
+			if (w[2] >= nifaces || w[5] > blen - 32)
+				continue;
+			replay_frame(links[w[2]],
+				     tsresol_ns((uint64_t)w[3] << 32 | w[4],
+						tsres[w[2]]),
+				     buf + off + 28, w[5]);
+		}
+	}
+	return true;
+}
+
+static uint8_t *
+read_file(
+	const char *	path,
+	size_t *	size
+	)
+{
+	FILE *		fp;
+	uint8_t *	buf = NULL;
+	size_t		have = 0, got;
+
+	fp = fopen(path, "rb");
+	if (NULL == fp) {
+		fprintf(stderr, "ntpdreplay: %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	do {
+		buf = erealloc(buf, have + 65536);
+		got = fread(buf + have, 1, 65536, fp);
+		have += got;
+	} while (got > 0);
+	fclose(fp);
+	*size = have;
+	return buf;
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: ntpdreplay [options] capture-file\n"
+"  -c file   configuration to load first (none)\n"
+"  -n passes times through the capture (1)\n"
+"  -v        show ntpd log messages\n");
+	exit(1);
+}
+
+static double
+cpu_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(
+	int	argc,
+	char **	argv
+	)
+{
+	static struct recvbuf rbuf;
+	const char *	conf = NULL;
+	unsigned long	passes = 1, pass;
+	uint8_t *	buf;
+	size_t		size, i;
+	uint32_t	magic;
+	uint64_t	span, now, first;
+	uptime_t	ticks = 0;
+	sigset_t	alrm;
+	struct timespec	ts;
+	double		cpu;
+	bool		verbose = false, ok;
+	int		op;
+
+	while ((op = ntp_getopt(argc, argv, "c:n:v")) != -1) {
+		switch (op) {
+		case 'c':
+			conf = ntp_optarg;
+			break;
+		case 'n':
+			passes = strtoul(ntp_optarg, NULL, 10);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (ntp_optind != argc - 1 || passes < 1)
+		usage();
+
+	syslogit = false;
+	termlogit = verbose;
+
+	buf = read_file(argv[ntp_optind], &size);
+	if (size < 24) {
+		fprintf(stderr, "ntpdreplay: %s: too short\n", argv[ntp_optind]);
+		exit(1);
+	}
+	memcpy(&magic, buf, sizeof(magic));
+	if (PCAPNG_SHB == magic)
+		ok = read_pcapng(buf, size);
+	else if (PCAP_MAGIC_US == magic || PCAP_MAGIC_NS == magic ||
+		 PCAP_MAGIC_US == bswap32(magic) ||
+		 PCAP_MAGIC_NS == bswap32(magic))
+		ok = read_pcap(buf, size);
+	else {
+		fprintf(stderr, "ntpdreplay: %s: not a pcapng or pcap file\n",
+			argv[ntp_optind]);
+		exit(1);
+	}
+	if (!ok)
+		fprintf(stderr, "ntpdreplay: %s: damaged, using what came "
+			"before the damage\n", argv[ntp_optind]);
+	if (0 == npkts) {
+		fprintf(stderr, "ntpdreplay: no datagrams to port %d\n",
+			NTP_PORT);
+		exit(1);
+	}
+
+	/* The same order as ntpd.c */
+	auth_init();
+	init_util();
+	init_restrict();
+	init_mon();
+	init_control();
+	init_peer();
+	init_proto(false);
+	init_loopfilter();
+	init_readconfig();
+	if (conf != NULL)
+		readconfig(conf);
+	mon_start();
+	loop_config(LOOP_DRIFTINIT, 0);
+#ifndef DISABLE_NTS
+	nts_init();
+	if (ntsconfig.ntsenable)
+		nts_cookie_init2();	/* the listener is left out */
+#endif
+
+	/*
+	 * init_timer() arms a real interval timer; we don't want it,
+	 * nor transmits paced in real time
+	 */
+	init_timer();
+	timer_pace(0);
+	sigemptyset(&alrm);
+	sigaddset(&alrm, SIGALRM);
+	sigprocmask(SIG_BLOCK, &alrm, NULL);
+
+	first = pkts[0].ns;
+	span = pkts[npkts - 1].ns - first + NS_PER_S;
+	cpu = cpu_seconds();
+	for (pass = 0; pass < passes; pass++) {
+		for (i = 0; i < npkts; i++) {
+			now = pkts[i].ns + pass * span;
+			while (ticks < (now - first) / NS_PER_S) {
+				timer();
+				ticks++;
+			}
+			ts.tv_sec = (time_t)(now / NS_PER_S);
+			ts.tv_nsec = (long)(now % NS_PER_S);
+			rbuf.link = NULL;
+			rbuf.recv_srcadr = pkts[i].src;
+			rbuf.dstadr = pkts[i].dst;
+			rbuf.fd = -1;
+			rbuf.recv_time = tspec_stamp_to_lfp(ts);
+			rbuf.recv_length = pkts[i].len;
+			memcpy(rbuf.recv_buffer, pkts[i].data, pkts[i].len);
+			pkts[i].dst->received++;
+			receive(&rbuf);
+		}
+	}
+	cpu = cpu_seconds() - cpu;
+
+	printf("%zu datagrams x %lu passes in %.3f s CPU: %.0f packets/s "
+	       "(%lu other packets skipped)\n",
+	       npkts, passes, cpu,
+	       cpu > 0 ? (double)npkts * passes / cpu : 0, skipped);
+	printf("processed %llu  restricted %llu  rate limited %llu  "
+	       "KoD %llu/%llu suppressed\n",
+	       (unsigned long long)stat_total_processed(),
+	       (unsigned long long)stat_total_restricted(),
+	       (unsigned long long)stat_total_limitrejected(),
+	       (unsigned long long)stat_total_kodsent(),
+	       (unsigned long long)stat_total_kodsuppressed());
+	printf("bad length %llu  bad auth %llu  declined %llu  sent %llu\n",
+	       (unsigned long long)stat_total_badlength(),
+	       (unsigned long long)stat_total_badauth(),
+	       (unsigned long long)stat_total_declined(),
+	       (unsigned long long)replay_sent);
+#ifndef DISABLE_NTS
+	if (ntsconfig.ntsenable)
+		printf("NTS good %llu  bad %llu  cookies decoded %llu "
+		       "made %llu\n",
+		       (unsigned long long)nts_cnt.server_recv_good,
+		       (unsigned long long)nts_cnt.server_recv_bad,
+		       (unsigned long long)nts_cnt.cookie_decode_total,
+		       (unsigned long long)nts_cnt.cookie_make);
+#endif
+	free(pkts);
+	free(buf);
+	return 0;
+}
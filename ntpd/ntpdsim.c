@@ -0,0 +1,748 @@
+/*
+ * ntpdsim.c - run the ntpd protocol engine in virtual time
+ *
+ * Copyright the NTPsec project contributors
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This links ntp_proto.c, ntp_peer.c, ntp_loopfilter.c and ntp_timer.c
+ * just as ntpd does, but the clock (get_systime(), adj_systime(),
+ * step_systime() and ntp_adjtime_ns()) and the network (sendpkt())
+ * are models.  Nothing waits on the wall clock, so a day of protocol
+ * time takes seconds and a run is repeatable from its seed.
+ *
+ * The model:
+ *  - True time starts at zero.  Each whole second timer() runs, and
+ *    replies from the simulated servers are fed to receive() at their
+ *    arrival times in between.
+ *  - The local clock reads true time plus a phase error.  That grows
+ *    with the oscillator frequency error (which may random walk), any
+ *    kernel frequency set via ntp_adjtime_ns(), and adjtime() slews,
+ *    which run off at 500 PPM and are replaced by the next call, like
+ *    the BSD and Linux implementations.
+ *  - Each server keeps true time plus an offset drawn from a normal
+ *    distribution, which may random walk.  Each way across the network
+ *    costs a minimum delay plus an exponential queueing delay, and each
+ *    packet may be lost.
+ *
+ * Only the daemon loop discipline is modeled; the kernel PLL is not,
+ * so ntpdsim runs as if "disable kernel" were configured.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntpd.h"
+#include "ntp_calendar.h"
+#include "ntp_config.h"
+#include "ntp_dns.h"
+#include "ntp_refclock.h"
+#include "ntp_stdlib.h"
+#include "ntp_syscall.h"
+#include "ntp_syslog.h"
+#include "recvbuff.h"
+#include "timespecops.h"
+
+#define SIM_NET		0x0a000000	/* servers are 10.0.0.1 and up */
+#define SIM_LOCAL	0x0affffff	/* our address, 10.255.255.255 */
+#define SLEW_RATE	500e-6		/* adjtime() slew (s/s) */
+#define TURNAROUND	20e-6		/* server receive to transmit (s) */
+#define SIM_EPOCH	3976214400U	/* 2026-01-01 00:00:00 UTC, NTP era 0 */
+#define PI		3.14159265358979323846
+
+#define FREQTOD(x)	((x) / 65536e6)            /* NTP to double */
+#define DTOFREQ(x)	((int32_t)((x) * 65536e6)) /* double to NTP */
+
+static struct {
+	unsigned int	servers;	/* number of associations */
+	double		seconds;	/* protocol time to run */
+	uint64_t	seed;
+	double		offset;		/* server offset sd (s) */
+	double		wander;		/* server random walk (s/root s) */
+	double		delay;		/* minimum one way delay (s) */
+	double		jitter;		/* mean queueing delay (s) */
+	double		loss;		/* per packet, each way */
+	double		freq;		/* oscillator frequency error */
+	double		fwander;	/* oscillator random walk (/root s) */
+	double		phase;		/* initial local clock error (s) */
+	double		settle;		/* settled when |error| below (s) */
+	uint8_t		minpoll;
+	uint8_t		maxpoll;
+	bool		iburst;
+	unsigned long	report;		/* progress line interval (s) */
+} cfg = {
+	.servers = 4,
+	.seconds = SECSPERDAY,
+	.seed = 1,
+	.offset = 500e-6,
+	.wander = 0,
+	.delay = 10e-3,
+	.jitter = 1e-3,
+	.loss = 0,
+	.freq = 20e-6,
+	.fwander = 0,
+	.phase = 0,
+	.settle = 1e-3,
+	.minpoll = NTP_MINDPOLL,
+	.maxpoll = NTP_MAXDPOLL,
+	.iburst = true,
+	.report = 0,
+};
+
+/* The local clock */
+static struct {
+	double	t;		/* true time since start (s) */
+	double	phase;		/* local clock minus true time (s) */
+	double	freq;		/* oscillator frequency error (s/s) */
+	double	kfreq;		/* kernel frequency correction (s/s) */
+	double	slew;		/* adjtime() left to run off (s) */
+	unsigned long steps;
+} simclock;
+
+struct simserver {
+	double	offset;		/* server clock minus true time (s) */
+	double	walked;		/* true time offset was last walked to */
+};
+static struct simserver *servers;
+
+/* Replies in flight, a binary heap on arrival time */
+struct simpkt {
+	double		arrive;
+	unsigned int	server;
+	uint8_t		data[LEN_PKT_NOMAC];
+};
+static struct simpkt *inflight;
+static size_t inflight_count, inflight_size;
+
+static uint64_t sim_sent, sim_received, sim_lost;
+static uint64_t rng_state;
+
+/* What ntpd.c, ntp_io.c, ntp_config.c and ntp_dns.c would provide */
+const char *progname = "ntpdsim";
+int waitsync_fd_to_close = -1;
+volatile struct signals_detected sig_flags;
+struct REMOTE_CONFIG_INFO remote_config;
+struct ntp_io_data io_data;
+uptime_t io_timereset;
+uint16_t extra_port = 0;
+time_stepped_callback step_callback;
+static endpt sim_endpt;
+
+static void usage(void);
+
+
+/*
+ * xorshift64* - ntpd's own random() is seeded separately
+ */
+static double
+sim_uniform(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return ldexp((double)((rng_state * 0x2545F4914F6CDD1DULL) >> 11), -53);
+}
+
+static double
+sim_normal(void)
+{
+	double u = 1 - sim_uniform();	/* (0, 1] */
+
+	return sqrt(-2 * log(u)) * cos(2 * PI * sim_uniform());
+}
+
+static double
+sim_netdelay(void)
+{
+	return cfg.delay - cfg.jitter * log(1 - sim_uniform());
+}
+
+/*
+ * sim_advance - run true time forward, and the local clock with it
+ */
+static void
+sim_advance(
+	double	t
+	)
+{
+	double	dt = t - simclock.t;
+	double	s;
+
+	if (dt <= 0)
+		return;
+	s = SLEW_RATE * dt;
+	if (fabs(simclock.slew) <= s)
+		s = simclock.slew;
+	else if (simclock.slew < 0)
+		s = -s;
+	simclock.slew -= s;
+	simclock.phase += (simclock.freq + simclock.kfreq) * dt + s;
+	simclock.t = t;
+}
+
+static l_fp
+sim_stamp(
+	double	t
+	)
+{
+	return lfpinit_u(SIM_EPOCH, 0) + dtolfp(t);
+}
+
+static void
+sim_addr(
+	sockaddr_u *	addr,
+	uint32_t	a
+	)
+{
+	ZERO_SOCK(addr);
+	SET_AF(addr, AF_INET);
+	SET_ADDR4(addr, a);
+	SET_PORT(addr, NTP_PORT);
+}
+
+
+/*
+ * The clock, as libntp/systime.c and libntp/clockwork.c provide it
+ */
+void
+get_systime(
+	l_fp *	now
+	)
+{
+	*now = sim_stamp(simclock.t + simclock.phase);
+}
+
+bool
+adj_systime(
+	double	now,
+	int (*ladjtime)(const struct timeval *, struct timeval *)
+	)
+{
+	UNUSED_ARG(ladjtime);
+	/* See libntp/systime.c: a zero adjustment must not cancel one */
+	if (D_ISZERO_NS(now))
+		return true;
+	simclock.slew = now;
+	return true;
+}
+
+bool
+step_systime(
+	doubletime_t step
+	)
+{
+	simclock.phase += (double)step;
+	simclock.steps++;
+	msyslog(LOG_WARNING, "CLOCK: time stepped by %Lf", step);
+	if (step_callback)
+		(*step_callback)();
+	return true;
+}
+
+int
+ntp_adjtime_ns(
+	struct timex *	ntx
+	)
+{
+	if (ntx->modes & MOD_FREQUENCY)
+		simclock.kfreq = FREQTOD(ntx->freq);
+	ntx->freq = DTOFREQ(simclock.kfreq);
+	ntx->offset = 0;
+	return TIME_OK;
+}
+
+
+/*
+ * The network, as ntpd/ntp_io.c provides it
+ */
+static void
+inflight_push(
+	const struct simpkt *sp
+	)
+{
+	size_t	i;
+
+	if (inflight_count == inflight_size) {
+		inflight_size = inflight_size ? 2 * inflight_size : 1024;
+		inflight = ereallocarray(inflight, inflight_size,
+					  sizeof(*inflight));
+	}
+	for (i = inflight_count++; i > 0; i = (i - 1) / 2) {
+		if (inflight[(i - 1) / 2].arrive <= sp->arrive)
+			break;
+		inflight[i] = inflight[(i - 1) / 2];
+	}
+	inflight[i] = *sp;
+}
+
+static void
+inflight_pop(
+	struct simpkt *	sp
+	)
+{
+	const struct simpkt *last;
+	size_t	i, c;
+
+	*sp = inflight[0];
+	last = &inflight[--inflight_count];
+	for (i = 0; (c = 2 * i + 1) < inflight_count; i = c) {
+		if (c + 1 < inflight_count &&
+		    inflight[c + 1].arrive < inflight[c].arrive)
+			c++;
+		if (last->arrive <= inflight[c].arrive)
+			break;
+		inflight[i] = inflight[c];
+	}
+	inflight[i] = *last;
+}
+
+static void
+put_stamp(
+	uint8_t *	p,
+	l_fp		ts
+	)
+{
+	uint32_t w[2];
+
+	w[0] = htonl(lfpuint(ts));
+	w[1] = htonl(lfpfrac(ts));
+	memcpy(p, w, sizeof(w));
+}
+
+/*
+ * sendpkt - a request reaches its server, which maybe answers
+ */
+void
+sendpkt(
+	sockaddr_u *	dest,
+	endpt *		ep,
+	void *		pkt,
+	unsigned int	len
+	)
+{
+	const uint8_t *req = pkt;
+	struct simserver *srv;
+	struct simpkt	sp;
+	unsigned int	idx;
+	double		rx, tx, dt;
+	uint32_t	w;
+
+	UNUSED_ARG(ep);
+	sim_sent++;
+	sim_endpt.sent++;
+	if (!IS_IPV4(dest) || len < LEN_PKT_NOMAC ||
+	    PKT_MODE(req[0]) != MODE_CLIENT)
+		return;
+	idx = SRCADR(dest) - SIM_NET - 1;
+	if (idx >= cfg.servers)
+		return;
+	if (sim_uniform() < cfg.loss || sim_uniform() < cfg.loss) {
+		sim_lost++;
+		return;
+	}
+
+	srv = &servers[idx];
+	rx = simclock.t + sim_netdelay();
+	tx = rx + TURNAROUND;
+	dt = rx - srv->walked;
+	if (cfg.wander > 0 && dt > 0) {
+		srv->offset += cfg.wander * sqrt(dt) * sim_normal();
+		srv->walked = rx;
+	}
+
+	memset(sp.data, 0, sizeof(sp.data));
+	sp.data[0] = PKT_LI_VN_MODE(LEAP_NOWARNING, PKT_VERSION(req[0]),
+				    MODE_SERVER);
+	sp.data[1] = 1;				/* stratum */
+	sp.data[2] = req[2];			/* poll */
+	sp.data[3] = (uint8_t)-20;		/* precision */
+	w = htonl(DTOUFP(100e-6));		/* root dispersion */
+	memcpy(&sp.data[8], &w, sizeof(w));
+	memcpy(&sp.data[12], "SIM", 4);		/* refid */
+	put_stamp(&sp.data[16], sim_stamp(floor(rx + srv->offset)));
+	memcpy(&sp.data[24], &req[40], 8);	/* org = their xmt */
+	put_stamp(&sp.data[32], sim_stamp(rx + srv->offset));
+	put_stamp(&sp.data[40], sim_stamp(tx + srv->offset));
+	sp.arrive = tx + sim_netdelay();
+	sp.server = idx;
+	inflight_push(&sp);
+}
+
+static void
+sim_deliver(
+	const struct simpkt *sp
+	)
+{
+	static struct recvbuf rbuf;
+
+	rbuf.link = NULL;
+	sim_addr(&rbuf.recv_srcadr, SIM_NET + 1 + sp->server);
+	rbuf.dstadr = &sim_endpt;
+	rbuf.fd = -1;
+	get_systime(&rbuf.recv_time);
+	rbuf.recv_length = sizeof(sp->data);
+	memcpy(rbuf.recv_buffer, sp->data, sizeof(sp->data));
+	sim_received++;
+	sim_endpt.received++;
+	receive(&rbuf);
+}
+
+endpt *
+getinterface(
+	sockaddr_u *	addr,
+	uint32_t	flags
+	)
+{
+	UNUSED_ARG(addr);
+	UNUSED_ARG(flags);
+	return &sim_endpt;
+}
+
+endpt *
+select_peerinterface(
+	struct peer *	peer,
+	sockaddr_u *	srcadr,
+	endpt *		dstadr
+	)
+{
+	UNUSED_ARG(peer);
+	UNUSED_ARG(srcadr);
+	UNUSED_ARG(dstadr);
+	return &sim_endpt;
+}
+
+endpt *
+findinterface(
+	sockaddr_u *	addr
+	)
+{
+	UNUSED_ARG(addr);
+	return &sim_endpt;
+}
+
+endpt *
+wildcard_interface(
+	const sockaddr_u *addr
+	)
+{
+	UNUSED_ARG(addr);
+	return &sim_endpt;
+}
+
+void interface_update(void) {}
+
+const char *
+latoa(
+	endpt *	la
+	)
+{
+	return (NULL == la) ? "<null>" : socktoa(&la->sin);
+}
+
+uint64_t dropped_count(void) { return 0; }
+uint64_t ignored_count(void) { return 0; }
+uint64_t received_count(void) { return sim_received; }
+uint64_t sent_count(void) { return sim_sent; }
+uint64_t notsent_count(void) { return 0; }
+uint64_t handler_calls_count(void) { return sim_received; }
+uint64_t handler_pkts_count(void) { return sim_received; }
+
+#ifdef REFCLOCK
+/* Reference clocks can be configured, but never get a device */
+char *sys_phone[2];		/* no phone numbers, NULL terminated */
+void inc_received_count(void) {}
+uint64_t handler_refrds_count(void) { return 0; }
+
+bool
+io_addclock(
+	struct refclockio *rio
+	)
+{
+	UNUSED_ARG(rio);
+	return false;
+}
+
+void
+io_closeclock(
+	struct refclockio *rio
+	)
+{
+	UNUSED_ARG(rio);
+}
+#endif
+
+void
+config_remotely(
+	sockaddr_u *	remote_addr
+	)
+{
+	UNUSED_ARG(remote_addr);
+}
+
+bool
+dns_probe(
+	struct peer *	pp
+	)
+{
+	UNUSED_ARG(pp);
+	return false;
+}
+
+const char *
+ntpd_version(void)
+{
+	return "ntpdsim ntpsec-" NTPSEC_VERSION_EXTENDED;
+}
+
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: ntpdsim [options]\n"
+"  -n servers   number of associations (4)\n"
+"  -t days      protocol time to run (1)\n"
+"  -s seed      random seed (1)\n"
+"  -o ms        server offset standard deviation (0.5)\n"
+"  -w us        server offset random walk per root second (0)\n"
+"  -d ms        minimum one way delay (10)\n"
+"  -j ms        mean one way queueing delay (1)\n"
+"  -l fraction  packet loss, each way (0)\n"
+"  -f ppm       oscillator frequency error (20)\n"
+"  -W ppb       oscillator frequency random walk per root second (0)\n"
+"  -F ppm       initial frequency, as if from a drift file (none)\n"
+"  -p ms        initial local clock error (0)\n"
+"  -e ms        settled when the clock error stays below this (1)\n"
+"  -m minpoll   (%d)\n"
+"  -M maxpoll   (%d)\n"
+"  -b           no iburst\n"
+"  -r seconds   print the clock state this often (never)\n"
+"  -v           show ntpd log messages\n",
+		NTP_MINDPOLL, NTP_MAXDPOLL);
+	exit(1);
+}
+
+static double
+cpu_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(
+	int	argc,
+	char **	argv
+	)
+{
+	struct peer_ctl	ctl;
+	struct simpkt	sp;
+	sockaddr_u	addr;
+	sigset_t	alrm;
+	unsigned int	i;
+	double		next, err, cpu;
+	double		t_sync = -1, t_unsettled = 0;
+	double		sum = 0, sumsq = 0, worst = 0;
+	unsigned long	samples = 0;
+	double		drift = 0;
+	bool		drift_set = false, verbose = false;
+	int		op;
+
+	while ((op = ntp_getopt(argc, argv, "n:t:s:o:w:d:j:l:f:W:F:p:e:m:M:br:v")) != -1) {
+		switch (op) {
+		case 'n':
+			cfg.servers = (unsigned int)strtoul(ntp_optarg, NULL, 10);
+			break;
+		case 't':
+			cfg.seconds = atof(ntp_optarg) * SECSPERDAY;
+			break;
+		case 's':
+			cfg.seed = strtoull(ntp_optarg, NULL, 10);
+			break;
+		case 'o':
+			cfg.offset = atof(ntp_optarg) * 1e-3;
+			break;
+		case 'w':
+			cfg.wander = atof(ntp_optarg) * 1e-6;
+			break;
+		case 'd':
+			cfg.delay = atof(ntp_optarg) * 1e-3;
+			break;
+		case 'j':
+			cfg.jitter = atof(ntp_optarg) * 1e-3;
+			break;
+		case 'l':
+			cfg.loss = atof(ntp_optarg);
+			break;
+		case 'f':
+			cfg.freq = atof(ntp_optarg) * 1e-6;
+			break;
+		case 'W':
+			cfg.fwander = atof(ntp_optarg) * 1e-9;
+			break;
+		case 'F':
+			drift = atof(ntp_optarg);
+			drift_set = true;
+			break;
+		case 'p':
+			cfg.phase = atof(ntp_optarg) * 1e-3;
+			break;
+		case 'e':
+			cfg.settle = atof(ntp_optarg) * 1e-3;
+			break;
+		case 'm':
+			cfg.minpoll = (uint8_t)atoi(ntp_optarg);
+			break;
+		case 'M':
+			cfg.maxpoll = (uint8_t)atoi(ntp_optarg);
+			break;
+		case 'b':
+			cfg.iburst = false;
+			break;
+		case 'r':
+			cfg.report = strtoul(ntp_optarg, NULL, 10);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (ntp_optind != argc || cfg.servers < 1 ||
+	    cfg.servers >= SIM_LOCAL - SIM_NET || cfg.seconds <= 0)
+		usage();
+
+	syslogit = false;
+	termlogit = verbose;
+	rng_state = cfg.seed * 0x9E3779B97F4A7C15ULL + 1;
+	srandom((unsigned int)cfg.seed);
+
+	simclock.phase = cfg.phase;
+	simclock.freq = cfg.freq;
+	servers = emalloc_zero(cfg.servers * sizeof(*servers));
+	for (i = 0; i < cfg.servers; i++)
+		servers[i].offset = cfg.offset * sim_normal();
+
+	sim_addr(&sim_endpt.sin, SIM_LOCAL);
+	strlcpy(sim_endpt.name, "sim", sizeof(sim_endpt.name));
+	sim_endpt.fd = -1;
+	sim_endpt.family = AF_INET;
+	sim_endpt.flags = INT_UP;
+	sim_endpt.inuse = true;
+
+	/* The same order as ntpd.c */
+	init_util();
+	init_restrict();
+	init_mon();
+	init_control();
+	init_peer();
+	init_proto(false);
+	init_loopfilter();
+
+	clock_ctl.allow_panic = true;		/* -g */
+	select_loop(false);			/* disable kernel */
+	if (drift_set)
+		loop_config(LOOP_FREQ, drift);
+	mon_start();
+	loop_config(LOOP_DRIFTINIT, 0);
+
+	ZERO(ctl);
+	ctl.version = NTP_VERSION;
+	ctl.minpoll = cfg.minpoll;
+	ctl.maxpoll = cfg.maxpoll;
+	ctl.flags = FLAG_CONFIG | (cfg.iburst ? FLAG_IBURST : 0);
+	for (i = 0; i < cfg.servers; i++) {
+		sim_addr(&addr, SIM_NET + 1 + i);
+		if (NULL == newpeer(&addr, NULL, &sim_endpt, MODE_CLIENT,
+				    &ctl, MDF_UCAST, true)) {
+			fprintf(stderr, "ntpdsim: can't mobilize %s\n",
+				socktoa(&addr));
+			exit(1);
+		}
+	}
+
+	/*
+	 * init_timer() arms a real interval timer; we don't want it,
+	 * nor transmits paced in real time
+	 */
+	init_timer();
+	timer_pace(0);
+	sigemptyset(&alrm);
+	sigaddset(&alrm, SIGALRM);
+	sigprocmask(SIG_BLOCK, &alrm, NULL);
+
+	cpu = cpu_seconds();
+	for (next = 1; next <= cfg.seconds; next++) {
+		while (inflight_count > 0 && inflight[0].arrive < next) {
+			inflight_pop(&sp);
+			sim_advance(sp.arrive);
+			sim_deliver(&sp);
+		}
+		sim_advance(next);
+		if (cfg.fwander > 0)
+			simclock.freq += cfg.fwander * sim_normal();
+		timer();
+
+		if (t_sync < 0 && NULL != sys_vars.sys_peer)
+			t_sync = next;
+		err = simclock.phase;
+		if (t_sync < 0 || fabs(err) >= cfg.settle)
+			t_unsettled = next;
+		if (next > cfg.seconds / 2) {
+			sum += err;
+			sumsq += err * err;
+			if (fabs(err) > worst)
+				worst = fabs(err);
+			samples++;
+		}
+		if (cfg.report && 0 == (unsigned long)next % cfg.report)
+			printf("%9.0f error %+11.3f us  offset %+11.3f us  "
+			       "jitter %9.3f us  freq %+9.3f ppm  poll %d\n",
+			       next, err * 1e6, clkstate.sys_offset * 1e6,
+			       clkstate.sys_jitter * 1e6,
+			       loop_data.drift_comp * 1e6, clkstate.sys_poll);
+	}
+	cpu = cpu_seconds() - cpu;
+
+	printf("%u servers, %.2f days in %.3f s CPU (%.0fx real time)\n",
+	       cfg.servers, cfg.seconds / SECSPERDAY, cpu,
+	       cpu > 0 ? cfg.seconds / cpu : 0);
+	if (t_sync < 0)
+		printf("sync:    never\n");
+	else
+		printf("sync:    first system peer at %.0f s\n", t_sync);
+	if (t_unsettled >= cfg.seconds)
+		printf("settle:  not within %g ms at the end\n",
+		       cfg.settle * 1e3);
+	else
+		printf("settle:  within %g ms of true time from %.0f s\n",
+		       cfg.settle * 1e3, t_unsettled + 1);
+	if (samples > 0) {
+		double mean = sum / samples;
+
+		printf("steady:  error mean %+.3f us, sd %.3f us, "
+		       "max %.3f us (second half)\n",
+		       mean * 1e6,
+		       sqrt(fmax(sumsq / samples - mean * mean, 0)) * 1e6,
+		       worst * 1e6);
+	}
+	printf("clock:   %lu steps, frequency %+.3f ppm "
+	       "(oscillator %+.3f ppm), poll %d\n",
+	       simclock.steps, loop_data.drift_comp * 1e6,
+	       simclock.freq * 1e6, clkstate.sys_poll);
+	printf("packets: %llu sent, %llu received, %llu lost\n",
+	       (unsigned long long)sim_sent,
+	       (unsigned long long)sim_received,
+	       (unsigned long long)sim_lost);
+	printf("cpu:     %.3f us per association per simulated hour\n",
+	       cpu * 1e6 / cfg.servers / (cfg.seconds / SECSPERHR));
+	return 0;
+}
@@ -44,6 +44,9 @@ struct ntsconfig_t ntsconfig = {
 	.ca = NULL,
 	.aead = NULL,
 	.tlscipherserverpreference = false,
+	.ke_rate = NTS_KE_RATE,
+	.ke_prefixrate = NTS_KE_PREFIXRATE,
+	.ke_queue = NTS_KE_QUEUE,
 };
 
 void nts_log_version(void);
@@ -144,11 +147,57 @@ uint16_t nts_string_to_aead(const char* text) {
 		return AEAD_AES_SIV_CMAC_384;
 	} else if (0 == strcmp(text, "AES_SIV_CMAC_512")) {
 		return AEAD_AES_SIV_CMAC_512;
+	} else if (0 == strcmp(text, "AES_128_GCM_SIV")) {
+		return AEAD_AES_128_GCM_SIV;
 	} else {
 		return NO_AEAD;
 	}
 }
 
+/* Translate a colon separated list of AEAD names, most preferred
+ * first.  Names we don't know and algorithms this OpenSSL can't do
+ * are skipped.  Returns the number of codes stored. */
+int nts_string_to_aeads(const char* text, uint16_t *aeads, int max) {
+	char name[32];
+	int count = 0;
+
+	while ((count < max) && ('\0' != *text)) {
+		size_t len = strcspn(text, ":");
+		uint16_t aead;
+
+		if (len < sizeof(name)) {
+			memcpy(name, text, len);
+			name[len] = '\0';
+			aead = nts_string_to_aead(name);
+			if ((NO_AEAD != aead) && nts_aead_ok(aead)) {
+				aeads[count++] = aead;
+			} else {
+				msyslog(LOG_ERR, "NTS: unusable AEAD: %s", name);
+			}
+		}
+		text += len;
+		if (':' == *text) {
+			text++;
+		}
+	}
+	return count;
+}
+
+/* What we ask for when nothing is configured: GCM-SIV if this
+ * OpenSSL has it, since it is about twice as fast per packet,
+ * then the mandatory AES_SIV_CMAC_256. */
+int nts_default_aeads(uint16_t *aeads, int max) {
+	int count = 0;
+
+	if ((count < max) && nts_aead_ok(AEAD_AES_128_GCM_SIV)) {
+		aeads[count++] = AEAD_AES_128_GCM_SIV;
+	}
+	if (count < max) {
+		aeads[count++] = AEAD_AES_SIV_CMAC_256;
+	}
+	return count;
+}
+
 /* returns key length, 0 if unknown arg */
 int nts_get_key_length(uint16_t aead) {
 	switch (aead) {
@@ -158,6 +207,8 @@ int nts_get_key_length(uint16_t aead) {
 		return AEAD_AES_SIV_CMAC_384_KEYLEN;
 	    case AEAD_AES_SIV_CMAC_512:
 		return AEAD_AES_SIV_CMAC_512_KEYLEN;
+	    case AEAD_AES_128_GCM_SIV:
+		return AEAD_AES_128_GCM_SIV_KEYLEN;
 	    default:
 		return 0;
 	}
@@ -47,6 +47,7 @@ bool nts_client_send_request_core(uint8_t *buff, int buf_size, int *used, struct
 bool nts_client_process_response(SSL *ssl, struct peer *peer);
 bool nts_client_process_response_core(uint8_t *buff, int transferred, struct peer* peer);
 bool nts_server_lookup(char *server, sockaddr_u *addr, int af);
+static void nts_cookie_space(struct ntsclient_t *state, int length);
 
 static SSL_CTX *client_ctx = NULL;
 
@@ -123,6 +124,7 @@ bool nts_probe(struct peer * peer) {
 		ssl = SSL_new(ctx);
 		SSL_CTX_free(ctx);
 	}
+	mem_count(MEM_TLS, 0, 1);
 	set_hostname(ssl, hostname);
 	SSL_set_fd(ssl, server);
 
@@ -177,6 +179,7 @@ bool nts_probe(struct peer * peer) {
 	}
 	SSL_shutdown(ssl);
 	SSL_free(ssl);
+	mem_count(MEM_TLS, 0, -1);
 	close(server);
 
 	clock_gettime(CLOCK_MONOTONIC, &finish);
@@ -202,6 +205,24 @@ bool nts_check(struct peer *peer) {
 	return addrOK;
 }
 
+/* Cookies are kept in one array sized for the length the server uses,
+ * rather than NTS_MAX_COOKIELEN each, so thousands of NTS associations
+ * (and every association not using NTS) don't carry 1.5K of mostly
+ * unused space.  A new NTS-KE may bring a different length. */
+static void nts_cookie_space(struct ntsclient_t *state, int length) {
+	if ((NULL != state->cookies) && (length == state->cookielen))
+		return;
+	nts_free_cookies(state);
+	state->cookies = etallocarray(MEM_PEER, NTS_MAX_COOKIES, (size_t)length);
+	state->cookielen = length;
+}
+
+void nts_free_cookies(struct ntsclient_t *state) {
+	etfree(MEM_PEER, state->cookies, NTS_MAX_COOKIES, (size_t)state->cookielen);
+	state->cookies = NULL;
+	state->cookielen = 0;
+}
+
 SSL_CTX* make_ssl_client_ctx(const char * filename) {
 	bool ok = true;
 	SSL_CTX *ctx;
@@ -561,7 +582,9 @@ bool nts_client_send_request(SSL *ssl, struct peer* peer) {
 
 bool nts_client_send_request_core(uint8_t *buff, int buf_size, int *used, struct peer* peer) {
 	struct  BufCtl_t buf;
-	uint16_t aead = NO_AEAD;
+	const uint16_t *aeads;
+	uint16_t defaults[NTS_MAX_AEADS];
+	int naead;
 
 	buf.next = buff;
 	buf.left = buf_size;
@@ -570,16 +593,21 @@ bool nts_client_send_request_core(uint8_t *buff, int buf_size, int *used, struct
 	ke_append_record_uint16(&buf,
 				NTS_CRITICAL+nts_next_protocol_negotiation, nts_protocol_NTP);
 
-	/* 4.1.5 AEAD Algorithm List */
-	// FIXME should be : separated list
-
-	if ((NO_AEAD == aead) && (NULL != peer->cfg.nts_cfg.aead))
-		aead = nts_string_to_aead(peer->cfg.nts_cfg.aead);
-	if ((NO_AEAD == aead) && (NULL != ntsconfig.aead))
-		aead = nts_string_to_aead(ntsconfig.aead);
-	if (NO_AEAD == aead)
-		aead = AEAD_AES_SIV_CMAC_256;
-	ke_append_record_uint16(&buf, nts_algorithm_negotiation, aead);
+	/* 4.1.5 AEAD Algorithm List, most preferred first.
+	 * The configured lists were parsed when they were read. */
+	naead = peer->cfg.nts_cfg.naeads;
+	aeads = peer->cfg.nts_cfg.aeads;
+	if (0 == naead) {
+		naead = ntsconfig.naeads;
+		aeads = ntsconfig.aeads;
+	}
+	if (0 == naead) {
+		naead = nts_default_aeads(defaults, NTS_MAX_AEADS);
+		aeads = defaults;
+	}
+	append_header(&buf, nts_algorithm_negotiation, naead*NTS_KE_U16_LNG);
+	for (int i=0; i<naead; i++)
+		append_uint16(&buf, aeads[i]);
 
 	/* 4.1.1: End, Critical */
 	ke_append_record_null(&buf, NTS_CRITICAL+nts_end_of_message);
@@ -614,6 +642,7 @@ bool nts_client_process_response_core(uint8_t *buff, int transferred, struct pee
 	peer->nts_state.writeIdx = 0;
 	peer->nts_state.readIdx = 0;
 	peer->nts_state.count = 0;
+	peer->nts_state.refresh = 0;
 
 	buf.next = buff;
 	buf.left = transferred;
@@ -654,7 +683,7 @@ bool nts_client_process_response_core(uint8_t *buff, int transferred, struct pee
 				return false;
 			}
 			keylength = nts_get_key_length(data);
-			if (0 == keylength) {
+			if ((0 == keylength) || !nts_aead_ok(data)) {
 				msyslog(LOG_ERR, "NTSc: AN-Unsupported AEAN type: %d", data);
 				return false;
 			}
@@ -665,8 +694,12 @@ bool nts_client_process_response_core(uint8_t *buff, int transferred, struct pee
 				msyslog(LOG_ERR, "NTSc: NC cookie too big: %d", length);
 				return false;
 			}
-			if (0 == peer->nts_state.cookielen)
-				peer->nts_state.cookielen = length;
+			if (0 >= length) {
+				msyslog(LOG_ERR, "NTSc: NC empty cookie");
+				return false;
+			}
+			if (0 == peer->nts_state.count)
+				nts_cookie_space(&peer->nts_state, length);
 			if (length != peer->nts_state.cookielen) {
 				msyslog(LOG_ERR, "NTSc: Cookie length mismatch %d, %d.",
 					length, peer->nts_state.cookielen);
@@ -675,12 +708,15 @@ bool nts_client_process_response_core(uint8_t *buff, int transferred, struct pee
 			idx = peer->nts_state.writeIdx;
 			if (NTS_MAX_COOKIES <= peer->nts_state.count) {
 				msyslog(LOG_ERR, "NTSc: Extra cookie ignored.");
+				buf.next += length;
+				buf.left -= length;
 				break;
 			}
-			next_bytes(&buf, (uint8_t*)&peer->nts_state.cookies[idx], length);
+			next_bytes(&buf, NTS_COOKIE(&peer->nts_state, idx), length);
 			peer->nts_state.writeIdx++;
 			peer->nts_state.writeIdx = peer->nts_state.writeIdx % NTS_MAX_COOKIES;
 			peer->nts_state.count++;
+			peer->nts_state.refreshed++;
 			break;
 		    case nts_server_negotiation:
 			if (MAX_SERVER < (length+1)) {
@@ -29,8 +29,10 @@
 #include <unistd.h>
 
 #include <aes_siv.h>
+#include <openssl/evp.h>
 
 #include "ntpd.h"
+#include "ntp_probe.h"
 #include "ntp_stdlib.h"
 #include "nts.h"
 #include "nts2.h"
@@ -43,6 +45,15 @@
  *  P is AEAD, C2S, S2C
  *  length of C2S and S2C depends upon AEAD
  *  CMAC is 16 bytes
+ *
+ * Short cookies have P = AEAD|COOKIE_SECRET, S
+ *  S is the NTS exporter secret of the NTS-KE TLS session,
+ *  Derive-Secret(exporter_master_secret, NTS label) from RFC 8446 7.5.
+ *  C2S and S2C are the last HKDF step of the TLS exporter on S,
+ *  so they come out the same as the client's.
+ *  S is 32 or 48 bytes (SHA-256 or SHA-384 cipher suite), so these
+ *  are 72 or 88 bytes rather than 104 to 168.  We only use them
+ *  when they are shorter.  Old cookies are still accepted.
  */
 
 /* K and I should be preserved across boots, and rotated every day or so.
@@ -76,6 +87,8 @@
  * ------
  * 168
  *
+ * Short cookies: 4+16+16+4+48 = 88 at most.
+ *
  * That's the max length for our cookies.
  * Round up a bit in case another implementation uses more.
  * #define is in include/nts.h
@@ -108,11 +121,35 @@ void nts_unlock_cookielock(void);
 /* Associated data: aead (rounded up to 4) plus NONCE */
 #define AD_LENGTH 20
 #define AEAD_LENGTH 4
+/* In the AEAD slot of the plaintext: S follows rather than C2S, S2C */
+#define COOKIE_SECRET 0x80000000u
+
+/* Also protected by cookie_lock */
+static EVP_MD_CTX *kdf_ctx, *kdf_ipad, *kdf_opad;
+static const EVP_MD *kdf_sha256, *kdf_sha384;
+
+static bool secret_keys(uint16_t aead, const uint8_t *secret, int secretlen,
+  uint8_t *c2s, uint8_t *s2c, int keylen);
 
 /* cookie_ctx needed for client side */
 bool nts_cookie_init(void) {
   cookie_ctx = AES_SIV_CTX_new();
-  if (NULL == cookie_ctx) {
+  kdf_ctx = EVP_MD_CTX_new();
+  kdf_ipad = EVP_MD_CTX_new();
+  kdf_opad = EVP_MD_CTX_new();
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  /* The implicit fetch behind EVP_sha256() costs more than the hash */
+  if (NULL == kdf_sha256) {
+    kdf_sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
+    kdf_sha384 = EVP_MD_fetch(NULL, "SHA384", NULL);
+  }
+#else
+  kdf_sha256 = EVP_sha256();
+  kdf_sha384 = EVP_sha384();
+#endif
+  if ((NULL == cookie_ctx) || (NULL == kdf_ctx) ||
+      (NULL == kdf_ipad) || (NULL == kdf_opad) ||
+      (NULL == kdf_sha256) || (NULL == kdf_sha384)) {
     msyslog(LOG_ERR, "NTS: Can't init cookie_ctx");
     exit(1);
   }
@@ -283,10 +320,12 @@ bool nts_write_cookie_keys(void) {
 	return true;
 }
 
-/* returns actual length */
+/* returns actual length
+ * secretlen is 0 if we don't have the session secret */
 int nts_make_cookie(uint8_t *cookie,
   uint16_t aead,
-  uint8_t *c2s, uint8_t *s2c, int keylen) {
+  uint8_t *c2s, uint8_t *s2c, int keylen,
+  uint8_t *secret, int secretlen) {
 	uint8_t plaintext[NTS_MAX_COOKIELEN];
 	uint8_t *nonce;
 	int used, plainlength;
@@ -307,13 +346,22 @@ int nts_make_cookie(uint8_t *cookie,
 	 * but costs cache space
 	 */
 	finger = plaintext;
-	temp = aead;
-	memcpy(finger, &temp, AEAD_LENGTH);
-	finger += AEAD_LENGTH;
-	memcpy(finger, c2s, keylen);
-	finger += keylen;
-	memcpy(finger, s2c, keylen);
-	finger += keylen;
+	if ((0 < secretlen) && (secretlen < 2*keylen)) {
+		nts_cnt.cookie_make_short++;
+		temp = aead | COOKIE_SECRET;
+		memcpy(finger, &temp, AEAD_LENGTH);
+		finger += AEAD_LENGTH;
+		memcpy(finger, secret, secretlen);
+		finger += secretlen;
+	} else {
+		temp = aead;
+		memcpy(finger, &temp, AEAD_LENGTH);
+		finger += AEAD_LENGTH;
+		memcpy(finger, c2s, keylen);
+		finger += keylen;
+		memcpy(finger, s2c, keylen);
+		finger += keylen;
+	}
 	plainlength = finger-plaintext;
 
 	/* collect associated data */
@@ -356,10 +404,12 @@ int nts_make_cookie(uint8_t *cookie,
 	return used;
 }
 
-/* can't decrypt in place - that would trash the unauthenticated packet */
+/* can't decrypt in place - that would trash the unauthenticated packet
+ * secretlen is set to 0 for old style cookies */
 bool nts_unpack_cookie(uint8_t *cookie, int cookielen,
   uint16_t *aead,
-  uint8_t *c2s, uint8_t *s2c, int *keylen) {
+  uint8_t *c2s, uint8_t *s2c, int *keylen,
+  uint8_t *secret, int *secretlen) {
 	uint8_t *finger;
 	uint8_t plaintext[NTS_MAX_COOKIELEN];
 	uint8_t *nonce;
@@ -393,6 +443,7 @@ bool nts_unpack_cookie(uint8_t *cookie, int cookielen,
 	nts_cnt.cookie_decode_total++;  /* total attempts, includes too old */
 	if (nts_nKeys == i) {
 		nts_cnt.cookie_decode_too_old++;
+		NTP_PROBE(cookie, cookielen, -1, false, 0);
 		return false;
         }
 	if (0 == i) {
@@ -430,26 +481,203 @@ bool nts_unpack_cookie(uint8_t *cookie, int cookielen,
 			     finger, cipherlength,
 			     cookie, AD_LENGTH);
 
+	if (ok && (AEAD_LENGTH <= plainlength)) {
+		finger = plaintext;
+		memcpy(&temp, finger, AEAD_LENGTH);
+		*aead = temp & 0xFFFF;
+		finger += AEAD_LENGTH;
+		if (temp & COOKIE_SECRET) {
+			*secretlen = plainlength-AEAD_LENGTH;
+			*keylen = nts_get_key_length(*aead);
+			ok = (NTS_MAX_SECRETLEN >= *secretlen);
+			if (ok) {
+				memcpy(secret, finger, *secretlen);
+				ok = secret_keys(*aead, secret, *secretlen,
+						 c2s, s2c, *keylen);
+			}
+		} else {
+			*secretlen = 0;
+			*keylen = (plainlength-AEAD_LENGTH)/2;
+			memcpy(c2s, finger, *keylen);
+			finger += *keylen;
+			memcpy(s2c, finger, *keylen);
+		}
+	} else {
+		ok = false;
+	}
+
 	nts_unlock_cookielock();
 
+	/* key age in days, whether it decoded, and the AEAD inside */
+	NTP_PROBE(cookie, cookielen, i, ok, ok ? *aead : 0);
 	if (!ok) {
 		nts_cnt.cookie_decode_error++;
 		return false;
 	}
 
-	*keylen = (plainlength-AEAD_LENGTH)/2;
-	finger = plaintext;
-	memcpy(&temp, finger, AEAD_LENGTH);
-	*aead = temp;
-	finger += AEAD_LENGTH;
-	memcpy(c2s, finger, *keylen);
-	finger += *keylen;
-	memcpy(s2c, finger, *keylen);
-	finger += *keylen;
+	return true;
+}
+
+/*
+ * TLS 1.3 exporter, RFC 8446 section 7.5
+ *   TLS-Exporter(label, context, length) =
+ *     HKDF-Expand-Label(Derive-Secret(Secret, label, ""),
+ *                       "exporter", Hash(context), length)
+ * The Derive-Secret step only depends on the session and our label,
+ * so that is what we keep in cookies.  The rest is one HMAC per key
+ * (two for 64 byte keys with SHA-256).  Both keys use the same HMAC
+ * key, so the padded key is hashed once and the state copied.
+ * That needs the kdf contexts, so the caller holds cookie_lock.
+ *
+ * The hash is implied by the secret length.
+ */
+static const EVP_MD *secret_md(int secretlen) {
+	if (32 == secretlen)
+		return kdf_sha256;
+	if (48 == secretlen)
+		return kdf_sha384;
+	return NULL;
+}
+
+static bool kdf_hash(const EVP_MD *md, const uint8_t *data, int datalen,
+  uint8_t *out) {
+	unsigned int len;
+	return (1 == EVP_DigestInit_ex(kdf_ctx, md, NULL)) &&
+	       (1 == EVP_DigestUpdate(kdf_ctx, data, datalen)) &&
+	       (1 == EVP_DigestFinal_ex(kdf_ctx, out, &len));
+}
+
+/* HMAC key.  It is never longer than a block here. */
+static bool kdf_key(const EVP_MD *md, const uint8_t *key, int keylen) {
+	uint8_t pad[EVP_MAX_MD_SIZE*2];   /* block size is 2x hash */
+	int block = EVP_MD_block_size(md);
+
+	memset(pad, 0x36, block);
+	for (int i=0; i<keylen; i++)
+		pad[i] ^= key[i];
+	if ((1 != EVP_DigestInit_ex(kdf_ipad, md, NULL)) ||
+	    (1 != EVP_DigestUpdate(kdf_ipad, pad, block)))
+		return false;
+	for (int i=0; i<block; i++)
+		pad[i] ^= 0x36^0x5c;
+	return (1 == EVP_DigestInit_ex(kdf_opad, md, NULL)) &&
+	       (1 == EVP_DigestUpdate(kdf_opad, pad, block));
+}
 
+static bool kdf_hmac(const uint8_t *data, int datalen, uint8_t *out) {
+	uint8_t inner[EVP_MAX_MD_SIZE];
+	unsigned int len;
+
+	return (1 == EVP_MD_CTX_copy_ex(kdf_ctx, kdf_ipad)) &&
+	       (1 == EVP_DigestUpdate(kdf_ctx, data, datalen)) &&
+	       (1 == EVP_DigestFinal_ex(kdf_ctx, inner, &len)) &&
+	       (1 == EVP_MD_CTX_copy_ex(kdf_ctx, kdf_opad)) &&
+	       (1 == EVP_DigestUpdate(kdf_ctx, inner, len)) &&
+	       (1 == EVP_DigestFinal_ex(kdf_ctx, out, &len));
+}
+
+/* HMAC key already set by kdf_key() */
+static bool hkdf_expand_label(const EVP_MD *md, const char *label,
+  const uint8_t *context, int contextlen, uint8_t *out, int outlen) {
+	uint8_t info[4+64+EVP_MAX_MD_SIZE];	/* HkdfLabel */
+	uint8_t data[EVP_MAX_MD_SIZE+sizeof(info)+1];
+	uint8_t t[EVP_MAX_MD_SIZE];
+	int hashlen = EVP_MD_size(md);
+	int labellen = strlen(label);
+	int infolen, tlen, used;
+
+	if ((labellen > 64-6) || (contextlen > EVP_MAX_MD_SIZE))
+		return false;
+	infolen = 0;
+	info[infolen++] = (outlen >> 8) & 0xFF;
+	info[infolen++] = outlen & 0xFF;
+	info[infolen++] = 6+labellen;
+	memcpy(info+infolen, "tls13 ", 6);
+	infolen += 6;
+	memcpy(info+infolen, label, labellen);
+	infolen += labellen;
+	info[infolen++] = contextlen;
+	memcpy(info+infolen, context, contextlen);
+	infolen += contextlen;
+
+	/* T(n) = HMAC(secret, T(n-1) || info || n) */
+	tlen = 0;
+	for (uint8_t n=1; 0 < outlen; n++) {
+		memcpy(data, t, tlen);
+		memcpy(data+tlen, info, infolen);
+		data[tlen+infolen] = n;
+		if (!kdf_hmac(data, tlen+infolen+1, t))
+			return false;
+		tlen = hashlen;
+		used = (outlen < hashlen) ? outlen : hashlen;
+		memcpy(out, t, used);
+		out += used;
+		outlen -= used;
+	}
 	return true;
 }
 
+static bool secret_keys(uint16_t aead, const uint8_t *secret, int secretlen,
+  uint8_t *c2s, uint8_t *s2c, int keylen) {
+	/* Hash(context) only depends on AEAD and direction */
+	static struct {
+		const EVP_MD *md;
+		uint16_t aead;
+		uint8_t c2s[EVP_MAX_MD_SIZE], s2c[EVP_MAX_MD_SIZE];
+	} hashes;
+	const EVP_MD *md = secret_md(secretlen);
+
+	if ((NULL == md) || (0 == keylen) || (NTS_MAX_KEYLEN < keylen))
+		return false;
+	if ((md != hashes.md) || (aead != hashes.aead)) {
+		uint8_t context[5];
+		context[0] = (nts_protocol_NTP >> 8) & 0xFF;
+		context[1] = nts_protocol_NTP & 0xFF;
+		context[2] = (aead >> 8) & 0xFF;
+		context[3] = aead & 0xFF;
+		context[4] = 0x00;
+		if (!kdf_hash(md, context, sizeof(context), hashes.c2s))
+			return false;
+		context[4] = 0x01;
+		if (!kdf_hash(md, context, sizeof(context), hashes.s2c))
+			return false;
+		hashes.md = md;
+		hashes.aead = aead;
+	}
+	return kdf_key(md, secret, secretlen) &&
+	       hkdf_expand_label(md, "exporter", hashes.c2s, secretlen,
+				 c2s, keylen) &&
+	       hkdf_expand_label(md, "exporter", hashes.s2c, secretlen,
+				 s2c, keylen);
+}
+
+bool nts_secret_keys(uint16_t aead, const uint8_t *secret, int secretlen,
+  uint8_t *c2s, uint8_t *s2c, int keylen) {
+	bool ok;
+	nts_lock_cookielock();
+	ok = secret_keys(aead, secret, secretlen, c2s, s2c, keylen);
+	nts_unlock_cookielock();
+	return ok;
+}
+
+/* exporter is the TLS 1.3 exporter_master_secret of an NTS-KE session.
+ * secret gets the same number of bytes. */
+bool nts_export_secret(const uint8_t *exporter, int len, uint8_t *secret) {
+	const EVP_MD *md = secret_md(len);
+	uint8_t hash[EVP_MAX_MD_SIZE];
+	bool ok;
+
+	if (NULL == md)
+		return false;
+	nts_lock_cookielock();
+	ok = kdf_hash(md, NULL, 0, hash) &&
+	     kdf_key(md, exporter, len) &&
+	     hkdf_expand_label(md, "EXPORTER-network-time-security",
+			       hash, len, secret, len);
+	nts_unlock_cookielock();
+	return ok;
+}
+
 void nts_lock_cookielock(void) {
 	int err = pthread_mutex_lock(&cookie_lock);
 	if (0 != err) {
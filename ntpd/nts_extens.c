@@ -8,17 +8,20 @@
  *
  * We carefully arrange things so that no padding is necessary.
  *
- * This is only called by the main ntpd thread, so we don't need
- * a lock to protect wire_ctx.
+ * Each thread that encrypts or decrypts gets AEAD contexts of its
+ * own, see wire_ctx_get(), so no lock is needed for them.
  */
 
 #include "config.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
 #include <aes_siv.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
 
 #include "ntp_stdlib.h"
 #include "ntp.h"
@@ -39,22 +42,251 @@ enum NtpExtFieldType {
 	NTS_AEEF = 0x404 /* Authenticated and Encrypted Extension Fields */
 };
 
-/* This is only called by the main thread so we don't need a lock. */
-AES_SIV_CTX* wire_ctx = NULL;
-
+/* AEAD contexts of one thread, made on its first use and freed
+ * when it exits. */
+struct wire_ctx {
+	AES_SIV_CTX *siv;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_CIPHER_CTX *gcmsiv;		/* NULL if no gcmsiv_cipher */
+#endif
+};
+static pthread_key_t wire_key;
+static pthread_once_t wire_once = PTHREAD_ONCE_INIT;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+/* AES-128-GCM-SIV is provided by OpenSSL 3.2 and later.
+ * Stays NULL if the library we are running with can't do it. */
+static EVP_CIPHER *gcmsiv_cipher = NULL;
+#endif
+
+static void wire_ctx_free(void *arg);
+static void wire_key_init(void);
+static struct wire_ctx *wire_ctx_get(void);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+/* Once only.  The config code asks before nts_init() runs. */
+static void gcmsiv_fetch(void) {
+	static bool tried = false;
+
+	if (tried) {
+		return;
+	}
+	tried = true;
+	gcmsiv_cipher = EVP_CIPHER_fetch(NULL, "AES-128-GCM-SIV", NULL);
+	if (NULL == gcmsiv_cipher) {
+		ERR_clear_error();  /* not an error, just old */
+		msyslog(LOG_INFO, "NTS: AES_128_GCM_SIV not available");
+	}
+}
+#endif
 
 bool extens_init(void) {
-	wire_ctx = AES_SIV_CTX_new();
-	if (NULL == wire_ctx) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	gcmsiv_fetch();
+#endif
+	(void)wire_ctx_get();	/* the main thread's, and fail early */
+	return true;
+}
+
+static void wire_ctx_free(void *arg) {
+	struct wire_ctx *ctx = arg;
+
+	AES_SIV_CTX_free(ctx->siv);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_CIPHER_CTX_free(ctx->gcmsiv);
+#endif
+	free(ctx);
+}
+
+static void wire_key_init(void) {
+	int err = pthread_key_create(&wire_key, wire_ctx_free);
+	if (0 != err) {
+		msyslog(LOG_ERR, "NTS: Can't make wire_key: %s", strerror(err));
+		exit(1);
+	}
+}
+
+static struct wire_ctx *wire_ctx_get(void) {
+	struct wire_ctx *ctx;
+	bool ok;
+
+	pthread_once(&wire_once, wire_key_init);
+	ctx = pthread_getspecific(wire_key);
+	if (NULL != ctx) {
+		return ctx;
+	}
+	ctx = emalloc_zero(sizeof(*ctx));
+	ok = (NULL != (ctx->siv = AES_SIV_CTX_new()));
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (NULL != gcmsiv_cipher) {
+		ok &= (NULL != (ctx->gcmsiv = EVP_CIPHER_CTX_new()));
+	}
+#endif
+	if (!ok || (0 != pthread_setspecific(wire_key, ctx))) {
 		msyslog(LOG_ERR, "NTS: Can't init wire_ctx");
 		exit(1);
 	}
+	return ctx;
+}
+
+/* Can we do this AEAD on the wire? */
+bool nts_aead_ok(uint16_t aead) {
+	switch (aead) {
+	    case AEAD_AES_SIV_CMAC_256:
+	    case AEAD_AES_SIV_CMAC_384:
+	    case AEAD_AES_SIV_CMAC_512:
+		return true;
+	    case AEAD_AES_128_GCM_SIV:
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		gcmsiv_fetch();
+		return NULL != gcmsiv_cipher;
+#else
+		return false;
+#endif
+	    default:
+		return false;
+	}
+}
+
+int nts_aead_nonce_length(uint16_t aead) {
+	if (AEAD_AES_128_GCM_SIV == aead) {
+		return GCM_SIV_NONCE_LENGTH;
+	}
+	return NONCE_LENGTH;
+}
+
+/*
+ * Wire AEAD.  Both families add a 16 byte tag.  AES-SIV puts it
+ * in front of the cipher text (RFC 5297), GCM-SIV after it
+ * (RFC 5116 layout), and that is what goes on the wire.
+ *
+ * The callers build plain text in place, so out may overlap plain
+ * (and cipher); OpenSSL only allows exact overlap, so the GCM-SIV
+ * path moves the data first and works in place.
+ */
+bool nts_aead_encrypt(uint16_t aead,
+	uint8_t *out, size_t *outlen,
+	const uint8_t *key, int keylen,
+	const uint8_t *nonce, int noncelen,
+	const uint8_t *plain, size_t plainlen,
+	const uint8_t *ad, size_t adlen) {
+	struct wire_ctx *ctx = wire_ctx_get();
+
+	if (AEAD_AES_128_GCM_SIV != aead) {
+		return AES_SIV_Encrypt(ctx->siv, out, outlen, key, keylen,
+				       nonce, noncelen, plain, plainlen,
+				       ad, adlen);
+	}
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_CIPHER_CTX *gcmsiv_ctx = ctx->gcmsiv;
+	int len;
+
+	if ((NULL == gcmsiv_ctx) ||
+	    (GCM_SIV_NONCE_LENGTH != noncelen) ||
+	    (AEAD_AES_128_GCM_SIV_KEYLEN != keylen) ||
+	    (plainlen+CMAC_LENGTH > *outlen)) {
+		return false;
+	}
+	if (0 < plainlen) {
+		memmove(out, plain, plainlen);
+	}
+	/* GCM-SIV wants AAD and data in one call each, and a
+	 * non-NULL buffer even when there is no data. */
+	if ((1 != EVP_EncryptInit_ex2(gcmsiv_ctx, gcmsiv_cipher,
+				      key, nonce, NULL)) ||
+	    (1 != EVP_EncryptUpdate(gcmsiv_ctx, NULL, &len,
+				    ad, (int)adlen)) ||
+	    (1 != EVP_EncryptUpdate(gcmsiv_ctx, out, &len,
+				    out, (int)plainlen)) ||
+	    (1 != EVP_EncryptFinal_ex(gcmsiv_ctx, out+plainlen, &len)) ||
+	    (1 != EVP_CIPHER_CTX_ctrl(gcmsiv_ctx, EVP_CTRL_AEAD_GET_TAG,
+				      CMAC_LENGTH, out+plainlen))) {
+		return false;
+	}
+	*outlen = plainlen+CMAC_LENGTH;
+	return true;
+#else
+	UNUSED_ARG(out);
+	UNUSED_ARG(outlen);
+	UNUSED_ARG(key);
+	UNUSED_ARG(keylen);
+	UNUSED_ARG(nonce);
+	UNUSED_ARG(noncelen);
+	UNUSED_ARG(plain);
+	UNUSED_ARG(plainlen);
+	UNUSED_ARG(ad);
+	UNUSED_ARG(adlen);
+	return false;
+#endif
+}
+
+/* out may be NULL if there is no plain text expected.
+ * The GCM-SIV path decrypts cipher in place. */
+bool nts_aead_decrypt(uint16_t aead,
+	uint8_t *out, size_t *outlen,
+	const uint8_t *key, int keylen,
+	const uint8_t *nonce, int noncelen,
+	uint8_t *cipher, size_t cipherlen,
+	const uint8_t *ad, size_t adlen) {
+	struct wire_ctx *ctx = wire_ctx_get();
+
+	if (AEAD_AES_128_GCM_SIV != aead) {
+		return AES_SIV_Decrypt(ctx->siv, out, outlen, key, keylen,
+				       nonce, noncelen, cipher, cipherlen,
+				       ad, adlen);
+	}
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_CIPHER_CTX *gcmsiv_ctx = ctx->gcmsiv;
+	uint8_t tag[CMAC_LENGTH];
+	size_t plainlen;
+	int len;
+
+	if ((NULL == gcmsiv_ctx) ||
+	    (GCM_SIV_NONCE_LENGTH != noncelen) ||
+	    (AEAD_AES_128_GCM_SIV_KEYLEN != keylen) ||
+	    (CMAC_LENGTH > cipherlen)) {
+		return false;
+	}
+	plainlen = cipherlen-CMAC_LENGTH;
+	if ((plainlen > *outlen) || ((NULL == out) && (0 < plainlen))) {
+		return false;
+	}
+	memcpy(tag, cipher+plainlen, CMAC_LENGTH);
+	/* The tag seeds the counter, so it has to be set first. */
+	if ((1 != EVP_DecryptInit_ex2(gcmsiv_ctx, gcmsiv_cipher,
+				      key, nonce, NULL)) ||
+	    (1 != EVP_CIPHER_CTX_ctrl(gcmsiv_ctx, EVP_CTRL_AEAD_SET_TAG,
+				      CMAC_LENGTH, tag)) ||
+	    (1 != EVP_DecryptUpdate(gcmsiv_ctx, NULL, &len,
+				    ad, (int)adlen)) ||
+	    (1 != EVP_DecryptUpdate(gcmsiv_ctx, cipher, &len,
+				    cipher, (int)plainlen)) ||
+	    (1 != EVP_DecryptFinal_ex(gcmsiv_ctx, tag, &len))) {
+		return false;
+	}
+	if (0 < plainlen) {
+		memmove(out, cipher, plainlen);
+	}
+	*outlen = plainlen;
 	return true;
+#else
+	UNUSED_ARG(out);
+	UNUSED_ARG(outlen);
+	UNUSED_ARG(key);
+	UNUSED_ARG(keylen);
+	UNUSED_ARG(nonce);
+	UNUSED_ARG(noncelen);
+	UNUSED_ARG(cipher);
+	UNUSED_ARG(cipherlen);
+	UNUSED_ARG(ad);
+	UNUSED_ARG(adlen);
+	return false;
+#endif
 }
 
 int extens_client_send(struct peer *peer, struct pkt *xpkt) {
 	struct BufCtl_t buf;
-	int used, adlength, idx;
+	int used, adlength, idx, noncelen;
 	size_t left;
 	uint8_t *nonce, *packet;
 	bool ok;
@@ -71,9 +303,11 @@ int extens_client_send(struct peer *peer, struct pkt *xpkt) {
 	/* cookie */
 	idx = peer->nts_state.readIdx++;
 	ex_append_record_bytes(&buf, NTS_Cookie,
-			       peer->nts_state.cookies[idx], peer->nts_state.cookielen);
+			       NTS_COOKIE(&peer->nts_state, idx),
+			       peer->nts_state.cookielen);
 	peer->nts_state.readIdx = peer->nts_state.readIdx % NTS_MAX_COOKIES;
 	peer->nts_state.count--;
+	peer->nts_state.used++;
 
 	/* Need more cookies? */
 	for (int i=peer->nts_state.count+1; i<NTS_MAX_COOKIES; i++) {
@@ -85,23 +319,24 @@ int extens_client_send(struct peer *peer, struct pkt *xpkt) {
 	}
 
 	/* AEAD */
+	noncelen = nts_aead_nonce_length(peer->nts_state.aead);
 	adlength = buf.next-packet;
-	ex_append_header(&buf, NTS_AEEF, NTP_EX_U16_LNG*2+NONCE_LENGTH+CMAC_LENGTH);
-	append_uint16(&buf, NONCE_LENGTH);
+	ex_append_header(&buf, NTS_AEEF, NTP_EX_U16_LNG*2+noncelen+CMAC_LENGTH);
+	append_uint16(&buf, noncelen);
 	append_uint16(&buf, CMAC_LENGTH);
 	nonce = buf.next;
-	ntp_RAND_bytes(nonce, NONCE_LENGTH);
-	buf.next += NONCE_LENGTH;
-	buf.left -= NONCE_LENGTH;
+	ntp_RAND_bytes(nonce, noncelen);
+	buf.next += noncelen;
+	buf.left -= noncelen;
 	left = buf.left;
-	ok = AES_SIV_Encrypt(wire_ctx,
-			     buf.next, &left,   /* left: in: max out length, out: length used */
-			     peer->nts_state.c2s, peer->nts_state.keylen,
-			     nonce, NONCE_LENGTH,
-			     NULL, 0,           /* no plain/cipher text */
-			     packet, adlength);
+	ok = nts_aead_encrypt(peer->nts_state.aead,
+			      buf.next, &left,   /* left: in: max out length, out: length used */
+			      peer->nts_state.c2s, peer->nts_state.keylen,
+			      nonce, noncelen,
+			      NULL, 0,           /* no plain/cipher text */
+			      packet, adlength);
 	if (!ok) {
-		msyslog(LOG_ERR, "NTS: extens_client_send - Error from AES_SIV_Encrypt");
+		msyslog(LOG_ERR, "NTS: extens_client_send - Error from nts_aead_encrypt");
 		/* I don't think this should happen,
 		 * so crash rather than work incorrectly.
 		 * Hal, 2019-Feb-17
@@ -172,13 +407,17 @@ bool extens_server_recv(struct ntspacket_t *ntspacket, uint8_t *pkt, int lng) {
 				return false;
 			}
 			ok = nts_unpack_cookie(buf.next, length, &aead, ntspacket->c2s,
-					       ntspacket->s2c, &ntspacket->keylen);
+					       ntspacket->s2c, &ntspacket->keylen,
+					       ntspacket->secret, &ntspacket->secretlen);
 			if (!ok) {
 				return false;
 			}
 			buf.next += length;
 			buf.left -= length;
 			sawcookie = true;
+			if (!nts_aead_ok(aead)) {
+				return false;
+			}
 			ntspacket->needed++;
 			ntspacket->aead = aead;
 			break;
@@ -197,7 +436,8 @@ bool extens_server_recv(struct ntspacket_t *ntspacket, uint8_t *pkt, int lng) {
 			if (!sawcookie) {
 				return false; /* no cookie yet, no c2s */
 			}
-			if (length != NTP_EX_HDR_LNG+NONCE_LENGTH+CMAC_LENGTH) {
+			if (length != NTP_EX_HDR_LNG+CMAC_LENGTH+
+			    nts_aead_nonce_length(ntspacket->aead)) {
 				return false;
 			}
 			/* Additional data is up to this exten. */
@@ -212,14 +452,14 @@ bool extens_server_recv(struct ntspacket_t *ntspacket, uint8_t *pkt, int lng) {
 				return false;
 			}
 			nonce = buf.next;
-			cmac = nonce+NONCE_LENGTH;
+			cmac = nonce+nts_aead_nonce_length(ntspacket->aead);
 			outlen = 6;
-			ok = AES_SIV_Decrypt(wire_ctx,
-					     NULL, &outlen,
-					     ntspacket->c2s, ntspacket->keylen,
-					     nonce, noncelen,
-					     cmac, CMAC_LENGTH,
-					     pkt, adlength);
+			ok = nts_aead_decrypt(ntspacket->aead,
+					      NULL, &outlen,
+					      ntspacket->c2s, ntspacket->keylen,
+					      nonce, noncelen,
+					      cmac, CMAC_LENGTH,
+					      pkt, adlength);
 			if (!ok) {
 				return false;
 			}
@@ -269,12 +509,13 @@ int extens_server_send(struct ntspacket_t *ntspacket, struct pkt *xpkt) {
 	uint8_t *nonce, *packet;
 	uint8_t *plaintext, *ciphertext;;
 	uint8_t cookie[NTS_MAX_COOKIELEN];
-	int cookielen, plainleng, aeadlen;
+	int cookielen, plainleng, aeadlen, noncelen;
 	bool ok;
 
 	/* get first cookie now so we have length */
 	cookielen = nts_make_cookie(cookie, ntspacket->aead,
-				    ntspacket->c2s, ntspacket->s2c, ntspacket->keylen);
+				    ntspacket->c2s, ntspacket->s2c, ntspacket->keylen,
+				    ntspacket->secret, ntspacket->secretlen);
 
 	packet = (uint8_t*)xpkt;
 	buf.next = xpkt->exten;
@@ -290,15 +531,16 @@ int extens_server_send(struct ntspacket_t *ntspacket, struct pkt *xpkt) {
 	/* length of whole AEEF */
 	plainleng = ntspacket->needed*(NTP_EX_HDR_LNG+cookielen);
 	/* length of whole AEEF header */
-	aeadlen = NTP_EX_U16_LNG*2+NONCE_LENGTH+CMAC_LENGTH + plainleng;
+	noncelen = nts_aead_nonce_length(ntspacket->aead);
+	aeadlen = NTP_EX_U16_LNG*2+noncelen+CMAC_LENGTH + plainleng;
 	ex_append_header(&buf, NTS_AEEF, aeadlen);
-	append_uint16(&buf, NONCE_LENGTH);
+	append_uint16(&buf, noncelen);
 	append_uint16(&buf, plainleng+CMAC_LENGTH);
 
 	nonce = buf.next;
-	ntp_RAND_bytes(nonce, NONCE_LENGTH);
-	buf.next += NONCE_LENGTH;
-	buf.left -= NONCE_LENGTH;
+	ntp_RAND_bytes(nonce, noncelen);
+	buf.next += noncelen;
+	buf.left -= noncelen;
 
 	ciphertext = buf.next;	/* cipher text starts here */
 	left = buf.left;
@@ -313,7 +555,8 @@ int extens_server_send(struct ntspacket_t *ntspacket, struct pkt *xpkt) {
 		 * Responses are the same length as requests to avoid DDoS amplification.
 		 * So if it got to us, there is a good chance it will get back.  */
 		nts_make_cookie(cookie, ntspacket->aead,
-				ntspacket->c2s, ntspacket->s2c, ntspacket->keylen);
+				ntspacket->c2s, ntspacket->s2c, ntspacket->keylen,
+				ntspacket->secret, ntspacket->secretlen);
 		ex_append_record_bytes(&buf, NTS_Cookie,
 				       cookie, cookielen);
 	}
@@ -321,14 +564,14 @@ int extens_server_send(struct ntspacket_t *ntspacket, struct pkt *xpkt) {
 	//printf("ESSa: %d, %d, %d, %d\n",
 	//  adlength, plainleng, cookielen, ntspacket->needed);
 
-	ok = AES_SIV_Encrypt(wire_ctx,
-			     ciphertext, &left,   /* left: in: max out length, out: length used */
-			     ntspacket->s2c, ntspacket->keylen,
-			     nonce, NONCE_LENGTH,
-			     plaintext, plainleng,
-			     packet, adlength);
+	ok = nts_aead_encrypt(ntspacket->aead,
+			      ciphertext, &left,   /* left: in: max out length, out: length used */
+			      ntspacket->s2c, ntspacket->keylen,
+			      nonce, noncelen,
+			      plaintext, plainleng,
+			      packet, adlength);
 	if (!ok) {
-		msyslog(LOG_ERR, "NTS: extens_server_send - Error from AES_SIV_Encrypt");
+		msyslog(LOG_ERR, "NTS: extens_server_send - Error from nts_aead_encrypt");
 		nts_log_ssl_error();
 		/* I don't think this should happen,
 		 * so crash rather than work incorrectly.
@@ -389,9 +632,10 @@ bool extens_client_recv(struct peer *peer, uint8_t *pkt, int lng) {
 			if (length != peer->nts_state.cookielen)
 				return false;			/* reject length change */
 			idx = peer->nts_state.writeIdx++;
-			memcpy((uint8_t*)&peer->nts_state.cookies[idx], buf.next, length);
+			memcpy(NTS_COOKIE(&peer->nts_state, idx), buf.next, length);
 			peer->nts_state.writeIdx = peer->nts_state.writeIdx % NTS_MAX_COOKIES;
 			peer->nts_state.count++;
+			peer->nts_state.refreshed++;
 			buf.next += length;
 			buf.left -= length;
 			break;
@@ -401,23 +645,25 @@ bool extens_client_recv(struct peer *peer, uint8_t *pkt, int lng) {
 			outlen = next_uint16(&buf);
 			if (noncelen&3 || outlen&3)
 				return false;                 /* else round up */
+			if (noncelen != nts_aead_nonce_length(peer->nts_state.aead))
+				return false;
 			nonce = buf.next;
 			ciphertext = nonce+noncelen;
 			plaintext = ciphertext+CMAC_LENGTH;
-			outlen = buf.left-NONCE_LENGTH-CMAC_LENGTH;
+			outlen = buf.left-noncelen-CMAC_LENGTH;
 			//      printf("ECRa: %lu, %d\n", (long unsigned)outlen, noncelen);
-			ok = AES_SIV_Decrypt(wire_ctx,
-					     plaintext, &outlen,
-					     peer->nts_state.s2c, peer->nts_state.keylen,
-					     nonce, noncelen,
-					     ciphertext, outlen+CMAC_LENGTH,
-					     pkt, adlength);
+			ok = nts_aead_decrypt(peer->nts_state.aead,
+					      plaintext, &outlen,
+					      peer->nts_state.s2c, peer->nts_state.keylen,
+					      nonce, noncelen,
+					      ciphertext, outlen+CMAC_LENGTH,
+					      pkt, adlength);
 			//      printf("ECRb: %d, %lu\n", ok, (long unsigned)outlen);
 			if (!ok)
 				return false;
 			/* setup to process encrypted headers */
-			buf.next += NONCE_LENGTH+CMAC_LENGTH;
-			buf.left -= NONCE_LENGTH+CMAC_LENGTH;
+			buf.next += noncelen+CMAC_LENGTH;
+			buf.left -= noncelen+CMAC_LENGTH;
 			sawAEEF = true;
 			break;
 		    default:
@@ -9,6 +9,7 @@
  */
 #include "config.h"
 
+#include <ctype.h>
 #include <signal.h>
 #include <pthread.h>
 #include <unistd.h>
@@ -22,6 +23,7 @@
 
 #include "ntp.h"
 #include "ntpd.h"
+#include "ntp_probe.h"
 #include "ntp_stdlib.h"
 #include "nts.h"
 #include "nts2.h"
@@ -35,8 +37,12 @@
 static bool create_listener4(int port);
 static bool create_listener6(int port);
 static void* nts_ke_listener(void*);
+static void* nts_ke_worker(void*);
+static void nts_ke_reject(int fd);
 static bool nts_ke_request(SSL *ssl);
 static void nts_ke_accept_fail(char* addrbuf, double sec);
+static int nts_ke_secret(SSL *ssl, int aead,
+	uint8_t *c2s, uint8_t *s2c, int keylen, uint8_t *secret);
 
 static void nts_lock_certlock(void);
 static void nts_unlock_certlock(void);
@@ -46,6 +52,84 @@ static SSL_CTX *server_ctx = NULL;
 static int listener4_sock = -1;
 static int listener6_sock = -1;
 
+/* TLS 1.3 exporter secret of the session being served, for short
+ * cookies.  OpenSSL only hands it out through the key log callback.
+ * Hung off the SSL so each listener thread has its own. */
+struct exporter {
+	int len;
+	uint8_t secret[NTS_MAX_SECRETLEN];
+};
+static int exporter_index = -1;
+
+/*
+ * NTS-KE admission control.  The listener threads only accept
+ * connections and decide, before any TLS work, whether to keep them.
+ * A kept connection goes on a queue of at most ntsconfig.ke_queue, as
+ * it was at startup, for one of NTS_KE_WORKERS threads to do the handshake and the NTS-KE
+ * exchange.  Otherwise it is closed at once with a reset; we never see
+ * the SYN, so the kernel's SYN cookies work as usual.
+ *
+ * The per-source (IPv4 address, IPv6 /64) and per-prefix (IPv4 /24,
+ * IPv6 /48) rates are token buckets holding NTS_KE_BURST seconds'
+ * worth.  There are NTS_KE_BUCKETS of each, indexed by a keyed hash:
+ * many sources push each other's buckets out, which only forgives
+ * them, but can't pick whose.
+ */
+#define NTS_KE_WORKERS	2
+#define NTS_KE_BUCKETS	1024
+#define NTS_KE_BURST	10.0
+
+struct ke_bucket {
+	uint8_t key[9];		/* family, then address bytes */
+	double tokens;
+	double when;		/* last update, CLOCK_MONOTONIC seconds */
+};
+
+struct ke_conn {
+	int fd;
+	sockaddr_u addr;
+	struct timespec start;	/* accepted, CLOCK_MONOTONIC */
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint32_t hashkey;
+	struct ke_bucket source[NTS_KE_BUCKETS];
+	struct ke_bucket prefix[NTS_KE_BUCKETS];
+	struct ke_conn *conn;	/* size of them */
+	int size;		/* ntsconfig.ke_queue at startup */
+	int head, count;
+	int idle;		/* workers waiting for a connection */
+} ke_admit = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void keylog_cb(const SSL *ssl, const char *line) {
+	static const char tag[] = "EXPORTER_SECRET ";
+	struct exporter *exporter = SSL_get_ex_data(ssl, exporter_index);
+	int len = 0;
+
+	if ((NULL == exporter) || (0 != strncmp(line, tag, sizeof(tag)-1)))
+		return;
+	/* EXPORTER_SECRET <client random> <secret>, both hex */
+	line = strchr(line+sizeof(tag)-1, ' ');
+	if (NULL == line)
+		return;
+	line++;
+	while ((len < NTS_MAX_SECRETLEN) && isxdigit((unsigned char)line[0])
+	       && isxdigit((unsigned char)line[1])) {
+		unsigned int temp;
+		if (1 != sscanf(line, "%2x", &temp))
+			return;
+		exporter->secret[len++] = temp;
+		line += 2;
+	}
+	if ('\0' == *line)
+		exporter->len = len;
+}
+
 /* We need a lock to protect reloading our certificate.
  * This seems like overkill, but it doesn't happen often. */
 pthread_mutex_t certificate_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -99,6 +183,11 @@ bool nts_server_init(void) {
 	}
 
 	SSL_CTX_set_alpn_select_cb(server_ctx, alpn_select_cb, NULL);
+	/* coverity[DC.WEAK_CRYPTO] */
+	ke_admit.hashkey = (uint32_t)random();
+	exporter_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+	if (0 <= exporter_index)
+		SSL_CTX_set_keylog_callback(server_ctx, keylog_cb);
 	SSL_CTX_set_session_cache_mode(server_ctx, SSL_SESS_CACHE_OFF);
 	SSL_CTX_set_timeout(server_ctx, NTS_KE_TIMEOUT);  /* session lifetime */
 
@@ -135,8 +224,22 @@ bool nts_server_init2(void) {
 		return false;
 	}
 
+	/* a later "nts kequeue" from ntpq :config can't resize it */
+	ke_admit.size = ntsconfig.ke_queue;
+	ke_admit.conn = eallocarray((size_t)ke_admit.size,
+				    sizeof(*ke_admit.conn));
 	sigfillset(&block_mask);
 	pthread_sigmask(SIG_BLOCK, &block_mask, &saved_sig_mask);
+	for (int i = 0; i < NTS_KE_WORKERS; i++) {
+		rc = pthread_create(&worker, NULL, nts_ke_worker, NULL);
+		if (rc) {
+			/* nobody would take connections off the queue */
+			ntp_strerror_r(rc, errbuf, sizeof(errbuf));
+			msyslog(LOG_ERR, "NTSs: nts_ke_worker: error from pthread_create: %s", errbuf);
+			pthread_sigmask(SIG_SETMASK, &saved_sig_mask, NULL);
+			return false;
+		}
+	}
 	if (listener4_sock != -1) {
 		rc = pthread_create(&worker, NULL, nts_ke_listener, &listener4_sock);
 		if (rc) {
@@ -193,10 +296,128 @@ static inline double lfptox(l_fp r) {
 }
 
 
+/* Key for a source or prefix bucket: family and the first n bytes */
+static void ke_key(const sockaddr_u *addr, int n, uint8_t *key) {
+	memset(key, 0, sizeof(((struct ke_bucket *)0)->key));
+	key[0] = (uint8_t)AF(addr);
+	if (IS_IPV4(addr))
+		memcpy(key + 1, &NSRCADR(addr), (size_t)n);
+	else
+		memcpy(key + 1, PSOCK_ADDR6(addr), (size_t)n);
+}
+
+/* Take a token from the bucket for key, if there is one */
+static bool ke_take(struct ke_bucket *table, const uint8_t *key,
+		    double rate, double now) {
+	const size_t keylen = sizeof(table->key);
+	double burst = max(1.0, rate * NTS_KE_BURST);
+	uint32_t hash = ke_admit.hashkey;
+	struct ke_bucket *b;
+
+	if (rate <= 0)
+		return true;
+	for (size_t i = 0; i < keylen; i++)	/* FNV-1a */
+		hash = (hash ^ key[i]) * 16777619U;
+	b = &table[hash % NTS_KE_BUCKETS];
+	if (0 != memcmp(b->key, key, keylen)) {
+		memcpy(b->key, key, keylen);
+		b->tokens = burst;
+		b->when = now;
+	}
+	b->tokens = min(burst, b->tokens + (now - b->when) * rate);
+	b->when = now;
+	if (b->tokens < 1.0)
+		return false;
+	b->tokens -= 1.0;
+	return true;
+}
+
+/* Check a new connection against the per-source and per-prefix rates.
+ * now is in seconds, from any clock that doesn't step. */
+bool nts_ke_admit(const sockaddr_u *addr, double now) {
+	uint8_t key[sizeof(((struct ke_bucket *)0)->key)];
+	bool ok;
+
+	pthread_mutex_lock(&ke_admit.lock);
+	ke_key(addr, IS_IPV4(addr) ? 4 : 8, key);
+	ok = ke_take(ke_admit.source, key, ntsconfig.ke_rate, now);
+	if (!ok) {
+		ntske_cnt.rejected_source++;
+	} else {
+		ke_key(addr, IS_IPV4(addr) ? 3 : 6, key);
+		ok = ke_take(ke_admit.prefix, key, ntsconfig.ke_prefixrate,
+			     now);
+		if (!ok)
+			ntske_cnt.rejected_prefix++;
+	}
+	pthread_mutex_unlock(&ke_admit.lock);
+	return ok;
+}
+
+/* Drop a connection we won't serve: a reset, and no TIME_WAIT */
+void nts_ke_reject(int fd) {
+	struct linger linger = {.l_onoff = 1, .l_linger = 0};
+
+	(void)setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+	close(fd);
+}
+
 void* nts_ke_listener(void* arg) {
-	struct timeval timeout = {.tv_sec = NTS_KE_TIMEOUT, .tv_usec = 0};
 	int sock = *(int*)arg;
 	char errbuf[100];
+
+#ifdef HAVE_SECCOMP_H
+        setup_SIGSYS_trap();   /* enable trap for this thread */
+#endif
+
+	while(1) {
+		struct ke_conn conn;
+		socklen_t len = sizeof(conn.addr);
+		bool queued;
+
+		conn.fd = accept(sock, &conn.addr.sa, &len);
+		if (conn.fd < 0) {
+			ntp_strerror_r(errno, errbuf, sizeof(errbuf));
+			msyslog(LOG_ERR, "NTSs: TCP accept failed: %s", errbuf);
+			if (EBADF == errno)
+				return NULL;
+			sleep(1);		/* avoid log clutter on bug */
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &conn.start);
+		NTP_PROBE(ke_accept, PROBE_ADDR(&conn.addr));
+
+		if (!nts_ke_admit(&conn.addr, tspec_to_d(conn.start))) {
+			/* outcome 3: turned away before TLS */
+			NTP_PROBE(ke_finish, PROBE_ADDR(&conn.addr), 3, 0);
+			nts_ke_reject(conn.fd);
+			continue;
+		}
+		pthread_mutex_lock(&ke_admit.lock);
+		queued = ke_admit.count < ke_admit.size;
+		if (queued) {
+			ke_admit.conn[(ke_admit.head + ke_admit.count) %
+				      ke_admit.size] = conn;
+			ke_admit.count++;
+			ntske_cnt.admitted++;
+			if (0 == ke_admit.idle)
+				ntske_cnt.queued++;
+			pthread_cond_signal(&ke_admit.cond);
+		} else {
+			ntske_cnt.rejected_busy++;
+		}
+		pthread_mutex_unlock(&ke_admit.lock);
+		if (!queued) {
+			NTP_PROBE(ke_finish, PROBE_ADDR(&conn.addr), 3, 0);
+			nts_ke_reject(conn.fd);
+		}
+	}
+	return NULL;
+}
+
+void* nts_ke_worker(void* arg) {
+	struct timeval timeout = {.tv_sec = NTS_KE_TIMEOUT, .tv_usec = 0};
+	char errbuf[100];
 	char addrbuf[100];
 	char usingbuf[100];
 	struct timespec start, finish;		/* wall clock */
@@ -210,14 +431,15 @@ void* nts_ke_listener(void* arg) {
 	struct rusage usage;
 #endif
 
+	UNUSED_ARG(arg);
+
 #ifdef HAVE_SECCOMP_H
         setup_SIGSYS_trap();   /* enable trap for this thread */
 #endif
 
 #ifdef RUSAGE_THREAD
 	/* NB: start_u and start_s are from near the end of the previous cycle.
-	 * Thus usage timing includes the TCP accept and
-	 * writing the previous msyslog message.
+	 * Thus usage timing includes writing the previous msyslog message.
 	 */
 	getrusage(RUSAGE_THREAD, &usage);
 	start_u = tval_to_tspec(usage.ru_utime);
@@ -225,21 +447,25 @@ void* nts_ke_listener(void* arg) {
 #endif
 
 	while(1) {
+		struct ke_conn conn;
 		sockaddr_u addr;
-		socklen_t len = sizeof(addr);
 		SSL *ssl;
+		struct exporter exporter;
 		int client, err;
 
-		client = accept(sock, &addr.sa, &len);
-		if (client < 0) {
-			ntp_strerror_r(errno, errbuf, sizeof(errbuf));
-			msyslog(LOG_ERR, "NTSs: TCP accept failed: %s", errbuf);
-			if (EBADF == errno)
-				return NULL;
-			sleep(1);		/* avoid log clutter on bug */
-			continue;
+		pthread_mutex_lock(&ke_admit.lock);
+		while (0 == ke_admit.count) {
+			ke_admit.idle++;
+			pthread_cond_wait(&ke_admit.cond, &ke_admit.lock);
+			ke_admit.idle--;
 		}
-		clock_gettime(CLOCK_MONOTONIC, &start);
+		conn = ke_admit.conn[ke_admit.head];
+		ke_admit.head = (ke_admit.head + 1) % ke_admit.size;
+		ke_admit.count--;
+		pthread_mutex_unlock(&ke_admit.lock);
+		client = conn.fd;
+		addr = conn.addr;
+		start = conn.start;	/* time in the queue counts */
 		sockporttoa_r(&addr, addrbuf, sizeof(addrbuf));
 
 /* This is disabled in order to reduce clutter in the log file.
@@ -269,17 +495,23 @@ void* nts_ke_listener(void* arg) {
 			continue;
 		}
 
-		/* WARN: For high volume servers, this should go in a new thread. */
 		nts_lock_certlock();
 		ssl = SSL_new(server_ctx);
 		nts_unlock_certlock();
+		mem_count(MEM_TLS, 0, 1);
 		SSL_set_fd(ssl, client);
+		exporter.len = 0;
+		SSL_set_ex_data(ssl, exporter_index, &exporter);
 
 		if (SSL_accept(ssl) <= 0) {
 			clock_gettime(CLOCK_MONOTONIC, &finish);
 			wall = tspec_intv_to_lfp(sub_tspec(finish, start));
+			/* outcome 2: the TLS handshake failed */
+			NTP_PROBE(ke_finish, PROBE_ADDR(&addr), 2,
+				  PROBE_TSPEC_NS(sub_tspec(finish, start)));
 			nts_ke_accept_fail(addrbuf, lfptox(wall));
 			SSL_free(ssl);
+			mem_count(MEM_TLS, 0, -1);
 			close(client);
 			ntske_cnt.serves_nossl++;
 			ntske_cnt.serves_nossl_wall += wall;
@@ -313,10 +545,15 @@ void* nts_ke_listener(void* arg) {
 
 		SSL_shutdown(ssl);
 		SSL_free(ssl);
+		mem_count(MEM_TLS, 0, -1);
 		close(client);
+		OPENSSL_cleanse(&exporter, sizeof(exporter));
 
 		clock_gettime(CLOCK_MONOTONIC, &finish);
 		wall = tspec_intv_to_lfp(sub_tspec(finish, start));
+		/* outcome 0 served, 1 failed after the handshake */
+		NTP_PROBE(ke_finish, PROBE_ADDR(&addr), worked ? 0 : 1,
+			  PROBE_TSPEC_NS(sub_tspec(finish, start)));
 		if (worked) {
 			ntske_cnt.serves_good++;
 			ntske_cnt.serves_good_wall += wall;
@@ -350,6 +587,30 @@ void* nts_ke_listener(void* arg) {
 	return NULL;
 }
 
+/* Session secret for short cookies.
+ * Returns its length, or 0 to fall back to cookies with keys in them.
+ * We check that it gives the keys we just exported, so anything
+ * odd about the TLS session just costs bytes on the wire. */
+int nts_ke_secret(SSL *ssl, int aead,
+	uint8_t *c2s, uint8_t *s2c, int keylen, uint8_t *secret) {
+	struct exporter *exporter = SSL_get_ex_data(ssl, exporter_index);
+	uint8_t c2s2[NTS_MAX_KEYLEN], s2c2[NTS_MAX_KEYLEN];
+	int len;
+
+	if ((NULL == exporter) || (0 == exporter->len))
+		return 0;
+	len = exporter->len;
+	if (!nts_export_secret(exporter->secret, len, secret) ||
+	    !nts_secret_keys(aead, secret, len, c2s2, s2c2, keylen))
+		return 0;
+	if ((0 != memcmp(c2s, c2s2, keylen)) ||
+	    (0 != memcmp(s2c, s2c2, keylen))) {
+		msyslog(LOG_ERR, "NTSs: session secret doesn't match keys");
+		return 0;
+	}
+	return len;
+}
+
 /* Analyze failure from SSL_accept
  * print single error message for common cases.
  */
@@ -378,12 +639,14 @@ void nts_ke_accept_fail(char* addrbuf, double sec) {
 
 bool nts_ke_request(SSL *ssl) {
 	/* RFC 4: servers must accept 1024
-	 * Our cookies can be 104, 136, or 168 for AES_SIV_CMAC_xxx
+	 * Our cookies can be 104, 136, or 168 for AES_SIV_CMAC_xxx,
+	 * 72 for AES_128_GCM_SIV, 72 or 88 if short
 	 * 8*168 fits comfortably into 2K.
 	 */
 	uint8_t buff[2048];
 	uint8_t c2s[NTS_MAX_KEYLEN], s2c[NTS_MAX_KEYLEN];
-	int aead, keylen;
+	uint8_t secret[NTS_MAX_SECRETLEN];
+	int aead, keylen, secretlen;
 	struct BufCtl_t buf;
 	int bytes_read, bytes_written;
 	int used;
@@ -398,18 +661,22 @@ bool nts_ke_request(SSL *ssl) {
 	if (!nts_ke_process_receive(&buf, &aead))
 		return false;
 
-	if ((NO_AEAD == aead) && (NULL != ntsconfig.aead))
-		aead = nts_string_to_aead(ntsconfig.aead);
+	if ((NO_AEAD == aead) && (0 < ntsconfig.naeads)) {
+		/* client didn't say, take our first choice */
+		aead = ntsconfig.aeads[0];
+	}
 	if (NO_AEAD == aead)
 		aead = AEAD_AES_SIV_CMAC_256;    /* default */
 
 	keylen = nts_get_key_length(aead);
 	if (!nts_make_keys(ssl, aead, c2s, s2c, keylen))
 		return false;
+	secretlen = nts_ke_secret(ssl, aead, c2s, s2c, keylen, secret);
 
 	buf.next = buff;
 	buf.left = sizeof(buff);
-	if (!nts_ke_setup_send(&buf, aead, c2s, s2c, keylen))
+	if (!nts_ke_setup_send(&buf, aead, c2s, s2c, keylen,
+			       secret, secretlen))
 		return false;
 
 	used = sizeof(buff)-buf.left;
@@ -556,7 +823,7 @@ bool nts_ke_process_receive(struct BufCtl_t *buf, int *aead) {
 		    case nts_algorithm_negotiation:
 			for (int i=0; i<length; i+=sizeof(uint16_t)) {
 				data = next_uint16(buf);
-				if (0 == nts_get_key_length(data)) {
+				if (!nts_aead_ok(data)) {
 					if (0)  /* for debugging */
 						msyslog(LOG_ERR, "NTSs: AN-Unsupported AEAN type: %d", data);
 					continue;     /* ignore types we don't support */
@@ -597,7 +864,8 @@ bool nts_ke_process_receive(struct BufCtl_t *buf, int *aead) {
 }
 
 bool nts_ke_setup_send(struct BufCtl_t *buf, int aead,
-       uint8_t *c2s, uint8_t *s2c, int keylen) {
+       uint8_t *c2s, uint8_t *s2c, int keylen,
+       uint8_t *secret, int secretlen) {
 
 	/* 4.1.2 Next Protocol */
 	ke_append_record_uint16(buf,
@@ -611,7 +879,8 @@ bool nts_ke_setup_send(struct BufCtl_t *buf, int aead,
 
 	for (int i=0; i<NTS_MAX_COOKIES; i++) {
 		uint8_t cookie[NTS_MAX_COOKIELEN];
-		int cookielen = nts_make_cookie(cookie, aead, c2s, s2c, keylen);
+		int cookielen = nts_make_cookie(cookie, aead, c2s, s2c, keylen,
+						secret, secretlen);
 		ke_append_record_bytes(buf, nts_new_cookie, cookie, cookielen);
 	}
 
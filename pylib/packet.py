@@ -254,6 +254,10 @@ MAXFRAGS = 32
 DEFTIMEOUT = 5000
 DEFSTIMEOUT = 3000
 
+# Hosts that ntpd's local stream socket stands in for, when it exists.
+# Set NTP_CONTROL_SOCKET to use another path, or to "" to stay on UDP.
+LOCALHOSTS = ("localhost", "127.0.0.1", "::1", "[::1]")
+
 # The maximum keyid for authentication, keyid is a 16-bit field
 MAX_KEYID = 0xFFFF
 
@@ -732,6 +736,7 @@ class ControlSession:
         self.hostname = None
         self.isnum = False
         self.sock = None
+        self.stream = False     # on ntpd's local stream socket
         self.port = 0
         self.sequence = 0
         self.response = ""
@@ -810,8 +815,35 @@ class ControlSession:
                         "ntpq: API error, missing socket attributes\n")
         return None
 
+    def __openstream(self, hname):
+        "Try ntpd's local stream socket instead of UDP to localhost."
+        path = os.environ.get("NTP_CONTROL_SOCKET",
+                              ntp.control.CTL_SOCKET_PATH)
+        if not path or not os.path.exists(path):
+            return False
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            sock.connect(path)
+        except socket.error as e:
+            ntp.util.dolog(self.logfp, "Can't use %s, %s"
+                           % (path, e.strerror), self.debug, 1)
+            sock.close()
+            return False
+        ntp.util.dolog(self.logfp, "Opening host %s via %s"
+                       % (hname, path), self.debug, 3)
+        self.sock = sock
+        self.stream = True
+        self.hostname = hname
+        self.isnum = hname != "localhost"
+        self.port = 0
+        return True
+
     def openhost(self, hname, fam=socket.AF_UNSPEC):
         "openhost - open a socket to a host"
+        self.stream = False
+        if (fam == socket.AF_UNSPEC and hname in LOCALHOSTS and
+                self.__openstream(hname)):
+            return True
         res = self.__lookuphost(hname, fam)
         if res is None:
             return False
@@ -840,6 +872,9 @@ class ControlSession:
 
     def password(self):
         "Get a keyid and the password if we don't have one."
+        if self.stream:
+            # The permissions on the socket stand in for a key
+            return
         if self.keyid is None:
             if self.auth is None:
                 try:
@@ -883,6 +918,8 @@ class ControlSession:
         "Send a packet to the host."
         while len(xdata) % 4:
             xdata += b"\x00"
+        if self.stream:
+            xdata = struct.pack("!I", len(xdata)) + ntp.poly.polybytes(xdata)
         ntp.util.dolog(self.logfp,
                        "Sending %d octets.  seq=%d"
                        % (len(xdata), self.sequence), self.debug, 3)
@@ -931,7 +968,7 @@ class ControlSession:
 
         # If it isn't authenticated we can just send it.  Otherwise
         # we're going to have to think about it a little.
-        if not auth and not self.always_auth:
+        if (not auth and not self.always_auth) or self.stream:
             return pkt.send()
 
         if self.keyid is None or self.passwd is None:
@@ -959,6 +996,8 @@ class ControlSession:
         # each packet and collect it in one long block.  When the last
         # packet in the sequence is received we'll know how much data we
         # should have had.  Note we use one long time out, should reconsider.
+        if self.stream:
+            return self.__getframe(opcode, associd, timeo)
         fragments = []
         self.response = ''
         seenlastfrag = False
@@ -1134,6 +1173,48 @@ class ControlSession:
         if not self._authpass:
             warn('AUTH: Content untrusted due to authentication failure!\n')
 
+    def __recvall(self, count, timeo):
+        "Read count octets from the stream socket."
+        data = b""
+        while len(data) < count:
+            try:
+                (rd, _, _) = select.select([self.sock], [], [], timeo)
+            except select.error:
+                raise ControlException(SERR_SELECT)
+            if not rd:
+                raise ControlException(SERR_TIMEOUT)
+            try:
+                chunk = self.sock.recv(count - len(data))
+            except socket.error:
+                raise ControlException(SERR_SOCKET)
+            if not chunk:
+                raise ControlException(SERR_SOCKET)
+            data += ntp.poly.polybytes(chunk)
+        return data
+
+    def __getframe(self, opcode, associd, timeo):
+        "Get a whole response from the stream socket."
+        # A response is a length and then one header and all the data,
+        # so there is nothing to reassemble.  Frames for an earlier
+        # request that timed out are skipped by sequence number.
+        tvo = self.primary_timeout / 1000
+        while True:
+            (length,) = struct.unpack("!I", self.__recvall(4, tvo))
+            if length < ControlPacket.HEADER_LEN:
+                raise ControlException(SERR_UNSPEC)
+            rawdata = self.__recvall(length, tvo)
+            self.warndbg("Received %d octet frame" % length, 3)
+            rpkt = ControlPacket(self)
+            rpkt.analyze(rawdata)
+            if self.__validate_packet(rpkt, rawdata, opcode, associd):
+                break
+        self.rstatus = rpkt.status
+        self.response = rpkt.extension
+        if self.debug >= 5:  # pragma: no cover
+            self.logfp.write("Response packet:\n")
+            dump_hex_printable(self.response, self.logfp)
+        return None
+
     def __validate_packet(self, rpkt, rawdata, opcode, associd):
         # TODO: refactor to simplify while retaining semantic info
         if self.logfp is not None:
@@ -1182,6 +1263,10 @@ class ControlSession:
             warn("Association ID %d doesn't match expected %d\n"
                  % (rpkt.associd, associd))
 
+        # The stream socket neither pads nor fragments
+        if self.stream:
+            return True
+
         # validate received payload size is padded to next 32-bit
         # boundary and no smaller than claimed by rpkt.count
         if len(rawdata) & 0x3:
@@ -1222,6 +1307,10 @@ class ControlSession:
     def readstat(self, associd=0):
         "Read peer status, or throw an exception."
         self.doquery(opcode=ntp.control.CTL_OP_READSTAT, associd=associd)
+        return self.__parse_statlist(associd)
+
+    def __parse_statlist(self, associd=0):
+        "Parse a response as binary association ID, status pairs."
         if len(self.response) % 4:
             raise ControlException(SERR_BADLENGTH)
         idlist = []
@@ -1233,6 +1322,30 @@ class ControlSession:
         idlist.sort(key=lambda a: a.associd)
         return idlist
 
+    def readchanges(self, since=0):
+        """Read the associations that changed after generation 'since'.
+
+Returns (gen, sysgen, full, peers): pass gen as 'since' next time;
+sysgen is the generation of the last change to the system variables.
+If full is true every association is listed and any others are gone.
+An ntpd without change generations sends the plain association list,
+returned with gen and sysgen None and full true.
+"""
+        self.doquery(opcode=ntp.control.CTL_OP_READSTAT,
+                     qdata="since=%d" % since)
+        if not self.response.startswith(ntp.poly.polybytes("gen=")):
+            return (None, None, True, self.__parse_statlist())
+        variables = self.__parse_varlist()
+        idlist = []
+        i = 0
+        while ("id.%d" % i) in variables:
+            idlist.append(Peer(self, variables["id.%d" % i],
+                               variables.get("st.%d" % i, 0)))
+            i += 1
+        idlist.sort(key=lambda a: a.associd)
+        return (variables["gen"], variables.get("sysgen"),
+                bool(variables.get("full")), idlist)
+
     def __parse_varlist(self, raw=False):
         "Parse a response as a textual varlist."
         # Strip out NULs and binary garbage from text;
@@ -1417,7 +1530,8 @@ This combats source address spoofing
                 limit = max(2, limit / 2)
                 self.warndbg("Row limit reduced to %d following "
                              " incomplete response." % limit, 1)
-        elif e.errorcode:
+        elif e.errorcode or e.message == SERR_SOCKET:
+            # ntpd went away, or hung up on the stream socket
             raise e
         return restarted_count, cap_frags, limit, frags
 
@@ -1550,6 +1664,10 @@ This combats source address spoofing
         "Retrieve ifstats data."
         return self.__ordlist("ifstats")
 
+    def monparts(self):
+        "Retrieve MRU partition data."
+        return self.__ordlist("mon_partitions")
+
 
 def parse_mru_variables(variables):
     sorter = None
@@ -1600,7 +1718,7 @@ def parse_mru_variables(variables):
         if k in ("mincount", "mindrop", "minscore",
                  "resall", "resany", "kod", "limited",
                  "maxlstint", "minlstint", "laddr", "recent",
-                 "sort", "frags", "limit"):
+                 "sort", "frags", "limit", "shared"):
             continue
         elif k.startswith('addr.') or k.startswith('last.'):
             kn = k.split('.')
@@ -1620,6 +1738,8 @@ def parse_mru_variables(variables):
         variables['resany'] = variables.get('resany', 0) \
                               | ntp.magic.RES_LIMITED
         del variables['limited']
+    if 'shared' in variables:
+        variables['shared'] = 1
     return sorter, sortkey, frags
 
 
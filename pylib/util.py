@@ -82,7 +82,7 @@ MS_VARS = ("rootdelay", "rootdisp", "rootdist", "offset", "sys_jitter",
            "clk_jitter", "leapsmearoffset", "authdelay", "koffset", "kmaxerr",
            "kesterr", "kprecis", "kppsjitter", "clk_wander_threshold",
            "tick", "in", "out", "bias", "delay", "jitter", "dispersion",
-           "fudgetime1", "fudgetime2")
+           "fudgetime1", "fudgetime2", "ctl_busy", "ctl_slowest")
 PPM_VARS = ("frequency", "clk_wander")
 
 
@@ -1415,6 +1415,31 @@ class IfstatsSummary:
         return s
 
 
+class MonpartsSummary:
+    "Reusable class for monparts entry summary generation."
+    header = """\
+   depth maxdepth      new recycled   none  limited  average  burst   kod
+    local address
+"""
+    width = 72
+    # Numbers are the fieldsize
+    fields = (('depth', '%8d'), ('maxdepth', '%8d'), ('new', '%8d'),
+              ('recycled', '%8d'), ('none', '%6d'), ('limited', '%8d'),
+              ('average', '%8g'), ('burst', '%6g'), ('kod', '%5g'))
+
+    def summary(self, variables):
+        try:
+            s = ' '.join(fmt % variables[name] for (name, fmt)
+                         in self.fields)
+            address = variables["addr"]
+        except (KeyError, TypeError):
+            # Can happen when ntpd ships a corrupted response
+            return ''
+        if address == '*':
+            address = 'all other addresses'
+        return "%s\n    %s\n" % (s, address)
+
+
 try:
     from collections import OrderedDict
 except ImportError:  # pragma: no cover
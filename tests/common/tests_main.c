@@ -56,6 +56,7 @@ static void RunAllTests(void)
 	RUN_TEST_GROUP(socktoa);
 	RUN_TEST_GROUP(statestr);
 	RUN_TEST_GROUP(timespecops);
+	RUN_TEST_GROUP(tsctime);
 	RUN_TEST_GROUP(vi64ops);
 	RUN_TEST_GROUP(ymd2yd);
 #endif
@@ -33,6 +33,8 @@ const int digestLength = 16;
 
 /* Need #define to avoid VLA (variable length array) */
 #define totalLength 36
+/* Room for any MAC the encrypt functions may write, not just 16 bytes */
+#define bufferLength (16 + 4 + MAX_BARE_MAC_LENGTH)
 
 char expectedMD5Packet[] = "ijklmnopqrstuvwx\0\0\0\0\x0c\x0e\x84\xcf\x0b\xb7\xa8\x68\x8e\x52\x38\xdb\xbc\x1c\x39\x53";
 char expectedCMACPacket[] = "ijklmnopqrstuvwx\0\0\0\0\xb0\xa1\xcf\xd2\x7f\x69\x0c\x43\xa7\x5d\x6c\x55\x91\x4b\x15\x14";
@@ -40,7 +42,7 @@ char expectedCMACPacket[] = "ijklmnopqrstuvwx\0\0\0\0\xb0\xa1\xcf\xd2\x7f\x69\x0
 auth_info auth;
 
 TEST(macencrypt, Encrypt) {
-	char packetPtr[totalLength];
+	char packetPtr[bufferLength];
 	memset(packetPtr+packetLength, 0, (size_t)keyIdLength);
 	memcpy(packetPtr, packet, (size_t)packetLength);
 
@@ -86,7 +88,7 @@ TEST(macencrypt, Encrypt) {
 }
 
 TEST(macencrypt, CMAC_Encrypt) {
-	char packetPtr[totalLength];
+	char packetPtr[bufferLength];
 	memset(packetPtr+packetLength, 0, (size_t)keyIdLength);
 	memcpy(packetPtr, packet, (size_t)packetLength);
 
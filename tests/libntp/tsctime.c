@@ -0,0 +1,144 @@
+#include "config.h"
+#include "ntp_stdlib.h"
+#include "ntp_fp.h"
+#include "timespecops.h"
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include <string.h>
+
+/*
+ * Feed tsc_calibrate() made-up readings from a 1 GHz TSC, so one tick
+ * is one nanosecond, starting well away from zero.
+ */
+static uint64_t		tsc;
+static struct timespec	ts;
+
+TEST_GROUP(tsctime);
+
+TEST_SETUP(tsctime) {
+	memset(&tsc_stats, 0, sizeof(tsc_stats));
+	tsc_reset();
+	tsc_stats.enabled = true;
+	tsc = 1000000;
+	ts.tv_sec = 1000;
+	ts.tv_nsec = 0;
+}
+
+TEST_TEAR_DOWN(tsctime) {
+	tsc_reset();
+	tsc_stats.enabled = false;
+}
+
+/* one second on the system clock, the TSC off by ppm */
+static bool
+tick(double ppm)
+{
+	tsc += (uint64_t)(NS_PER_S * (1 + ppm * 1e-6));
+	ts.tv_sec++;
+	return tsc_calibrate(tsc, ts, 10);
+}
+
+/* the first reading, one for a rate, then 8 (TSC_SETTLE) checked */
+static void
+settle(void)
+{
+	int i;
+
+	TEST_ASSERT_TRUE(tsc_calibrate(tsc, ts, 10));
+	for (i = 0; i < 8; i++) {
+		TEST_ASSERT_FALSE(tsc_stats.active);
+		TEST_ASSERT_TRUE(tick(0));
+	}
+	TEST_ASSERT_FALSE(tsc_stats.active);
+	TEST_ASSERT_EQUAL_STRING("calibrating", tsc_state());
+	TEST_ASSERT_TRUE(tick(0));
+	TEST_ASSERT_TRUE(tsc_stats.active);
+	TEST_ASSERT_EQUAL_STRING("on", tsc_state());
+}
+
+
+TEST(tsctime, Settles) {
+	settle();
+	TEST_ASSERT_DOUBLE_WITHIN(1, 1e9, tsc_stats.hz);
+	TEST_ASSERT_EQUAL(0, tsc_stats.fallbacks);
+}
+
+TEST(tsctime, KeepsSmallError) {
+	settle();
+	TEST_ASSERT_TRUE(tick(5));
+	TEST_ASSERT_TRUE(tsc_stats.active);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-7, 5e-6, tsc_stats.maxerr);
+}
+
+TEST(tsctime, RejectsLargeError) {
+	settle();
+	TEST_ASSERT_TRUE(tick(20));
+	TEST_ASSERT_FALSE(tsc_stats.active);
+	TEST_ASSERT_EQUAL(0, tsc_stats.good);
+	TEST_ASSERT_EQUAL(1, tsc_stats.fallbacks);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-7, -20e-6, tsc_stats.err);
+	TEST_ASSERT_EQUAL_STRING("calibrating", tsc_state());
+}
+
+TEST(tsctime, RejectsTSCBackwards) {
+	settle();
+	tsc -= 2 * NS_PER_S;
+	ts.tv_sec++;
+	TEST_ASSERT_TRUE(tsc_calibrate(tsc, ts, 10));
+	TEST_ASSERT_FALSE(tsc_stats.active);
+	TEST_ASSERT_EQUAL(1, tsc_stats.fallbacks);
+}
+
+TEST(tsctime, RejectsClockStep) {
+	settle();
+	tsc += NS_PER_S;
+	ts.tv_sec += 10;	/* more than TSC_SPAN */
+	TEST_ASSERT_TRUE(tsc_calibrate(tsc, ts, 10));
+	TEST_ASSERT_FALSE(tsc_stats.active);
+	TEST_ASSERT_EQUAL(1, tsc_stats.fallbacks);
+}
+
+TEST(tsctime, SkipsWidePair) {
+	int good;
+
+	settle();
+	good = tsc_stats.good;
+	tsc += NS_PER_S;
+	ts.tv_sec++;
+	/* 10 us between the TSC readings, more than TSC_MAXERR / 2 */
+	TEST_ASSERT_FALSE(tsc_calibrate(tsc, ts, 10000));
+	TEST_ASSERT_TRUE(tsc_stats.active);
+	TEST_ASSERT_EQUAL(good, tsc_stats.good);
+}
+
+TEST(tsctime, FallsBackToSystemClock) {
+	struct timespec	real, got;
+	l_fp		now;
+
+	settle();
+	TEST_ASSERT_TRUE(tick(20));
+	TEST_ASSERT_FALSE(tsc_gettime(&got));
+
+	/* not the made-up time of the calibration */
+	clock_gettime(CLOCK_REALTIME, &real);
+	get_systime(&now);
+	got = lfp_stamp_to_tspec(now, real.tv_sec);
+	TEST_ASSERT_DOUBLE_WITHIN(1, 0,
+				  tspec_to_d(sub_tspec(got, real)));
+
+	tsc_reset();
+	TEST_ASSERT_FALSE(tsc_gettime(&got));
+	TEST_ASSERT_EQUAL_STRING("calibrating", tsc_state());
+}
+
+TEST_GROUP_RUNNER(tsctime) {
+	RUN_TEST_CASE(tsctime, Settles);
+	RUN_TEST_CASE(tsctime, KeepsSmallError);
+	RUN_TEST_CASE(tsctime, RejectsLargeError);
+	RUN_TEST_CASE(tsctime, RejectsTSCBackwards);
+	RUN_TEST_CASE(tsctime, RejectsClockStep);
+	RUN_TEST_CASE(tsctime, SkipsWidePair);
+	RUN_TEST_CASE(tsctime, FallsBackToSystemClock);
+}
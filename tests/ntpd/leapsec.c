@@ -957,6 +957,59 @@ TEST(leapsec, ls2012seqInsDumb) {
 	TEST_ASSERT_EQUAL(LSPROX_NOWARN, qr.proximity);
 }
 
+#ifdef ENABLE_LEAP_SMEAR
+// ----------------------------------------------------------------------
+// smear the 2012.07.01 insert over two hours, publishing once per tick
+// and answering a burst of requests between ticks
+TEST(leapsec, ls2012smear) {
+	bool              rc;
+	leap_result_t     qr;
+	leap_smear_info_t ls;
+	time_t            t;
+	const long        intv  = 2 * SECSPERHR;
+	const time_t      start = lsec2012 - intv;
+
+	rc = setup_load_table(leap1);
+	TEST_ASSERT_TRUE(rc);
+	leapsec_electric(electric_on);
+	memset(&ls, 0, sizeof(ls));
+	ls.enabled = true;
+
+	// scheduled, but not smearing yet
+	leapsec_query(&qr, lsec2012 - 7*SECSPERDAY);
+	leapsec_smear_update(&ls, &qr, lsec2012 - 7*SECSPERDAY, intv);
+	TEST_ASSERT_FALSE(ls.in_progress);
+	TEST_ASSERT_EQUAL(intv, ls.interval);
+	TEST_ASSERT_EQUAL(0, lfptod(ls.offset));
+
+	for (t = start; t < lsec2012; t++) {
+		leapsec_query(&qr, t);
+		leapsec_smear_update(&ls, &qr, t, intv);
+		TEST_ASSERT_TRUE(ls.in_progress);
+		TEST_ASSERT_EQUAL_UINT32(convertLFPToRefID(ls.offset),
+					 ls.refid);
+		for (int i = 0; i < 64; i++) {
+			l_fp when = lfpinit_u((uint32_t)(t + JAN_1970),
+					      (uint32_t)i << 26);
+			double want = -((double)(t - start) + i / 64.0) / intv;
+			double got = (double)lfptod(leap_smear_at(&ls, when));
+			TEST_ASSERT_DOUBLE_WITHIN(1e-9, want, got);
+		}
+	}
+
+	// late requests don't run past the end of the interval
+	TEST_ASSERT_DOUBLE_WITHIN(1e-9, -1.0, (double)lfptod(leap_smear_at(
+	    &ls, lfpinit_u((uint32_t)(lsec2012 + 5 + JAN_1970), 0))));
+
+	// leap second done, smear is over
+	rc = leapsec_query(&qr, lsec2012);
+	TEST_ASSERT_TRUE(rc);
+	leapsec_smear_update(&ls, &qr, lsec2012, intv);
+	TEST_ASSERT_FALSE(ls.in_progress);
+	TEST_ASSERT_EQUAL(0, ls.interval);
+}
+#endif
+
 // ----------------------------------------------------------------------
 // test repeated query on empty table in dumb mode
 TEST(leapsec, lsEmptyTableDumb) {
@@ -1023,6 +1076,9 @@ TEST_GROUP_RUNNER(leapsec) {
 	RUN_TEST_CASE(leapsec, ls2009seqDelDumb);
 	RUN_TEST_CASE(leapsec, ls2012seqInsElectric);
 	RUN_TEST_CASE(leapsec, ls2012seqInsDumb);
+#ifdef ENABLE_LEAP_SMEAR
+	RUN_TEST_CASE(leapsec, ls2012smear);
+#endif
 	RUN_TEST_CASE(leapsec, lsEmptyTableDumb);
 	RUN_TEST_CASE(leapsec, lsEmptyTableElectric);
 }
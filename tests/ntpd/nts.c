@@ -27,9 +27,68 @@ TEST(nts, nts_string_to_aead) {
 				nts_string_to_aead("AES_SIV_CMAC_384"));
 	TEST_ASSERT_EQUAL_INT16(AEAD_AES_SIV_CMAC_512,
 				nts_string_to_aead("AES_SIV_CMAC_512"));
+	TEST_ASSERT_EQUAL_INT16(AEAD_AES_128_GCM_SIV,
+				nts_string_to_aead("AES_128_GCM_SIV"));
 	TEST_ASSERT_EQUAL_INT16(NO_AEAD, nts_string_to_aead("blah"));
 }
 
+TEST(nts, nts_string_to_aeads) {
+	uint16_t aeads[NTS_MAX_AEADS];
+
+	TEST_ASSERT_EQUAL_INT(2, nts_string_to_aeads(
+		"AES_SIV_CMAC_512:AES_SIV_CMAC_256", aeads, NTS_MAX_AEADS));
+	TEST_ASSERT_EQUAL_INT16(AEAD_AES_SIV_CMAC_512, aeads[0]);
+	TEST_ASSERT_EQUAL_INT16(AEAD_AES_SIV_CMAC_256, aeads[1]);
+	/* unknown entries are skipped */
+	TEST_ASSERT_EQUAL_INT(1, nts_string_to_aeads(
+		"blah:AES_SIV_CMAC_384", aeads, NTS_MAX_AEADS));
+	TEST_ASSERT_EQUAL_INT16(AEAD_AES_SIV_CMAC_384, aeads[0]);
+	TEST_ASSERT_EQUAL_INT(1, nts_string_to_aeads(
+		"AES_SIV_CMAC_256:AES_SIV_CMAC_512", aeads, 1));
+	TEST_ASSERT_EQUAL_INT(0, nts_string_to_aeads("blah", aeads, NTS_MAX_AEADS));
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+/* RFC 8452 Appendix C.1, the vector with both AAD and plain text */
+TEST(nts, aead_gcm_siv_kat) {
+	const uint8_t key[16] = {0x01};
+	const uint8_t nonce[12] = {0x03};
+	const uint8_t ad[1] = {0x01};
+	const uint8_t plain[8] = {0x02};
+	const uint8_t expect[24] = {
+		0x1e, 0x6d, 0xab, 0xa3, 0x56, 0x69, 0xf4, 0x27,
+		0x3b, 0x0a, 0x1a, 0x25, 0x60, 0x96, 0x9c, 0xdf,
+		0x79, 0x0d, 0x99, 0x75, 0x9a, 0xbd, 0x15, 0x08};
+	uint8_t cipher[24], back[8];
+	size_t len;
+
+	if (!nts_aead_ok(AEAD_AES_128_GCM_SIV)) {
+		TEST_IGNORE_MESSAGE("no AES-128-GCM-SIV in this OpenSSL");
+	}
+	len = sizeof(cipher);
+	TEST_ASSERT_TRUE(nts_aead_encrypt(AEAD_AES_128_GCM_SIV,
+		cipher, &len, key, sizeof(key), nonce, sizeof(nonce),
+		plain, sizeof(plain), ad, sizeof(ad)));
+	TEST_ASSERT_EQUAL_INT(sizeof(expect), len);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expect, cipher, sizeof(expect));
+
+	len = sizeof(back);
+	TEST_ASSERT_TRUE(nts_aead_decrypt(AEAD_AES_128_GCM_SIV,
+		back, &len, key, sizeof(key), nonce, sizeof(nonce),
+		cipher, sizeof(cipher), ad, sizeof(ad)));
+	TEST_ASSERT_EQUAL_INT(sizeof(plain), len);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(plain, back, sizeof(plain));
+
+	/* a flipped tag bit must not decrypt */
+	memcpy(cipher, expect, sizeof(expect));
+	cipher[23] ^= 1;
+	len = sizeof(back);
+	TEST_ASSERT_FALSE(nts_aead_decrypt(AEAD_AES_128_GCM_SIV,
+		back, &len, key, sizeof(key), nonce, sizeof(nonce),
+		cipher, sizeof(cipher), ad, sizeof(ad)));
+}
+#endif
+
 TEST(nts, nts_get_key_length) {
 	TEST_ASSERT_EQUAL_INT32(AEAD_AES_SIV_CMAC_256_KEYLEN,
 				nts_get_key_length(AEAD_AES_SIV_CMAC_256));
@@ -37,6 +96,8 @@ TEST(nts, nts_get_key_length) {
 				nts_get_key_length(AEAD_AES_SIV_CMAC_384));
 	TEST_ASSERT_EQUAL_INT32(AEAD_AES_SIV_CMAC_512_KEYLEN,
 				nts_get_key_length(AEAD_AES_SIV_CMAC_512));
+	TEST_ASSERT_EQUAL_INT32(AEAD_AES_128_GCM_SIV_KEYLEN,
+				nts_get_key_length(AEAD_AES_128_GCM_SIV));
 	TEST_ASSERT_EQUAL_INT32(0, nts_get_key_length(-23));
 }
 
@@ -401,6 +462,10 @@ TEST(nts, next_bytes) {
 TEST_GROUP_RUNNER(nts) {
 	RUN_TEST_CASE(nts, nts_translate_version);
 	RUN_TEST_CASE(nts, nts_string_to_aead);
+	RUN_TEST_CASE(nts, nts_string_to_aeads);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	RUN_TEST_CASE(nts, aead_gcm_siv_kat);
+#endif
 	RUN_TEST_CASE(nts, nts_get_key_length);
 	RUN_TEST_CASE(nts, ke_append_record_null);
 	RUN_TEST_CASE(nts, ke_append_record_uint16);
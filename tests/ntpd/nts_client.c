@@ -31,6 +31,8 @@ TEST(nts_client, nts_client_send_request_core) {
 	char pAEAD[50] = "AES_SIV_CMAC_512";
 	/* ===== Test: correct, peer aead ===== */
 	peer.cfg.nts_cfg.aead = pAEAD;
+	peer.cfg.nts_cfg.naeads = nts_string_to_aeads(pAEAD,
+		peer.cfg.nts_cfg.aeads, NTS_MAX_AEADS);
 	/* run */
 	success = nts_client_send_request_core(buffer, sizeof(buffer), &used, &peer);
 	TEST_ASSERT_EQUAL(true, success);
@@ -53,8 +55,11 @@ TEST(nts_client, nts_client_send_request_core) {
 	TEST_ASSERT_EQUAL(0, buffer[15]);
 	/* ===== Test: correct, global config aead ===== */
 	peer.cfg.nts_cfg.aead = NULL;
+	peer.cfg.nts_cfg.naeads = 0;
 	char gAEAD[50] = "AES_SIV_CMAC_384";
 	ntsconfig.aead = gAEAD;
+	ntsconfig.naeads = nts_string_to_aeads(gAEAD,
+		ntsconfig.aeads, NTS_MAX_AEADS);
 	/* run */
 	success = nts_client_send_request_core(buffer, sizeof(buffer), &used, &peer);
 	TEST_ASSERT_EQUAL(true, success);
@@ -78,6 +83,7 @@ TEST(nts_client, nts_client_send_request_core) {
 	/* ===== Test: correct, default aead ===== */
 	peer.cfg.nts_cfg.aead = NULL;
 	ntsconfig.aead = NULL;
+	ntsconfig.naeads = 0;
 	/* run */
 	success = nts_client_send_request_core(buffer, sizeof(buffer), &used, &peer);
 	TEST_ASSERT_EQUAL(true, success);
@@ -106,6 +112,7 @@ TEST(nts_client, nts_client_process_response_core) {
 	struct peer peer;
 	peer.nts_state.aead = 42; /* Dummy init values */
 	peer.nts_state.cookielen = 0;
+	peer.nts_state.cookies = NULL;
 	peer.nts_state.writeIdx = 0;
 	peer.nts_state.count = 0;
 	/* Coverity barfed on uninitialized peer.srcadr, 2022-Mar-16
@@ -134,14 +141,14 @@ TEST(nts_client, nts_client_process_response_core) {
 	TEST_ASSERT_EQUAL(true, success);
 	TEST_ASSERT_EQUAL_INT16(AEAD_AES_SIV_CMAC_256, peer.nts_state.aead);
 	TEST_ASSERT_EQUAL_INT32(8, peer.nts_state.cookielen);
-	TEST_ASSERT_EQUAL_INT8(1, peer.nts_state.cookies[0][0]);
-	TEST_ASSERT_EQUAL_INT8(2, peer.nts_state.cookies[0][1]);
-	TEST_ASSERT_EQUAL_INT8(3, peer.nts_state.cookies[0][2]);
-	TEST_ASSERT_EQUAL_INT8(4, peer.nts_state.cookies[0][3]);
-	TEST_ASSERT_EQUAL_INT8(5, peer.nts_state.cookies[0][4]);
-	TEST_ASSERT_EQUAL_INT8(6, peer.nts_state.cookies[0][5]);
-	TEST_ASSERT_EQUAL_INT8(7, peer.nts_state.cookies[0][6]);
-	TEST_ASSERT_EQUAL_INT8(8, peer.nts_state.cookies[0][7]);
+	TEST_ASSERT_EQUAL_INT8(1, peer.nts_state.cookies[0]);
+	TEST_ASSERT_EQUAL_INT8(2, peer.nts_state.cookies[1]);
+	TEST_ASSERT_EQUAL_INT8(3, peer.nts_state.cookies[2]);
+	TEST_ASSERT_EQUAL_INT8(4, peer.nts_state.cookies[3]);
+	TEST_ASSERT_EQUAL_INT8(5, peer.nts_state.cookies[4]);
+	TEST_ASSERT_EQUAL_INT8(6, peer.nts_state.cookies[5]);
+	TEST_ASSERT_EQUAL_INT8(7, peer.nts_state.cookies[6]);
+	TEST_ASSERT_EQUAL_INT8(8, peer.nts_state.cookies[7]);
 	TEST_ASSERT_EQUAL_INT32(1, peer.nts_state.writeIdx);
 	TEST_ASSERT_EQUAL_INT32(1, peer.nts_state.count);
 	/* ===== Test: nts_error ===== */
@@ -198,30 +205,43 @@ TEST(nts_client, nts_client_process_response_core) {
 	/* run */
 	success = nts_client_process_response_core(buf6, sizeof(buf6), &peer);
 	TEST_ASSERT_EQUAL(false, success);
-	/* ===== Test: nts_new_cookie, cookie doesn't equal peer cookie size ===== */
+	/* ===== Test: nts_new_cookie, cookie doesn't equal first cookie size ===== */
 	/* data */
-	peer.nts_state.cookielen = 8;
 	uint8_t buf7[] = {
-		0x80, nts_new_cookie, 0, 4, 0, 9,
+		0x80, nts_algorithm_negotiation, 0, 2,
+			0, AEAD_AES_SIV_CMAC_256,
+		0x80, nts_new_cookie, 0, 4, 1, 2, 3, 4,
+		0x80, nts_new_cookie, 0, 8, 1, 2, 3, 4, 5, 6, 7, 8,
 		0x80, nts_end_of_message, 0, 0
 	};
 	/* run */
 	success = nts_client_process_response_core(buf7, sizeof(buf7), &peer);
 	TEST_ASSERT_EQUAL(false, success);
-	/* ===== Test: nts_new_cookie, have max cookies ===== */
+	/* ===== Test: nts_new_cookie, have max cookies, new length ===== */
 	/* data */
 	uint8_t buf8[] = {
-		0x80, nts_new_cookie, 0, 4, 0, 8, 10, 20, 30, 40, 50, 60, 70, 80,
+		0x80, nts_algorithm_negotiation, 0, 2,
+			0, AEAD_AES_SIV_CMAC_256,
+		0x80, nts_new_cookie, 0, 4, 1, 1, 1, 1,
+		0x80, nts_new_cookie, 0, 4, 2, 2, 2, 2,
+		0x80, nts_new_cookie, 0, 4, 3, 3, 3, 3,
+		0x80, nts_new_cookie, 0, 4, 4, 4, 4, 4,
+		0x80, nts_new_cookie, 0, 4, 5, 5, 5, 5,
+		0x80, nts_new_cookie, 0, 4, 6, 6, 6, 6,
+		0x80, nts_new_cookie, 0, 4, 7, 7, 7, 7,
+		0x80, nts_new_cookie, 0, 4, 8, 8, 8, 8,
+		0x80, nts_new_cookie, 0, 4, 9, 9, 9, 9,
 		0x80, nts_end_of_message, 0, 0
 	};
-	peer.nts_state.writeIdx = 0;
-	peer.nts_state.count = NTS_MAX_COOKIES;
 	/* run */
 	success = nts_client_process_response_core(buf8, sizeof(buf8), &peer);
 	/* check */
-	TEST_ASSERT_EQUAL(false, success);
+	TEST_ASSERT_EQUAL(true, success);
+	TEST_ASSERT_EQUAL_INT32(4, peer.nts_state.cookielen);
+	TEST_ASSERT_EQUAL(NTS_MAX_COOKIES, peer.nts_state.count);
 	TEST_ASSERT_EQUAL(0, peer.nts_state.writeIdx);
-	TEST_ASSERT_NOT_EQUAL(10, peer.nts_state.cookies[0][0]);
+	TEST_ASSERT_EQUAL_INT8(1, peer.nts_state.cookies[0]);
+	TEST_ASSERT_EQUAL_INT8(8, NTS_COOKIE(&peer.nts_state, 7)[3]);
 	/* ===== Test: nts_end_of_message, wrong length ===== */
 	/* data */
 	uint8_t buf9[] = {
@@ -267,6 +287,7 @@ TEST(nts_client, nts_client_process_response_core) {
 	/* run */
 	success = nts_client_process_response_core(buf13, sizeof(buf13), &peer);
 	TEST_ASSERT_EQUAL(false, success);
+	nts_free_cookies(&peer.nts_state);
 }
 
 /* Hacks to keep linker happy */
@@ -60,23 +60,91 @@ TEST(nts_cookie, nts_make_unpack_cookie) {
 	int keylen;
 	bool ok;
 	uint16_t aead; /* retrieved on unpack */
+	uint8_t secret[NTS_MAX_SECRETLEN];
+	int secretlen;
 	/* Init for cookie_ctx */
 	nts_cookie_init();
 	nts_nKeys = 0;
 	nts_make_cookie_key();
 	/* Test */
-	len = nts_make_cookie(cookie, AEAD_AES_SIV_CMAC_256, c2s, s2c, sizeof(c2s));
+	len = nts_make_cookie(cookie, AEAD_AES_SIV_CMAC_256, c2s, s2c, sizeof(c2s),
+			      NULL, 0);
 	TEST_ASSERT_EQUAL(72, len);
 	/* Very limited in what data can be directly checked here */
 	/* Reverse the test */
-	ok = nts_unpack_cookie(cookie, len, &aead, c2s_2, s2c_2, &keylen);
+	ok = nts_unpack_cookie(cookie, len, &aead, c2s_2, s2c_2, &keylen,
+			       secret, &secretlen);
 	TEST_ASSERT_EQUAL(true, ok);
 	TEST_ASSERT_EQUAL(AEAD_AES_SIV_CMAC_256, aead);
 	TEST_ASSERT_EQUAL(16, keylen);
+	TEST_ASSERT_EQUAL(0, secretlen);
 	TEST_ASSERT_EQUAL_UINT8_ARRAY(c2s, c2s_2, 16);
 	TEST_ASSERT_EQUAL_UINT8_ARRAY(s2c, s2c_2, 16);
 }
 
+TEST(nts_cookie, nts_short_cookie) {
+	/* TLS 1.3 exporter secret, SHA-256 */
+	uint8_t exporter[32] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31};
+	const uint8_t expect_secret[32] = {
+		0x63, 0xfb, 0xaf, 0x1e, 0x52, 0xfc, 0xca, 0x08,
+		0x78, 0x2b, 0xf2, 0x2c, 0x4f, 0x00, 0x99, 0xcb,
+		0xb6, 0xc6, 0xf5, 0xcf, 0x61, 0x23, 0x68, 0x4b,
+		0xfc, 0x49, 0xeb, 0x06, 0x33, 0xf6, 0x4e, 0x98};
+	const uint8_t expect_c2s[32] = {
+		0x7a, 0xce, 0x59, 0xb6, 0x4c, 0x90, 0x3e, 0xae,
+		0x1c, 0xfc, 0x53, 0xba, 0x4c, 0x43, 0x8a, 0xf6,
+		0x2e, 0x58, 0x57, 0xce, 0x94, 0x43, 0xb8, 0xc5,
+		0xa4, 0xf2, 0xbe, 0xde, 0xc4, 0xbe, 0x8c, 0x7d};
+	const uint8_t expect_s2c[32] = {
+		0xe8, 0x87, 0xfc, 0x4b, 0xe1, 0x49, 0x3a, 0xc9,
+		0xc7, 0xb6, 0x47, 0x71, 0xd2, 0x60, 0x00, 0x7b,
+		0x2f, 0xd5, 0x3b, 0x5b, 0x47, 0xed, 0xa9, 0x91,
+		0xcf, 0x40, 0x73, 0xf9, 0xfa, 0x36, 0x3c, 0xa5};
+	uint8_t secret[NTS_MAX_SECRETLEN], secret_2[NTS_MAX_SECRETLEN];
+	uint8_t c2s[32], s2c[32], c2s_2[32], s2c_2[32];
+	uint8_t cookie[NTS_MAX_COOKIELEN];
+	int len, keylen, secretlen;
+	uint16_t aead;
+	bool ok;
+
+	nts_cookie_init();
+	nts_nKeys = 0;
+	nts_make_cookie_key();
+	/* RFC 8446 7.5 exporter, checked against the HKDF in Python */
+	ok = nts_export_secret(exporter, sizeof(exporter), secret);
+	TEST_ASSERT_EQUAL(true, ok);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expect_secret, secret, 32);
+	ok = nts_secret_keys(AEAD_AES_SIV_CMAC_256, secret, 32,
+			     c2s, s2c, sizeof(c2s));
+	TEST_ASSERT_EQUAL(true, ok);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expect_c2s, c2s, 32);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expect_s2c, s2c, 32);
+	/* Short cookie carries the secret, not the keys */
+	len = nts_make_cookie(cookie, AEAD_AES_SIV_CMAC_256, c2s, s2c,
+			      sizeof(c2s), secret, 32);
+	TEST_ASSERT_EQUAL(72, len);
+	ok = nts_unpack_cookie(cookie, len, &aead, c2s_2, s2c_2, &keylen,
+			       secret_2, &secretlen);
+	TEST_ASSERT_EQUAL(true, ok);
+	TEST_ASSERT_EQUAL(AEAD_AES_SIV_CMAC_256, aead);
+	TEST_ASSERT_EQUAL(32, keylen);
+	TEST_ASSERT_EQUAL(32, secretlen);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(secret, secret_2, 32);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(c2s, c2s_2, 32);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(s2c, s2c_2, 32);
+	/* Not worth it if the keys are shorter than the secret */
+	len = nts_make_cookie(cookie, AEAD_AES_SIV_CMAC_256, c2s, s2c,
+			      16, secret, 32);
+	TEST_ASSERT_EQUAL(72, len);
+	ok = nts_unpack_cookie(cookie, len, &aead, c2s_2, s2c_2, &keylen,
+			       secret_2, &secretlen);
+	TEST_ASSERT_EQUAL(true, ok);
+	TEST_ASSERT_EQUAL(16, keylen);
+	TEST_ASSERT_EQUAL(0, secretlen);
+}
+
 const char *cookie_file_name = "test-cookie-keys";
 
 TEST(nts_cookie, nts_read_write_cookies) {
@@ -109,6 +177,7 @@ TEST(nts_cookie, nts_read_write_cookies) {
 
 TEST_GROUP_RUNNER(nts_cookie) {
 	RUN_TEST_CASE(nts_cookie, nts_make_unpack_cookie);
+	RUN_TEST_CASE(nts_cookie, nts_short_cookie);
 	RUN_TEST_CASE(nts_cookie, nts_make_cookie_key);
 	RUN_TEST_CASE(nts_cookie, nts_read_write_cookies);
 	/* This test gets run as root during install
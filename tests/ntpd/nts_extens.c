@@ -47,7 +47,11 @@ TEST(nts_extens, extens_client_send) {
 	uint8_t c2s[NTS_MAX_KEYLEN] = {1, 2, 3, 4, 5, 6, 7, 8};
 	memcpy(peer.nts_state.c2s, c2s, sizeof(c2s));
 	peer.nts_state.keylen = sizeof(c2s);
+	peer.nts_state.aead = AEAD_AES_SIV_CMAC_256;
 	peer.nts_state.cookielen = NTS_MAX_COOKIELEN;
+	uint8_t cookies[NTS_MAX_COOKIES * NTS_MAX_COOKIELEN] = {0};
+	peer.nts_state.cookies = cookies;
+	peer.nts_state.used = 0;
 	struct pkt xpkt;
 	int used = 0;
 	/* Test */
@@ -56,6 +60,7 @@ TEST(nts_extens, extens_client_send) {
 	TEST_ASSERT_EQUAL(1, peer.nts_state.readIdx);
 	TEST_ASSERT_EQUAL(1, nts_cnt.client_send);
 	TEST_ASSERT_EQUAL(3, peer.nts_state.count);
+	TEST_ASSERT_EQUAL(1, peer.nts_state.used);
 }
 
 TEST(nts_extens, extens_server_recv) {
@@ -75,7 +80,7 @@ TEST(nts_extens, extens_server_recv) {
 	uint8_t s2c[16] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
 	int cookielen;
 	cookielen = nts_make_cookie(cookie, AEAD_AES_SIV_CMAC_256, c2s, s2c,
-				    sizeof(c2s));
+				    sizeof(c2s), NULL, 0);
 	/* === Pre Switch === */
 	/* Bad record length; non-aligned */
 	append_header(&buf, 0x1234, 0x0003);
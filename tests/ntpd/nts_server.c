@@ -105,6 +105,37 @@ TEST(nts_server, nts_ke_process_receive) {
 	TEST_ASSERT_EQUAL(false, success);
 }
 
+TEST(nts_server, nts_ke_admit) {
+	sockaddr_u addr, neighbour;
+	int i;
+
+	ZERO_SOCK(&addr);
+	AF(&addr) = AF_INET;
+	PSOCK_ADDR4(&addr)->s_addr = htonl(0xC0000201);	/* 192.0.2.1 */
+	neighbour = addr;
+	PSOCK_ADDR4(&neighbour)->s_addr = htonl(0xC0000202);
+	ntsconfig.ke_rate = 1.0;
+	ntsconfig.ke_prefixrate = 0;
+
+	/* A burst of 10, then nothing until a token comes back */
+	for (i = 0; i < 10; i++)
+		TEST_ASSERT_TRUE(nts_ke_admit(&addr, 100.0));
+	TEST_ASSERT_FALSE(nts_ke_admit(&addr, 100.0));
+	TEST_ASSERT_TRUE(nts_ke_admit(&neighbour, 100.0));
+	TEST_ASSERT_FALSE(nts_ke_admit(&addr, 100.5));
+	TEST_ASSERT_TRUE(nts_ke_admit(&addr, 101.0));
+
+	/* The /24 shares a bucket */
+	ntsconfig.ke_rate = 0;
+	ntsconfig.ke_prefixrate = 0.1;
+	TEST_ASSERT_TRUE(nts_ke_admit(&addr, 200.0));
+	TEST_ASSERT_FALSE(nts_ke_admit(&neighbour, 200.0));
+
+	ntsconfig.ke_rate = NTS_KE_RATE;
+	ntsconfig.ke_prefixrate = NTS_KE_PREFIXRATE;
+}
+
 TEST_GROUP_RUNNER(nts_server) {
 	RUN_TEST_CASE(nts_server, nts_ke_process_receive);
+	RUN_TEST_CASE(nts_server, nts_ke_admit);
 }
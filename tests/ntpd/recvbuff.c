@@ -28,7 +28,19 @@ TEST(recvbuff, GetAndFree) {
 	TEST_ASSERT_EQUAL(initial, free_recvbuffs());
 }
 
+TEST(recvbuff, MemAccounting) {
+	unsigned long bytes = mem_use[MEM_RECVBUF].bytes;
+	unsigned long objects = mem_use[MEM_RECVBUF].objects;
+
+	init_recvbuff(RECV_INIT);
+	TEST_ASSERT_EQUAL(objects + RECV_INIT,
+			  mem_use[MEM_RECVBUF].objects);
+	TEST_ASSERT_EQUAL(bytes + RECV_INIT * sizeof(recvbuf_t),
+			  mem_use[MEM_RECVBUF].bytes);
+}
+
 TEST_GROUP_RUNNER(recvbuff) {
 	RUN_TEST_CASE(recvbuff, Initialization);
 	RUN_TEST_CASE(recvbuff, GetAndFree);
+	RUN_TEST_CASE(recvbuff, MemAccounting);
 }
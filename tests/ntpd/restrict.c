@@ -184,6 +184,28 @@ TEST(hackrestrict, RestrictUnflagWorks) {
 	TEST_ASSERT_EQUAL(1, restrictions(&resaddr));
 }
 
+TEST(hackrestrict, SourceHoleIsHashed) {
+	sockaddr_u resaddr = create_sockaddr_u(54321, "0.0.0.0");
+	sockaddr_u resmask = create_sockaddr_u(54321, "0.0.0.0");
+	struct peer server;
+
+	/* "restrict default ignore" and "restrict source nomodify" */
+	hack_restrict(RESTRICT_FLAGS, &resaddr, &resmask, 0, RES_IGNORE);
+	hack_restrict(RESTRICT_FLAGS, NULL, NULL, RESM_SOURCE, RES_NOMODIFY);
+
+	memset(&server, 0, sizeof(server));
+	server.srcadr = create_sockaddr_u(123, "11.22.33.44");
+	restrict_source(&server);
+
+	TEST_ASSERT_EQUAL(RES_NOMODIFY, restrictions(&server.srcadr));
+	/* The hole is not on the sorted list */
+	TEST_ASSERT_NULL(rstrct.restrictlist4->link);
+
+	unrestrict_source(&server);
+	TEST_ASSERT_EQUAL(RES_Default|RES_IGNORE,
+			  restrictions(&server.srcadr));
+}
+
 TEST_GROUP_RUNNER(hackrestrict) {
 	RUN_TEST_CASE(hackrestrict, RestrictionsAreEmptyAfterInit);
 	RUN_TEST_CASE(hackrestrict, ReturnsCorrectDefaultRestrictions);
@@ -193,4 +215,5 @@ TEST_GROUP_RUNNER(hackrestrict) {
 	RUN_TEST_CASE(hackrestrict, TheMostFittingRestrictionIsMatched);
 	RUN_TEST_CASE(hackrestrict, DeletedRestrictionIsNotMatched);
 	RUN_TEST_CASE(hackrestrict, RestrictUnflagWorks);
+	RUN_TEST_CASE(hackrestrict, SourceHoleIsHashed);
 }
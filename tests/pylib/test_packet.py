@@ -153,6 +153,10 @@ class TestPacket(unittest.TestCase):
                          {"mincount": 50, "resall": 1, "resany": 1061,
                           "maxlstint": 100, "laddr": "foo.test",
                           "recent": "foo", "limit": 80})
+        # Test the shared table
+        data = {"shared": True, "frags": 20}
+        sorter, sortkey, frags = f(data)
+        self.assertEqual(data, {"shared": 1})
         # Test bad sort
         data = {"sort": "FAIL", "mincount": 50, "resall": 1, "resany": 5,
                 "kod": True, "limited": True, "maxlstint": 100,
@@ -1238,6 +1242,52 @@ class TestControlSession(unittest.TestCase):
         finally:
             ntpp.select = select
 
+    def test_stream(self):
+        sockjig = jigs.SocketJig()
+        fakeselectmod = jigs.SelectModuleJig()
+        # Init
+        cls = self.target()
+        cls.sock = sockjig
+        cls.stream = True
+        try:
+            ntpp.select = fakeselectmod
+            # Test framed request, no MAC or credentials needed
+            cls.sendrequest(8, 0, "foo", auth=True)
+            self.assertEqual(sockjig.data,
+                             [ntp.poly.polybytes(
+                                 "\x00\x00\x00\x10"
+                                 "\xD6\x08\x00\x01\x00\x00\x00\x00"
+                                 "\x00\x00\x00\x03foo\x00")])
+            # Test response in one unpadded frame, after a stale one
+            sockjig.return_data = [
+                "\x00\x00\x00\x0C",
+                "\x16\x82\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+                "\x00\x00\x00\x15"
+                "\x16\x82\x00\x01\x06\x15\x00\x00\x00\x00\x00\x09",
+                "foo=4223,"]
+            cls.getresponse(2, 0, True)
+            self.assertEqual(cls.response, ntp.poly.polybytes("foo=4223,"))
+            self.assertEqual(cls.rstatus, 0x0615)
+            # Test server error
+            sockjig.return_data = [
+                "\x00\x00\x00\x0C"
+                "\x16\xC2\x00\x01\x04\x00\x00\x00\x00\x00\x00\x00"]
+            try:
+                cls.getresponse(2, 0, True)
+                errored = False
+            except ctlerr as e:
+                errored = e.message
+            self.assertEqual(errored, ntpp.SERR_SERVER % "BADASSOC")
+            # Test ntpd hanging up
+            try:
+                cls.getresponse(2, 0, True)
+                errored = False
+            except ctlerr as e:
+                errored = e.message
+            self.assertEqual(errored, ntpp.SERR_SOCKET)
+        finally:
+            ntpp.select = select
+
     def test___validate_packet(self):
         logjig = jigs.FileJig()
         faketimemod = jigs.TimeModuleJig()
@@ -1468,6 +1518,34 @@ class TestControlSession(unittest.TestCase):
             errored = True
         self.assertEqual(errored, True)
 
+    def test_readchanges(self):
+        # Init
+        queries = []
+
+        def doquery_jig(opcode, associd=0, qdata="", auth=False):
+            queries.append((opcode, associd, qdata, auth))
+        cls = self.target()
+        cls.doquery = doquery_jig
+        # Test changes
+        cls.response = ntp.poly.polybytes(
+            "gen=120, sysgen=97, full=0, id.0=40113, st.0=0x961a,\r\n"
+            "id.1=40112, st.1=0x9424")
+        gen, sysgen, full, idlist = cls.readchanges(100)
+        self.assertEqual(queries, [(ntp.control.CTL_OP_READSTAT,
+                                    0, "since=100", False)])
+        self.assertEqual((gen, sysgen, full), (120, 97, False))
+        self.assertEqual([(p.associd, p.status) for p in idlist],
+                         [(40112, 0x9424), (40113, 0x961a)])
+        # Test nothing changed
+        cls.response = ntp.poly.polybytes("gen=120, sysgen=97, full=0")
+        self.assertEqual(cls.readchanges(120), (120, 97, False, []))
+        # Test an ntpd that ignores "since"
+        cls.response = ntp.poly.polybytes("\xDE\xAD\xF0\x0D")
+        gen, sysgen, full, idlist = cls.readchanges(120)
+        self.assertEqual((gen, sysgen, full), (None, None, True))
+        self.assertEqual([(p.associd, p.status) for p in idlist],
+                         [(0xDEAD, 0xF00D)])
+
     def test___parse_varlist(self):
         # Init
         cls = self.target()
@@ -2003,6 +2081,20 @@ class TestControlSession(unittest.TestCase):
         self.assertEqual(result, 23)
         self.assertEqual(ords, ["ifstats"])
 
+    def test_monparts(self):
+        ords = []
+
+        def ordlist_jig(listtype):
+            ords.append(listtype)
+            return 23
+        # Init
+        cls = self.target()
+        cls._ControlSession__ordlist = ordlist_jig
+        # Test
+        result = cls.monparts()
+        self.assertEqual(result, 23)
+        self.assertEqual(ords, ["mon_partitions"])
+
 
 class TestAuthenticator(unittest.TestCase):
     target = ntpp.Authenticator
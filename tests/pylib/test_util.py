@@ -1005,6 +1005,22 @@ class TestPylibUtilMethods(unittest.TestCase):
         # Test with missing data
         self.assertEqual(cls.summary(1, od()), "")
 
+    def test_MonpartsSummary(self):
+        cls = ntp.util.MonpartsSummary()
+
+        data = {"addr": "192.0.2.1", "depth": 12, "maxdepth": 5000,
+                "new": 34, "recycled": 5, "none": 0, "limited": 7,
+                "average": 2, "burst": 20, "kod": 0.5}
+        self.assertEqual(cls.summary(data),
+                         "      12     5000       34        5      0"
+                         "        7        2     20   0.5\n"
+                         "    192.0.2.1\n")
+        data["addr"] = "*"
+        self.assertEqual(cls.summary(data)[-24:],
+                         "    all other addresses\n")
+        # Test with missing data
+        self.assertEqual(cls.summary({"addr": "*"}), "")
+
 
 class TestPeerSummary(unittest.TestCase):
     target = ntp.util.PeerSummary
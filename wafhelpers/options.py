@@ -18,6 +18,14 @@ def options_cmd(ctx, config):
                    default=False, help="Disable GDB debugging symbols")
     grp.add_option('--enable-attic', action='store_true',
                    default=False, help="Enable building attic/*.")
+    grp.add_option('--enable-simulator', action='store_true',
+                   default=False,
+                   help="Build ntpdsim, ntpd's protocol engine in "
+                        "virtual time.")
+    grp.add_option('--enable-pgo', action='store_true',
+                   default=False,
+                   help="Optimize with a profile from a bundled training "
+                        "run, and LTO (gcc).")
     grp.add_option('--disable-nts', action='store_true',
                    default=False, help="Disable NTS.")
     grp.add_option('--disable-droproot', action='store_true',
@@ -29,6 +37,9 @@ def options_cmd(ctx, config):
                    default=False, help="Enable seccomp (restricts syscalls).")
     grp.add_option('--disable-mdns-registration', action='store_true',
                    default=False, help="Disable MDNS registration.")
+    grp.add_option('--disable-usdt', action='store_true',
+                   default=False,
+                   help="Leave out USDT probes even if <sys/sdt.h> exists.")
     grp.add_option(
         '--enable-classic-mode', action='store_true',
         default=False,
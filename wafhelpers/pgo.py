@@ -0,0 +1,397 @@
+# Copyright the NTPsec project contributors
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+"""
+Profile-guided optimization, for "waf configure --enable-pgo".
+
+The build then has a third variant, "pgo", built between host and main
+with -fprofile-generate.  Once it is built, pgo_train() runs its
+ntpdreplay over a synthetic packet capture (write_capture() below, with
+devel/pgo/ntp.conf) and its ntpdsim for a few simulated days, both
+without touching the network or the clock.  The counts they leave
+behind (.gcda files) are copied into the main variant, which is
+compiled with -fprofile-use and linked with -flto.
+
+ntpd itself never runs.  Its ntp_proto.c, ntp_peer.c and friends are
+separate objects from the copies in ntpdsim and ntpdreplay, but they
+are compiled from the same source with the same flags, so their
+profiles are the merge of those copies.  The training run is repeated
+only when the instrumented programs or the workload change.
+
+Run as a script, this writes the training capture, so the two builds
+can be compared:
+
+    python3 wafhelpers/pgo.py /tmp/mix.pcap
+    cd devel/pgo
+    ../../build/main/ntpd/ntpdreplay -c ntp.conf -n 300 /tmp/mix.pcap
+"""
+
+from __future__ import print_function
+
+import hashlib
+import os
+import random
+import shutil
+import struct
+import sys
+import tempfile
+
+TRAINING_DIR = "devel/pgo"
+TRAINING_PROGRAMS = ("ntpdreplay", "ntpdsim")
+REPLAY_PASSES = 20
+# ntpdsim runs: a quiet LAN, then a lossy WAN with a wandering oscillator
+SIM_RUNS = (
+    ["-n", "4", "-t", "2", "-s", "1"],
+    ["-n", "8", "-t", "2", "-s", "2", "-l", "0.05", "-d", "40", "-j", "10",
+     "-w", "20", "-W", "2", "-p", "300"],
+)
+STAMP = "pgo-training.sig"
+
+FRAGMENT = '''
+int main(int argc, char **argv) {
+        (void)argv;
+        return argc > 1;
+}
+'''
+
+
+def pgo_configure(ctx):
+    "Set up the pgo variant and add the profile to the main one."
+    from waflib.Errors import ConfigurationError
+
+    def check(flags, msg):
+        try:
+            ctx.check(cflags=flags, ldflags=flags, fragment=FRAGMENT,
+                      msg=msg, run_build_cls='oc')
+        except ConfigurationError:
+            return False
+        return True
+
+    if ctx.env.ENABLE_CROSS:
+        ctx.fatal("--enable-pgo can't run its training on a cross build")
+    if ctx.env.CC_NAME != "gcc":
+        ctx.fatal("--enable-pgo needs gcc, not %s" % ctx.env.CC_NAME)
+
+    if not check(["-fprofile-generate"],
+                 "Checking if C compiler supports -fprofile-generate"):
+        ctx.fatal("--enable-pgo needs -fprofile-generate")
+    # ntpd's profiles are put together from other programs', so they
+    # may not add up
+    use = ["-fprofile-use", "-fprofile-correction", "-Wno-missing-profile"]
+    if not check(use, "Checking if C compiler supports -fprofile-use"):
+        ctx.fatal("--enable-pgo needs -fprofile-use, -fprofile-correction "
+                  "and -Wmissing-profile")
+    # Code the training never reached is compiled as if there were
+    # no profile, not for size
+    if check(use + ["-fprofile-partial-training"],
+             "Checking if C compiler supports -fprofile-partial-training"):
+        use += ["-fprofile-partial-training"]
+    lto = ["-flto=auto"]
+    if not check(lto, "Checking if C compiler supports -flto=auto"):
+        lto = ["-flto"]
+        if not check(lto, "Checking if C compiler supports -flto"):
+            lto = []
+
+    # gcov-tool merges the profiles of ntpdsim and ntpdreplay for ntpd.
+    # It must come with the compiler.
+    ctx.find_program(["gcov-tool-%s" % ctx.env.CC_VERSION[0], "gcov-tool"],
+                     var="BIN_GCOV_TOOL", mandatory=False)
+
+    ctx.env.ENABLE_PGO = True
+    ctx.env.ENABLE_SIMULATOR = True
+    main = ctx.variant
+    ctx.setenv("pgo", ctx.env)
+    ctx.env.append_value("CFLAGS", ["-fprofile-generate"])
+    ctx.env.append_value("LDFLAGS", ["-fprofile-generate"])
+    ctx.setenv(main)
+    ctx.env.append_value("CFLAGS", use + lto)
+    ctx.env.append_value("LDFLAGS", lto)
+
+
+def _hash_files(paths):
+    "Digest of the contents of files, in order."
+    h = hashlib.sha256()
+    for path in paths:
+        with open(path, "rb") as f:
+            h.update(f.read())
+    return h.hexdigest()
+
+
+def _gcda(node):
+    "The profile gcc writes for an object file."
+    return os.path.splitext(node.abspath())[0] + ".gcda"
+
+
+def _merge(bld, paths, out):
+    "Merge the profiles in paths into out, or take the first."
+    if len(paths) == 1 or not bld.env.BIN_GCOV_TOOL:
+        shutil.copyfile(paths[0], out)
+        return
+    # gcov-tool merges directories of like-named files, two at a time
+    tmp = tempfile.mkdtemp(prefix="ntpsec-pgo-")
+    try:
+        acc = paths[0]
+        for i, path in enumerate(paths[1:]):
+            dirs = []
+            for j, src in enumerate((acc, path)):
+                d = os.path.join(tmp, "%d-%d" % (i, j))
+                os.mkdir(d)
+                shutil.copyfile(src, os.path.join(d, "p.gcda"))
+                dirs.append(d)
+            res = os.path.join(tmp, "%d-out" % i)
+            if bld.exec_command(bld.env.BIN_GCOV_TOOL +
+                                ["merge", "-o", res] + dirs):
+                bld.fatal("gcov-tool merge failed for %s" % out)
+            acc = os.path.join(res, "p.gcda")
+        shutil.copyfile(acc, out)
+    finally:
+        shutil.rmtree(tmp)
+
+
+def pgo_train(bld):
+    "Run the training workload on the pgo variant, profile main."
+    from waflib.Logs import pprint
+
+    pgo = bld.bldnode
+    main = pgo.parent.make_node("main")
+    training = bld.srcnode.find_node(TRAINING_DIR).abspath()
+    progs = [pgo.find_node("ntpd/%s" % p).abspath()
+             for p in TRAINING_PROGRAMS]
+    inputs = [os.path.join(training, f) for f in sorted(os.listdir(training))]
+    sig = _hash_files(progs + inputs + [__file__.replace(".pyc", ".py")])
+    stamp = pgo.make_node(STAMP)
+    if stamp.exists() and stamp.read().strip() == sig:
+        return
+
+    pprint("YELLOW", "--- training pgo ---")
+    for node in pgo.ant_glob("**/*.gcda", quiet=True):
+        node.delete()
+    capture = pgo.make_node("training.pcap").abspath()
+    npkts = write_capture(capture)
+    cmds = [[progs[0], "-c", "ntp.conf", "-n", str(REPLAY_PASSES), capture]]
+    cmds += [[progs[1]] + args for args in SIM_RUNS]
+    for cmd in cmds:
+        if bld.exec_command(cmd, cwd=training):
+            bld.fatal("PGO training failed: %s" % " ".join(cmd))
+
+    # Everything but ntpd's own objects goes over as it is
+    profiles = {}
+    for node in pgo.ant_glob("**/*.gcda", quiet=True):
+        profiles[node.path_from(pgo)] = [node.abspath()]
+    trained = {}
+    for name in TRAINING_PROGRAMS:
+        for task in bld.get_tgen_by_name(name).compiled_tasks:
+            path = _gcda(task.outputs[0])
+            if os.path.exists(path):
+                trained.setdefault(task.inputs[0], []).append(path)
+    for task in bld.get_tgen_by_name("ntpd").compiled_tasks:
+        if task.inputs[0] in trained:
+            rel = os.path.relpath(_gcda(task.outputs[0]), pgo.abspath())
+            profiles[rel] = trained[task.inputs[0]]
+
+    # Objects whose profile changed must be compiled again
+    stale = 0
+    main.mkdir()
+    old = set(n.path_from(main)
+              for n in main.ant_glob("**/*.gcda", quiet=True))
+    for rel in sorted(old | set(profiles)):
+        dest = os.path.join(main.abspath(), rel)
+        obj = os.path.splitext(dest)[0] + ".o"
+        if rel in profiles:
+            new = dest + ".new"
+            if not os.path.isdir(os.path.dirname(dest)):
+                os.makedirs(os.path.dirname(dest))
+            _merge(bld, profiles[rel], new)
+            if (rel in old and
+                    _hash_files([new]) == _hash_files([dest])):
+                os.remove(new)
+                continue
+            os.rename(new, dest)
+        else:
+            os.remove(dest)
+        if os.path.exists(obj):
+            os.remove(obj)
+            stale += 1
+    stamp.write(sig + "\n")
+    pprint("YELLOW", "PGO: %d packets x %d passes and %d simulations, "
+           "%d profiles, %d objects to rebuild"
+           % (npkts, REPLAY_PASSES, len(SIM_RUNS), len(profiles), stale))
+
+
+# 2025-01-01 00:00:00 UTC, so the capture is the same every time
+CAPTURE_START = 1735689600
+CAPTURE_SECONDS = 64
+NTP_EPOCH_OFFSET = 2208988800
+KEYS = {
+    1: ("sha1", bytes.fromhex("3128b20c807e936fa5fa275e43d4026163ce4f31")),
+    2: ("md5", bytes.fromhex("66edf75ea470e06e40d6344d47fc9c27")),
+}
+
+
+def _ntp_stamp(t, r):
+    "An NTP timestamp near time t, with random low bits."
+    return ((int(t) + NTP_EPOCH_OFFSET) << 32) | r.getrandbits(32)
+
+
+def _ntp(t, r, mode, version=4, li=0, stratum=0, org=0):
+    "A 48-octet NTP header."
+    return struct.pack("!BBbbII4sQQQQ",
+                       li << 6 | version << 3 | mode, stratum, 6, -20,
+                       0, 0, b"\0\0\0\0", 0, org, 0, _ntp_stamp(t, r))
+
+
+def _server(t, r, org):
+    "A server reply from a stratum 2 server."
+    return struct.pack("!BBbbII4sQQQQ", 4 << 3 | 4, 2, 6, -23,
+                       0x80, 0x100, bytes([192, 0, 2, 7]),
+                       _ntp_stamp(t - 30, r), org, _ntp_stamp(t, r),
+                       _ntp_stamp(t, r))
+
+
+def _mac(pkt, keyid, good=True):
+    "Append a MAC with key keyid, spoiled if not good."
+    kind, key = KEYS.get(keyid, ("sha1", b"no such key"))
+    digest = hashlib.new(kind, key + pkt).digest()
+    if not good:
+        digest = bytes([digest[0] ^ 1]) + digest[1:]
+    return pkt + struct.pack("!I", keyid) + digest
+
+
+def _mode6(op, seq, data=b"", associd=0):
+    "A mode 6 request."
+    pad = b"\0" * (-len(data) % 4)
+    return struct.pack("!BBHHHHH", 4 << 3 | 6, op, seq, 0, associd, 0,
+                       len(data)) + data + pad
+
+
+def _junk(t, r):
+    "Something a public server sees that isn't a good request."
+    kind = r.randrange(7)
+    if kind == 0:                       # short
+        return bytes(r.getrandbits(8) for _ in range(r.randrange(1, 48)))
+    if kind == 1:                       # version 0 or 5 to 7
+        return _ntp(t, r, 3, version=r.choice((0, 5, 6, 7)))
+    if kind == 2:                       # mode 0 or 7
+        return _ntp(t, r, r.choice((0, 7)))
+    if kind == 3:                       # extension field of bad length
+        return _ntp(t, r, 3) + struct.pack("!HH", 0x0104,
+                                           r.choice((0, 3, 6, 1000))) \
+            + b"\0" * 16
+    if kind == 4:                       # unknown extension field
+        return _ntp(t, r, 3) + struct.pack("!HH", 0x2005, 28) + b"\0" * 24
+    if kind == 5:                       # MAC too short
+        return _ntp(t, r, 3) + struct.pack("!I", 1) + b"\0" * 8
+    return bytes(r.getrandbits(8) for _ in range(r.randrange(48, 600)))
+
+
+def _mix(r):
+    "Yield (time, source, payload) for a minute of a public server."
+    end = CAPTURE_START + CAPTURE_SECONDS
+
+    def every(interval, jitter=0.0):
+        t = CAPTURE_START + r.random() * interval
+        while t < end:
+            yield t
+            t += interval * (1 + jitter * (r.random() - 0.5))
+
+    # Polite clients, once every 64 s, some of them NTPv3 or older
+    for i in range(3000):
+        src = "10.%d.%d.%d" % (i >> 12, (i >> 4) & 255, (i & 15) * 16 + 1)
+        version = 4 if i % 20 else (3 if i % 40 else r.choice((1, 2)))
+        for t in every(64):
+            yield t, src, _ntp(t, r, 3, version=version, li=3)
+    for i in range(600):
+        src = "2001:db8:%x::%x" % (i >> 6, i + 1)
+        for t in every(64):
+            yield t, src, _ntp(t, r, 3, li=3)
+    # Clients polling too fast: rate limited, some KoDs
+    for i in range(40):
+        src = "198.51.100.%d" % (i + 1)
+        for t in every(1 + i % 4, jitter=0.5):
+            yield t, src, _ntp(t, r, 3)
+    for i in range(4):
+        src = "10.200.0.%d" % (i + 1)
+        for t in every(0.02, jitter=1.0):
+            yield t, src, _ntp(t, r, 3)
+    # Authenticated clients, a few with bad MACs or keys we don't have
+    for i in range(200):
+        src = "10.100.%d.%d" % (i >> 8, i & 255)
+        keyid = (1, 1, 1, 2, 9)[i % 5]
+        for t in every(16):
+            yield t, src, _mac(_ntp(t, r, 3), keyid, good=i % 17 != 0)
+    # Networks we ignore
+    for i in range(100):
+        src = "192.0.2.%d" % (i + 1) if i % 2 else \
+            "2001:db8:bad::%x" % (i + 1)
+        for t in every(8):
+            yield t, src, _ntp(t, r, 3)
+    # Replies from our server, and from servers we never asked
+    for t in every(2):
+        yield t, "203.0.113.1", _server(t, r, _ntp_stamp(t - 0.05, r))
+    for i in range(50):
+        for t in every(32):
+            yield t, "203.0.113.%d" % (i + 10), \
+                _server(t, r, _ntp_stamp(t, r))
+    # Symmetric active and broadcast from strangers
+    for i in range(100):
+        src = "10.150.0.%d" % (i + 1)
+        mode = 5 if i % 10 == 0 else 1
+        for t in every(32):
+            yield t, src, _ntp(t, r, mode, stratum=3)
+    # Junk from all over
+    for i in range(1500):
+        t = CAPTURE_START + r.random() * CAPTURE_SECONDS
+        yield t, "10.250.%d.%d" % (i >> 8, i & 255), _junk(t, r)
+    # ntpq on the server itself, and from outside
+    seq = 0
+    requests = ((1, b""), (2, b""), (2, b"version,leap,stratum,offset"),
+                (2, b"nosuchvar"), (12, b""), (10, b"nonce=0, frags=8"),
+                (31, b""))
+    for t in every(0.25):
+        seq += 1
+        op, data = requests[seq % len(requests)]
+        yield t, "127.0.0.1", _mode6(op, seq, data)
+        if seq % 8 == 0:
+            yield t, "::1", _mode6(1, seq)
+            yield t, "198.51.100.200", _mode6(2, seq)
+    for t in every(4):
+        seq += 1
+        yield t, "127.0.0.1", _mac(_mode6(2, seq), 1)
+
+
+def write_capture(path, seed=1):
+    """Write the training capture to path as a pcap file of bare IP
+    packets.  Returns the number of packets."""
+    import socket
+
+    r = random.Random(seed)
+    packets = sorted(_mix(r), key=lambda p: p[0])
+    with open(path, "wb") as f:
+        f.write(struct.pack("<IHHiIII", 0xa1b2c3d4, 2, 4, 0, 0, 65535,
+                            101))       # LINKTYPE_RAW
+        for t, src, payload in packets:
+            udp = struct.pack("!HHHH", 1024 + r.randrange(60000), 123,
+                              8 + len(payload), 0) + payload
+            if ":" in src:
+                ip = struct.pack("!IHBB16s16s", 6 << 28, len(udp), 17, 64,
+                                 socket.inet_pton(socket.AF_INET6, src),
+                                 socket.inet_pton(socket.AF_INET6,
+                                                  "2001:db8::123"))
+            else:
+                ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + len(udp),
+                                 0, 0, 64, 17, 0, socket.inet_aton(src),
+                                 socket.inet_aton("198.18.0.1"))
+            frame = ip + udp
+            usec = int(round((t - int(t)) * 1e6))
+            f.write(struct.pack("<IIII", int(t), min(usec, 999999),
+                                len(frame), len(frame)))
+            f.write(frame)
+    return len(packets)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: pgo.py capture-file\n")
+        sys.exit(1)
+    print("%d packets" % write_capture(sys.argv[1]))